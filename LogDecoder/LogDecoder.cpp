@@ -0,0 +1,140 @@
+﻿#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include "BinaryLog.h"
+#include "LogFormat.h"
+#include "Platform.h"
+
+namespace {
+
+/**
+ * @brief Печатает справку по параметрам.
+ */
+void printUsage() {
+    std::fputs(
+        "Использование: LogDecoder <файл> [-t шаблон | -j] [-p s|ms|us] [-o файл]\n"
+        "  -t  шаблон форматирования, как в Logger::setFormatTemplate (по умолчанию \"{t} | {L} | {f}:{l} -> {m}\")\n"
+        "  -j  выводить JSON lines, как LineFormat::JsonLines\n"
+        "  -p  точность временной метки: s, ms или us (по умолчанию s)\n"
+        "  -o  записать текст в файл вместо стандартного вывода\n",
+        stderr);
+}
+
+/**
+ * @brief Разбирает точность временной метки.
+ * @param text Значение параметра -p.
+ * @param precision Результат.
+ * @return false, если значение не распознано.
+ */
+bool parsePrecision(const char* text, TimestampPrecision& precision) {
+    if (std::strcmp(text, "s") == 0) precision = TimestampPrecision::Seconds;
+    else if (std::strcmp(text, "ms") == 0) precision = TimestampPrecision::Milliseconds;
+    else if (std::strcmp(text, "us") == 0) precision = TimestampPrecision::Microseconds;
+    else return false;
+    return true;
+}
+
+}
+
+/**
+ * @brief Преобразует двоичный файл лога (FileFormat::Binary) в текст.
+ *
+ * Текст форматируется теми же FormatTemplate и TimestampCache, что и
+ * в Logger, поэтому при одинаковом шаблоне результат совпадает с текстовым логом.
+ */
+int main(int argc, char** argv) {
+    const char* inputPath = nullptr;
+    const char* outputPath = nullptr;
+    std::string templateText = DefaultFormatTemplate;
+    TimestampPrecision precision = TimestampPrecision::Seconds;
+    LineFormat lineFormat = LineFormat::Template;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            templateText = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-j") == 0) {
+            lineFormat = LineFormat::JsonLines;
+        }
+        else if (std::strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            if (!parsePrecision(argv[++i], precision)) {
+                printUsage();
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        }
+        else if (inputPath == nullptr && argv[i][0] != '-') {
+            inputPath = argv[i];
+        }
+        else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (inputPath == nullptr) {
+        printUsage();
+        return 1;
+    }
+
+    std::ifstream input(inputPath, std::ios::in | std::ios::binary);
+    if (!input.is_open()) {
+        std::fprintf(stderr, "Не удалось открыть %s\n", inputPath);
+        return 2;
+    }
+    std::string data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+    BinaryLogReader reader(data);
+    if (!reader.valid()) {
+        std::fprintf(stderr, "%s не является двоичным логом\n", inputPath);
+        return 2;
+    }
+
+    std::ofstream output;
+    if (outputPath != nullptr) {
+        output.open(outputPath, std::ios::out | std::ios::trunc);
+        if (!output.is_open()) {
+            std::fprintf(stderr, "Не удалось создать %s\n", outputPath);
+            return 2;
+        }
+        output << "\xEF\xBB\xBF";
+    }
+    else {
+        platform::prepareConsole(platform::standardOutput());
+    }
+
+    constexpr std::size_t FlushThreshold = 64 * 1024;
+    FormatTemplate format(templateText);
+    TimestampCache timestamps;
+    timestamps.setPrecision(precision);
+
+    std::string text;
+    std::string scratch;
+    auto flushText = [&]() {
+        if (output.is_open()) output.write(text.data(), static_cast<std::streamsize>(text.size()));
+        else std::fwrite(text.data(), 1, text.size(), stdout);
+        text.clear();
+        };
+
+    BinaryLogEntry entry;
+    while (reader.next(entry)) {
+        if (lineFormat == LineFormat::JsonLines) {
+            formatJsonRecord(timestamps, entry.site, entry.time, entry.payload, text, scratch);
+        }
+        else {
+            formatRecord(format, timestamps, entry.site, entry.time, entry.payload, text);
+        }
+        text += '\n';
+        if (text.size() >= FlushThreshold) flushText();
+    }
+    flushText();
+
+    if (reader.damaged()) {
+        std::fprintf(stderr, "Файл обрывается или повреждён; выведены сообщения до повреждения\n");
+        return 3;
+    }
+    return 0;
+}
@@ -0,0 +1,305 @@
+﻿#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+#include "BinaryLog.h"
+#include "LogFormat.h"
+#include "LogIndex.h"
+#include "MappedFile.h"
+#include "Platform.h"
+
+namespace {
+
+/**
+ * @struct Range
+ * @brief Участок файла лога, который нужно прочитать.
+ */
+struct Range {
+    std::uint64_t begin;  /**< Начало */
+    std::uint64_t end;    /**< Конец (не включается) */
+};
+
+/**
+ * @brief Печатает справку по параметрам.
+ */
+void printUsage() {
+    std::fputs(
+        "Использование: LogQuery <файл> [-from время] [-to время] [-l уровень] [-t шаблон | -j] [-p s|ms|us] [-o файл]\n"
+        "  -from  начало интервала (местное время \"ГГГГ-ММ-ДД ЧЧ:ММ[:СС]\" или \"ГГГГ-ММ-ДД\"), включается\n"
+        "  -to    конец интервала в том же виде, не включается\n"
+        "  -l     минимальный уровень: TRACE, DEBUG, INFO, WARNING, ERROR или CRITICAL\n"
+        "  -t     шаблон форматирования двоичного лога (по умолчанию \"{t} | {L} | {f}:{l} -> {m}\")\n"
+        "  -j     выводить двоичный лог как JSON lines\n"
+        "  -p     точность временной метки: s, ms или us (по умолчанию s)\n"
+        "  -o     записать результат в файл вместо стандартного вывода\n"
+        "Читаются только блоки, которые по индексу (<файл>.idx) пересекают интервал\n"
+        "и содержат сообщения нужного уровня, и непроиндексированный хвост файла.\n"
+        "Двоичный лог фильтруется точно по каждому сообщению, текстовый выводится\n"
+        "найденными блоками целиком.\n",
+        stderr);
+}
+
+/**
+ * @brief Разбирает точность временной метки.
+ * @param text Значение параметра -p.
+ * @param precision Результат.
+ * @return false, если значение не распознано.
+ */
+bool parsePrecision(const char* text, TimestampPrecision& precision) {
+    if (std::strcmp(text, "s") == 0) precision = TimestampPrecision::Seconds;
+    else if (std::strcmp(text, "ms") == 0) precision = TimestampPrecision::Milliseconds;
+    else if (std::strcmp(text, "us") == 0) precision = TimestampPrecision::Microseconds;
+    else return false;
+    return true;
+}
+
+/**
+ * @brief Разбирает имя уровня.
+ * @param text Значение параметра -l.
+ * @param level Результат.
+ * @return false, если уровень не распознан.
+ */
+bool parseLevel(const char* text, LogLevel& level) {
+    for (std::size_t i = 0; i < LogLevelCount; ++i) {
+        LogLevel candidate = static_cast<LogLevel>(i);
+        if (levelToString(candidate) == text) {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Разбирает местное время "ГГГГ-ММ-ДД[ ЧЧ:ММ[:СС]]" (вместо пробела допускается 'T').
+ * @param text Значение параметра -from или -to.
+ * @param time Наносекунды от эпохи.
+ * @return false, если время не распознано.
+ */
+bool parseTime(const char* text, std::int64_t& time) {
+    std::tm parts{};
+    int second = 0;
+    char separator = ' ';
+    int fields = std::sscanf(text, "%d-%d-%d%c%d:%d:%d", &parts.tm_year, &parts.tm_mon, &parts.tm_mday,
+        &separator, &parts.tm_hour, &parts.tm_min, &second);
+    if (fields != 3 && fields != 6 && fields != 7) return false;
+    if (fields > 3 && separator != ' ' && separator != 'T') return false;
+
+    parts.tm_year -= 1900;
+    parts.tm_mon -= 1;
+    parts.tm_sec = second;
+    parts.tm_isdst = -1;
+    std::time_t seconds = std::mktime(&parts);
+    if (seconds == static_cast<std::time_t>(-1)) return false;
+
+    time = static_cast<std::int64_t>(seconds) * 1000000000;
+    return true;
+}
+
+/**
+ * @brief Читает участок файла.
+ * @param input Файл.
+ * @param range Участок.
+ * @param data Прочитанные байты.
+ * @return false при ошибке чтения.
+ */
+bool readRange(std::ifstream& input, const Range& range, std::string& data) {
+    data.resize(static_cast<std::size_t>(range.end - range.begin));
+    input.clear();
+    input.seekg(static_cast<std::streamoff>(range.begin));
+    input.read(data.data(), static_cast<std::streamsize>(data.size()));
+    return static_cast<std::size_t>(input.gcount()) == data.size();
+}
+
+/**
+ * @brief Добавляет участок, объединяя его с предыдущим, если они соседние.
+ */
+void addRange(std::vector<Range>& ranges, std::uint64_t begin, std::uint64_t end) {
+    if (begin >= end) return;
+    if (!ranges.empty() && ranges.back().end == begin) {
+        ranges.back().end = end;
+        return;
+    }
+    ranges.push_back({ begin, end });
+}
+
+}
+
+/**
+ * @brief Выбирает из файла лога сообщения интервала времени и уровня по индексу.
+ *
+ * По записям индекса отбираются блоки, чей диапазон времени пересекает
+ * [from, to) и в которых есть сообщения не ниже заданного уровня;
+ * к ним добавляются участки, не описанные индексом (хвост файла и
+ * промежутки от прежних запусков), так что ни одно подходящее сообщение
+ * не теряется. Каждый участок читается отдельно, без чтения остального файла.
+ */
+int main(int argc, char** argv) {
+    const char* inputPath = nullptr;
+    const char* outputPath = nullptr;
+    std::int64_t from = (std::numeric_limits<std::int64_t>::min)();
+    std::int64_t to = (std::numeric_limits<std::int64_t>::max)();
+    LogLevel minLevel = LogLevel::TRACE;
+    std::string templateText = DefaultFormatTemplate;
+    TimestampPrecision precision = TimestampPrecision::Seconds;
+    LineFormat lineFormat = LineFormat::Template;
+
+    for (int i = 1; i < argc; ++i) {
+        bool valid = true;
+        if (std::strcmp(argv[i], "-from") == 0 && i + 1 < argc) {
+            valid = parseTime(argv[++i], from);
+        }
+        else if (std::strcmp(argv[i], "-to") == 0 && i + 1 < argc) {
+            valid = parseTime(argv[++i], to);
+        }
+        else if (std::strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            valid = parseLevel(argv[++i], minLevel);
+        }
+        else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            templateText = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-j") == 0) {
+            lineFormat = LineFormat::JsonLines;
+        }
+        else if (std::strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            valid = parsePrecision(argv[++i], precision);
+        }
+        else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        }
+        else if (inputPath == nullptr && argv[i][0] != '-') {
+            inputPath = argv[i];
+        }
+        else {
+            valid = false;
+        }
+        if (!valid) {
+            printUsage();
+            return 1;
+        }
+    }
+    if (inputPath == nullptr) {
+        printUsage();
+        return 1;
+    }
+
+    std::ifstream input(inputPath, std::ios::in | std::ios::binary);
+    if (!input.is_open()) {
+        std::fprintf(stderr, "Не удалось открыть %s\n", inputPath);
+        return 2;
+    }
+    input.seekg(0, std::ios::end);
+    std::uint64_t fileSize = static_cast<std::uint64_t>(input.tellg());
+
+    // Начало данных: заголовок MappedFile (его длина ограничивает данные),
+    // затем метка двоичного лога или BOM текстового.
+    std::uint64_t dataBegin = 0;
+    std::uint64_t dataEnd = fileSize;
+    std::string head;
+    std::uint64_t mappedLength = 0;
+    if (readRange(input, { 0, (std::min)(fileSize, std::uint64_t(MappedFile::HeaderSize)) }, head)
+        && head.size() == MappedFile::HeaderSize && MappedFile::parseHeader(head.data(), mappedLength)) {
+        dataBegin = MappedFile::HeaderSize;
+        dataEnd = (std::min)(fileSize, dataBegin + mappedLength);
+    }
+    readRange(input, { dataBegin, (std::min)(dataEnd, dataBegin + BinaryLogMagic.size()) }, head);
+    bool binary = head == BinaryLogMagic;
+    if (binary) dataBegin += BinaryLogMagic.size();
+    else if (head.compare(0, 3, "\xEF\xBB\xBF") == 0) dataBegin += 3;
+
+    std::vector<LogIndexEntry> entries;
+    std::ifstream indexFile(logIndexPath(inputPath), std::ios::in | std::ios::binary);
+    std::string indexData((std::istreambuf_iterator<char>(indexFile)), std::istreambuf_iterator<char>());
+    if (!parseLogIndex(indexData, entries)) {
+        std::fprintf(stderr, "Индекс %s не найден, файл читается целиком\n", logIndexPath(inputPath).c_str());
+    }
+
+    unsigned levelMask = 0;
+    for (std::size_t i = static_cast<std::size_t>(minLevel); i < LogLevelCount; ++i) levelMask |= 1u << i;
+
+    std::vector<Range> ranges;
+    std::uint64_t cursor = dataBegin;
+    for (const LogIndexEntry& entry : entries) {
+        std::uint64_t begin = (std::max)(entry.offset, cursor);
+        std::uint64_t end = (std::min)(entry.offset + entry.length, dataEnd);
+        if (begin >= end) continue;
+
+        addRange(ranges, cursor, (std::min)(entry.offset, dataEnd));
+        if ((entry.levels & levelMask) != 0 && entry.lastTime >= from && entry.firstTime < to) {
+            addRange(ranges, begin, end);
+        }
+        cursor = end;
+    }
+    addRange(ranges, cursor, dataEnd);
+
+    std::ofstream output;
+    if (outputPath != nullptr) {
+        output.open(outputPath, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!output.is_open()) {
+            std::fprintf(stderr, "Не удалось создать %s\n", outputPath);
+            return 2;
+        }
+        output << "\xEF\xBB\xBF";
+    }
+    else {
+        platform::prepareConsole(platform::standardOutput());
+    }
+
+    constexpr std::size_t FlushThreshold = 64 * 1024;
+    FormatTemplate format(templateText);
+    TimestampCache timestamps;
+    timestamps.setPrecision(precision);
+
+    std::string text;
+    std::string scratch;
+    auto flushText = [&]() {
+        if (output.is_open()) output.write(text.data(), static_cast<std::streamsize>(text.size()));
+        else std::fwrite(text.data(), 1, text.size(), stdout);
+        text.clear();
+        };
+
+    bool damaged = false;
+    std::string bytes;
+    std::string block;
+    for (const Range& range : ranges) {
+        if (!binary) {
+            if (!readRange(input, range, text)) damaged = true;
+            flushText();
+            continue;
+        }
+
+        // Блок начинается со сброшенного словаря и декодируется отдельно.
+        if (!readRange(input, range, bytes)) damaged = true;
+        block.assign(BinaryLogMagic);
+        block += bytes;
+
+        BinaryLogReader reader(block);
+        BinaryLogEntry entry;
+        while (reader.next(entry)) {
+            std::int64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(entry.time.time_since_epoch()).count();
+            if (time < from || time >= to || entry.site.level < minLevel) continue;
+
+            if (lineFormat == LineFormat::JsonLines) {
+                formatJsonRecord(timestamps, entry.site, entry.time, entry.payload, text, scratch);
+            }
+            else {
+                formatRecord(format, timestamps, entry.site, entry.time, entry.payload, text);
+            }
+            text += '\n';
+            if (text.size() >= FlushThreshold) flushText();
+        }
+        damaged = damaged || reader.damaged();
+    }
+    flushText();
+
+    if (damaged) {
+        std::fprintf(stderr, "Часть файла обрывается или повреждена; выведены сообщения до повреждения\n");
+        return 3;
+    }
+    return 0;
+}
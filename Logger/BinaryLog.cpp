@@ -0,0 +1,305 @@
+﻿#include "BinaryLog.h"
+#include "LogFormat.h"
+#include "LogSink.h"
+#include "MappedFile.h"
+#include <cstring>
+
+namespace {
+
+/**
+ * @brief Дописывает значение фиксированного размера.
+ */
+template<typename V>
+void put(std::string& out, V value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+/**
+ * @brief Читает значение фиксированного размера.
+ * @return false, если данных недостаточно.
+ */
+template<typename V>
+bool get(const char*& pos, const char* end, V& value) {
+    if (static_cast<std::size_t>(end - pos) < sizeof(V)) return false;
+    std::memcpy(&value, pos, sizeof(V));
+    pos += sizeof(V);
+    return true;
+}
+
+/**
+ * @brief Размер значения аргумента фиксированной длины.
+ * @return 0 для строковых и неизвестных типов.
+ */
+std::size_t fixedSize(ArgType type) {
+    switch (type) {
+    case ArgType::Int64:
+    case ArgType::UInt64:
+    case ArgType::Double:
+        return 8;
+    case ArgType::Bool:
+    case ArgType::Char:
+        return 1;
+    case ArgType::Span:
+        return 2 * sizeof(std::int64_t) + sizeof(std::uint32_t);
+    default:
+        return 0;
+    }
+}
+
+}
+
+/**
+ * @brief Забывает словарь текущего файла.
+ */
+void BinaryLogEncoder::reset() {
+    sites.clear();
+    strings.clear();
+}
+
+/**
+ * @brief Дописывает в out записи сообщений пачки.
+ * @param batch Пачка сообщений.
+ * @param minLevel Минимальный уровень.
+ * @param out Приёмник.
+ */
+void BinaryLogEncoder::encode(const LogBatch& batch, LogLevel minLevel, std::string& out) {
+    for (const BatchRecord& record : batch.records) {
+        if (record.site->level < minLevel) continue;
+        encodeRecord(record, out);
+    }
+}
+
+/**
+ * @brief Дописывает в out запись одного сообщения.
+ * @param record Сообщение.
+ * @param out Приёмник.
+ * @return false, если аргументы повреждены и сообщение пропущено.
+ */
+bool BinaryLogEncoder::encodeRecord(const BatchRecord& record, std::string& out) {
+    std::uint32_t site = siteId(record.site, out);
+    if (!encodeArguments(record.payload, out)) return false;
+
+    put(out, BinaryRecordType::Message);
+    put(out, site);
+    put(out, static_cast<std::int64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(record.time.time_since_epoch()).count()));
+    put(out, static_cast<std::uint32_t>(scratch.size()));
+    out += scratch;
+    return true;
+}
+
+/**
+ * @brief Номер места вызова; при первом появлении в файле пишет запись Site.
+ */
+std::uint32_t BinaryLogEncoder::siteId(const LogSite* site, std::string& out) {
+    auto it = sites.find(site);
+    if (it != sites.end()) return it->second;
+
+    std::uint32_t id = static_cast<std::uint32_t>(sites.size());
+    sites.emplace(site, id);
+
+    std::string_view file(site->file);
+    put(out, BinaryRecordType::Site);
+    put(out, id);
+    put(out, static_cast<std::uint8_t>(site->level));
+    put(out, static_cast<std::int32_t>(site->line));
+    put(out, static_cast<std::uint32_t>(file.size()));
+    out += file;
+    return id;
+}
+
+/**
+ * @brief Номер литерала; при первом появлении в файле пишет запись String.
+ */
+std::uint32_t BinaryLogEncoder::stringId(const char* text, std::uint32_t length, std::string& out) {
+    auto it = strings.find(text);
+    if (it != strings.end()) return it->second;
+
+    std::uint32_t id = static_cast<std::uint32_t>(strings.size());
+    strings.emplace(text, id);
+
+    put(out, BinaryRecordType::String);
+    put(out, id);
+    put(out, length);
+    out.append(text, length);
+    return id;
+}
+
+/**
+ * @brief Перекодирует аргументы сообщения в scratch, заменяя литералы номерами словаря.
+ * @param payload Аргументы в формате ArgumentWriter.
+ * @param out Приёмник записей String.
+ * @return false, если аргументы повреждены.
+ */
+bool BinaryLogEncoder::encodeArguments(std::string_view payload, std::string& out) {
+    scratch.clear();
+    const char* pos = payload.data();
+    const char* end = pos + payload.size();
+
+    while (pos < end) {
+        ArgType type = static_cast<ArgType>(*pos);
+        if (type == ArgType::StaticString) {
+            ++pos;
+            const char* text;
+            std::uint32_t length;
+            if (!get(pos, end, text) || !get(pos, end, length)) return false;
+            put(scratch, ArgType::StringRef);
+            put(scratch, stringId(text, length, out));
+            continue;
+        }
+
+        std::size_t size = fixedSize(type);
+        if (type == ArgType::String) {
+            std::uint32_t length;
+            const char* lengthPos = pos + 1;
+            if (!get(lengthPos, end, length)) return false;
+            size = sizeof(length) + length;
+        }
+        else if (type == ArgType::Field) {
+            if (end - pos < 2) return false;
+            size = 1 + static_cast<unsigned char>(pos[1]);
+        }
+        else if (size == 0) {
+            return false;
+        }
+
+        if (static_cast<std::size_t>(end - pos) < 1 + size) return false;
+        scratch.append(pos, 1 + size);
+        pos += 1 + size;
+    }
+    return true;
+}
+
+/**
+ * @brief Конструктор. Проверяет метку и пропускает заголовок MappedFile.
+ * @param data Содержимое файла.
+ */
+BinaryLogReader::BinaryLogReader(std::string_view data) {
+    std::uint64_t mappedLength = 0;
+    if (data.size() >= MappedFile::HeaderSize && MappedFile::parseHeader(data.data(), mappedLength)) {
+        data = data.substr(MappedFile::HeaderSize);
+        if (mappedLength < data.size()) data = data.substr(0, static_cast<std::size_t>(mappedLength));
+    }
+
+    pos = data.data();
+    end = pos + data.size();
+    isValid = data.substr(0, BinaryLogMagic.size()) == BinaryLogMagic;
+    if (isValid) pos += BinaryLogMagic.size();
+}
+
+/**
+ * @brief Читает следующее сообщение, попутно обрабатывая записи словаря.
+ * @param entry Прочитанное сообщение.
+ * @return false в конце файла или на повреждённых данных.
+ */
+bool BinaryLogReader::next(BinaryLogEntry& entry) {
+    if (!isValid || isDamaged) return false;
+
+    while (pos < end) {
+        BinaryRecordType type = static_cast<BinaryRecordType>(*pos++);
+        switch (type) {
+        case BinaryRecordType::Site: {
+            std::uint32_t id;
+            std::uint8_t level;
+            std::int32_t line;
+            std::uint32_t length;
+            if (!get(pos, end, id) || !get(pos, end, level) || !get(pos, end, line) || !get(pos, end, length)
+                || static_cast<std::size_t>(end - pos) < length) {
+                return fail();
+            }
+            if (id >= sites.size()) sites.resize(static_cast<std::size_t>(id) + 1);
+            sites[id].level = static_cast<LogLevel>(level);
+            sites[id].line = line;
+            sites[id].file.assign(pos, length);
+            pos += length;
+            break;
+        }
+        case BinaryRecordType::String: {
+            std::uint32_t id;
+            std::uint32_t length;
+            if (!get(pos, end, id) || !get(pos, end, length) || static_cast<std::size_t>(end - pos) < length) {
+                return fail();
+            }
+            if (id >= strings.size()) strings.resize(static_cast<std::size_t>(id) + 1);
+            strings[id].assign(pos, length);
+            pos += length;
+            break;
+        }
+        case BinaryRecordType::Message: {
+            std::uint32_t site;
+            std::int64_t nanoseconds;
+            std::uint32_t length;
+            if (!get(pos, end, site) || !get(pos, end, nanoseconds) || !get(pos, end, length)
+                || static_cast<std::size_t>(end - pos) < length || site >= sites.size()) {
+                return fail();
+            }
+
+            entry.payload.clear();
+            if (!decodeArguments(std::string_view(pos, length), entry.payload)) return fail();
+            pos += length;
+
+            const SiteInfo& info = sites[site];
+            entry.site = { info.level, info.file.c_str(), info.line };
+            entry.time = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                std::chrono::nanoseconds(nanoseconds)));
+            return true;
+        }
+        default:
+            return fail();
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Отмечает повреждение данных.
+ * @return false для возврата из next().
+ */
+bool BinaryLogReader::fail() {
+    isDamaged = true;
+    return false;
+}
+
+/**
+ * @brief Заменяет ссылки на литералы их текстом (ArgType::String).
+ * @param payload Аргументы из файла.
+ * @param out Аргументы, пригодные для appendArguments().
+ * @return false, если аргументы повреждены.
+ */
+bool BinaryLogReader::decodeArguments(std::string_view payload, std::string& out) const {
+    const char* p = payload.data();
+    const char* e = p + payload.size();
+
+    while (p < e) {
+        ArgType type = static_cast<ArgType>(*p);
+        if (type == ArgType::StringRef) {
+            ++p;
+            std::uint32_t id;
+            if (!get(p, e, id) || id >= strings.size()) return false;
+            put(out, ArgType::String);
+            put(out, static_cast<std::uint32_t>(strings[id].size()));
+            out += strings[id];
+            continue;
+        }
+
+        std::size_t size = fixedSize(type);
+        if (type == ArgType::String) {
+            std::uint32_t length;
+            const char* lengthPos = p + 1;
+            if (!get(lengthPos, e, length)) return false;
+            size = sizeof(length) + length;
+        }
+        else if (type == ArgType::Field) {
+            if (e - p < 2) return false;
+            size = 1 + static_cast<unsigned char>(p[1]);
+        }
+        else if (size == 0) {
+            return false;
+        }
+
+        if (static_cast<std::size_t>(e - p) < 1 + size) return false;
+        out.append(p, 1 + size);
+        p += 1 + size;
+    }
+    return true;
+}
@@ -0,0 +1,139 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "LogRecord.h"
+
+struct BatchRecord;
+struct LogBatch;
+
+/**
+ * @brief Метка в начале двоичного файла лога.
+ */
+inline constexpr std::string_view BinaryLogMagic{ "LOGBIN01", 8 };
+
+/**
+ * @enum BinaryRecordType
+ * @brief Тип записи двоичного файла лога.
+ *
+ * Формат записей (целые числа little-endian):
+ * - Site: id (u32), уровень (u8), строка (i32), длина (u32) и имя файла;
+ * - String: id (u32), длина (u32) и текст строкового литерала;
+ * - Message: id места вызова (u32), время в наносекундах от эпохи (i64),
+ *   длина (u32) и аргументы в формате ArgumentWriter, где литералы
+ *   заменены на ArgType::StringRef с id (u32).
+ *
+ * Записи Site и String появляются один раз в файле, перед первым
+ * сообщением, которое на них ссылается.
+ */
+enum class BinaryRecordType : std::uint8_t {
+    Site = 1,     /**< Описание места вызова */
+    String = 2,   /**< Строка словаря */
+    Message = 3   /**< Сообщение */
+};
+
+/**
+ * @class BinaryLogEncoder
+ * @brief Кодирует пачки сообщений в двоичный формат лога.
+ *
+ * Хранит словарь уже записанных мест вызова и литералов текущего файла;
+ * при начале нового файла словарь сбрасывается через reset().
+ */
+class BinaryLogEncoder {
+public:
+    /**
+     * @brief Забывает словарь, чтобы следующий файл получил свои записи Site и String.
+     */
+    void reset();
+
+    /**
+     * @brief Дописывает в out записи сообщений пачки.
+     * @param batch Пачка сообщений.
+     * @param minLevel Сообщения ниже этого уровня пропускаются.
+     * @param out Приёмник двоичных данных.
+     */
+    void encode(const LogBatch& batch, LogLevel minLevel, std::string& out);
+
+    /**
+     * @brief Дописывает в out запись одного сообщения и, при необходимости, записи словаря.
+     * @param record Сообщение пачки.
+     * @param out Приёмник двоичных данных.
+     * @return false, если аргументы повреждены и сообщение пропущено.
+     */
+    bool encodeRecord(const BatchRecord& record, std::string& out);
+
+private:
+    std::uint32_t siteId(const LogSite* site, std::string& out);  /**< Номер места вызова, при необходимости описать его */
+    std::uint32_t stringId(const char* text, std::uint32_t length, std::string& out);  /**< Номер литерала */
+    bool encodeArguments(std::string_view payload, std::string& out);  /**< Перекодировать аргументы в scratch */
+
+    std::unordered_map<const LogSite*, std::uint32_t> sites;  /**< Описанные места вызова */
+    std::unordered_map<const char*, std::uint32_t> strings;   /**< Описанные литералы */
+    std::string scratch;  /**< Аргументы текущего сообщения */
+};
+
+/**
+ * @struct BinaryLogEntry
+ * @brief Сообщение, прочитанное из двоичного файла лога.
+ */
+struct BinaryLogEntry {
+    LogSite site;     /**< Место вызова; file действителен до следующего чтения */
+    std::chrono::system_clock::time_point time;  /**< Момент вызова лога */
+    std::string payload;  /**< Аргументы в формате ArgumentWriter, литералы подставлены */
+};
+
+/**
+ * @class BinaryLogReader
+ * @brief Последовательное чтение двоичного файла лога.
+ *
+ * Понимает и файлы, записанные через FileBackend::MemoryMapped:
+ * заголовок MappedFile пропускается, а данные ограничиваются записанной длиной.
+ */
+class BinaryLogReader {
+public:
+    /**
+     * @brief Конструктор.
+     * @param data Содержимое файла; должно жить дольше читателя.
+     */
+    explicit BinaryLogReader(std::string_view data);
+
+    /**
+     * @brief Начинается ли файл с метки двоичного лога.
+     */
+    bool valid() const { return isValid; }
+
+    /**
+     * @brief Читает следующее сообщение.
+     * @param entry Прочитанное сообщение.
+     * @return false в конце файла или на повреждённых данных.
+     */
+    bool next(BinaryLogEntry& entry);
+
+    /**
+     * @brief Чтение остановилось на неполной или повреждённой записи.
+     */
+    bool damaged() const { return isDamaged; }
+
+private:
+    struct SiteInfo {
+        LogLevel level = LogLevel::TRACE;  /**< Уровень */
+        int line = 0;          /**< Номер строки */
+        std::string file;      /**< Имя файла */
+    };
+
+    bool fail();               /**< Отметить повреждение и завершить чтение */
+    bool decodeArguments(std::string_view payload, std::string& out) const;  /**< Подставить литералы */
+
+    const char* pos = nullptr;  /**< Текущая позиция */
+    const char* end = nullptr;  /**< Конец данных */
+    bool isValid = false;       /**< Метка найдена */
+    bool isDamaged = false;     /**< Найдена повреждённая запись */
+    std::vector<SiteInfo> sites;       /**< Места вызова по id */
+    std::vector<std::string> strings;  /**< Литералы по id */
+};
@@ -0,0 +1,472 @@
+﻿#include "Compression.h"
+#include "Platform.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t WindowSize = 32768;      /**< Окно deflate */
+constexpr std::size_t MinMatch = 3;            /**< Минимальная длина совпадения */
+constexpr std::size_t MaxMatch = 258;          /**< Максимальная длина совпадения */
+constexpr std::size_t MinLookahead = MaxMatch + MinMatch + 1;  /**< Запас данных перед поиском */
+constexpr unsigned HashBits = 15;
+constexpr std::size_t HashSize = std::size_t(1) << HashBits;
+constexpr unsigned MaxChain = 64;              /**< Сколько кандидатов проверять по цепочке */
+constexpr std::size_t MaxStoredBlock = 65535;  /**< Наибольший блок без сжатия */
+
+constexpr std::uint16_t LengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+constexpr std::uint8_t LengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+constexpr std::uint16_t DistanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+constexpr std::uint8_t DistanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+/**
+ * @brief Таблица CRC-32 (полином 0xEDB88320), вычисляемая при компиляции.
+ */
+constexpr std::array<std::uint32_t, 256> makeCrcTable() {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t i = 0; i < 256; ++i) {
+        std::uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+constexpr std::array<std::uint32_t, 256> CrcTable = makeCrcTable();
+
+/**
+ * @brief Продолжает вычисление CRC-32.
+ * @param crc Текущее значение (0 для начала).
+ * @param data Данные.
+ * @param size Размер данных.
+ */
+std::uint32_t updateCrc(std::uint32_t crc, const unsigned char* data, std::size_t size) {
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; ++i) {
+        crc = CrcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/**
+ * @class BitWriter
+ * @brief Запись битового потока deflate (младшие биты первыми) с буферизацией.
+ */
+class BitWriter {
+public:
+    explicit BitWriter(std::ofstream& file) : out(file) { buffer.reserve(BufferSize + 8); }
+
+    /** @brief Записывает count младших бит value. */
+    void bits(std::uint32_t value, unsigned count) {
+        bitBuffer |= static_cast<std::uint64_t>(value) << bitCount;
+        bitCount += count;
+        while (bitCount >= 8) {
+            buffer.push_back(static_cast<char>(bitBuffer & 0xFF));
+            bitBuffer >>= 8;
+            bitCount -= 8;
+        }
+        if (buffer.size() >= BufferSize) flushBuffer();
+    }
+
+    /** @brief Записывает код Хаффмана (старшие биты кода первыми). */
+    void code(std::uint32_t value, unsigned length) {
+        std::uint32_t reversed = 0;
+        for (unsigned i = 0; i < length; ++i) {
+            reversed = (reversed << 1) | ((value >> i) & 1);
+        }
+        bits(reversed, length);
+    }
+
+    /** @brief Дополняет нулями неполный байт. */
+    void alignToByte() {
+        if (bitCount > 0) {
+            buffer.push_back(static_cast<char>(bitBuffer & 0xFF));
+            bitBuffer = 0;
+            bitCount = 0;
+        }
+    }
+
+    /** @brief Записывает байты как есть; поток должен быть выровнен alignToByte(). */
+    void bytes(const unsigned char* data, std::size_t size) {
+        buffer.insert(buffer.end(), reinterpret_cast<const char*>(data), reinterpret_cast<const char*>(data) + size);
+        if (buffer.size() >= BufferSize) flushBuffer();
+    }
+
+    /** @brief Сколько бит записано после последней границы байта. */
+    unsigned pendingBits() const { return bitCount; }
+
+    /** @brief Дописывает неполный байт и сбрасывает буфер в файл. */
+    void finish() {
+        alignToByte();
+        flushBuffer();
+    }
+
+private:
+    static constexpr std::size_t BufferSize = 64 * 1024;
+
+    void flushBuffer() {
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    }
+
+    std::ofstream& out;
+    std::vector<char> buffer;
+    std::uint64_t bitBuffer = 0;
+    unsigned bitCount = 0;
+};
+
+/**
+ * @struct Token
+ * @brief Литерал или совпадение блока, ожидающего записи.
+ */
+struct Token {
+    std::uint16_t length;    /**< Длина совпадения; 0 - литерал */
+    std::uint16_t value;     /**< Байт литерала или расстояние совпадения */
+};
+
+/**
+ * @brief Записывает литерал или код длины фиксированным кодом Хаффмана.
+ * @param writer Приёмник.
+ * @param symbol Символ алфавита литералов/длин (0..287).
+ */
+void writeLiteralSymbol(BitWriter& writer, unsigned symbol) {
+    if (symbol < 144) writer.code(0x30 + symbol, 8);
+    else if (symbol < 256) writer.code(0x190 + symbol - 144, 9);
+    else if (symbol < 280) writer.code(symbol - 256, 7);
+    else writer.code(0xC0 + symbol - 280, 8);
+}
+
+/**
+ * @brief Длина фиксированного кода символа алфавита литералов/длин.
+ */
+unsigned literalSymbolBits(unsigned symbol) {
+    if (symbol < 144) return 8;
+    if (symbol < 256) return 9;
+    if (symbol < 280) return 7;
+    return 8;
+}
+
+/**
+ * @brief Номер кода длины совпадения (0..28).
+ */
+unsigned lengthCodeFor(std::size_t length) {
+    unsigned lengthCode = 28;
+    while (LengthBase[lengthCode] > length) --lengthCode;
+    return lengthCode;
+}
+
+/**
+ * @brief Номер кода расстояния совпадения (0..29).
+ */
+unsigned distanceCodeFor(std::size_t distance) {
+    unsigned distanceCode = 29;
+    while (DistanceBase[distanceCode] > distance) --distanceCode;
+    return distanceCode;
+}
+
+/**
+ * @brief Записывает пару (длина, расстояние).
+ */
+void writeMatch(BitWriter& writer, std::size_t length, std::size_t distance) {
+    unsigned lengthCode = lengthCodeFor(length);
+    writeLiteralSymbol(writer, 257 + lengthCode);
+    writer.bits(static_cast<std::uint32_t>(length - LengthBase[lengthCode]), LengthExtra[lengthCode]);
+
+    unsigned distanceCode = distanceCodeFor(distance);
+    writer.code(distanceCode, 5);
+    writer.bits(static_cast<std::uint32_t>(distance - DistanceBase[distanceCode]), DistanceExtra[distanceCode]);
+}
+
+/**
+ * @brief Размер пары (длина, расстояние) в фиксированных кодах, в битах.
+ */
+std::uint64_t matchBits(std::size_t length, std::size_t distance) {
+    unsigned lengthCode = lengthCodeFor(length);
+    unsigned distanceCode = distanceCodeFor(distance);
+    return literalSymbolBits(257 + lengthCode) + LengthExtra[lengthCode] + 5 + DistanceExtra[distanceCode];
+}
+
+/**
+ * @brief Записывает блок deflate: фиксированными кодами или без сжатия, если так короче.
+ *
+ * Блок без сжатия вмещает не больше MaxStoredBlock байт, поэтому длинный
+ * несжимаемый участок записывается несколькими такими блоками.
+ *
+ * @param writer Приёмник.
+ * @param tokens Литералы и совпадения блока.
+ * @param fixedBits Размер tokens в фиксированных кодах, в битах.
+ * @param raw Исходные байты блока.
+ * @param rawSize Число исходных байт.
+ * @param final Последний блок потока.
+ */
+void writeBlock(BitWriter& writer, const std::vector<Token>& tokens, std::uint64_t fixedBits,
+    const unsigned char* raw, std::size_t rawSize, bool final) {
+    std::uint64_t fixedSize = 3 + fixedBits + 7;
+    std::uint64_t storedBlocks = rawSize == 0 ? 1 : (rawSize + MaxStoredBlock - 1) / MaxStoredBlock;
+    std::uint64_t storedSize = 3 + (8 - (writer.pendingBits() + 3) % 8) % 8 + 32 + (storedBlocks - 1) * (8 + 32) + 8 * std::uint64_t(rawSize);
+
+    if (fixedSize <= storedSize) {
+        writer.bits(final ? 1 : 0, 1);
+        writer.bits(1, 2);  // BTYPE = 01, фиксированные коды
+        for (const Token& token : tokens) {
+            if (token.length == 0) writeLiteralSymbol(writer, token.value);
+            else writeMatch(writer, token.length, token.value);
+        }
+        writeLiteralSymbol(writer, 256);  // конец блока
+        return;
+    }
+
+    do {
+        std::size_t size = (std::min)(rawSize, MaxStoredBlock);
+        writer.bits(final && size == rawSize ? 1 : 0, 1);
+        writer.bits(0, 2);  // BTYPE = 00, без сжатия
+        writer.alignToByte();
+        writer.bits(static_cast<std::uint32_t>(size), 16);
+        writer.bits(static_cast<std::uint32_t>(~size & 0xFFFF), 16);
+        writer.bytes(raw, size);
+        raw += size;
+        rawSize -= size;
+    } while (rawSize != 0);
+}
+
+/**
+ * @brief Хэш трёх байтов для поиска совпадений.
+ */
+std::size_t hash3(const unsigned char* p) {
+    std::uint32_t v = (std::uint32_t(p[0]) << 16) | (std::uint32_t(p[1]) << 8) | p[2];
+    return (v * 2654435761u) >> (32 - HashBits);
+}
+
+/**
+ * @brief Записывает 32-битное значение в порядке little-endian.
+ */
+void writeLe32(std::ofstream& out, std::uint32_t value) {
+    char bytes[4] = {
+        static_cast<char>(value & 0xFF), static_cast<char>((value >> 8) & 0xFF),
+        static_cast<char>((value >> 16) & 0xFF), static_cast<char>((value >> 24) & 0xFF) };
+    out.write(bytes, sizeof(bytes));
+}
+
+}
+
+/**
+ * @brief Сжимает файл в формат gzip.
+ *
+ * Данные кодируются блоками deflate с фиксированными кодами Хаффмана;
+ * совпадения ищутся по хэш-цепочкам в окне 32 КБ. Для текстовых логов
+ * с повторяющимися префиксами строк этого достаточно, чтобы сократить
+ * размер в несколько раз без внешних зависимостей. Блок заканчивается
+ * перед каждым сдвигом окна, пока его исходные байты ещё в окне; если
+ * фиксированные коды длиннее исходных байт (уже сжатые или случайные
+ * данные), блок записывается без сжатия.
+ *
+ * @param source Исходный файл.
+ * @param destination Файл результата.
+ * @return true при успехе.
+ */
+bool gzipFile(const std::string& source, const std::string& destination) {
+    std::ifstream in(source, std::ios::in | std::ios::binary);
+    if (!in.is_open()) return false;
+    std::ofstream out(destination, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+
+    const unsigned char header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF };
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    std::vector<unsigned char> window(2 * WindowSize);
+    std::vector<std::int32_t> head(HashSize, -1);
+    std::vector<std::int32_t> prev(WindowSize, -1);
+    std::size_t length = 0;
+    std::size_t pos = 0;
+    bool eof = false;
+    std::uint32_t crc = 0;
+    std::uint32_t totalSize = 0;
+
+    BitWriter writer(out);
+    std::vector<Token> tokens;
+    std::uint64_t tokenBits = 0;
+    std::size_t blockStart = 0;
+
+    auto flushBlock = [&](bool final) {
+        writeBlock(writer, tokens, tokenBits, window.data() + blockStart, pos - blockStart, final);
+        tokens.clear();
+        tokenBits = 0;
+        blockStart = pos;
+        };
+
+    auto insert = [&](std::size_t at) {
+        std::size_t h = hash3(&window[at]);
+        prev[at & (WindowSize - 1)] = head[h];
+        head[h] = static_cast<std::int32_t>(at);
+        };
+
+    for (;;) {
+        if (!eof && length - pos < MinLookahead) {
+            if (length == window.size()) {
+                flushBlock(false);
+                std::memmove(window.data(), window.data() + WindowSize, WindowSize);
+                length -= WindowSize;
+                pos -= WindowSize;
+                blockStart = pos;
+                auto shift = [](std::int32_t& v) {
+                    v = v >= static_cast<std::int32_t>(WindowSize) ? v - static_cast<std::int32_t>(WindowSize) : -1;
+                    };
+                for (auto& v : head) shift(v);
+                for (auto& v : prev) shift(v);
+            }
+            in.read(reinterpret_cast<char*>(window.data() + length), static_cast<std::streamsize>(window.size() - length));
+            std::size_t got = static_cast<std::size_t>(in.gcount());
+            crc = updateCrc(crc, window.data() + length, got);
+            totalSize += static_cast<std::uint32_t>(got);
+            length += got;
+            if (!in) eof = true;
+            if (in.bad()) return false;
+        }
+        if (pos >= length) break;
+
+        std::size_t bestLength = 0;
+        std::size_t bestDistance = 0;
+        if (length - pos >= MinMatch) {
+            std::size_t maxLength = (std::min)(MaxMatch, length - pos);
+            std::int32_t candidate = head[hash3(&window[pos])];
+            for (unsigned chain = 0; candidate >= 0 && chain < MaxChain; ++chain) {
+                std::size_t c = static_cast<std::size_t>(candidate);
+                if (c >= pos || pos - c > WindowSize) break;
+                if (window[c + bestLength] == window[pos + bestLength]) {
+                    std::size_t n = 0;
+                    while (n < maxLength && window[c + n] == window[pos + n]) ++n;
+                    if (n > bestLength) {
+                        bestLength = n;
+                        bestDistance = pos - c;
+                        if (n == maxLength) break;
+                    }
+                }
+                std::int32_t next = prev[c & (WindowSize - 1)];
+                if (next >= candidate) break;
+                candidate = next;
+            }
+            insert(pos);
+        }
+
+        if (bestLength >= MinMatch) {
+            tokens.push_back({ static_cast<std::uint16_t>(bestLength), static_cast<std::uint16_t>(bestDistance) });
+            tokenBits += matchBits(bestLength, bestDistance);
+            for (std::size_t i = 1; i < bestLength; ++i) {
+                if (pos + i + MinMatch <= length) insert(pos + i);
+            }
+            pos += bestLength;
+        }
+        else {
+            tokens.push_back({ 0, window[pos] });
+            tokenBits += literalSymbolBits(window[pos]);
+            ++pos;
+        }
+    }
+
+    flushBlock(true);
+    writer.finish();
+
+    writeLe32(out, crc);
+    writeLe32(out, totalSize);
+    out.close();
+    return !out.fail();
+}
+
+/**
+ * @brief Деструктор. Дожидается выполнения очереди.
+ */
+LogCompressor::~LogCompressor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cv.notify_one();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+/**
+ * @brief Ставит файл в очередь на сжатие.
+ * @param path Путь к файлу.
+ */
+void LogCompressor::compress(const std::string& path) {
+    post({ path, false });
+}
+
+/**
+ * @brief Ставит в очередь удаление файла и его сжатой копии.
+ * @param path Путь к файлу.
+ */
+void LogCompressor::remove(const std::string& path) {
+    post({ path, true });
+}
+
+/**
+ * @brief Добавляет задание и при необходимости запускает поток.
+ * @param job Задание.
+ */
+void LogCompressor::post(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+        if (!thread.joinable()) {
+            thread = std::thread(&LogCompressor::threadFunc, this);
+        }
+    }
+    cv.notify_one();
+}
+
+/**
+ * @brief Функция потока сжатия.
+ *
+ * Поток работает с пониженным приоритетом, чтобы не отнимать время
+ * у потока обработки и потоков приложения.
+ */
+void LogCompressor::threadFunc() {
+    platform::setThreadPriority(-2);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        cv.wait(lock, [this]() { return stop || !jobs.empty(); });
+        if (jobs.empty()) break;
+
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        lock.unlock();
+
+        std::error_code ec;
+        std::string compressed = compressedPath(job.path);
+        if (job.removeOnly) {
+            std::filesystem::remove(job.path, ec);
+            std::filesystem::remove(compressed, ec);
+        }
+        else {
+            std::string partial = compressed + ".part";
+            if (gzipFile(job.path, partial)) {
+                std::filesystem::rename(partial, compressed, ec);
+                if (!ec) std::filesystem::remove(job.path, ec);
+            }
+            else {
+                std::filesystem::remove(partial, ec);
+            }
+        }
+
+        lock.lock();
+    }
+}
@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Сжимает файл в формат gzip (deflate с фиксированными кодами Хаффмана).
+ *
+ * Файл читается потоково, поэтому размер исходного файла не ограничен
+ * объёмом памяти. Блоки, которые не сжимаются, записываются как есть,
+ * так что результат больше исходного файла не более чем на заголовки.
+ *
+ * @param source Исходный файл.
+ * @param destination Файл результата; перезаписывается.
+ * @return true, если сжатие выполнено полностью.
+ */
+bool gzipFile(const std::string& source, const std::string& destination);
+
+/**
+ * @class LogCompressor
+ * @brief Фоновое сжатие файлов лога после ротации.
+ *
+ * Задания выполняются по порядку в отдельном потоке с пониженным
+ * приоритетом. Файл "имя.log" сжимается в "имя.log.gz" через временный
+ * "имя.log.gz.part", исходный файл удаляется только после успешного сжатия.
+ * Удаление старых файлов ставится в ту же очередь, чтобы не удалить
+ * файл, который ещё сжимается.
+ */
+class LogCompressor {
+public:
+    LogCompressor() = default;
+    ~LogCompressor();
+
+    LogCompressor(const LogCompressor&) = delete;
+    LogCompressor& operator=(const LogCompressor&) = delete;
+
+    /**
+     * @brief Ставит файл в очередь на сжатие.
+     * @param path Путь к закрытому файлу лога.
+     */
+    void compress(const std::string& path);
+
+    /**
+     * @brief Ставит в очередь удаление файла и его сжатой копии.
+     * @param path Путь к файлу лога (без ".gz").
+     */
+    void remove(const std::string& path);
+
+    /**
+     * @brief Имя сжатой копии файла.
+     * @param path Путь к файлу лога.
+     */
+    static std::string compressedPath(const std::string& path) { return path + ".gz"; }
+
+private:
+    struct Job {
+        std::string path;            /**< Файл лога */
+        bool removeOnly;             /**< Только удалить файл и его сжатую копию */
+    };
+
+    void post(Job job);              /**< Добавить задание и запустить поток */
+    void threadFunc();               /**< Функция потока сжатия */
+
+    std::thread thread;              /**< Поток сжатия */
+    std::mutex mutex;                /**< Мьютекс очереди */
+    std::condition_variable cv;      /**< Пробуждение потока сжатия */
+    std::deque<Job> jobs;            /**< Очередь заданий */
+    bool stop = false;               /**< Запрос остановки после выполнения очереди */
+};
@@ -0,0 +1,587 @@
+﻿#include "LogFile.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Разбирает имя файла ротации "префикс" + N + "расширение".
+ * @param name Имя файла без каталога.
+ * @param prefix Имя исходного файла без расширения и с точкой в конце.
+ * @param extension Расширение исходного файла.
+ * @param index Номер N.
+ * @return true, если имя имеет такой вид и N больше нуля.
+ */
+bool parseRotatedName(std::string_view name, std::string_view prefix, std::string_view extension, unsigned& index) {
+    if (name.size() <= prefix.size() + extension.size()) return false;
+    if (!name.starts_with(prefix) || !name.ends_with(extension)) return false;
+
+    std::string_view digits = name.substr(prefix.size(), name.size() - prefix.size() - extension.size());
+    if (!std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) return false;
+
+    auto result = std::from_chars(digits.data(), digits.data() + digits.size(), index);
+    return result.ec == std::errc() && index != 0;
+}
+
+}
+
+/**
+ * @brief Деструктор. Останавливает вспомогательный поток и закрывает файл.
+ */
+LogFile::~LogFile() {
+    close();
+    stopHelper();
+}
+
+/**
+ * @brief Открывает файл лога.
+ *
+ * В пустой файл записывается начало файла (по умолчанию BOM UTF-8).
+ * Номера ротации продолжают файлы "имя.N.расширение" (и их сжатые копии),
+ * оставшиеся от прошлых запусков: они не перезаписываются и учитываются
+ * в maxFiles как самые старые. Если выбран
+ * FileBackend::MemoryMapped, но файл нельзя отобразить (например, это
+ * обычный лог, открытый для дописывания), он открывается для прямой записи.
+ *
+ * @param path Путь к файлу.
+ * @param append Дописывать в конец или перезаписывать.
+ * @return true, если файл открыт.
+ */
+bool LogFile::open(const std::string& path, bool append) {
+    close();
+
+    if (backend == FileBackend::MemoryMapped && openMapped(path, append)) {
+        currentSize = mapped.size();
+    }
+    else {
+        if (!stream->open(path, !append)) return false;
+
+        writeHeaderIfEmpty(*stream, fileHeader);
+        currentSize = stream->size();
+    }
+    ++fileGeneration;
+    currentPath = path;
+    basePath = path;
+    findRotatedFiles();
+    files.push_back(path);
+    resetIntervalDeadline();
+    openIndex(append);
+
+    if (!mapped.isOpen() && (rotation.maxFileSize != 0 || rotation.interval.count() != 0)) {
+        scheduleNextFile();
+    }
+    enforceMaxFiles();
+    publishCrashPath();
+    return true;
+}
+
+/**
+ * @brief Закрывает файл и удаляет неиспользованный заранее созданный файл.
+ */
+void LogFile::close() {
+    publishedCrashPath.store(nullptr, std::memory_order_release);
+    indexWriter.close(currentSize);
+    stream->close();
+    mapped.close();
+
+    std::unique_ptr<platform::AppendFile> unused;
+    std::string unusedPath;
+    {
+        std::lock_guard<std::mutex> lock(helperMutex);
+        preopenPath.clear();
+        unused = std::move(preopened);
+        unusedPath = std::move(preopenedPath);
+        preopenedPath.clear();
+    }
+    if (unused) {
+        unused->close();
+        std::error_code ec;
+        std::filesystem::remove(unusedPath, ec);
+    }
+}
+
+/**
+ * @brief Устанавливает условия ротации.
+ * @param policy Условия ротации.
+ */
+void LogFile::setRotation(const RotationPolicy& policy) {
+    rotation = policy;
+    resetIntervalDeadline();
+    if (stream->isOpen() && (rotation.maxFileSize != 0 || rotation.interval.count() != 0)) {
+        scheduleNextFile();
+    }
+    enforceMaxFiles();
+}
+
+/**
+ * @brief Записывает пачку, предварительно сменив файл, если выполнено условие ротации.
+ *
+ * Ротация проверяется перед пачкой, поэтому строки не разрываются.
+ * Пачка, которая не помещается в room(), целиком пишется в новый файл.
+ *
+ * @param parts Части пачки.
+ * @param count Число частей.
+ * @return false, если файл не открыт или запись не удалась.
+ */
+bool LogFile::write(const std::string_view* parts, std::size_t count) {
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < count; ++i) size += parts[i].size();
+
+    rotateIfDue(size);
+    return append(parts, count);
+}
+
+/**
+ * @brief Сменяет файл, если перед записью size байт выполнено условие ротации.
+ * @param size Размер предстоящей записи.
+ * @return true, если начат новый файл.
+ */
+bool LogFile::rotateIfDue(std::size_t size) {
+    if (!isOpen() || !rotationDue(size)) return false;
+
+    return rotate();
+}
+
+/**
+ * @brief Сколько байт ещё помещается в текущий файл до maxFileSize.
+ * @return Остаток до maxFileSize; без ограничения размера - максимум uint64_t.
+ */
+std::uint64_t LogFile::room() const {
+    if (rotation.maxFileSize == 0) return (std::numeric_limits<std::uint64_t>::max)();
+
+    return currentSize < rotation.maxFileSize ? rotation.maxFileSize - currentSize : 0;
+}
+
+/**
+ * @brief Дописывает данные в текущий файл без проверки ротации.
+ * @param parts Части.
+ * @param count Число частей.
+ * @return false, если файл не открыт или запись не удалась.
+ */
+bool LogFile::append(const std::string_view* parts, std::size_t count) {
+    if (!isOpen()) return false;
+
+    std::size_t size = 0;
+    if (mapped.isOpen()) {
+        for (std::size_t i = 0; i < count; ++i) {
+            if (!mapped.write(parts[i].data(), parts[i].size())) return false;
+            size += parts[i].size();
+        }
+    }
+    else {
+        if (!stream->write(parts, count)) return false;
+        for (std::size_t i = 0; i < count; ++i) size += parts[i].size();
+    }
+    currentSize += size;
+    return true;
+}
+
+/**
+ * @brief Дожидается начатых записей или инициирует запись страниц отображения.
+ */
+void LogFile::flush() {
+    if (stream->isOpen()) {
+        stream->flush();
+    }
+    mapped.flush();
+}
+
+/**
+ * @brief Выбирает способ записи для следующих открываемых файлов.
+ * @param fileBackend Поток или отображение в память.
+ * @param mappedSegmentSize Шаг увеличения отображаемого файла.
+ */
+void LogFile::setBackend(FileBackend fileBackend, std::uint64_t mappedSegmentSize) {
+    backend = fileBackend;
+    segmentSize = mappedSegmentSize;
+}
+
+/**
+ * @brief Задаёт начало новых файлов и режим открытия.
+ * @param header Байты, с которых начинается каждый новый файл.
+ * @param binary Содержимое двоичное.
+ */
+void LogFile::setContent(std::string header, bool binary) {
+    fileHeader = std::move(header);
+    binaryContent = binary;
+    publishCrashPath();
+}
+
+/**
+ * @brief Проверяет условия ротации.
+ *
+ * По размеру сменяется только файл, в котором уже есть записи: иначе
+ * запись больше maxFileSize открывала бы новые файлы без конца.
+ *
+ * @param incoming Размер следующей записи.
+ * @return true, если перед записью нужно сменить файл.
+ */
+bool LogFile::rotationDue(std::size_t incoming) const {
+    if (rotation.maxFileSize != 0 && currentSize > emptyFileSize() && currentSize + incoming > rotation.maxFileSize) {
+        return true;
+    }
+    if (rotation.interval.count() != 0 && std::chrono::system_clock::now() >= nextRotation) {
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Переходит на следующий файл.
+ *
+ * Используется файл, созданный вспомогательным потоком; если он ещё
+ * не начат, файл открывается здесь же, а если создаётся прямо сейчас -
+ * дожидаемся его. Отображаемые файлы создаются здесь же: создание
+ * сводится к открытию и резервированию первого сегмента.
+ *
+ * Следующий файл открывается без обрезки. Если открыть его не удалось,
+ * запись продолжается в текущий файл, неудача учитывается в
+ * rotationFailures(), а попытка повторяется перед следующей пачкой.
+ *
+ * @return true, если начат новый файл.
+ */
+bool LogFile::rotate() {
+    std::string nextPath = pathForIndex(currentIndex + 1);
+    if (mapped.isOpen()) {
+        mapped.close();
+        if (!openMapped(nextPath, true)) {
+            ++failedRotations;
+            openMapped(currentPath, true);
+            return false;
+        }
+        indexWriter.close(currentSize);
+        if (rotation.compress) {
+            compressor.compress(currentPath);
+        }
+
+        ++fileGeneration;
+        ++currentIndex;
+        currentPath = nextPath;
+        currentSize = mapped.size();
+        files.push_back(nextPath);
+        resetIntervalDeadline();
+        openIndex(currentSize > emptyFileSize());
+        enforceMaxFiles();
+        publishCrashPath();
+        return true;
+    }
+
+    std::unique_ptr<platform::AppendFile> next;
+    {
+        std::unique_lock<std::mutex> lock(helperMutex);
+        helperCv.wait(lock, [this, &nextPath]() { return inProgressPath != nextPath; });
+        if (preopened && preopenedPath == nextPath) {
+            next = std::move(preopened);
+            preopenedPath.clear();
+        }
+        preopenPath.clear();
+    }
+
+    if (!next) {
+        next = std::make_unique<platform::AppendFile>();
+        if (!next->open(nextPath, false)) {
+            ++failedRotations;
+            return false;
+        }
+        writeHeaderIfEmpty(*next, fileHeader);
+    }
+
+    indexWriter.close(currentSize);
+    stream->close();
+    if (rotation.compress) {
+        compressor.compress(currentPath);
+    }
+    stream = std::move(next);
+
+    ++fileGeneration;
+    ++currentIndex;
+    currentPath = nextPath;
+    currentSize = stream->size();
+    files.push_back(nextPath);
+    resetIntervalDeadline();
+    openIndex(currentSize > emptyFileSize());
+
+    scheduleNextFile();
+    enforceMaxFiles();
+    publishCrashPath();
+    return true;
+}
+
+/**
+ * @brief Имя файла с номером ротации: "app.log" -> "app.3.log".
+ * @param index Номер ротации (0 - исходное имя).
+ * @return Путь к файлу.
+ */
+std::string LogFile::pathForIndex(unsigned index) const {
+    if (index == 0) return basePath;
+
+    std::filesystem::path path(basePath);
+    std::string stem = path.stem().string();
+    std::string extension = path.extension().string();
+    std::string number = std::to_string(index);
+
+    std::string name;
+    name.reserve(stem.size() + 1 + number.size() + extension.size());
+    name.append(stem).append(1, '.').append(number).append(extension);
+    return (path.parent_path() / name).string();
+}
+
+/**
+ * @brief Находит файлы ротации, оставшиеся от прошлых запусков.
+ *
+ * Учитываются и сжатые копии ("имя.N.расширение.gz"). Найденные файлы
+ * заполняют список files от меньших номеров к большим, а следующая
+ * ротация получает номер после наибольшего.
+ */
+void LogFile::findRotatedFiles() {
+    files.clear();
+    currentIndex = 0;
+
+    std::filesystem::path path(basePath);
+    std::string prefix = path.stem().string();
+    prefix.append(1, '.');
+    std::string extension = path.extension().string();
+    std::filesystem::path directory = path.parent_path();
+    if (directory.empty()) directory = ".";
+
+    std::vector<unsigned> found;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (name.ends_with(".gz")) name.resize(name.size() - 3);
+
+        unsigned index = 0;
+        if (parseRotatedName(name, prefix, extension, index)) found.push_back(index);
+    }
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+
+    for (unsigned index : found) {
+        files.push_back(pathForIndex(index));
+    }
+    if (!found.empty()) currentIndex = found.back();
+}
+
+/**
+ * @brief Размер только что созданного файла текущего способа записи.
+ * @return Размер начала файла, а для отображаемого файла - ещё и заголовка MappedFile.
+ */
+std::uint64_t LogFile::emptyFileSize() const {
+    if (mapped.isOpen()) {
+        return MappedFile::HeaderSize + (binaryContent ? fileHeader.size() : 0);
+    }
+    return fileHeader.size();
+}
+
+/**
+ * @brief Поручает вспомогательному потоку создать файл для следующей ротации.
+ */
+void LogFile::scheduleNextFile() {
+    {
+        std::lock_guard<std::mutex> lock(helperMutex);
+        if (!helperThread.joinable()) {
+            helperStop = false;
+            helperThread = std::thread(&LogFile::helperFunc, this);
+        }
+        preopenPath = pathForIndex(currentIndex + 1);
+        preopenHeader = fileHeader;
+    }
+    helperCv.notify_all();
+}
+
+/**
+ * @brief Передаёт на удаление файлы сверх maxFiles.
+ *
+ * При включённом сжатии удаление идёт через очередь LogCompressor,
+ * чтобы не удалить файл, который ещё сжимается, и заодно удалить его
+ * сжатую копию. Без сжатия удаляется и сжатая копия, которая могла
+ * остаться от запуска со сжатием. Индекс файла удаляет вспомогательный поток.
+ */
+void LogFile::enforceMaxFiles() {
+    if (rotation.maxFiles == 0 || files.size() <= rotation.maxFiles) return;
+
+    {
+        std::lock_guard<std::mutex> lock(helperMutex);
+        while (files.size() > rotation.maxFiles) {
+            if (rotation.compress) {
+                compressor.remove(files.front());
+            }
+            else {
+                pendingRemovals.push_back(files.front());
+                pendingRemovals.push_back(LogCompressor::compressedPath(files.front()));
+            }
+            if (indexInterval != 0) {
+                pendingRemovals.push_back(logIndexPath(files.front()));
+            }
+            files.pop_front();
+        }
+        if (pendingRemovals.empty()) return;
+        if (!helperThread.joinable()) {
+            helperStop = false;
+            helperThread = std::thread(&LogFile::helperFunc, this);
+        }
+    }
+    helperCv.notify_all();
+}
+
+/**
+ * @brief Функция вспомогательного потока: создание следующего файла и удаление старых.
+ */
+void LogFile::helperFunc() {
+    std::unique_lock<std::mutex> lock(helperMutex);
+    for (;;) {
+        helperCv.wait(lock, [this]() {
+            return helperStop || !pendingRemovals.empty() || (!preopenPath.empty() && preopenPath != preopenedPath);
+            });
+        if (helperStop) break;
+
+        while (!pendingRemovals.empty()) {
+            std::string victim = std::move(pendingRemovals.front());
+            pendingRemovals.pop_front();
+            lock.unlock();
+            std::error_code ec;
+            std::filesystem::remove(victim, ec);
+            lock.lock();
+        }
+
+        if (!preopenPath.empty() && preopenPath != preopenedPath) {
+            std::string target = preopenPath;
+            std::string header = preopenHeader;
+            inProgressPath = target;
+            lock.unlock();
+
+            auto file = std::make_unique<platform::AppendFile>();
+            if (file->open(target, false)) writeHeaderIfEmpty(*file, header);
+
+            lock.lock();
+            inProgressPath.clear();
+            if (!file->isOpen() && preopenPath == target) {
+                preopenPath.clear();
+            }
+            if (file->isOpen() && preopenPath == target) {
+                if (preopened) {
+                    preopened->close();
+                    std::error_code ec;
+                    std::filesystem::remove(preopenedPath, ec);
+                }
+                preopened = std::move(file);
+                preopenedPath = target;
+            }
+            else if (file->isOpen()) {
+                file->close();
+                std::error_code ec;
+                std::filesystem::remove(target, ec);
+            }
+            helperCv.notify_all();
+        }
+    }
+}
+
+/**
+ * @brief Останавливает вспомогательный поток, дождавшись удаления файлов.
+ */
+void LogFile::stopHelper() {
+    {
+        std::lock_guard<std::mutex> lock(helperMutex);
+        helperStop = true;
+    }
+    helperCv.notify_all();
+    if (helperThread.joinable()) {
+        helperThread.join();
+    }
+    for (const std::string& victim : pendingRemovals) {
+        std::error_code ec;
+        std::filesystem::remove(victim, ec);
+    }
+    pendingRemovals.clear();
+}
+
+/**
+ * @brief Записывает начало файла, если файл пуст.
+ * @param file Открытый файл.
+ * @param header Начало файла (по умолчанию BOM UTF-8).
+ * @return true, если начало записано.
+ */
+bool LogFile::writeHeaderIfEmpty(platform::AppendFile& file, const std::string& header) {
+    if (file.size() != 0 || header.empty()) return false;
+
+    return file.write(header.data(), header.size());
+}
+
+/**
+ * @brief Открывает отображаемый файл.
+ *
+ * Заголовок MappedFile уже начинается с BOM, поэтому собственное начало
+ * файла записывается только для двоичного содержимого.
+ *
+ * @param path Путь к файлу.
+ * @param append Продолжить запись после данных существующего файла.
+ * @return true, если файл открыт.
+ */
+bool LogFile::openMapped(const std::string& path, bool append) {
+    if (!mapped.open(path, append, segmentSize)) return false;
+
+    if (binaryContent && mapped.size() == MappedFile::HeaderSize) {
+        mapped.write(fileHeader.data(), fileHeader.size());
+    }
+    return true;
+}
+
+/**
+ * @brief Открывает индекс текущего файла, если индекс включён.
+ *
+ * Индекс, который не удалось открыть, просто не ведётся: запись лога
+ * от него не зависит.
+ *
+ * @param append Дописывать существующий индекс.
+ */
+void LogFile::openIndex(bool append) {
+    if (indexInterval != 0) {
+        indexWriter.open(currentPath, append, indexInterval);
+    }
+}
+
+/**
+ * @brief Публикует путь аварийной записи для текущего файла.
+ *
+ * Текстовый файл с прямой записью дополняется аварийными строками
+ * напрямую; в отображаемый или двоичный файл писать их нельзя, поэтому
+ * для него публикуется "имя.crash.log". Строка собирается в неопубликованной
+ * ячейке и только потом становится видна crashPath().
+ */
+void LogFile::publishCrashPath() {
+    static constexpr char Suffix[] = ".crash.log";
+    bool separate = mapped.isOpen() || binaryContent;
+    std::size_t length = currentPath.size() + (separate ? sizeof(Suffix) - 1 : 0);
+    if (!isOpen() || length >= sizeof(crashPaths[0])) {
+        publishedCrashPath.store(nullptr, std::memory_order_release);
+        return;
+    }
+
+    crashPathSlot ^= 1;
+    char* target = crashPaths[crashPathSlot];
+    std::memcpy(target, currentPath.data(), currentPath.size());
+    if (separate) std::memcpy(target + currentPath.size(), Suffix, sizeof(Suffix) - 1);
+    target[length] = '\0';
+    publishedCrashPath.store(target, std::memory_order_release);
+}
+
+/**
+ * @brief Вычисляет момент следующей ротации по времени.
+ *
+ * Момент выравнивается по кратным интервалу границам часов,
+ * например для часового интервала ротация происходит в начале часа.
+ */
+void LogFile::resetIntervalDeadline() {
+    if (rotation.interval.count() == 0) return;
+
+    auto now = std::chrono::system_clock::now();
+    auto sinceEpoch = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch());
+    auto periods = sinceEpoch / rotation.interval;
+    nextRotation = std::chrono::system_clock::time_point((periods + 1) * rotation.interval);
+}
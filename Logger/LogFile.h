@@ -0,0 +1,287 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "Compression.h"
+#include "LogIndex.h"
+#include "MappedFile.h"
+#include "Platform.h"
+
+/**
+ * @struct RotationPolicy
+ * @brief Условия ротации файла лога. Нулевое значение отключает условие.
+ */
+struct RotationPolicy {
+    std::uint64_t maxFileSize = 0;       /**< Максимальный размер файла в байтах */
+    std::chrono::seconds interval{ 0 };  /**< Интервал ротации, выровненный по границам часов */
+    std::size_t maxFiles = 0;            /**< Сколько файлов хранить, включая текущий */
+    bool compress = false;               /**< Сжимать закрытые файлы в gzip */
+};
+
+/**
+ * @enum FileBackend
+ * @brief Способ записи файла лога.
+ */
+enum class FileBackend {
+    Stream,         /**< Запись пачек в конец файла системным вызовом (platform::AppendFile) */
+    MemoryMapped    /**< Отображение файла в память (MappedFile) */
+};
+
+/**
+ * @brief Шаг увеличения отображаемого файла по умолчанию.
+ */
+inline constexpr std::uint64_t DefaultMappedSegmentSize = 64ull * 1024 * 1024;
+
+/**
+ * @class LogFile
+ * @brief Файл лога с ротацией по размеру и времени.
+ *
+ * Запись выполняется только потоком обработки. Следующий файл
+ * ("имя.N.расширение", N продолжает номера файлов, уже лежащих рядом)
+ * заранее создаётся вспомогательным потоком,
+ * поэтому смена файла между пачками сводится к перестановке дескрипторов,
+ * а удаление старых файлов сверх maxFiles также выполняется в фоне.
+ * При включённом сжатии закрытые файлы передаются LogCompressor.
+ * Если задан setIndexInterval(), рядом с каждым файлом ведётся индекс
+ * времени (LogIndexWriter), который сменяется и удаляется вместе с файлом;
+ * смещения индекса сжатого файла относятся к распакованному содержимому.
+ */
+class LogFile {
+public:
+    LogFile() = default;
+    ~LogFile();
+
+    LogFile(const LogFile&) = delete;
+    LogFile& operator=(const LogFile&) = delete;
+
+    /**
+     * @brief Открывает файл лога, закрывая предыдущий.
+     * @param path Путь к файлу.
+     * @param append Дописывать в конец (true) или перезаписывать (false).
+     * @return true, если файл открыт.
+     */
+    bool open(const std::string& path, bool append);
+
+    /**
+     * @brief Закрывает файл и удаляет неиспользованный заранее созданный файл.
+     */
+    void close();
+
+    /**
+     * @brief Открыт ли файл.
+     */
+    bool isOpen() const { return stream->isOpen() || mapped.isOpen(); }
+
+    /**
+     * @brief Открыт ли текущий файл через отображение в память.
+     */
+    bool isMapped() const { return mapped.isOpen(); }
+
+    /**
+     * @brief Путь к текущему файлу.
+     */
+    const std::string& path() const { return currentPath; }
+
+    /**
+     * @brief Путь для аварийной записи строк из потока сбоя.
+     *
+     * Читается без блокировок, в том числе из обработчика сигнала: поток
+     * обработки готовит строку в той из двух ячеек, которая сейчас
+     * не опубликована, и публикует её атомарной записью указателя.
+     * Для отображаемого или двоичного файла это "имя.crash.log" рядом
+     * с текущим файлом. Строка остаётся целой, пока файл не сменится
+     * дважды за время её чтения.
+     *
+     * @return Путь с завершающим нулём или nullptr, если файл не открыт.
+     */
+    const char* crashPath() const { return publishedCrashPath.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Устанавливает условия ротации.
+     * @param policy Условия ротации.
+     */
+    void setRotation(const RotationPolicy& policy);
+
+    /**
+     * @brief Выбирает способ записи. Применяется к файлам, открытым после вызова.
+     * @param fileBackend Поток или отображение в память.
+     * @param mappedSegmentSize Шаг увеличения отображаемого файла.
+     */
+    void setBackend(FileBackend fileBackend, std::uint64_t mappedSegmentSize);
+
+    /**
+     * @brief Включает индекс времени. Применяется к файлам, открытым после вызова.
+     * @param bytes Размер блока индекса в байтах; 0 - без индекса.
+     */
+    void setIndexInterval(std::uint64_t bytes) { indexInterval = bytes; }
+
+    /**
+     * @brief Индекс текущего файла; открыт, только если индекс включён.
+     *
+     * Приёмник отмечает в нём строки пачки перед append() и подтверждает
+     * отметки после записи (LogIndexWriter::commit()).
+     */
+    LogIndexWriter& index() { return indexWriter; }
+
+    /**
+     * @brief Размер текущего файла, то есть смещение следующей записи.
+     */
+    std::uint64_t size() const { return currentSize; }
+
+    /**
+     * @brief Сколько байт ещё помещается в текущий файл до maxFileSize.
+     *
+     * Приёмник делит по этому значению пачку, чтобы файлы не превышали
+     * maxFileSize: строки до предела дописываются в текущий файл,
+     * остальные - после rotateIfDue() в следующий.
+     *
+     * @return Остаток до maxFileSize; без ограничения размера - максимум uint64_t.
+     */
+    std::uint64_t room() const;
+
+    /**
+     * @brief Задаёт начало новых файлов и режим открытия.
+     *
+     * Применяется к файлам, открытым после вызова. По умолчанию файл
+     * текстовый и начинается с BOM UTF-8. Байты пишутся как есть,
+     * без преобразования '\n' и на Windows.
+     *
+     * @param header Байты, с которых начинается каждый новый файл.
+     * @param binary Содержимое двоичное: в отображаемый файл начало пишется
+     *        после заголовка MappedFile (заголовок уже начинается с BOM).
+     */
+    void setContent(std::string header, bool binary);
+
+    /**
+     * @brief Записывает пачку данных, при необходимости сменив файл перед записью.
+     *
+     * Пачка пишется в один файл целиком; делить её по room() должен вызывающий.
+     *
+     * @param data Данные.
+     * @param size Размер данных.
+     * @return false, если файл не открыт или запись не удалась.
+     */
+    bool write(const char* data, std::size_t size) {
+        std::string_view part(data, size);
+        return write(&part, 1);
+    }
+
+    /**
+     * @brief Записывает пачку из нескольких частей одной операцией.
+     *
+     * Части - например, уцелевшие после фильтрации по уровню отрезки
+     * текста пачки - не склеиваются в промежуточный буфер.
+     *
+     * @param parts Части.
+     * @param count Число частей.
+     * @return false, если файл не открыт или запись не удалась.
+     */
+    bool write(const std::string_view* parts, std::size_t count);
+
+    /**
+     * @brief Сменяет файл, если перед записью size байт выполнено условие ротации.
+     *
+     * Нужен форматам, содержимое которых зависит от того, начат ли новый файл
+     * (например, словарь двоичного лога).
+     *
+     * @param size Размер предстоящей записи.
+     * @return true, если начат новый файл.
+     */
+    bool rotateIfDue(std::size_t size);
+
+    /**
+     * @brief Дописывает данные в текущий файл без проверки ротации.
+     * @param data Данные.
+     * @param size Размер данных.
+     * @return false, если файл не открыт или запись не удалась.
+     */
+    bool append(const char* data, std::size_t size) {
+        std::string_view part(data, size);
+        return append(&part, 1);
+    }
+
+    /**
+     * @brief Дописывает несколько частей в текущий файл без проверки ротации.
+     * @param parts Части.
+     * @param count Число частей.
+     * @return false, если файл не открыт или запись не удалась.
+     */
+    bool append(const std::string_view* parts, std::size_t count);
+
+    /**
+     * @brief Номер текущего файла; увеличивается при каждом open() и ротации.
+     */
+    std::uint64_t generation() const { return fileGeneration; }
+
+    /**
+     * @brief Сколько раз не удалось открыть следующий файл при ротации.
+     *
+     * После неудачи запись продолжается в текущий файл, а ротация
+     * повторяется перед следующей пачкой.
+     */
+    std::uint64_t rotationFailures() const { return failedRotations; }
+
+    /**
+     * @brief Дожидается начатых записей или инициирует запись страниц отображения.
+     */
+    void flush();
+
+private:
+    bool rotationDue(std::size_t incoming) const;  /**< Нужна ли ротация перед записью */
+    bool rotate();                   /**< Перейти на следующий файл */
+    std::string pathForIndex(unsigned index) const;  /**< Имя файла с номером ротации */
+    void findRotatedFiles();         /**< Найти файлы с номерами, оставшиеся от прошлых запусков */
+    std::uint64_t emptyFileSize() const;  /**< Размер нового файла без записей */
+    void scheduleNextFile();         /**< Поручить фоновому потоку создать следующий файл */
+    void enforceMaxFiles();          /**< Поручить фоновому потоку удалить лишние файлы */
+    void helperFunc();               /**< Функция вспомогательного потока */
+    void stopHelper();               /**< Остановить вспомогательный поток */
+    static bool writeHeaderIfEmpty(platform::AppendFile& file, const std::string& header);  /**< Записать начало пустого файла */
+    bool openMapped(const std::string& path, bool append);  /**< Открыть отображаемый файл */
+    void resetIntervalDeadline();    /**< Вычислить момент следующей ротации по времени */
+    void openIndex(bool append);     /**< Открыть индекс текущего файла, если он включён */
+    void publishCrashPath();         /**< Опубликовать путь для crashPath() */
+
+    std::unique_ptr<platform::AppendFile> stream = std::make_unique<platform::AppendFile>();  /**< Текущий файл (FileBackend::Stream) */
+    MappedFile mapped;               /**< Текущий файл (FileBackend::MemoryMapped) */
+    FileBackend backend = FileBackend::Stream;  /**< Способ записи новых файлов */
+    std::uint64_t segmentSize = DefaultMappedSegmentSize;  /**< Шаг увеличения отображаемого файла */
+    std::string fileHeader = "\xEF\xBB\xBF";  /**< Начало каждого нового файла */
+    bool binaryContent = false;      /**< Содержимое двоичное */
+    std::uint64_t indexInterval = 0; /**< Размер блока индекса; 0 - без индекса */
+    LogIndexWriter indexWriter;      /**< Индекс текущего файла */
+    std::uint64_t fileGeneration = 0;  /**< Счётчик открытых файлов */
+    std::string currentPath;         /**< Путь к текущему файлу */
+    std::string basePath;            /**< Путь, переданный в open() */
+    std::uint64_t currentSize = 0;   /**< Размер текущего файла */
+    unsigned currentIndex = 0;       /**< Последний занятый номер ротации */
+    std::uint64_t failedRotations = 0;  /**< Неудачных попыток ротации */
+    std::chrono::system_clock::time_point nextRotation;  /**< Момент ротации по времени */
+    RotationPolicy rotation;         /**< Условия ротации */
+    std::deque<std::string> files;   /**< Файлы с номерами и текущий, от старых к новым */
+    char crashPaths[2][1024] = {};   /**< Ячейки пути для crashPath() */
+    int crashPathSlot = 0;           /**< Ячейка последней публикации */
+    std::atomic<const char*> publishedCrashPath{ nullptr };  /**< Опубликованный путь для crashPath() */
+
+    std::thread helperThread;        /**< Вспомогательный поток */
+    std::mutex helperMutex;          /**< Мьютекс данных вспомогательного потока */
+    std::condition_variable helperCv;  /**< Пробуждение вспомогательного потока и ожидание ротации */
+    bool helperStop = false;         /**< Запрос остановки вспомогательного потока */
+    std::string preopenPath;         /**< Какой файл создать заранее */
+    std::string inProgressPath;      /**< Файл, который создаётся прямо сейчас */
+    std::string preopenHeader;       /**< Начало заранее создаваемого файла */
+    std::unique_ptr<platform::AppendFile> preopened;  /**< Заранее созданный файл */
+    std::string preopenedPath;       /**< Путь к заранее созданному файлу */
+    std::deque<std::string> pendingRemovals;  /**< Файлы к удалению */
+
+    LogCompressor compressor;        /**< Фоновое сжатие закрытых файлов */
+};
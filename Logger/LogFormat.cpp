@@ -0,0 +1,740 @@
+﻿#include "LogFormat.h"
+#include "Platform.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+namespace {
+
+/**
+ * @brief Записывает число фиксированной ширины с ведущими нулями.
+ * @param dst Начало области записи (не менее width символов).
+ * @param value Неотрицательное значение.
+ * @param width Количество цифр.
+ */
+void writeDigits(char* dst, std::uint32_t value, int width) {
+    for (int i = width - 1; i >= 0; --i) {
+        dst[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+}
+
+/**
+ * @brief Читает значение фиксированного размера из двоичного потока.
+ * @param pos Текущая позиция; сдвигается за прочитанное значение.
+ * @param end Конец потока.
+ * @param value Прочитанное значение.
+ * @return false, если данных недостаточно.
+ */
+template<typename V>
+bool readValue(const char*& pos, const char* end, V& value) {
+    if (static_cast<std::size_t>(end - pos) < sizeof(V)) return false;
+    std::memcpy(&value, pos, sizeof(V));
+    pos += sizeof(V);
+    return true;
+}
+
+}
+
+/**
+ * @brief Разбирает строку шаблона на литералы и плейсхолдеры.
+ *
+ * Нераспознанные последовательности в фигурных скобках остаются литералами.
+ * Соседние литералы объединяются в один сегмент.
+ *
+ * @param text Строка шаблона.
+ */
+FormatTemplate::FormatTemplate(std::string_view text)
+    : source(text) {
+    auto appendLiteral = [this](std::string_view literal) {
+        if (literal.empty()) return;
+        if (!parts.empty() && parts.back().field == Field::Literal) {
+            parts.back().literal += literal;
+        }
+        else {
+            parts.push_back({ Field::Literal, std::string(literal) });
+        }
+        };
+
+    std::size_t pos = 0;
+    while (pos < text.size()) {
+        std::size_t open = text.find('{', pos);
+        if (open == std::string_view::npos || open + 2 >= text.size()) {
+            appendLiteral(text.substr(pos));
+            break;
+        }
+
+        appendLiteral(text.substr(pos, open - pos));
+
+        Field field = Field::Literal;
+        if (text[open + 2] == '}') {
+            switch (text[open + 1]) {
+            case 't': field = Field::Timestamp; break;
+            case 'L': field = Field::Level; break;
+            case 'f': field = Field::File; break;
+            case 'l': field = Field::Line; break;
+            case 'm': field = Field::Message; break;
+            default: break;
+            }
+        }
+
+        if (field == Field::Literal) {
+            appendLiteral(text.substr(open, 1));
+            pos = open + 1;
+        }
+        else {
+            parts.push_back({ field, std::string() });
+            pos = open + 3;
+        }
+    }
+}
+
+/**
+ * @brief Дописывает временную метку в буфер.
+ *
+ * Вызов localtime выполняется только при смене секунды,
+ * в остальных случаях копируется кэшированный префикс.
+ *
+ * @param time Момент времени.
+ * @param out Выходной буфер.
+ */
+void TimestampCache::append(std::chrono::system_clock::time_point time, std::string& out) {
+    using namespace std::chrono;
+
+    auto second = floor<seconds>(time);
+    std::int64_t secondCount = second.time_since_epoch().count();
+    if (secondCount != cachedSecond) {
+        rebuildPrefix(secondCount);
+    }
+    out.append(prefix, PrefixLength);
+
+    char fraction[7];
+    auto subsecond = duration_cast<microseconds>(time - second).count();
+    switch (precision) {
+    case TimestampPrecision::Milliseconds:
+        fraction[0] = '.';
+        writeDigits(fraction + 1, static_cast<std::uint32_t>(subsecond / 1000), 3);
+        out.append(fraction, 4);
+        break;
+    case TimestampPrecision::Microseconds:
+        fraction[0] = '.';
+        writeDigits(fraction + 1, static_cast<std::uint32_t>(subsecond), 6);
+        out.append(fraction, 7);
+        break;
+    case TimestampPrecision::Seconds:
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Пересобирает префикс "YYYY-MM-DD HH:MM:SS" для указанной секунды.
+ * @param second Число секунд от эпохи.
+ */
+void TimestampCache::rebuildPrefix(std::int64_t second) {
+    std::time_t t_c = static_cast<std::time_t>(second);
+    std::tm timeInfo{};
+    platform::localTime(t_c, timeInfo);
+
+    writeDigits(prefix, static_cast<std::uint32_t>(timeInfo.tm_year + 1900), 4);
+    prefix[4] = '-';
+    writeDigits(prefix + 5, static_cast<std::uint32_t>(timeInfo.tm_mon + 1), 2);
+    prefix[7] = '-';
+    writeDigits(prefix + 8, static_cast<std::uint32_t>(timeInfo.tm_mday), 2);
+    prefix[10] = ' ';
+    writeDigits(prefix + 11, static_cast<std::uint32_t>(timeInfo.tm_hour), 2);
+    prefix[13] = ':';
+    writeDigits(prefix + 14, static_cast<std::uint32_t>(timeInfo.tm_min), 2);
+    prefix[16] = ':';
+    writeDigits(prefix + 17, static_cast<std::uint32_t>(timeInfo.tm_sec), 2);
+
+    cachedSecond = second;
+}
+
+namespace {
+
+/**
+ * @struct ArgumentValue
+ * @brief Значение одного сериализованного аргумента.
+ */
+struct ArgumentValue {
+    ArgType type;            /**< Тип аргумента */
+    std::int64_t i = 0;      /**< Int64; начало замера (Span) */
+    std::uint64_t u = 0;     /**< UInt64 */
+    double d = 0;            /**< Double */
+    bool b = false;          /**< Bool */
+    char c = 0;              /**< Char */
+    std::string_view text;   /**< Строки и имя поля (Field) */
+    std::int64_t end = 0;    /**< Конец замера (Span) */
+    std::uint32_t thread = 0;  /**< Номер потока замера (Span) */
+};
+
+/**
+ * @brief Обходит сериализованные аргументы по порядку.
+ *
+ * Повреждённый хвост потока молча отбрасывается.
+ *
+ * @param payload Аргументы, записанные ArgumentWriter.
+ * @param visit Вызывается для каждого аргумента с ArgumentValue.
+ */
+template<typename Visitor>
+void visitArguments(std::string_view payload, Visitor&& visit) {
+    const char* pos = payload.data();
+    const char* end = pos + payload.size();
+
+    while (pos < end) {
+        ArgumentValue arg;
+        arg.type = static_cast<ArgType>(*pos++);
+        switch (arg.type) {
+        case ArgType::Int64:
+            if (!readValue(pos, end, arg.i)) return;
+            break;
+        case ArgType::UInt64:
+            if (!readValue(pos, end, arg.u)) return;
+            break;
+        case ArgType::Double:
+            if (!readValue(pos, end, arg.d)) return;
+            break;
+        case ArgType::Bool:
+            if (pos >= end) return;
+            arg.b = *pos++ != 0;
+            break;
+        case ArgType::Char:
+            if (pos >= end) return;
+            arg.c = *pos++;
+            break;
+        case ArgType::StaticString: {
+            const char* text;
+            std::uint32_t length;
+            if (!readValue(pos, end, text) || !readValue(pos, end, length)) return;
+            arg.text = std::string_view(text, length);
+            break;
+        }
+        case ArgType::String: {
+            std::uint32_t length;
+            if (!readValue(pos, end, length) || static_cast<std::size_t>(end - pos) < length) return;
+            arg.text = std::string_view(pos, length);
+            pos += length;
+            break;
+        }
+        case ArgType::Field: {
+            if (pos >= end) return;
+            std::size_t length = static_cast<unsigned char>(*pos++);
+            if (static_cast<std::size_t>(end - pos) < length) return;
+            arg.text = std::string_view(pos, length);
+            pos += length;
+            break;
+        }
+        case ArgType::Span:
+            if (!readValue(pos, end, arg.i) || !readValue(pos, end, arg.end) || !readValue(pos, end, arg.thread)) return;
+            break;
+        default:
+            return;
+        }
+        visit(arg);
+    }
+}
+
+/**
+ * @brief Дописывает число наносекунд как микросекунды с тремя знаками после точки.
+ * @param nanoseconds Неотрицательное число наносекунд.
+ * @param out Выходной буфер.
+ */
+void appendMicroseconds(std::int64_t nanoseconds, std::string& out) {
+    char digits[32];
+    out.append(digits, std::to_chars(digits, digits + sizeof(digits), nanoseconds / 1000).ptr);
+    out.push_back('.');
+    std::int64_t fraction = nanoseconds % 1000;
+    out.push_back(static_cast<char>('0' + fraction / 100));
+    out.push_back(static_cast<char>('0' + fraction / 10 % 10));
+    out.push_back(static_cast<char>('0' + fraction % 10));
+}
+
+/**
+ * @brief Дописывает длительность в подходящих единицах: "850 ns", "12.345 us", "1.204 ms", "2.500 s".
+ * @param nanoseconds Длительность; отрицательная считается нулевой.
+ * @param out Выходной буфер.
+ */
+void appendDuration(std::int64_t nanoseconds, std::string& out) {
+    nanoseconds = (std::max)(nanoseconds, std::int64_t(0));
+    if (nanoseconds < 1000) {
+        char digits[8];
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), nanoseconds).ptr);
+        out += " ns";
+        return;
+    }
+
+    // Три знака после точки во всех единицах: масштаб на 1000 меньше единицы.
+    std::int64_t scale = 1;
+    const char* unit = " us";
+    if (nanoseconds >= 1000000000) {
+        scale = 1000000;
+        unit = " s";
+    }
+    else if (nanoseconds >= 1000000) {
+        scale = 1000;
+        unit = " ms";
+    }
+    appendMicroseconds(nanoseconds / scale, out);
+    out += unit;
+}
+
+/**
+ * @brief Дописывает значение аргумента как текст (как это сделал бы std::ostream).
+ *
+ * Замер LogScope выводится как " took <длительность>".
+ *
+ * @param arg Аргумент (не Field).
+ * @param out Выходной буфер.
+ */
+void appendValue(const ArgumentValue& arg, std::string& out) {
+    char digits[32];
+    switch (arg.type) {
+    case ArgType::Int64:
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), arg.i).ptr);
+        break;
+    case ArgType::UInt64:
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), arg.u).ptr);
+        break;
+    case ArgType::Double:
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), arg.d, std::chars_format::general, 6).ptr);
+        break;
+    case ArgType::Bool:
+        out.push_back(arg.b ? '1' : '0');
+        break;
+    case ArgType::Char:
+        out.push_back(arg.c);
+        break;
+    case ArgType::Span:
+        out += " took ";
+        appendDuration(arg.end - arg.i, out);
+        break;
+    default:
+        out += arg.text;
+        break;
+    }
+}
+
+/**
+ * @brief Дописывает значение аргумента как значение JSON.
+ *
+ * Числа пишутся как есть (бесконечность и NaN - как null),
+ * bool - как true/false, символы и строки - как строки JSON,
+ * замер - как длительность в наносекундах.
+ *
+ * @param arg Аргумент (не Field).
+ * @param out Выходной буфер.
+ */
+void appendJsonValue(const ArgumentValue& arg, std::string& out) {
+    switch (arg.type) {
+    case ArgType::Int64:
+    case ArgType::UInt64:
+        appendValue(arg, out);
+        break;
+    case ArgType::Double:
+        if (std::isfinite(arg.d)) appendValue(arg, out);
+        else out += "null";
+        break;
+    case ArgType::Bool:
+        out += arg.b ? "true" : "false";
+        break;
+    case ArgType::Span: {
+        char digits[32];
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), arg.end - arg.i).ptr);
+        break;
+    }
+    case ArgType::Char:
+        out.push_back('"');
+        appendJsonEscaped(std::string_view(&arg.c, 1), out);
+        out.push_back('"');
+        break;
+    default:
+        out.push_back('"');
+        appendJsonEscaped(arg.text, out);
+        out.push_back('"');
+        break;
+    }
+}
+
+/**
+ * @brief Таблица экранирования JSON: 0 - символ не экранируется,
+ * 'u' - запись \u00XX, иначе буква после обратной косой черты.
+ */
+constexpr std::array<char, 256> makeJsonEscapes() {
+    std::array<char, 256> table{};
+    for (int c = 0; c < 0x20; ++c) table[c] = 'u';
+    table['"'] = '"';
+    table['\\'] = '\\';
+    table['\b'] = 'b';
+    table['\f'] = 'f';
+    table['\n'] = 'n';
+    table['\r'] = 'r';
+    table['\t'] = 't';
+    return table;
+}
+
+constexpr std::array<char, 256> JsonEscapes = makeJsonEscapes();
+
+/**
+ * @struct FixedWriter
+ * @brief Запись в буфер фиксированного размера без выделения памяти; лишнее отбрасывается.
+ */
+struct FixedWriter {
+    char* pos;        /**< Текущая позиция */
+    char* end;        /**< Конец буфера */
+
+    void put(std::string_view text) {
+        std::size_t length = (std::min)(text.size(), static_cast<std::size_t>(end - pos));
+        std::memcpy(pos, text.data(), length);
+        pos += length;
+    }
+
+    void put(char c) {
+        if (pos < end) *pos++ = c;
+    }
+
+    template<typename V>
+    void number(V value) {
+        char digits[32];
+        put(std::string_view(digits, static_cast<std::size_t>(std::to_chars(digits, digits + sizeof(digits), value).ptr - digits)));
+    }
+
+    void padded(unsigned value, int width) {
+        char digits[8];
+        for (int i = width - 1; i >= 0; --i) {
+            digits[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+        put(std::string_view(digits, static_cast<std::size_t>(width)));
+    }
+};
+
+}
+
+/**
+ * @brief Форматирует сериализованные аргументы.
+ *
+ * Целые выводятся в десятичном виде, double - как std::ostream
+ * с точностью по умолчанию (6 значащих цифр), bool - как 1/0.
+ * Поле kv() выводится как " имя=значение".
+ * Повреждённый хвост потока молча отбрасывается.
+ *
+ * @param payload Сериализованные аргументы.
+ * @param out Выходной буфер.
+ */
+void appendArguments(std::string_view payload, std::string& out) {
+    std::size_t start = out.size();
+    visitArguments(payload, [&out, start](const ArgumentValue& arg) {
+        if (arg.type == ArgType::Field) {
+            if (out.size() > start) out.push_back(' ');
+            out += arg.text;
+            out.push_back('=');
+        }
+        else {
+            appendValue(arg, out);
+        }
+        });
+}
+
+/**
+ * @brief Форматирует сообщение по разобранному шаблону.
+ * @param format Разобранный шаблон.
+ * @param timestamps Кэш временных меток.
+ * @param site Место вызова.
+ * @param time Момент вызова лога.
+ * @param payload Аргументы сообщения.
+ * @param out Буфер, в конец которого дописывается результат.
+ */
+void formatRecord(const FormatTemplate& format, TimestampCache& timestamps, const LogSite& site,
+    std::chrono::system_clock::time_point time, std::string_view payload, std::string& out) {
+    for (const FormatTemplate::Segment& segment : format.segments()) {
+        switch (segment.field) {
+        case FormatTemplate::Field::Literal:
+            out += segment.literal;
+            break;
+        case FormatTemplate::Field::Timestamp:
+            timestamps.append(time, out);
+            break;
+        case FormatTemplate::Field::Level:
+            out += levelToString(site.level);
+            break;
+        case FormatTemplate::Field::File:
+            out += site.file;
+            break;
+        case FormatTemplate::Field::Line: {
+            char digits[16];
+            auto result = std::to_chars(digits, digits + sizeof(digits), site.line);
+            out.append(digits, result.ptr);
+            break;
+        }
+        case FormatTemplate::Field::Message:
+            appendArguments(payload, out);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Дописывает текст, экранированный для строки JSON.
+ *
+ * Неэкранируемые участки копируются целиком; байты UTF-8 старше 0x7F
+ * передаются без изменений.
+ *
+ * @param text Текст.
+ * @param out Буфер результата.
+ */
+void appendJsonEscaped(std::string_view text, std::string& out) {
+    static const char hex[] = "0123456789abcdef";
+    std::size_t run = 0;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        char escape = JsonEscapes[c];
+        if (escape == 0) continue;
+
+        out.append(text.data() + run, i - run);
+        out.push_back('\\');
+        if (escape == 'u') {
+            out += "u00";
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 0xF]);
+        }
+        else {
+            out.push_back(escape);
+        }
+        run = i + 1;
+    }
+    out.append(text.data() + run, text.size() - run);
+}
+
+/**
+ * @brief Форматирует сообщение как JSON-объект.
+ *
+ * Аргументы обходятся дважды: сначала текст сообщения (все аргументы,
+ * кроме полей, их значений и замера), затем поля и замер.
+ *
+ * @param timestamps Кэш временных меток.
+ * @param site Место вызова.
+ * @param time Момент вызова лога.
+ * @param payload Аргументы сообщения.
+ * @param out Буфер, в конец которого дописывается результат.
+ * @param scratch Буфер для текста нестроковых аргументов.
+ */
+void formatJsonRecord(TimestampCache& timestamps, const LogSite& site,
+    std::chrono::system_clock::time_point time, std::string_view payload, std::string& out, std::string& scratch) {
+    out += "{\"time\":\"";
+    timestamps.append(time, out);
+    out += "\",\"level\":\"";
+    out += levelToString(site.level);
+    out += "\",\"file\":\"";
+    appendJsonEscaped(site.file, out);
+    out += "\",\"line\":";
+    char digits[16];
+    out.append(digits, std::to_chars(digits, digits + sizeof(digits), site.line).ptr);
+    out += ",\"message\":\"";
+
+    bool fieldValue = false;
+    visitArguments(payload, [&](const ArgumentValue& arg) {
+        if (arg.type == ArgType::Field) {
+            fieldValue = true;
+        }
+        else if (fieldValue) {
+            fieldValue = false;
+        }
+        else if (arg.type == ArgType::StaticString || arg.type == ArgType::String) {
+            appendJsonEscaped(arg.text, out);
+        }
+        else if (arg.type != ArgType::Span) {
+            scratch.clear();
+            appendValue(arg, scratch);
+            appendJsonEscaped(scratch, out);
+        }
+        });
+    out.push_back('"');
+
+    bool pending = false;
+    visitArguments(payload, [&](const ArgumentValue& arg) {
+        if (arg.type == ArgType::Field) {
+            if (pending) out += "null";
+            out += ",\"";
+            appendJsonEscaped(arg.text, out);
+            out += "\":";
+            pending = true;
+        }
+        else if (pending) {
+            appendJsonValue(arg, out);
+            pending = false;
+        }
+        else if (arg.type == ArgType::Span) {
+            out += ",\"duration_ns\":";
+            appendJsonValue(arg, out);
+            out += ",\"thread\":";
+            out.append(digits, std::to_chars(digits, digits + sizeof(digits), arg.thread).ptr);
+        }
+        });
+    if (pending) out += "null";
+    out.push_back('}');
+}
+
+/**
+ * @brief Форматирует замер LogScope как событие Chrome trace.
+ *
+ * Текст name собирается так же, как message в formatJsonRecord();
+ * поля kv() попадают в args вслед за файлом и строкой.
+ *
+ * @param site Место вызова.
+ * @param payload Аргументы сообщения.
+ * @param processId Номер процесса.
+ * @param out Буфер, в конец которого дописывается результат.
+ * @param scratch Буфер для текста нестроковых аргументов.
+ * @return false, если замера нет.
+ */
+bool formatTraceEvent(const LogSite& site, std::string_view payload, std::uint32_t processId,
+    std::string& out, std::string& scratch) {
+    std::size_t start = out.size();
+    out += "{\"name\":\"";
+
+    ArgumentValue span{};
+    bool measured = false;
+    bool fieldValue = false;
+    visitArguments(payload, [&](const ArgumentValue& arg) {
+        if (arg.type == ArgType::Field) {
+            fieldValue = true;
+        }
+        else if (fieldValue) {
+            fieldValue = false;
+        }
+        else if (arg.type == ArgType::Span) {
+            span = arg;
+            measured = true;
+        }
+        else if (arg.type == ArgType::StaticString || arg.type == ArgType::String) {
+            appendJsonEscaped(arg.text, out);
+        }
+        else {
+            scratch.clear();
+            appendValue(arg, scratch);
+            appendJsonEscaped(scratch, out);
+        }
+        });
+    if (!measured) {
+        out.resize(start);
+        return false;
+    }
+
+    char digits[16];
+    out += "\",\"cat\":\"";
+    out += levelToString(site.level);
+    out += "\",\"ph\":\"X\",\"ts\":";
+    appendMicroseconds((std::max)(span.i, std::int64_t(0)), out);
+    out += ",\"dur\":";
+    appendMicroseconds((std::max)(span.end - span.i, std::int64_t(0)), out);
+    out += ",\"pid\":";
+    out.append(digits, std::to_chars(digits, digits + sizeof(digits), processId).ptr);
+    out += ",\"tid\":";
+    out.append(digits, std::to_chars(digits, digits + sizeof(digits), span.thread).ptr);
+    out += ",\"args\":{\"file\":\"";
+    appendJsonEscaped(site.file, out);
+    out += "\",\"line\":";
+    out.append(digits, std::to_chars(digits, digits + sizeof(digits), site.line).ptr);
+
+    bool pending = false;
+    visitArguments(payload, [&](const ArgumentValue& arg) {
+        if (arg.type == ArgType::Field) {
+            if (pending) out += "null";
+            out += ",\"";
+            appendJsonEscaped(arg.text, out);
+            out += "\":";
+            pending = true;
+        }
+        else if (pending) {
+            appendJsonValue(arg, out);
+            pending = false;
+        }
+        });
+    if (pending) out += "null";
+    out += "}}";
+    return true;
+}
+
+/**
+ * @brief Форматирует сообщение для аварийной выгрузки, не выделяя память.
+ *
+ * Дата вычисляется из числа дней от эпохи (алгоритм civil_from_days
+ * Г. Хиннанта), без обращения к localtime и часовым поясам.
+ *
+ * @param site Место вызова.
+ * @param time Момент вызова лога.
+ * @param payload Аргументы сообщения.
+ * @param out Буфер результата.
+ * @param capacity Размер буфера.
+ * @return Число записанных байт.
+ */
+std::size_t formatEmergencyRecord(const LogSite& site, std::chrono::system_clock::time_point time,
+    std::string_view payload, char* out, std::size_t capacity) {
+    FixedWriter writer{ out, out + capacity - 1 };
+
+    std::int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+    std::int64_t seconds = micros >= 0 ? micros / 1000000 : (micros - 999999) / 1000000;
+    std::int64_t days = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+    unsigned secondOfDay = static_cast<unsigned>(seconds - days * 86400);
+
+    std::int64_t z = days + 719468;
+    std::int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = static_cast<unsigned>(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    unsigned day = doy - (153 * mp + 2) / 5 + 1;
+    unsigned month = mp < 10 ? mp + 3 : mp - 9;
+    std::int64_t year = static_cast<std::int64_t>(yoe) + era * 400 + (month <= 2 ? 1 : 0);
+
+    writer.number(year);
+    writer.put('-');
+    writer.padded(month, 2);
+    writer.put('-');
+    writer.padded(day, 2);
+    writer.put(' ');
+    writer.padded(secondOfDay / 3600, 2);
+    writer.put(':');
+    writer.padded(secondOfDay / 60 % 60, 2);
+    writer.put(':');
+    writer.padded(secondOfDay % 60, 2);
+    writer.put('.');
+    writer.padded(static_cast<unsigned>(micros - seconds * 1000000), 6);
+    writer.put(" UTC | ");
+    writer.put(levelToString(site.level));
+    writer.put(" | ");
+    writer.put(site.file);
+    writer.put(':');
+    writer.number(site.line);
+    writer.put(" -> ");
+
+    bool started = false;
+    visitArguments(payload, [&writer, &started](const ArgumentValue& arg) {
+        switch (arg.type) {
+        case ArgType::Int64: writer.number(arg.i); break;
+        case ArgType::UInt64: writer.number(arg.u); break;
+        case ArgType::Double: writer.number(arg.d); break;
+        case ArgType::Bool: writer.put(arg.b ? '1' : '0'); break;
+        case ArgType::Char: writer.put(arg.c); break;
+        case ArgType::Span:
+            writer.put(" took ");
+            writer.number(arg.end - arg.i);
+            writer.put(" ns");
+            break;
+        case ArgType::Field:
+            if (started) writer.put(' ');
+            writer.put(arg.text);
+            writer.put('=');
+            break;
+        default: writer.put(arg.text); break;
+        }
+        started = true;
+        });
+
+    *writer.pos++ = '\n';
+    return static_cast<std::size_t>(writer.pos - out);
+}
@@ -0,0 +1,451 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "LogRecord.h"
+#include "Payload.h"
+
+/**
+ * @brief Шаблон форматирования лог-сообщений по умолчанию.
+ */
+inline constexpr const char* DefaultFormatTemplate = "{t} | {L} | {f}:{l} -> {m}";
+
+/**
+ * @class FormatTemplate
+ * @brief Шаблон форматирования, заранее разобранный на сегменты.
+ *
+ * Строка шаблона разбирается один раз при установке на последовательность
+ * литералов и плейсхолдеров. Форматирование проходит по списку сегментов
+ * и дописывает значения в выходной буфер, поэтому подставленный текст
+ * повторно не сканируется и не раскрывается.
+ *
+ * Поддерживаемые плейсхолдеры:
+ * - {t} - timestamp (дата и время)
+ * - {L} - уровень логирования
+ * - {f} - имя файла
+ * - {l} - номер строки
+ * - {m} - текст сообщения
+ */
+class FormatTemplate {
+public:
+    /**
+     * @enum Field
+     * @brief Тип сегмента шаблона.
+     */
+    enum class Field {
+        Literal,    /**< Текст шаблона без изменений */
+        Timestamp,  /**< {t} */
+        Level,      /**< {L} */
+        File,       /**< {f} */
+        Line,       /**< {l} */
+        Message     /**< {m} */
+    };
+
+    /**
+     * @struct Segment
+     * @brief Сегмент разобранного шаблона.
+     */
+    struct Segment {
+        Field field;            /**< Тип сегмента */
+        std::string literal;    /**< Текст для Field::Literal */
+    };
+
+    /**
+     * @brief Конструктор. Разбирает строку шаблона.
+     * @param text Строка шаблона с плейсхолдерами.
+     */
+    explicit FormatTemplate(std::string_view text = DefaultFormatTemplate);
+
+    /**
+     * @brief Исходная строка шаблона.
+     */
+    const std::string& text() const { return source; }
+
+    /**
+     * @brief Сегменты шаблона в порядке следования.
+     */
+    const std::vector<Segment>& segments() const { return parts; }
+
+private:
+    std::string source;            /**< Исходная строка шаблона */
+    std::vector<Segment> parts;    /**< Разобранные сегменты */
+};
+
+/**
+ * @enum TimestampPrecision
+ * @brief Точность временной метки в выводе.
+ */
+enum class TimestampPrecision {
+    Seconds,       /**< YYYY-MM-DD HH:MM:SS */
+    Milliseconds,  /**< YYYY-MM-DD HH:MM:SS.mmm */
+    Microseconds   /**< YYYY-MM-DD HH:MM:SS.uuuuuu */
+};
+
+/**
+ * @class TimestampCache
+ * @brief Форматирование временных меток с кэшированием префикса даты и времени.
+ *
+ * Префикс "YYYY-MM-DD HH:MM:SS" пересобирается только при смене секунды,
+ * дробная часть дописывается целочисленным форматированием.
+ * Объект не потокобезопасен и используется одним потоком (потоком обработки).
+ */
+class TimestampCache {
+public:
+    /**
+     * @brief Устанавливает точность дробной части.
+     * @param precision Точность временной метки.
+     */
+    void setPrecision(TimestampPrecision precision) { this->precision = precision; }
+
+    /**
+     * @brief Дописывает отформатированную временную метку в буфер.
+     * @param time Момент времени, снятый в месте вызова лога.
+     * @param out Буфер, в конец которого дописывается метка.
+     */
+    void append(std::chrono::system_clock::time_point time, std::string& out);
+
+private:
+    static constexpr std::size_t PrefixLength = 19;  /**< Длина "YYYY-MM-DD HH:MM:SS" */
+
+    void rebuildPrefix(std::int64_t second);  /**< Пересобрать префикс для новой секунды */
+
+    TimestampPrecision precision = TimestampPrecision::Seconds;  /**< Точность дробной части */
+    std::int64_t cachedSecond = std::numeric_limits<std::int64_t>::min();  /**< Секунда, для которой собран префикс */
+    char prefix[PrefixLength] = {};  /**< Кэшированный префикс */
+};
+
+/**
+ * @enum FormattingMode
+ * @brief Где формируется текст сообщения.
+ */
+enum class FormattingMode {
+    Immediate,  /**< В потоке вызова через std::ostringstream */
+    Deferred    /**< В потоке обработки; в очередь попадают типизированные аргументы */
+};
+
+/**
+ * @enum ArgType
+ * @brief Тег типа аргумента в двоичном представлении сообщения.
+ */
+enum class ArgType : std::uint8_t {
+    Int64,         /**< Знаковое целое */
+    UInt64,        /**< Беззнаковое целое */
+    Double,        /**< Число с плавающей точкой */
+    Bool,          /**< Логическое значение */
+    Char,          /**< Символ */
+    StaticString,  /**< Указатель и длина строки LogLiteral (без копирования) */
+    String,        /**< Копия динамической строки */
+    StringRef,     /**< Номер строки словаря; только в двоичном файле лога (BinaryLog.h) */
+    Field,         /**< Имя поля (длина u8 и байты); следующий аргумент - значение поля */
+    Span           /**< Замер LogScope: начало и конец (i64, нс steady_clock) и номер потока (u32) */
+};
+
+/**
+ * @enum LineFormat
+ * @brief Вид строки, в которую форматируется сообщение.
+ */
+enum class LineFormat {
+    Template,   /**< По шаблону форматирования ({t} | {L} | ...) */
+    JsonLines   /**< Один JSON-объект на строку; поля kv() - свойства объекта */
+};
+
+/**
+ * @struct LogField
+ * @brief Именованное поле структурированного сообщения, создаётся через kv().
+ *
+ * Хранит ссылку на значение, поэтому должно использоваться только
+ * в пределах выражения вызова лога.
+ */
+template<typename V>
+struct LogField {
+    std::string_view key;  /**< Имя поля (не длиннее 255 байт) */
+    V& value;              /**< Значение поля */
+};
+
+/**
+ * @brief Создаёт поле структурированного сообщения: LOGI("вход", kv("user", name)).
+ * @param key Имя поля.
+ * @param value Значение; сериализуется по тем же правилам, что и аргумент лога.
+ * @return Поле для передачи в log().
+ */
+template<typename V>
+LogField<std::remove_reference_t<V>> kv(std::string_view key, V&& value) {
+    return { key, value };
+}
+
+template<typename T>
+struct IsLogField : std::false_type {};
+
+template<typename V>
+struct IsLogField<LogField<V>> : std::true_type {};
+
+/**
+ * @brief Есть ли среди типов аргументов поля kv().
+ */
+template<typename... Args>
+inline constexpr bool HasLogFields = (IsLogField<std::remove_cv_t<std::remove_reference_t<Args>>>::value || ...);
+
+/**
+ * @struct LogLiteral
+ * @brief Строка со статическим временем жизни, передаваемая в очередь указателем.
+ *
+ * Массивы char в аргументах лога копируются: по типу строковый литерал
+ * не отличить от массива на стеке или в объекте, и в режиме Deferred
+ * поток обработки прочитал бы уже освобождённую память. LogLiteral("текст ")
+ * сохраняет только указатель и длину, а в двоичном файле текст попадает
+ * в словарь один раз. Конструктор consteval, поэтому компилируется лишь
+ * для литералов, __func__ и static constexpr массивов.
+ */
+struct LogLiteral {
+    const char* text;     /**< Текст */
+    std::size_t length;   /**< Длина текста */
+
+    /**
+     * @brief Конструктор.
+     * @param value Строка со статическим временем жизни.
+     */
+    template<std::size_t N>
+    consteval LogLiteral(const char (&value)[N])
+        : text(value), length(std::char_traits<char>::length(value)) {}
+};
+
+/**
+ * @brief Выводит LogLiteral в поток (режим Immediate).
+ */
+inline std::ostream& operator<<(std::ostream& stream, const LogLiteral& literal) {
+    return stream.write(literal.text, static_cast<std::streamsize>(literal.length));
+}
+
+/**
+ * @class ArgumentWriter
+ * @brief Сериализует аргументы лога в компактный типизированный двоичный вид.
+ *
+ * Каждый аргумент записывается как байт ArgType и значение:
+ * целые и double - 8 байт, bool и char - 1 байт, LogLiteral - указатель и длина,
+ * строки и массивы char - длина и байты (копия); прочие типы с operator<<
+ * форматируются сразу (через PayloadStream, без промежуточной строки)
+ * и сохраняются как строка.
+ * Поле kv() записывается как имя (ArgType::Field) и следующее за ним значение.
+ * Замер LogScope (ArgType::Span) - 20 байт: начало, конец и номер потока.
+ */
+class ArgumentWriter {
+public:
+    /**
+     * @brief Конструктор.
+     * @param buffer Буфер, в конец которого дописываются аргументы.
+     */
+    explicit ArgumentWriter(PayloadBuffer& buffer) : out(buffer) {}
+
+    /**
+     * @brief Сериализует один аргумент.
+     * @tparam T Тип аргумента.
+     * @param value Значение аргумента.
+     */
+    template<typename T>
+    void write(T&& value) {
+        using Raw = std::remove_reference_t<T>;
+        using U = std::remove_cv_t<Raw>;
+
+        if constexpr (IsLogField<U>::value) {
+            writeFieldName(value.key);
+            write(value.value);
+        }
+        else if constexpr (std::is_same_v<U, LogLiteral>) {
+            writeStaticString(value.text, value.length);
+        }
+        else if constexpr (std::is_array_v<Raw> && std::is_same_v<std::remove_cv_t<std::remove_extent_t<Raw>>, char>) {
+            writeString(std::string_view(value));
+        }
+        else if constexpr (std::is_same_v<U, bool>) {
+            writeTag(ArgType::Bool);
+            out.push_back(value ? 1 : 0);
+        }
+        else if constexpr (std::is_same_v<U, char> || std::is_same_v<U, signed char> || std::is_same_v<U, unsigned char>) {
+            writeTag(ArgType::Char);
+            out.push_back(static_cast<char>(value));
+        }
+        else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+            writeScalar(ArgType::Int64, static_cast<std::int64_t>(value));
+        }
+        else if constexpr (std::is_integral_v<U>) {
+            writeScalar(ArgType::UInt64, static_cast<std::uint64_t>(value));
+        }
+        else if constexpr (std::is_floating_point_v<U>) {
+            writeScalar(ArgType::Double, static_cast<double>(value));
+        }
+        else if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>) {
+            writeString(value ? std::string_view(value) : std::string_view("(null)"));
+        }
+        else if constexpr (std::is_convertible_v<const U&, std::string_view>) {
+            writeString(std::string_view(value));
+        }
+        else {
+            writeStreamed(std::forward<T>(value));
+        }
+    }
+
+    /**
+     * @brief Форматирует аргументы через operator<< в одну строку-аргумент.
+     *
+     * Текст пишется прямо в буфер сообщения, длина проставляется после записи.
+     *
+     * @tparam Args Типы аргументов.
+     * @param args Аргументы.
+     */
+    template<typename... Args>
+    void writeStreamed(Args&&... args) {
+        writeTag(ArgType::String);
+        std::size_t lengthOffset = out.size();
+        writeLength(0);
+
+        {
+            PayloadStream::Scope scope(out);
+            (scope.stream() << ... << std::forward<Args>(args));
+        }
+
+        auto length = static_cast<std::uint32_t>(out.size() - lengthOffset - sizeof(std::uint32_t));
+        std::memcpy(out.data() + lengthOffset, &length, sizeof(length));
+    }
+
+    /**
+     * @brief Записывает динамическую строку (копируется).
+     * @param text Текст.
+     */
+    void writeString(std::string_view text) {
+        writeTag(ArgType::String);
+        writeLength(text.size());
+        out.append(text.data(), text.size());
+    }
+
+    /**
+     * @brief Записывает замер интервала.
+     * @param start Начало, наносекунды steady_clock.
+     * @param end Конец, наносекунды steady_clock.
+     * @param thread Системный номер потока.
+     */
+    void writeSpan(std::int64_t start, std::int64_t end, std::uint32_t thread) {
+        writeScalar(ArgType::Span, start);
+        out.append(reinterpret_cast<const char*>(&end), sizeof(end));
+        out.append(reinterpret_cast<const char*>(&thread), sizeof(thread));
+    }
+
+private:
+    void writeTag(ArgType type) { out.push_back(static_cast<char>(type)); }
+
+    void writeLength(std::size_t length) {
+        std::uint32_t value = static_cast<std::uint32_t>(length);
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template<typename V>
+    void writeScalar(ArgType type, V value) {
+        writeTag(type);
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void writeStaticString(const char* text, std::size_t length) {
+        writeTag(ArgType::StaticString);
+        out.append(reinterpret_cast<const char*>(&text), sizeof(text));
+        writeLength(length);
+    }
+
+    void writeFieldName(std::string_view key) {
+        std::size_t length = key.size() < 255 ? key.size() : 255;
+        writeTag(ArgType::Field);
+        out.push_back(static_cast<char>(length));
+        out.append(key.data(), length);
+    }
+
+    PayloadBuffer& out;  /**< Выходной буфер */
+};
+
+/**
+ * @brief Форматирует сериализованные аргументы так же, как это сделал бы std::ostream.
+ * @param payload Аргументы, записанные ArgumentWriter.
+ * @param out Буфер, в конец которого дописывается текст.
+ */
+void appendArguments(std::string_view payload, std::string& out);
+
+/**
+ * @brief Форматирует сообщение для аварийной выгрузки, не выделяя память.
+ *
+ * Вид строки фиксирован: "ГГГГ-ММ-ДД ЧЧ:ММ:СС.мкс UTC | LEVEL | файл:строка -> сообщение\n".
+ * Время выводится в UTC, так как localtime небезопасна в обработчике сбоя.
+ * Не поместившийся хвост отбрасывается, строка всегда заканчивается '\n'.
+ *
+ * @param site Место вызова.
+ * @param time Момент вызова лога.
+ * @param payload Аргументы, записанные ArgumentWriter.
+ * @param out Буфер результата.
+ * @param capacity Размер буфера (не меньше 1).
+ * @return Число записанных байт.
+ */
+std::size_t formatEmergencyRecord(const LogSite& site, std::chrono::system_clock::time_point time,
+    std::string_view payload, char* out, std::size_t capacity);
+
+/**
+ * @brief Форматирует сообщение по разобранному шаблону.
+ *
+ * Используется потоком обработки и декодером двоичных логов,
+ * поэтому текст совпадает независимо от места форматирования.
+ *
+ * @param format Разобранный шаблон.
+ * @param timestamps Кэш временных меток.
+ * @param site Место вызова (уровень, файл, строка).
+ * @param time Момент вызова лога.
+ * @param payload Аргументы, записанные ArgumentWriter.
+ * @param out Буфер, в конец которого дописывается результат.
+ */
+void formatRecord(const FormatTemplate& format, TimestampCache& timestamps, const LogSite& site,
+    std::chrono::system_clock::time_point time, std::string_view payload, std::string& out);
+
+/**
+ * @brief Форматирует сообщение как JSON-объект без перевода строки.
+ *
+ * Свойства: time, level, file, line, message (текст аргументов без полей)
+ * и по одному свойству на каждое поле kv() с типизированным значением.
+ * Замер LogScope не входит в message и выводится свойствами duration_ns и thread.
+ *
+ * @param timestamps Кэш временных меток.
+ * @param site Место вызова.
+ * @param time Момент вызова лога.
+ * @param payload Аргументы, записанные ArgumentWriter.
+ * @param out Буфер, в конец которого дописывается результат.
+ * @param scratch Буфер вызывающего для текста нестроковых аргументов перед
+ *        экранированием; переиспользуется между сообщениями, чтобы не выделять память.
+ */
+void formatJsonRecord(TimestampCache& timestamps, const LogSite& site,
+    std::chrono::system_clock::time_point time, std::string_view payload, std::string& out, std::string& scratch);
+
+/**
+ * @brief Форматирует замер LogScope как событие Chrome trace ("ph":"X").
+ *
+ * Событие - JSON-объект без перевода строки: name (текст аргументов без
+ * полей), cat (уровень), ts и dur (микросекунды steady_clock), pid, tid
+ * и args с файлом, строкой и полями kv(). Такие события понимают
+ * chrome://tracing и Perfetto.
+ *
+ * @param site Место вызова.
+ * @param payload Аргументы, записанные ArgumentWriter.
+ * @param processId Номер процесса для свойства pid.
+ * @param out Буфер, в конец которого дописывается результат.
+ * @param scratch Буфер вызывающего для текста нестроковых аргументов (как в formatJsonRecord()).
+ * @return false, если в сообщении нет замера (буфер не меняется).
+ */
+bool formatTraceEvent(const LogSite& site, std::string_view payload, std::uint32_t processId,
+    std::string& out, std::string& scratch);
+
+/**
+ * @brief Дописывает текст, экранированный для строки JSON (без кавычек).
+ * @param text Текст в UTF-8.
+ * @param out Буфер результата.
+ */
+void appendJsonEscaped(std::string_view text, std::string& out);
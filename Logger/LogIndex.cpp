@@ -0,0 +1,169 @@
+﻿#include "LogIndex.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+/**
+ * @brief Дописывает значение фиксированного размера.
+ */
+template<typename V>
+void put(std::string& out, V value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+/**
+ * @brief Читает значение фиксированного размера.
+ */
+template<typename V>
+V get(const char*& pos) {
+    V value;
+    std::memcpy(&value, pos, sizeof(V));
+    pos += sizeof(V);
+    return value;
+}
+
+/**
+ * @brief Момент сообщения в наносекундах от эпохи.
+ */
+std::int64_t nanoseconds(std::chrono::system_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+}
+
+/**
+ * @brief Путь к индексу файла лога.
+ * @param logPath Путь к файлу лога.
+ * @return Путь к файлу индекса.
+ */
+std::string logIndexPath(const std::string& logPath) {
+    return logPath + ".idx";
+}
+
+/**
+ * @brief Разбирает содержимое файла индекса.
+ * @param data Содержимое файла.
+ * @param entries Блоки в порядке записи.
+ * @return false, если метка не найдена.
+ */
+bool parseLogIndex(std::string_view data, std::vector<LogIndexEntry>& entries) {
+    entries.clear();
+    if (data.substr(0, LogIndexMagic.size()) != LogIndexMagic) return false;
+
+    const char* pos = data.data() + LogIndexMagic.size();
+    const char* end = data.data() + data.size();
+    while (static_cast<std::size_t>(end - pos) >= LogIndexEntrySize) {
+        const char* next = pos + LogIndexEntrySize;
+        LogIndexEntry entry;
+        entry.offset = get<std::uint64_t>(pos);
+        entry.length = get<std::uint64_t>(pos);
+        entry.firstTime = get<std::int64_t>(pos);
+        entry.lastTime = get<std::int64_t>(pos);
+        entry.levels = get<std::uint8_t>(pos);
+        entries.push_back(entry);
+        pos = next;
+    }
+    return true;
+}
+
+/**
+ * @brief Открывает индекс файла лога.
+ *
+ * Первая отметка после открытия начинает новый блок, поэтому при
+ * дописывании существующего лога его прежний хвост остаётся
+ * непроиндексированным промежутком, а не попадает в чужой блок.
+ *
+ * @param logPath Путь к файлу лога.
+ * @param append Дописывать существующий индекс.
+ * @param blockSize Размер блока.
+ * @return true, если индекс открыт.
+ */
+bool LogIndexWriter::open(const std::string& logPath, bool append, std::uint64_t blockSize) {
+    close(0);
+    interval = (std::max)(blockSize, std::uint64_t(1));
+    if (!file.open(logIndexPath(logPath), !append)) return false;
+
+    if (file.size() == 0) {
+        file.write(LogIndexMagic.data(), LogIndexMagic.size());
+    }
+    return true;
+}
+
+/**
+ * @brief Описывает последний блок и закрывает индекс.
+ * @param end Размер файла лога.
+ */
+void LogIndexWriter::close(std::uint64_t end) {
+    discard();
+    if (file.isOpen() && current.started && end > current.start) {
+        finishBlock(end);
+        commit();
+    }
+    file.close();
+    current = Block{};
+    committed = Block{};
+}
+
+/**
+ * @brief Отмечает начало строки.
+ *
+ * Новый блок начинается, когда от начала текущего набралось interval байт.
+ *
+ * @param offset Смещение строки в файле лога.
+ * @param time Момент сообщения.
+ * @param level Уровень сообщения.
+ * @return true, если строка начинает новый блок.
+ */
+bool LogIndexWriter::mark(std::uint64_t offset, std::chrono::system_clock::time_point time, LogLevel level) {
+    if (!file.isOpen()) return false;
+
+    std::int64_t moment = nanoseconds(time);
+    std::uint8_t bit = static_cast<std::uint8_t>(1u << static_cast<unsigned>(level));
+    if (current.started && offset - current.start < interval) {
+        current.firstTime = (std::min)(current.firstTime, moment);
+        current.lastTime = (std::max)(current.lastTime, moment);
+        current.levels |= bit;
+        return false;
+    }
+
+    if (current.started) finishBlock(offset);
+    current.start = offset;
+    current.firstTime = moment;
+    current.lastTime = moment;
+    current.levels = bit;
+    current.started = true;
+    return true;
+}
+
+/**
+ * @brief Записывает завершённые блоки одной записью.
+ */
+void LogIndexWriter::commit() {
+    if (!pending.empty()) {
+        file.write(pending.data(), pending.size());
+        pending.clear();
+    }
+    committed = current;
+}
+
+/**
+ * @brief Отменяет отметки с последнего commit().
+ */
+void LogIndexWriter::discard() {
+    pending.clear();
+    current = committed;
+}
+
+/**
+ * @brief Добавляет запись о текущем блоке в pending.
+ * @param end Смещение конца блока.
+ */
+void LogIndexWriter::finishBlock(std::uint64_t end) {
+    put(pending, current.start);
+    put(pending, end - current.start);
+    put(pending, current.firstTime);
+    put(pending, current.lastTime);
+    put(pending, current.levels);
+    pending.append(LogIndexEntrySize - 4 * sizeof(std::uint64_t) - sizeof(std::uint8_t), '\0');
+}
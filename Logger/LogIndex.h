@@ -0,0 +1,142 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "LogRecord.h"
+#include "Platform.h"
+
+/**
+ * @brief Метка в начале файла индекса.
+ */
+inline constexpr std::string_view LogIndexMagic{ "LOGIDX01", 8 };
+
+/**
+ * @brief Размер блока индекса по умолчанию.
+ */
+inline constexpr std::uint64_t DefaultIndexInterval = 64 * 1024;
+
+/**
+ * @brief Размер одной записи в файле индекса.
+ */
+inline constexpr std::size_t LogIndexEntrySize = 40;
+
+/**
+ * @struct LogIndexEntry
+ * @brief Блок файла лога, описанный в индексе.
+ *
+ * В файле (целые числа little-endian): смещение (u64), длина (u64),
+ * наименьшее и наибольшее время (i64, наносекунды от эпохи), биты
+ * уровней (u8) и 7 байт выравнивания. Блок начинается с начала строки
+ * (в двоичном формате - с первой записи словаря сообщения) и содержит
+ * целые строки.
+ */
+struct LogIndexEntry {
+    std::uint64_t offset = 0;    /**< Смещение начала блока в файле лога */
+    std::uint64_t length = 0;    /**< Длина блока */
+    std::int64_t firstTime = 0;  /**< Наименьшее время сообщения блока */
+    std::int64_t lastTime = 0;   /**< Наибольшее время сообщения блока */
+    std::uint8_t levels = 0;     /**< Уровни сообщений блока: бит 1 << LogLevel */
+};
+
+/**
+ * @brief Путь к индексу файла лога: "app.log" -> "app.log.idx".
+ * @param logPath Путь к файлу лога.
+ * @return Путь к файлу индекса.
+ */
+std::string logIndexPath(const std::string& logPath);
+
+/**
+ * @brief Разбирает содержимое файла индекса.
+ * @param data Содержимое файла.
+ * @param entries Блоки в порядке записи; неполная последняя запись пропускается.
+ * @return false, если файл не начинается с LogIndexMagic.
+ */
+bool parseLogIndex(std::string_view data, std::vector<LogIndexEntry>& entries);
+
+/**
+ * @class LogIndexWriter
+ * @brief Запись индекса времени рядом с файлом лога.
+ *
+ * Файл лога делится на блоки примерно по blockSize байт (open()), границы блоков
+ * проходят между строками. Для каждого блока в индекс пишется смещение,
+ * длина, диапазон времени сообщений и набор уровней, поэтому LogQuery
+ * читает только блоки, пересекающие запрошенный интервал.
+ *
+ * Начала строк отмечаются mark() до записи пачки, а записи индекса
+ * попадают в файл в commit() после её успешной записи: если пачка
+ * не записана или ушла в новый файл после ротации, отметки отменяются
+ * discard(). Блок, начатый последним, описывается при закрытии; до этого
+ * (и после аварийного завершения) хвост файла не проиндексирован и
+ * читается LogQuery целиком.
+ */
+class LogIndexWriter {
+public:
+    /**
+     * @brief Открывает индекс файла лога, закрывая предыдущий.
+     * @param logPath Путь к файлу лога.
+     * @param append Дописывать существующий индекс или начать заново.
+     * @param blockSize Размер блока в байтах (больше нуля).
+     * @return true, если индекс открыт.
+     */
+    bool open(const std::string& logPath, bool append, std::uint64_t blockSize);
+
+    /**
+     * @brief Отменяет неподтверждённые отметки, описывает последний блок и закрывает индекс.
+     * @param end Размер файла лога (конец последнего блока).
+     */
+    void close(std::uint64_t end);
+
+    /**
+     * @brief Открыт ли индекс.
+     */
+    bool isOpen() const { return file.isOpen(); }
+
+    /**
+     * @brief Отмечает начало строки.
+     * @param offset Смещение строки в файле лога.
+     * @param time Момент сообщения.
+     * @param level Уровень сообщения.
+     * @return true, если строка начинает новый блок.
+     */
+    bool mark(std::uint64_t offset, std::chrono::system_clock::time_point time, LogLevel level);
+
+    /**
+     * @brief Начнёт ли отметка mark() с этим смещением новый блок.
+     * @param offset Смещение строки в файле лога.
+     */
+    bool startsBlock(std::uint64_t offset) const {
+        return file.isOpen() && (!current.started || offset - current.start >= interval);
+    }
+
+    /**
+     * @brief Записывает блоки, завершённые отметками с последнего commit().
+     */
+    void commit();
+
+    /**
+     * @brief Отменяет отметки с последнего commit().
+     */
+    void discard();
+
+private:
+    struct Block {
+        std::uint64_t start = 0;     /**< Смещение первой строки */
+        std::int64_t firstTime = 0;  /**< Наименьшее время */
+        std::int64_t lastTime = 0;   /**< Наибольшее время */
+        std::uint8_t levels = 0;     /**< Биты уровней */
+        bool started = false;        /**< В блоке есть строки */
+    };
+
+    void finishBlock(std::uint64_t end);  /**< Добавить запись о текущем блоке в pending */
+
+    platform::AppendFile file;       /**< Файл индекса */
+    std::uint64_t interval = DefaultIndexInterval;  /**< Размер блока */
+    Block current;                   /**< Текущий блок с учётом неподтверждённых отметок */
+    Block committed;                 /**< Текущий блок на момент последнего commit() */
+    std::string pending;             /**< Неподтверждённые записи индекса */
+};
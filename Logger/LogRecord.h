@@ -0,0 +1,93 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @enum LogLevel
+ * @brief Уровни логирования.
+ */
+enum class LogLevel {
+    TRACE,    /**< Трассировка */
+    DEBUG,    /**< Отладка */
+    INFO,     /**< Информация */
+    WARNING,  /**< Предупреждение */
+    ERROR_,   /**< Ошибка */
+    CRITICAL  /**< Критическая ошибка */
+};
+
+/**
+ * @brief Число уровней логирования (размер массивов, индексируемых уровнем).
+ */
+inline constexpr std::size_t LogLevelCount = 6;
+
+/**
+ * @struct LogSiteState
+ * @brief Изменяемое состояние места вызова: ограничение частоты и выборка сообщений.
+ *
+ * Ограничение - алгоритм GCRA: одно число (время, с которого место
+ * снова может писать без превышения запаса) заменяет счётчик токенов
+ * и время пополнения, поэтому проверка - одна операция compare_exchange.
+ */
+struct LogSiteState {
+    std::atomic<std::int64_t> nextAllowed{ 0 };  /**< Теоретическое время следующего сообщения, нс steady_clock */
+    std::atomic<std::uint32_t> suppressed{ 0 };  /**< Отброшено с последнего пропущенного сообщения */
+    std::atomic<std::uint32_t> sampled{ 0 };     /**< Счётчик сообщений для выборки 1 из N */
+};
+
+/**
+ * @struct LogSite
+ * @brief Неизменяемые метаданные места вызова лога.
+ *
+ * Макросы LOGx создают по одному static constexpr экземпляру на каждое
+ * раскрытие, а элемент очереди хранит только указатель на него,
+ * поэтому имя файла не копируется при каждом вызове.
+ * Рядом с ним макрос создаёт static LogSiteState, на который указывает state.
+ */
+struct LogSite {
+    LogLevel level;     /**< Уровень сообщения */
+    const char* file;   /**< Имя файла (__FILE__) */
+    int line;           /**< Номер строки (__LINE__) */
+    LogSiteState* state = nullptr;  /**< Состояние ограничения частоты или nullptr */
+};
+
+/**
+ * @enum BackpressurePolicy
+ * @brief Поведение при заполненной очереди сообщений или буфере повторной отправки.
+ */
+enum class BackpressurePolicy {
+    Block,          /**< Ждать освобождения места */
+    DropNewest,     /**< Отбросить новое сообщение */
+    DropOldest,     /**< Вытеснить самое старое сообщение из очереди */
+    DropBelowLevel  /**< Отбросить новое сообщение ниже заданного уровня, остальные ждут */
+};
+
+/**
+ * @struct DropCounters
+ * @brief Количество сообщений, отброшенных каждой из политик переполнения.
+ */
+struct DropCounters {
+    std::uint64_t droppedNewest = 0;      /**< Отброшено политикой DropNewest */
+    std::uint64_t droppedOldest = 0;      /**< Вытеснено политикой DropOldest */
+    std::uint64_t droppedBelowLevel = 0;  /**< Отброшено политикой DropBelowLevel */
+    std::uint64_t rateLimited = 0;        /**< Отброшено ограничением частоты места вызова */
+};
+
+/**
+ * @brief Преобразует уровень логирования в строку.
+ * @param level Уровень логирования.
+ * @return Строковое представление уровня.
+ */
+inline std::string_view levelToString(LogLevel level) {
+    switch (level) {
+    case LogLevel::TRACE: return "TRACE";
+    case LogLevel::DEBUG: return "DEBUG";
+    case LogLevel::INFO: return "INFO";
+    case LogLevel::WARNING: return "WARNING";
+    case LogLevel::ERROR_: return "ERROR";
+    case LogLevel::CRITICAL: return "CRITICAL";
+    default: return "UNKNOWN";
+    }
+}
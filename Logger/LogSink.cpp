@@ -0,0 +1,329 @@
+﻿#include "LogSink.h"
+#include <limits>
+
+/**
+ * @brief Возвращает текст строк пачки, прошедших фильтр уровня.
+ * @param batch Пачка.
+ * @param scratch Буфер для отфильтрованных строк.
+ * @return Текст для записи.
+ */
+std::string_view LogSink::filtered(const LogBatch& batch, std::string& scratch) const {
+    LogLevel threshold = level();
+    if (batch.minLevel >= threshold) {
+        return batch.text;
+    }
+
+    scratch.clear();
+    for (const FormattedLine& line : batch.lines) {
+        if (line.level >= threshold) {
+            scratch += batch.line(line);
+        }
+    }
+    return scratch;
+}
+
+/**
+ * @brief Собирает отрезки текста пачки со строками, прошедшими фильтр уровня.
+ * @param batch Пачка.
+ * @param parts Отрезки.
+ * @return Суммарная длина отрезков.
+ */
+std::size_t LogSink::filteredParts(const LogBatch& batch, std::vector<std::string_view>& parts) const {
+    parts.clear();
+    LogLevel threshold = level();
+    if (batch.minLevel >= threshold) {
+        if (!batch.text.empty()) parts.push_back(batch.text);
+        return batch.text.size();
+    }
+
+    std::size_t size = 0;
+    for (const FormattedLine& line : batch.lines) {
+        if (line.level < threshold) continue;
+
+        std::string_view text = batch.line(line);
+        if (!parts.empty() && parts.back().data() + parts.back().size() == text.data()) {
+            parts.back() = std::string_view(parts.back().data(), parts.back().size() + text.size());
+        }
+        else {
+            parts.push_back(text);
+        }
+        size += text.size();
+    }
+    return size;
+}
+
+/**
+ * @brief Снимок диагностических счётчиков.
+ * @return Значения счётчиков.
+ */
+SinkCounters LogSink::getCounters() const {
+    SinkCounters counters;
+    counters.batches = batchCount.load(std::memory_order_relaxed);
+    counters.bytes = byteCount.load(std::memory_order_relaxed);
+    counters.failures = failureCount.load(std::memory_order_relaxed);
+    writeTimes.addTo(counters.writeLatency);
+    return counters;
+}
+
+/**
+ * @brief Конструктор. Определяет, выводится ли stdout в консоль.
+ */
+ConsoleSink::ConsoleSink()
+    : output(platform::standardOutput()),
+    isConsole(platform::prepareConsole(output)) {
+}
+
+/**
+ * @brief Выводит пачку в консоль одной операцией.
+ * @param batch Пачка сообщений.
+ */
+void ConsoleSink::write(const LogBatch& batch) {
+    LogLevel threshold = level();
+
+    buffer.clear();
+    for (const FormattedLine& line : batch.lines) {
+        if (line.level < threshold) continue;
+        buffer += "[Console] ";
+        buffer += batch.line(line);
+    }
+    if (buffer.empty()) return;
+
+    bool written = output != platform::InvalidFile && (isConsole
+        ? platform::writeConsole(output, buffer.data(), buffer.size())
+        : platform::writeAll(output, buffer.data(), buffer.size()));
+    if (written) {
+        countWrite(buffer.size());
+    }
+    else {
+        countFailure();
+    }
+}
+
+/**
+ * @brief Записывает пачку в файл.
+ *
+ * Неудачная ротация (следующий файл не открылся) учитывается как
+ * неудачная запись, хотя пачка дописана в текущий файл.
+ *
+ * @param batch Пачка сообщений.
+ */
+void FileSink::write(const LogBatch& batch) {
+    if (!logFile.isOpen()) {
+        countFailure();
+        return;
+    }
+    if (format == FileFormat::Binary) {
+        writeBinary(batch);
+    }
+    else {
+        writeText(batch);
+    }
+
+    for (; reportedRotationFailures < logFile.rotationFailures(); ++reportedRotationFailures) {
+        countFailure();
+    }
+}
+
+/**
+ * @brief Записывает пачку в текстовом формате.
+ *
+ * Пачка, которая помещается в текущий файл и не требует отметок индекса,
+ * пишется одной операцией, иначе - по строкам через writeLines().
+ *
+ * @param batch Пачка сообщений.
+ */
+void FileSink::writeText(const LogBatch& batch) {
+    std::size_t size = filteredParts(batch, parts);
+    if (size == 0) return;
+
+    logFile.rotateIfDue(0);
+    if (!logFile.index().isOpen() && size <= logFile.room()) {
+        appendParts(size);
+        return;
+    }
+    writeLines(batch);
+}
+
+/**
+ * @brief Записывает строки пачки, деля её по пределу размера файла.
+ *
+ * Строки, помещающиеся в текущий файл, дописываются в него, остальные -
+ * после ротации в следующий. Строки не разрываются: строка больше
+ * maxFileSize пишется в новый файл целиком. Если следующий файл открыть
+ * не удалось, остаток пачки дописывается в текущий, а ротация повторяется
+ * с новой пачкой. Смещение каждой строки в индексе - размер файла плюс
+ * длина предыдущих строк той же части.
+ *
+ * @param batch Пачка сообщений.
+ */
+void FileSink::writeLines(const LogBatch& batch) {
+    LogIndexWriter& index = logFile.index();
+    LogLevel threshold = level();
+    std::uint64_t room = logFile.room();
+    std::size_t size = 0;
+
+    parts.clear();
+    for (std::size_t i = 0; i < batch.lines.size(); ++i) {
+        const FormattedLine& line = batch.lines[i];
+        if (line.level < threshold) continue;
+
+        if (size + line.length > room) {
+            if (size != 0) {
+                appendParts(size);
+                size = 0;
+            }
+            room = rotateForRecord(line.length);
+        }
+
+        index.mark(logFile.size() + size, batch.records[i].time, line.level);
+        std::string_view text = batch.line(line);
+        if (!parts.empty() && parts.back().data() + parts.back().size() == text.data()) {
+            parts.back() = std::string_view(parts.back().data(), parts.back().size() + text.size());
+        }
+        else {
+            parts.push_back(text);
+        }
+        size += text.size();
+    }
+    if (size != 0) appendParts(size);
+}
+
+/**
+ * @brief Дописывает parts в текущий файл и подтверждает отметки индекса.
+ * @param size Суммарная длина частей.
+ */
+void FileSink::appendParts(std::size_t size) {
+    if (logFile.append(parts.data(), parts.size())) {
+        logFile.index().commit();
+        countWrite(size);
+    }
+    else {
+        logFile.index().discard();
+        countFailure();
+    }
+    parts.clear();
+}
+
+/**
+ * @brief Сменяет файл перед записью, которая не помещается в текущий.
+ * @param size Размер записи.
+ * @return Сколько байт можно писать дальше: room() нового файла, а если
+ *         ротация не удалась - без ограничения до конца пачки.
+ */
+std::uint64_t FileSink::rotateForRecord(std::size_t size) {
+    std::uint64_t failures = logFile.rotationFailures();
+    logFile.rotateIfDue(size);
+    if (logFile.rotationFailures() != failures) {
+        return (std::numeric_limits<std::uint64_t>::max)();
+    }
+    return logFile.room();
+}
+
+/**
+ * @brief Записывает пачку в двоичном формате.
+ *
+ * Словарь кодировщика относится к одному файлу: после open() или ротации
+ * он сбрасывается, чтобы новый файл содержал свои записи Site и String.
+ * Пачка, которая помещается в текущий файл и не требует отметок индекса,
+ * кодируется целиком, иначе - по сообщениям через writeRecords().
+ *
+ * @param batch Пачка сообщений.
+ */
+void FileSink::writeBinary(const LogBatch& batch) {
+    logFile.rotateIfDue(0);
+    if (logFile.generation() != encodedGeneration) {
+        encoder.reset();
+        encodedGeneration = logFile.generation();
+    }
+
+    buffer.clear();
+    if (!logFile.index().isOpen()) {
+        encoder.encode(batch, level(), buffer);
+        if (buffer.size() <= logFile.room()) {
+            appendBuffer();
+            return;
+        }
+        // Словарь уже учёл записи, которые не попадут в этот файл целиком.
+        encoder.reset();
+        buffer.clear();
+    }
+    writeRecords(batch);
+}
+
+/**
+ * @brief Кодирует и записывает сообщения пачки, деля её по пределу размера файла.
+ *
+ * С началом каждого блока индекса словарь сбрасывается, чтобы блок
+ * содержал нужные ему записи Site и String и LogQuery мог декодировать
+ * его отдельно от остального файла. Сообщение, которое не помещается
+ * в текущий файл, кодируется заново после ротации с чистым словарём.
+ *
+ * @param batch Пачка сообщений.
+ */
+void FileSink::writeRecords(const LogBatch& batch) {
+    LogIndexWriter& index = logFile.index();
+    LogLevel threshold = level();
+    std::uint64_t room = logFile.room();
+
+    for (const BatchRecord& record : batch.records) {
+        if (record.site->level < threshold) continue;
+
+        std::size_t start = buffer.size();
+        if (index.startsBlock(logFile.size() + start)) {
+            encoder.reset();
+        }
+        encoder.encodeRecord(record, buffer);
+
+        if (buffer.size() > room) {
+            std::size_t size = buffer.size() - start;
+            buffer.resize(start);
+            appendBuffer();
+            room = rotateForRecord(size);
+
+            start = 0;
+            encoder.reset();
+            encodedGeneration = logFile.generation();
+            encoder.encodeRecord(record, buffer);
+        }
+        index.mark(logFile.size() + start, record.time, record.site->level);
+    }
+    appendBuffer();
+}
+
+/**
+ * @brief Дописывает buffer в текущий файл и подтверждает отметки индекса.
+ */
+void FileSink::appendBuffer() {
+    if (buffer.empty()) return;
+
+    if (logFile.append(buffer.data(), buffer.size())) {
+        logFile.index().commit();
+        countWrite(buffer.size());
+    }
+    else {
+        logFile.index().discard();
+        countFailure();
+    }
+    buffer.clear();
+}
+
+/**
+ * @brief Выбирает формат файла.
+ * @param fileFormat Текстовый или двоичный формат.
+ */
+void FileSink::setFormat(FileFormat fileFormat) {
+    format = fileFormat;
+    if (format == FileFormat::Binary) {
+        logFile.setContent(std::string(BinaryLogMagic), true);
+    }
+    else {
+        logFile.setContent("\xEF\xBB\xBF", false);
+    }
+}
+
+/**
+ * @brief Сбрасывает файл лога.
+ */
+void FileSink::flush() {
+    logFile.flush();
+}
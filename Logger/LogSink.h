@@ -0,0 +1,285 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BinaryLog.h"
+#include "LogFile.h"
+#include "LogRecord.h"
+#include "LogStats.h"
+#include "Platform.h"
+
+/**
+ * @struct FormattedLine
+ * @brief Положение одной отформатированной строки в тексте пачки.
+ */
+struct FormattedLine {
+    std::uint32_t offset;  /**< Смещение начала строки */
+    std::uint32_t length;  /**< Длина строки вместе с '\n' */
+    LogLevel level;        /**< Уровень сообщения */
+};
+
+/**
+ * @struct BatchRecord
+ * @brief Исходное (неотформатированное) сообщение пачки.
+ */
+struct BatchRecord {
+    const LogSite* site;   /**< Место вызова */
+    std::chrono::system_clock::time_point time;  /**< Момент вызова лога */
+    std::string_view payload;  /**< Аргументы в формате ArgumentWriter */
+};
+
+/**
+ * @struct LogBatch
+ * @brief Пачка отформатированных сообщений, передаваемая приёмникам.
+ *
+ * Все строки лежат подряд в text, каждая заканчивается '\n'.
+ * Пачка форматируется один раз для всех приёмников и только если
+ * хотя бы одному из них нужен текст (LogSink::needsText()); иначе
+ * у строк нулевая длина, а приёмники работают с records.
+ */
+struct LogBatch {
+    std::string text;                   /**< Строки пачки подряд */
+    std::vector<FormattedLine> lines;   /**< Границы и уровни строк */
+    std::vector<BatchRecord> records;   /**< Исходные сообщения в том же порядке, что и lines */
+    LogLevel minLevel = LogLevel::CRITICAL;  /**< Минимальный уровень среди строк */
+
+    /**
+     * @brief Текст строки вместе с '\n'.
+     * @param line Описание строки.
+     */
+    std::string_view line(const FormattedLine& line) const {
+        return std::string_view(text).substr(line.offset, line.length);
+    }
+
+    /**
+     * @brief Очищает пачку, сохраняя выделенную память.
+     */
+    void clear() {
+        text.clear();
+        lines.clear();
+        records.clear();
+        minLevel = LogLevel::CRITICAL;
+    }
+};
+
+/**
+ * @struct SinkCounters
+ * @brief Диагностические счётчики приёмника.
+ */
+struct SinkCounters {
+    std::uint64_t batches = 0;   /**< Записанных пачек */
+    std::uint64_t bytes = 0;     /**< Записанных байт */
+    std::uint64_t failures = 0;  /**< Неудачных записей */
+    LatencyHistogram writeLatency;  /**< Длительность write() пачки, нс */
+};
+
+/**
+ * @class LogSink
+ * @brief Приёмник отформатированных сообщений.
+ *
+ * Методы write() и flush() вызываются только потоком обработки,
+ * поэтому реализации не нуждаются в собственной синхронизации записи.
+ * У каждого приёмника свой минимальный уровень, который применяется
+ * поверх общего уровня логгера.
+ * Диагностические счётчики ведутся только после enableDiagnostics(true).
+ */
+class LogSink {
+public:
+    virtual ~LogSink() = default;
+
+    /**
+     * @brief Записывает пачку сообщений.
+     * @param batch Пачка; строки ниже level() приёмник должен пропустить.
+     */
+    virtual void write(const LogBatch& batch) = 0;
+
+    /**
+     * @brief Сбрасывает буферизованные данные.
+     */
+    virtual void flush() {}
+
+    /**
+     * @brief Нужен ли приёмнику отформатированный текст пачки.
+     *
+     * Если ни одному приёмнику текст не нужен, пачка не форматируется.
+     */
+    virtual bool needsText() const { return true; }
+
+    /**
+     * @brief Остались ли у приёмника данные, которые он ещё не смог записать.
+     *
+     * Пока это так, простаивающий поток обработки не засыпает до нового
+     * сообщения, а периодически вызывает flush().
+     */
+    virtual bool hasPending() const { return false; }
+
+    /**
+     * @brief Устанавливает минимальный уровень приёмника.
+     * @param level Уровень.
+     */
+    void setLevel(LogLevel level) { minLevel.store(level, std::memory_order_relaxed); }
+
+    /**
+     * @brief Минимальный уровень приёмника.
+     */
+    LogLevel level() const { return minLevel.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Включает или выключает подсчёт записей.
+     * @param enabled Вести счётчики.
+     */
+    void enableDiagnostics(bool enabled) { diagnostics.store(enabled, std::memory_order_relaxed); }
+
+    /**
+     * @brief Ведутся ли диагностические счётчики.
+     */
+    bool diagnosticsEnabled() const { return diagnostics.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Учитывает длительность write() одной пачки, если диагностика включена.
+     *
+     * Вызывается логгером, который измеряет каждый вызов write();
+     * приёмник может принадлежать нескольким логгерам, поэтому запись общая.
+     *
+     * @param duration Длительность записи.
+     */
+    void countWriteTime(std::chrono::nanoseconds duration) {
+        if (!diagnosticsEnabled()) return;
+        writeTimes.addShared(static_cast<std::uint64_t>((std::max)(duration.count(), std::int64_t(0))));
+    }
+
+    /**
+     * @brief Снимок диагностических счётчиков.
+     */
+    SinkCounters getCounters() const;
+
+protected:
+    /**
+     * @brief Возвращает текст строк пачки, прошедших фильтр уровня.
+     *
+     * Если фильтр не отбрасывает ни одной строки, возвращается весь текст
+     * пачки без копирования, иначе подходящие строки собираются в scratch.
+     *
+     * @param batch Пачка.
+     * @param scratch Буфер для отфильтрованных строк.
+     * @return Текст для записи.
+     */
+    std::string_view filtered(const LogBatch& batch, std::string& scratch) const;
+
+    /**
+     * @brief Собирает отрезки текста пачки со строками, прошедшими фильтр уровня.
+     *
+     * Подряд идущие строки объединяются в один отрезок, текст не копируется:
+     * без отброшенных строк получается один отрезок на всю пачку.
+     *
+     * @param batch Пачка.
+     * @param parts Отрезки (очищаются перед заполнением).
+     * @return Суммарная длина отрезков.
+     */
+    std::size_t filteredParts(const LogBatch& batch, std::vector<std::string_view>& parts) const;
+
+    /**
+     * @brief Учитывает успешную запись, если диагностика включена.
+     * @param size Записано байт.
+     */
+    void countWrite(std::size_t size) {
+        if (!diagnostics.load(std::memory_order_relaxed)) return;
+        batchCount.fetch_add(1, std::memory_order_relaxed);
+        byteCount.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Учитывает неудачную запись, если диагностика включена.
+     */
+    void countFailure() {
+        if (!diagnostics.load(std::memory_order_relaxed)) return;
+        failureCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<LogLevel> minLevel{ LogLevel::TRACE };  /**< Минимальный уровень приёмника */
+    std::atomic<bool> diagnostics{ false };             /**< Вести счётчики */
+    std::atomic<std::uint64_t> batchCount{ 0 };         /**< Записанных пачек */
+    std::atomic<std::uint64_t> byteCount{ 0 };          /**< Записанных байт */
+    std::atomic<std::uint64_t> failureCount{ 0 };       /**< Неудачных записей */
+    HistogramCounters writeTimes;                       /**< Длительности write() */
+};
+
+/**
+ * @class ConsoleSink
+ * @brief Вывод в консоль с префиксом "[Console] ".
+ *
+ * Байты UTF-8 пишутся в дескриптор stdout одной операцией на пачку:
+ * platform::writeConsole() для консоли (в Windows - WriteConsoleA с кодовой
+ * страницей UTF-8), platform::writeAll() при перенаправлении в файл или канал.
+ */
+class ConsoleSink : public LogSink {
+public:
+    ConsoleSink();
+
+    void write(const LogBatch& batch) override;
+
+private:
+    platform::FileHandle output;  /**< Дескриптор stdout */
+    bool isConsole;               /**< stdout - консоль, а не файл или канал */
+    std::string buffer;       /**< Буфер строк с префиксом */
+};
+
+/**
+ * @enum FileFormat
+ * @brief Формат содержимого файла лога.
+ */
+enum class FileFormat {
+    Text,    /**< Строки по шаблону форматирования */
+    Binary   /**< Двоичные записи (BinaryLog.h), текст восстанавливает LogDecoder */
+};
+
+/**
+ * @class FileSink
+ * @brief Запись в файл лога с ротацией и выбором способа записи.
+ */
+class FileSink : public LogSink {
+public:
+    void write(const LogBatch& batch) override;
+    void flush() override;
+    bool needsText() const override { return format == FileFormat::Text; }
+
+    /**
+     * @brief Выбирает формат. Применяется к файлам, открытым после вызова.
+     * @param fileFormat Текстовый или двоичный формат.
+     */
+    void setFormat(FileFormat fileFormat);
+
+    /**
+     * @brief Текущий формат файла.
+     */
+    FileFormat getFormat() const { return format; }
+
+    /**
+     * @brief Файл лога приёмника. Настраивается потоком обработки логгера.
+     */
+    LogFile& file() { return logFile; }
+
+private:
+    void writeText(const LogBatch& batch);    /**< Записать пачку в текстовом формате */
+    void writeLines(const LogBatch& batch);   /**< Записать строки частями по пределу размера файла */
+    void appendParts(std::size_t size);       /**< Дописать parts и подтвердить индекс */
+    void writeBinary(const LogBatch& batch);  /**< Записать пачку в двоичном формате */
+    void writeRecords(const LogBatch& batch); /**< Записать сообщения частями по пределу размера файла */
+    void appendBuffer();                      /**< Дописать buffer и подтвердить индекс */
+    std::uint64_t rotateForRecord(std::size_t size);  /**< Ротация перед записью; остаток места */
+
+    LogFile logFile;     /**< Файл лога */
+    std::string buffer;  /**< Буфер двоичных записей */
+    std::vector<std::string_view> parts;  /**< Отрезки текста пачки для записи */
+    FileFormat format = FileFormat::Text;  /**< Формат файла */
+    BinaryLogEncoder encoder;            /**< Словарь двоичного формата текущего файла */
+    std::uint64_t encodedGeneration = 0; /**< Файл, к которому относится словарь */
+    std::uint64_t reportedRotationFailures = 0;  /**< Учтённые в failures неудачные ротации */
+};
@@ -0,0 +1,132 @@
+﻿#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Увеличивает счётчик, который пишет только один поток.
+ *
+ * Обычные load и store вместо fetch_add: без блокирующей инструкции
+ * и без борьбы за кэш-линию, читатели видят значение с задержкой.
+ *
+ * @param counter Счётчик.
+ * @param delta Приращение.
+ */
+inline void addRelaxed(std::atomic<std::uint64_t>& counter, std::uint64_t delta = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+/**
+ * @struct LatencyHistogram
+ * @brief Снимок гистограммы с логарифмическими интервалами.
+ *
+ * Значения 0-3 имеют собственные интервалы, каждая следующая степень
+ * двойки делится на четыре равных интервала, так что граница интервала
+ * отличается от значения не больше чем на 25%. Для задержек значения -
+ * наносекунды, для размеров пачек - сообщения.
+ */
+struct LatencyHistogram {
+    static constexpr std::size_t SubBuckets = 4;  /**< Интервалов на степень двойки */
+    static constexpr std::size_t Buckets = SubBuckets + 44 * SubBuckets;  /**< Интервалов (значения до 2^46) */
+
+    std::uint64_t counts[Buckets] = {};  /**< Значений в каждом интервале */
+
+    /**
+     * @brief Интервал, в который попадает значение.
+     * @param value Значение.
+     */
+    static std::size_t bucketOf(std::uint64_t value) {
+        if (value < SubBuckets) return static_cast<std::size_t>(value);
+
+        std::size_t exponent = static_cast<std::size_t>(std::bit_width(value)) - 1;
+        std::size_t sub = static_cast<std::size_t>(value >> (exponent - 2)) & (SubBuckets - 1);
+        std::size_t bucket = SubBuckets + (exponent - 2) * SubBuckets + sub;
+        return bucket < Buckets ? bucket : Buckets - 1;
+    }
+
+    /**
+     * @brief Наибольшее значение интервала.
+     * @param bucket Интервал.
+     */
+    static std::uint64_t upperBound(std::size_t bucket) {
+        if (bucket < SubBuckets) return bucket;
+
+        std::size_t shift = (bucket - SubBuckets) / SubBuckets;
+        std::uint64_t lower = std::uint64_t(SubBuckets + (bucket - SubBuckets) % SubBuckets) << shift;
+        return lower + (std::uint64_t(1) << shift) - 1;
+    }
+
+    /**
+     * @brief Число значений.
+     */
+    std::uint64_t total() const {
+        std::uint64_t sum = 0;
+        for (std::uint64_t count : counts) sum += count;
+        return sum;
+    }
+
+    /**
+     * @brief Оценка квантиля сверху (граница интервала, в который он попал).
+     * @param q Квантиль от 0 до 1, например 0.99.
+     * @return Верхняя граница интервала или 0 для пустой гистограммы.
+     */
+    std::uint64_t percentile(double q) const {
+        std::uint64_t all = total();
+        if (all == 0) return 0;
+
+        auto rank = static_cast<std::uint64_t>(q * static_cast<double>(all));
+        if (rank >= all) rank = all - 1;
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < Buckets; ++i) {
+            seen += counts[i];
+            if (seen > rank) return upperBound(i);
+        }
+        return upperBound(Buckets - 1);
+    }
+};
+
+/**
+ * @class HistogramCounters
+ * @brief Гистограмма, которую пополняет один поток, а читают любые.
+ */
+class HistogramCounters {
+public:
+    /**
+     * @brief Учитывает значение (только поток-владелец).
+     * @param value Значение.
+     */
+    void add(std::uint64_t value) { addRelaxed(buckets[LatencyHistogram::bucketOf(value)]); }
+
+    /**
+     * @brief Учитывает значение, когда писателей может быть несколько.
+     * @param value Значение.
+     */
+    void addShared(std::uint64_t value) {
+        buckets[LatencyHistogram::bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Переносит значения другой гистограммы (только поток-владелец).
+     * @param other Гистограмма.
+     */
+    void merge(const HistogramCounters& other) {
+        for (std::size_t i = 0; i < LatencyHistogram::Buckets; ++i) {
+            addRelaxed(buckets[i], other.buckets[i].load(std::memory_order_relaxed));
+        }
+    }
+
+    /**
+     * @brief Добавляет значения к снимку.
+     * @param out Снимок.
+     */
+    void addTo(LatencyHistogram& out) const {
+        for (std::size_t i = 0; i < LatencyHistogram::Buckets; ++i) {
+            out.counts[i] += buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::atomic<std::uint64_t> buckets[LatencyHistogram::Buckets] = {};  /**< Значений в каждом интервале */
+};
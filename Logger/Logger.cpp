@@ -1,66 +1,197 @@
 ﻿#include "Logger.h"
-#include <iostream>
+#include "LoggerRegistry.h"
+#include "Platform.h"
 #include <chrono>
 #include <iomanip>
 #include <sstream>
 #include <ctime>
 #include <filesystem>
-#include <windows.h>
+#include <algorithm>
+#include <csignal>
+#include <limits>
 
 /**
  * @brief Глобальный объект логгера.
  */
 Logger LoggerInstance;
 
+namespace {
+
 /**
- * @brief Конвертирует строку UTF-8 в широкую строку (wstring) для вывода в консоль Windows.
- * @param utf8Str Входная строка в UTF-8.
- * @return Широкая строка (wstring).
+ * @brief Источник уникальных идентификаторов логгеров.
  */
-std::wstring utf8_to_wstring(const std::string& utf8Str) {
-    if (utf8Str.empty()) return std::wstring();
+std::atomic<std::uint64_t> nextLoggerId{ 1 };
+
+/**
+ * @brief Ключ выборки текущего потока (Logger::setSamplingKey()).
+ */
+thread_local std::uint64_t samplingKey = 0;
+
+/**
+ * @brief Место вызова строки статистики (Logger::setStatsInterval()).
+ */
+constexpr LogSite StatsSite{ LogLevel::INFO, "Logger", 0 };
+
+/**
+ * @brief Глубина очереди по позициям записи и чтения.
+ *
+ * Позиция чтения читается первой; вытеснение DropOldest может сдвинуть
+ * её дальше прочитанной позиции записи, тогда глубина считается нулевой.
+ */
+std::size_t queueDepth(std::size_t pushed, std::size_t popped) {
+    return pushed > popped ? pushed - popped : 0;
+}
+
+/**
+ * @brief Живые логгеры, которые выгружает обработчик сбоев.
+ *
+ * Фиксированный массив атомарных указателей можно обходить
+ * из обработчика сигнала без блокировок и выделения памяти.
+ */
+constexpr int MaxCrashLoggers = 64;
+std::atomic<Logger*> crashLoggers[MaxCrashLoggers];
+
+std::atomic<bool> crashHandlerInstalled{ false };  /**< Обработчики сбоев установлены */
+std::atomic<bool> crashInProgress{ false };        /**< Аварийная выгрузка уже выполняется */
+std::atomic<long long> crashBudgetMs{ 500 };       /**< Время выгрузки для обработчиков */
+
+constexpr int CrashSignals[] = { SIGSEGV, SIGILL, SIGFPE, SIGABRT };  /**< Перехватываемые сигналы */
+void (*previousSignalHandlers[std::size(CrashSignals)])(int) = {};   /**< Прежние обработчики сигналов */
+
+/**
+ * @brief Выгрузка при необработанном исключении SEH (platform::installExceptionHook()).
+ */
+void crashExceptionHook() {
+    Logger::emergencyFlushAll(std::chrono::milliseconds(crashBudgetMs.load(std::memory_order_relaxed)));
+}
+
+/**
+ * @brief Обработчик сигналов сбоя: выгружает логи и передаёт сигнал прежнему обработчику.
+ */
+void crashSignalHandler(int sig) {
+    Logger::emergencyFlushAll(std::chrono::milliseconds(crashBudgetMs.load(std::memory_order_relaxed)));
+
+    for (std::size_t i = 0; i < std::size(CrashSignals); ++i) {
+        if (CrashSignals[i] != sig) continue;
+        auto previous = previousSignalHandlers[i];
+        std::signal(sig, previous != nullptr && previous != SIG_ERR ? previous : SIG_DFL);
+        break;
+    }
+    std::raise(sig);
+}
+
+}
 
-    int size_needed = MultiByteToWideChar(CP_UTF8, 0, utf8Str.data(), (int)utf8Str.size(), nullptr, 0);
-    std::wstring wstrTo(size_needed, 0);
+/**
+ * @struct Logger::ThreadBufferCache
+ * @brief Буферы текущего потока во всех логгерах, с которыми он работал.
+ *
+ * Деструктор (завершение потока) помечает буферы как retired,
+ * передавая их дочитывание и освобождение потоку обработки.
+ */
+struct Logger::ThreadBufferCache {
+    std::uint64_t lastLoggerId = 0;     /**< Логгер последнего обращения */
+    ThreadBuffer* lastBuffer = nullptr; /**< Буфер последнего обращения */
+    std::vector<std::pair<std::uint64_t, std::shared_ptr<ThreadBuffer>>> buffers;  /**< Все буферы потока */
 
-    MultiByteToWideChar(CP_UTF8, 0, utf8Str.data(), (int)utf8Str.size(), &wstrTo[0], size_needed);
+    ~ThreadBufferCache() {
+        for (auto& entry : buffers) {
+            entry.second->retired.store(true, std::memory_order_release);
+        }
+    }
+};
 
-    return wstrTo;
+/**
+ * @brief Конвертирует строку UTF-8 в широкую строку (UTF-16 в Windows, UTF-32 в Linux).
+ * @param utf8Str Входная строка в UTF-8.
+ * @return Широкая строка (wstring).
+ */
+std::wstring utf8_to_wstring(const std::string& utf8Str) {
+    return platform::utf8ToWide(utf8Str);
 }
 
 /**
  * @brief Конструктор Logger.
  *
  * Инициализирует время запуска, запускает поток обработки сообщений.
+ * @param queueCapacity Максимальное число сообщений в буфере одного потока.
+ */
+Logger::Logger(std::size_t queueCapacity)
+    : Logger(queueCapacity, nullptr) {
+}
+
+/**
+ * @brief Конструктор Logger, обрабатываемого пулом потоков.
+ *
+ * Без пула запускает собственный поток обработки, иначе
+ * регистрирует логгер в одном из потоков пула.
+ * @param queueCapacity Максимальное число сообщений в буфере одного потока.
+ * @param pool Пул потоков обработки или nullptr.
  */
-Logger::Logger() {
+Logger::Logger(std::size_t queueCapacity, std::shared_ptr<LoggerWorkerPool> pool)
+    : consoleSink(std::make_shared<ConsoleSink>()),
+      fileSink(std::make_shared<FileSink>()),
+      loggerId(nextLoggerId.fetch_add(1, std::memory_order_relaxed)),
+      threadBufferCapacity(queueCapacity),
+      workerPool(std::move(pool)) {
+    workerBatch.reserve(MaxBatchSize);
+    batchOrder.reserve(MaxBatchSize);
+    consoleSink->enableDiagnostics(true);
+    fileSink->enableDiagnostics(true);
+    publishConfig(config.load(std::memory_order_relaxed));
+
+    for (int i = 0; i < MaxCrashLoggers; ++i) {
+        Logger* expected = nullptr;
+        if (crashLoggers[i].compare_exchange_strong(expected, this)) {
+            crashSlot = i;
+            break;
+        }
+    }
+
     auto now = std::chrono::system_clock::now();
     auto t_c = std::chrono::system_clock::to_time_t(now);
-    std::tm timeInfo;
-    localtime_s(&timeInfo, &t_c);
+    std::tm timeInfo{};
+    platform::localTime(t_c, timeInfo);
 
     std::ostringstream oss;
     oss << std::put_time(&timeInfo, "%Y-%m-%d_%H-%M-%S");
     startupTime = oss.str();
 
-    workerThread = std::thread(&Logger::workerFunc, this);
+    if (workerPool != nullptr) {
+        wakeSignal = &workerPool->attach(*this);
+    }
+    else {
+        workerThread = std::thread(&Logger::workerFunc, this);
+    }
 }
 
 /**
  * @brief Деструктор Logger.
  *
- * Завершает поток обработки, закрывает файл лога.
+ * Завершает поток обработки (логгер пула отсоединяется от пула),
+ * затем дописывает в вызывающем потоке сообщения, поставленные
+ * производителями, пока поток обработки завершался, и закрывает файл лога.
  */
 Logger::~Logger() {
-    exitFlag = true;
-    cv.notify_all();
-    if (workerThread.joinable()) {
-        workerThread.join();
+    if (crashSlot >= 0) {
+        crashLoggers[crashSlot].store(nullptr, std::memory_order_release);
     }
 
-    if (logFileStream.is_open()) {
-        logFileStream.close();
+    if (workerPool != nullptr) {
+        workerPool->detach(*this);
+    }
+    else {
+        exitFlag = true;
+        ownSignal.epoch.fetch_add(1, std::memory_order_release);
+        ownSignal.epoch.notify_one();
+        if (workerThread.joinable()) {
+            workerThread.join();
+        }
     }
+    workerStopped.store(true, std::memory_order_release);
+    drainAll();
+
+    fileSink->file().close();
 }
 
 /**
@@ -71,8 +202,7 @@ Logger::~Logger() {
  * @param addTimestampSuffix Добавлять временной суффикс к имени файла.
  */
 void Logger::init(LogLevel level, const std::string& filePath, bool append, bool addTimestampSuffix) {
-    std::lock_guard<std::mutex> lock(queueMutex);
-    currentLevel = level;
+    currentLevel.store(level, std::memory_order_relaxed);
 
     std::filesystem::path path(filePath);
     std::filesystem::path dir = path.parent_path();
@@ -81,8 +211,8 @@ void Logger::init(LogLevel level, const std::string& filePath, bool append, bool
         std::filesystem::create_directories(dir);
     }
 
+    std::string fullName = filePath;
     if (addTimestampSuffix) {
-        std::string fullName;
         auto dot = filePath.rfind('.');
         if (dot != std::string::npos) {
             fullName = filePath.substr(0, dot) + "_" + startupTime + filePath.substr(dot);
@@ -90,29 +220,139 @@ void Logger::init(LogLevel level, const std::string& filePath, bool append, bool
         else {
             fullName = filePath + "_" + startupTime;
         }
-        logFilePath = fullName;
+    }
+
+    // Файл открывает поток обработки: он единственный пишет в него
+    updateConfig([&](LoggerConfig& next) {
+        next.filePath = std::move(fullName);
+        next.fileAppend = append;
+        ++next.fileGeneration;
+        });
+    wakeWorker();
+}
+
+/**
+ * @brief Устанавливает минимальный уровень логирования.
+ * @param level Новый уровень.
+ */
+void Logger::setLogLevel(LogLevel level) {
+    currentLevel.store(level, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Переопределяет минимальный уровень для исходного файла.
+ *
+ * Публикует новый снимок переопределений с пустым кэшем; кэш
+ * заполняется заново при следующих вызовах лога.
+ *
+ * @param file Имя или окончание пути файла.
+ * @param level Минимальный уровень.
+ */
+void Logger::setFileLogLevel(const std::string& file, LogLevel level) {
+    std::lock_guard<std::mutex> lock(fileLevelMutex);
+
+    const FileLevelTable* current = fileLevels.load(std::memory_order_relaxed);
+    std::vector<std::pair<std::string, LogLevel>> overrides;
+    if (current != nullptr) overrides = current->overrides;
+
+    auto it = std::find_if(overrides.begin(), overrides.end(),
+        [&file](const auto& entry) { return entry.first == file; });
+    if (it != overrides.end()) {
+        it->second = level;
     }
     else {
-        logFilePath = filePath;
+        overrides.emplace_back(file, level);
     }
 
-    std::ios_base::openmode mode = std::ios::out;
-    if (append) mode |= std::ios::app;
+    publishFileLevels(std::move(overrides));
+    hasFileLevels.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Удаляет все переопределения уровня по файлам.
+ */
+void Logger::clearFileLogLevels() {
+    std::lock_guard<std::mutex> lock(fileLevelMutex);
+    hasFileLevels.store(false, std::memory_order_release);
+    fileLevels.store(nullptr, std::memory_order_release);
+}
+
+/**
+ * @brief Публикует снимок переопределений уровня по файлам.
+ *
+ * Вызывается под fileLevelMutex. Прежние снимки не освобождаются:
+ * производитель мог загрузить указатель на них до публикации.
+ *
+ * @param overrides Переопределения по имени файла.
+ */
+void Logger::publishFileLevels(std::vector<std::pair<std::string, LogLevel>> overrides) {
+    auto table = std::make_unique<FileLevelTable>();
+    table->overrides = std::move(overrides);
+    fileLevels.store(table.get(), std::memory_order_release);
+    fileLevelTables.push_back(std::move(table));
+}
+
+/**
+ * @brief Возвращает действующий уровень для файла вызова.
+ *
+ * Уровень ищется в кэше текущего снимка по значению указателя, не дальше
+ * FileLevelProbes ячеек. При промахе он вычисляется по именам файлов
+ * снимка и заносится в свободную ячейку, если она нашлась. Ни поиск,
+ * ни вычисление не берут блокировок.
+ *
+ * @param file Указатель __FILE__ места вызова.
+ * @return Минимальный уровень для этого файла.
+ */
+LogLevel Logger::fileLevel(const char* file) const {
+    const FileLevelTable* table = fileLevels.load(std::memory_order_acquire);
+    int level = -1;
+    if (table != nullptr) {
+        auto hash = static_cast<std::size_t>((reinterpret_cast<std::uintptr_t>(file) >> 3) * 0x9E3779B97F4A7C15ull);
+        FileLevelSlot* empty = nullptr;
+        bool cached = false;
+        for (std::size_t probe = 0; probe < FileLevelProbes; ++probe) {
+            FileLevelSlot& slot = table->slots[(hash + probe) % FileLevelSlots];
+            const char* key = slot.file.load(std::memory_order_acquire);
+            if (key == file) {
+                level = slot.level.load(std::memory_order_acquire);
+                cached = level != FileLevelPending;
+                break;
+            }
+            if (key == nullptr) {
+                empty = &slot;
+                break;
+            }
+        }
 
-    logFileStream.open(logFilePath, mode);
-    if (logFileStream.is_open() && logFileStream.tellp() == 0) {
-        const unsigned char bom[] = { 0xEF, 0xBB, 0xBF };
-        logFileStream.write(reinterpret_cast<const char*>(bom), sizeof(bom));
+        if (!cached) {
+            level = resolveFileLevel(*table, file);
+            const char* expected = nullptr;
+            if (empty != nullptr && empty->file.compare_exchange_strong(expected, file, std::memory_order_acq_rel)) {
+                empty->level.store(level, std::memory_order_release);
+            }
+        }
     }
+    return level < 0 ? currentLevel.load(std::memory_order_relaxed) : static_cast<LogLevel>(level);
 }
 
 /**
- * @brief Устанавливает минимальный уровень логирования.
- * @param level Новый уровень.
+ * @brief Находит уровень файла по именам переопределений снимка.
+ * @param table Снимок переопределений.
+ * @param file Путь файла места вызова.
+ * @return Уровень последнего совпавшего переопределения или -1.
  */
-void Logger::setLogLevel(LogLevel level) {
-    std::lock_guard<std::mutex> lock(queueMutex);
-    currentLevel = level;
+int Logger::resolveFileLevel(const FileLevelTable& table, const char* file) {
+    std::string_view path(file);
+    int level = -1;
+    for (const auto& [name, overrideLevel] : table.overrides) {
+        if (path.size() >= name.size() && path.compare(path.size() - name.size(), name.size(), name) == 0) {
+            std::size_t start = path.size() - name.size();
+            if (start == 0 || path[start - 1] == '/' || path[start - 1] == '\\') {
+                level = static_cast<int>(overrideLevel);
+            }
+        }
+    }
+    return level;
 }
 
 /**
@@ -120,8 +360,35 @@ void Logger::setLogLevel(LogLevel level) {
  * @param target Цель вывода.
  */
 void Logger::setOutputTarget(OutputTarget target) {
-    std::lock_guard<std::mutex> lock(queueMutex);
-    outputTarget = target;
+    updateConfig([target](LoggerConfig& next) { next.outputTarget = target; });
+}
+
+/**
+ * @brief Добавляет приёмник сообщений.
+ * @param sink Приёмник.
+ */
+void Logger::addSink(std::shared_ptr<LogSink> sink) {
+    if (!sink) return;
+
+    updateConfig([&sink](LoggerConfig& next) { next.sinks.push_back(std::move(sink)); });
+}
+
+/**
+ * @brief Удаляет приёмник, добавленный через addSink().
+ * @param sink Приёмник.
+ */
+void Logger::removeSink(const std::shared_ptr<LogSink>& sink) {
+    updateConfig([&sink](LoggerConfig& next) {
+        next.sinks.erase(std::remove(next.sinks.begin(), next.sinks.end(), sink), next.sinks.end());
+        });
+}
+
+/**
+ * @brief Устанавливает режим формирования текста сообщений.
+ * @param mode Immediate (в потоке вызова) или Deferred (в потоке обработки).
+ */
+void Logger::setFormattingMode(FormattingMode mode) {
+    formattingMode.store(mode, std::memory_order_relaxed);
 }
 
 /**
@@ -129,151 +396,1268 @@ void Logger::setOutputTarget(OutputTarget target) {
  * @param formatTemplate Строка шаблона с плейсхолдерами.
  */
 void Logger::setFormatTemplate(const std::string& formatTemplate) {
-    std::lock_guard<std::mutex> lock(queueMutex);
-    this->formatTemplate = formatTemplate;
+    FormatTemplate compiled(formatTemplate);
+    updateConfig([&compiled](LoggerConfig& next) { next.formatTemplate = std::move(compiled); });
 }
 
 /**
- * @brief Получить текущую временную метку.
- * @return Строка с датой и временем в формате "YYYY-MM-DD HH:MM:SS".
+ * @brief Выбирает вид строки лога.
+ * @param format Шаблон или JSON lines.
  */
-std::string Logger::getTimestamp() const {
-    auto now = std::chrono::system_clock::now();
-    auto t_c = std::chrono::system_clock::to_time_t(now);
-    std::tm timeInfo;
-    localtime_s(&timeInfo, &t_c);
+void Logger::setLineFormat(LineFormat format) {
+    updateConfig([format](LoggerConfig& next) { next.lineFormat = format; });
+}
 
-    std::ostringstream oss;
-    oss << std::put_time(&timeInfo, "%Y-%m-%d %H:%M:%S");
-    return oss.str();
+/**
+ * @brief Устанавливает точность временной метки.
+ * @param precision Точность дробной части секунд.
+ */
+void Logger::setTimestampPrecision(TimestampPrecision precision) {
+    updateConfig([precision](LoggerConfig& next) { next.timestampPrecision = precision; });
+}
+
+/**
+ * @brief Устанавливает интервал сброса файла лога на диск.
+ * @param interval Минимальный интервал между сбросами (0 - после каждой пачки).
+ */
+void Logger::setFlushInterval(std::chrono::milliseconds interval) {
+    updateConfig([interval](LoggerConfig& next) { next.flushInterval = interval; });
+}
+
+/**
+ * @brief Задаёт уровень немедленного сброса.
+ * @param level Уровень.
+ */
+void Logger::setFlushLevel(LogLevel level) {
+    updateConfig([level](LoggerConfig& next) { next.flushLevel = level; });
+}
+
+/**
+ * @brief Дожидается записи сообщений, поставленных в очередь до вызова.
+ */
+void Logger::flush() {
+    flushUntil(std::chrono::steady_clock::time_point::max());
+}
+
+/**
+ * @brief Дожидается записи сообщений, поставленных до вызова, не дольше timeout.
+ * @param timeout Наибольшее время ожидания.
+ * @return false, если время истекло.
+ */
+bool Logger::flush(std::chrono::milliseconds timeout) {
+    return flushUntil(std::chrono::steady_clock::now() + timeout);
+}
+
+/**
+ * @brief Реализация flush().
+ *
+ * Запоминает позиции записи всех буферов потоков. Каждый запрос сброса
+ * выполняется потоком обработки в конце шага drainOnce(), то есть после
+ * записи всех сообщений, извлечённых на этом шаге; поэтому как только
+ * позиции чтения дошли до запомненных и следующий запрос выполнен,
+ * сообщения записаны и приёмники сброшены. Новые сообщения других
+ * потоков не продлевают ожидание.
+ *
+ * @param deadline Крайний срок.
+ * @return false, если срок истёк.
+ */
+bool Logger::flushUntil(std::chrono::steady_clock::time_point deadline) {
+    std::vector<std::pair<std::shared_ptr<ThreadBuffer>, std::size_t>> targets;
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        targets.reserve(threadBuffers.size());
+        for (const auto& buffer : threadBuffers) {
+            targets.emplace_back(buffer, buffer->queue.pushPosition());
+        }
+    }
+
+    for (;;) {
+        bool reached = std::all_of(targets.begin(), targets.end(), [](const auto& target) {
+            return target.first->queue.popPosition() >= target.second;
+            });
+        if (!waitFlushed(requestFlush(), deadline)) return false;
+        if (reached) return true;
+    }
 }
 
 /**
- * @brief Преобразует уровень логирования в строку.
- * @param level Уровень логирования.
- * @return Строковое представление уровня.
+ * @brief Публикует снимок настроек вместе с позициями записи буферов потоков.
+ *
+ * Вызывается updateConfig() под configMutex, поэтому снимки попадают
+ * в очередь в порядке публикации. Поток обработки применит снимок, когда
+ * извлечёт сообщения до запомненных позиций, и до этого не заберёт
+ * ни одного следующего: сообщения, поставленные до init()
+ * или setFormatTemplate(), пишутся по прежним настройкам.
+ * Ни поток обработки, ни вызывающий поток при этом не ждут друг друга.
+ *
+ * @param next Новый снимок.
  */
-std::string Logger::levelToString(LogLevel level) const {
-    switch (level) {
-    case LogLevel::TRACE: return "TRACE";
-    case LogLevel::DEBUG: return "DEBUG";
-    case LogLevel::INFO: return "INFO";
-    case LogLevel::WARNING: return "WARNING";
-    case LogLevel::ERROR_: return "ERROR";
-    case LogLevel::CRITICAL: return "CRITICAL";
-    default: return "UNKNOWN";
+void Logger::publishConfig(std::shared_ptr<const LoggerConfig> next) {
+    auto pending = std::make_shared<PendingConfig>();
+    pending->config = next;
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        pending->boundary.reserve(threadBuffers.size());
+        for (const auto& buffer : threadBuffers) {
+            pending->boundary.emplace_back(buffer, buffer->queue.pushPosition());
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(pendingConfigsMutex);
+        pendingConfigs.push_back(std::move(pending));
+        configPending.store(true, std::memory_order_release);
     }
+    config.store(std::move(next), std::memory_order_release);
+}
+
+/**
+ * @brief Регистрирует запрос сброса и будит поток обработки.
+ * @return Номер запроса.
+ */
+std::uint64_t Logger::requestFlush() {
+    std::uint64_t ticket = flushRequested.fetch_add(1, std::memory_order_seq_cst) + 1;
+    wakeWorker();
+    return ticket;
 }
 
 /**
- * @brief Форматирует сообщение согласно шаблону.
- * @param msg Сообщение для форматирования.
- * @return Отформатированная строка.
+ * @brief Ждёт выполнения запроса сброса.
+ *
+ * Без срока ожидание выполняется на счётчике flushCompleted, со сроком -
+ * опросом с паузой в 1 мс (в том числе из обработчика сбоя).
+ *
+ * @param ticket Номер запроса.
+ * @param deadline Крайний срок или time_point::max().
+ * @return false, если срок истёк или потока обработки уже нет.
  */
-std::string Logger::formatLogMessage(const LogMessage& msg) const {
-    std::string formatted = formatTemplate;
+bool Logger::waitFlushed(std::uint64_t ticket, std::chrono::steady_clock::time_point deadline) {
+    bool unbounded = deadline == std::chrono::steady_clock::time_point::max();
+    for (;;) {
+        std::uint64_t completed = flushCompleted.load(std::memory_order_acquire);
+        if (completed >= ticket) return true;
+        if (workerStopped.load(std::memory_order_acquire)) return false;
 
-    auto replaceAll = [](std::string& str, const std::string& from, const std::string& to) {
-        size_t start_pos = 0;
-        while ((start_pos = str.find(from, start_pos)) != std::string::npos) {
-            str.replace(start_pos, from.length(), to);
-            start_pos += to.length();
+        if (unbounded) {
+            flushCompleted.wait(completed, std::memory_order_acquire);
         }
-        };
+        else if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+/**
+ * @brief Выполняет запрос сброса, если он есть.
+ *
+ * Вызывается потоком обработки в конце шага drainOnce(). Перед сбросом
+ * применяет снимки настроек, сообщения до которых уже записаны; flush()
+ * дожидается всех сообщений, поставленных до него, поэтому после flush()
+ * действуют все настройки, заданные до вызова. При аварийной выгрузке сначала
+ * записывает всё, что осталось в очереди.
+ */
+void Logger::completeFlushRequest() {
+    std::uint64_t requested = flushRequested.load(std::memory_order_acquire);
+    if (requested == flushCompleted.load(std::memory_order_relaxed)) return;
 
-    replaceAll(formatted, "{t}", msg.timestamp);
-    replaceAll(formatted, "{L}", levelToString(msg.level));
-    replaceAll(formatted, "{f}", msg.file);
-    replaceAll(formatted, "{l}", std::to_string(msg.line));
-    replaceAll(formatted, "{m}", msg.message);
+    refreshConfig();
+    if (emergencyRequested.load(std::memory_order_acquire)) {
+        for (;;) {
+            collectBatch(workerBatch);
+            if (workerBatch.empty()) break;
+            writeBatch(workerBatch);
+            workerBatch.clear();
+            refreshConfig();
+        }
+    }
+    flushRepeats(true);
+    flushSinks(true);
 
-    return formatted;
+    flushCompleted.store(requested, std::memory_order_release);
+    flushCompleted.notify_all();
 }
 
 /**
- * @brief Логирует сообщение, если уровень не ниже текущего.
- * @param level Уровень сообщения.
- * @param message Текст сообщения.
- * @param file Имя файла вызова.
- * @param line Номер строки.
+ * @brief Устанавливает обработчики сбоев.
+ * @param budget Наибольшее время выгрузки всех логгеров.
  */
-void Logger::log(LogLevel level, const std::string& message,
-    const std::string& file, int line) {
-    if (level < currentLevel) return;
+void Logger::installCrashHandler(std::chrono::milliseconds budget) {
+    crashBudgetMs.store(budget.count(), std::memory_order_relaxed);
+    if (crashHandlerInstalled.exchange(true)) return;
 
-    LogMessage msg;
-    msg.level = level;
-    msg.message = message;
-    msg.file = file;
-    msg.line = line;
-    msg.timestamp = getTimestamp();
+    platform::installExceptionHook(&crashExceptionHook);
+    for (std::size_t i = 0; i < std::size(CrashSignals); ++i) {
+        previousSignalHandlers[i] = std::signal(CrashSignals[i], &crashSignalHandler);
+    }
+}
+
+/**
+ * @brief Аварийно выгружает очереди всех живых логгеров.
+ * @param budget Наибольшее время выгрузки.
+ */
+void Logger::emergencyFlushAll(std::chrono::milliseconds budget) {
+    if (crashInProgress.exchange(true)) return;
 
-    enqueueLog(msg);
+    auto deadline = std::chrono::steady_clock::now() + budget;
+    for (auto& slot : crashLoggers) {
+        Logger* logger = slot.load(std::memory_order_acquire);
+        if (logger != nullptr) logger->emergencyFlush(deadline);
+    }
 }
 
 /**
- * @brief Добавляет сообщение в очередь для асинхронной обработки.
- * @param msg Сообщение для добавления.
+ * @brief Аварийная выгрузка одного логгера.
+ *
+ * Если поток обработки жив и сбой произошёл не в нём, он получает запрос
+ * записать очередь до конца и половину оставшегося времени; иначе или
+ * по истечении этого времени очередь выгружается прямо из текущего потока.
+ *
+ * @param deadline Крайний срок.
  */
-void Logger::enqueueLog(const LogMessage& msg) {
-    {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        messageQueue.push(msg);
+void Logger::emergencyFlush(std::chrono::steady_clock::time_point deadline) {
+    bool inWorker = drainingThread.load(std::memory_order_relaxed) == std::this_thread::get_id();
+    if (!inWorker && !workerStopped.load(std::memory_order_acquire)) {
+        auto now = std::chrono::steady_clock::now();
+        emergencyRequested.store(true, std::memory_order_release);
+        if (waitFlushed(requestFlush(), now + (deadline - now) / 2)) return;
     }
-    cv.notify_one();
+    emergencyWrite(deadline);
 }
 
 /**
- * @brief Записывает сообщение в выбранные места вывода.
- * @param msg Сообщение для записи.
+ * @brief Выгружает очередь в файл из потока сбоя.
+ *
+ * Не выделяет память и не берёт блокировок: буферы потоков читаются
+ * из массива crashBuffers, путь файла - из LogFile::crashPath(), оба
+ * публикуются атомарно. Сообщения извлекаются RingBuffer::tryConsume()
+ * (безопасно параллельно с потоком обработки), форматируются
+ * в статический буфер и пишутся platform::writeAll(). Текстовый файл
+ * с прямой записью дополняется напрямую, для двоичного или отображаемого
+ * файла строки пишутся рядом, в "имя.crash.log". Без открытого файла - в stderr.
+ *
+ * @param deadline Крайний срок.
  */
-void Logger::writeLog(const LogMessage& msg) {
-    std::string output = formatLogMessage(msg);
-    int target = static_cast<int>(outputTarget);
+void Logger::emergencyWrite(std::chrono::steady_clock::time_point deadline) {
+    static char line[8192];
 
-    if ((target & static_cast<int>(OutputTarget::Console)) != 0) {
-        std::wcout << L"[Console] " << utf8_to_wstring(output) << std::endl;
+    platform::FileHandle output = platform::InvalidFile;
+    const char* path = fileSink->file().crashPath();
+    if (path != nullptr) {
+        output = platform::openForAppend(path);
+    }
+    bool ownsOutput = output != platform::InvalidFile;
+    if (!ownsOutput) {
+        output = platform::standardError();
     }
 
-    if ((target & static_cast<int>(OutputTarget::File)) != 0) {
-        if (logFileStream.is_open()) {
-            std::wcout << L"[File] Запись в файл: " << utf8_to_wstring(logFilePath) << std::endl;
-            std::wcout << L"[File] Записано байт: " << output.size() << std::endl;
-            logFileStream << output << std::endl;
-            logFileStream.flush();
+    for (auto& slot : crashBuffers) {
+        ThreadBuffer* buffer = slot.load(std::memory_order_seq_cst);
+        if (buffer == nullptr) continue;
+        while (std::chrono::steady_clock::now() < deadline) {
+            bool consumed = buffer->queue.tryConsume([&](const LogMessage& msg) {
+                std::size_t length = formatEmergencyRecord(*msg.site, msg.time, msg.payload.view(), line, sizeof(line));
+                platform::writeAll(output, line, length);
+                });
+            if (!consumed) break;
         }
-        else {
-            std::wcout << L"[File] Файл не открыт!" << std::endl;
+    }
+
+    if (ownsOutput) platform::closeFile(output);
+}
+
+/**
+ * @brief Устанавливает условия ротации файла лога.
+ * @param policy Условия ротации.
+ */
+void Logger::setRotation(const RotationPolicy& policy) {
+    updateConfig([&policy](LoggerConfig& next) { next.rotation = policy; });
+}
+
+/**
+ * @brief Выбирает способ записи файла лога.
+ * @param backend Поток или отображение в память.
+ * @param segmentSize Шаг увеличения отображаемого файла.
+ */
+void Logger::setFileBackend(FileBackend backend, std::uint64_t segmentSize) {
+    updateConfig([backend, segmentSize](LoggerConfig& next) {
+        next.fileBackend = backend;
+        next.segmentSize = segmentSize;
+        });
+}
+
+/**
+ * @brief Выбирает формат файла лога.
+ * @param format Текстовый или двоичный формат.
+ */
+void Logger::setFileFormat(FileFormat format) {
+    updateConfig([format](LoggerConfig& next) { next.fileFormat = format; });
+}
+
+/**
+ * @brief Включает индекс времени рядом с файлом лога.
+ * @param blockSize Размер блока индекса; 0 - без индекса.
+ */
+void Logger::setFileIndex(std::uint64_t blockSize) {
+    updateConfig([blockSize](LoggerConfig& next) { next.fileIndexInterval = blockSize; });
+}
+
+/**
+ * @brief Устанавливает политику поведения при заполненной очереди.
+ * @param policy Политика переполнения.
+ * @param minKeptLevel Минимальный уровень, который DropBelowLevel не отбрасывает.
+ */
+void Logger::setBackpressurePolicy(BackpressurePolicy policy, LogLevel minKeptLevel) {
+    backpressureLevel.store(minKeptLevel, std::memory_order_relaxed);
+    backpressurePolicy.store(policy, std::memory_order_release);
+}
+
+/**
+ * @brief Возвращает счётчики отброшенных сообщений.
+ * @return Снимок счётчиков.
+ */
+DropCounters Logger::getDropCounters() const {
+    LoggerStats stats;
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    retiredCounters.addTo(stats);
+    for (const auto& buffer : threadBuffers) {
+        buffer->counters.addTo(stats);
+    }
+    return stats.drops;
+}
+
+/**
+ * @brief Возвращает снимок статистики.
+ *
+ * Складывает счётчики буферов всех потоков и уже удалённых буферов
+ * под мьютексом списка, поэтому удаление буфера не теряет и не удваивает
+ * его счётчики.
+ *
+ * @return Снимок.
+ */
+LoggerStats Logger::getStats() const {
+    LoggerStats stats;
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        stats.threads = threadBuffers.size();
+        retiredCounters.addTo(stats);
+        for (const auto& buffer : threadBuffers) {
+            buffer->counters.addTo(stats);
+            std::size_t popped = buffer->queue.popPosition();
+            stats.queueDepth += queueDepth(buffer->queue.pushPosition(), popped);
         }
     }
+
+    for (std::size_t i = 0; i < LogLevelCount; ++i) {
+        stats.written[i] = writtenCount[i].load(std::memory_order_relaxed);
+    }
+    stats.collapsed = collapsedCount.load(std::memory_order_relaxed);
+    stats.batches = batchCount.load(std::memory_order_relaxed);
+    stats.peakQueueDepth = (std::max)(peakDepth.load(std::memory_order_relaxed), stats.queueDepth);
+    batchSizes.addTo(stats.batchSizes);
+
+    std::shared_ptr<const LoggerConfig> current = getConfig();
+    int target = static_cast<int>(current->outputTarget);
+    if ((target & static_cast<int>(OutputTarget::Console)) != 0) stats.sinks.push_back({ consoleSink, consoleSink->getCounters() });
+    if ((target & static_cast<int>(OutputTarget::File)) != 0) stats.sinks.push_back({ fileSink, fileSink->getCounters() });
+    for (const auto& sink : current->sinks) {
+        stats.sinks.push_back({ sink, sink->getCounters() });
+    }
+    return stats;
+}
+
+/**
+ * @brief Добавляет счётчики другого потока (только поток обработки, под buffersMutex).
+ * @param other Счётчики удаляемого буфера.
+ */
+void Logger::ProducerCounters::merge(const ProducerCounters& other) {
+    for (std::size_t i = 0; i < LogLevelCount; ++i) {
+        addRelaxed(enqueued[i], other.enqueued[i].load(std::memory_order_relaxed));
+    }
+    addRelaxed(droppedNewest, other.droppedNewest.load(std::memory_order_relaxed));
+    addRelaxed(droppedOldest, other.droppedOldest.load(std::memory_order_relaxed));
+    addRelaxed(droppedBelowLevel, other.droppedBelowLevel.load(std::memory_order_relaxed));
+    addRelaxed(rateLimited, other.rateLimited.load(std::memory_order_relaxed));
+    latency.merge(other.latency);
+}
+
+/**
+ * @brief Добавляет счётчики потока к снимку статистики.
+ * @param stats Снимок.
+ */
+void Logger::ProducerCounters::addTo(LoggerStats& stats) const {
+    for (std::size_t i = 0; i < LogLevelCount; ++i) {
+        stats.enqueued[i] += enqueued[i].load(std::memory_order_relaxed);
+    }
+    stats.drops.droppedNewest += droppedNewest.load(std::memory_order_relaxed);
+    stats.drops.droppedOldest += droppedOldest.load(std::memory_order_relaxed);
+    stats.drops.droppedBelowLevel += droppedBelowLevel.load(std::memory_order_relaxed);
+    stats.drops.rateLimited += rateLimited.load(std::memory_order_relaxed);
+    latency.addTo(stats.enqueueLatency);
+}
+
+/**
+ * @brief Задаёт параметры собственного потока обработки.
+ * @param options Ядра, приоритет, способ ожидания.
+ */
+void Logger::setWorkerOptions(const WorkerOptions& options) {
+    updateConfig([&options](LoggerConfig& next) { next.worker = options; });
+    wakeWorker();
 }
 
 /**
- * @brief Функция потока, обрабатывающего очередь сообщений.
+ * @brief Применяет маску ядер и приоритет к текущему потоку.
  *
- * Ожидает появления сообщений или сигнала выхода,
- * затем последовательно записывает их.
+ * Нулевая маска возвращает поток на все ядра процесса.
+ *
+ * @param options Параметры потока.
  */
-void Logger::workerFunc() {
-    while (!exitFlag) {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        cv.wait(lock, [this]() { return !messageQueue.empty() || exitFlag; });
+void Logger::applyThreadOptions(const WorkerOptions& options) {
+    platform::setThreadAffinity(options.affinityMask);
 
-        while (!messageQueue.empty()) {
-            LogMessage msg = messageQueue.front();
-            messageQueue.pop();
-            lock.unlock();
+    int priority = 0;
+    switch (options.priority) {
+    case WorkerPriority::Lowest: priority = -2; break;
+    case WorkerPriority::BelowNormal: priority = -1; break;
+    case WorkerPriority::AboveNormal: priority = 1; break;
+    case WorkerPriority::Highest: priority = 2; break;
+    case WorkerPriority::Normal:
+    default: break;
+    }
+    platform::setThreadPriority(priority);
+}
+
+/**
+ * @brief Подсказка процессору, что поток крутится в цикле опроса.
+ */
+void Logger::cpuRelax() {
+    platform::cpuRelax();
+}
 
-            writeLog(msg);
+/**
+ * @brief Включает периодическую строку статистики.
+ * @param interval Период; 0 выключает.
+ */
+void Logger::setStatsInterval(std::chrono::milliseconds interval) {
+    updateConfig([interval](LoggerConfig& next) { next.statsInterval = interval; });
+}
 
-            lock.lock();
-        }
+/**
+ * @brief Ограничивает частоту сообщений каждого места вызова.
+ * @param messagesPerSecond Средняя частота; 0 снимает ограничение.
+ * @param burst Сколько сообщений можно записать подряд.
+ */
+void Logger::setRateLimit(double messagesPerSecond, std::uint32_t burst) {
+    if (messagesPerSecond <= 0) {
+        rateInterval.store(0, std::memory_order_relaxed);
+        return;
     }
 
-    // Обработка оставшихся сообщений при завершении
-    std::lock_guard<std::mutex> lock(queueMutex);
-    while (!messageQueue.empty()) {
-        writeLog(messageQueue.front());
-        messageQueue.pop();
+    auto interval = (std::max)(static_cast<std::int64_t>(1e9 / messagesPerSecond), std::int64_t(1));
+    rateTolerance.store(interval * ((std::max)(burst, 1u) - 1), std::memory_order_relaxed);
+    rateInterval.store(interval, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Проверка ограничения частоты (GCRA).
+ *
+ * Сообщение пропускается, если теоретическое время следующего сообщения
+ * опережает текущее не больше чем на запас burst; тогда оно сдвигается
+ * на один интервал.
+ *
+ * @param state Состояние места вызова.
+ * @param interval Интервал между сообщениями, нс.
+ * @return true, если сообщение можно записать.
+ */
+bool Logger::admitLimited(LogSiteState& state, std::int64_t interval) {
+    std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    std::int64_t tolerance = rateTolerance.load(std::memory_order_relaxed);
+
+    std::int64_t next = state.nextAllowed.load(std::memory_order_relaxed);
+    for (;;) {
+        std::int64_t start = (std::max)(next, now);
+        if (start - now > tolerance) {
+            state.suppressed.fetch_add(1, std::memory_order_relaxed);
+            addRelaxed(localBuffer().counters.rateLimited);
+            return false;
+        }
+        if (state.nextAllowed.compare_exchange_weak(next, start + interval, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief Включает выборку 1 из N для сообщений низких уровней.
+ * @param maxLevel Наибольший уровень выборки.
+ * @param oneIn Базовое N; 0 или 1 выключает выборку.
+ * @param adaptive Увеличивать N при заполнении очереди.
+ */
+void Logger::setSampling(LogLevel maxLevel, std::uint32_t oneIn, bool adaptive) {
+    if (oneIn <= 1) {
+        sampledLevel.store(-1, std::memory_order_relaxed);
+        return;
+    }
+
+    sampleBase.store(oneIn, std::memory_order_relaxed);
+    sampleAdaptive.store(adaptive, std::memory_order_relaxed);
+    if (!adaptive) sampleShift.store(0, std::memory_order_relaxed);
+    sampledLevel.store(static_cast<int>(maxLevel), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Задаёт ключ выборки текущего потока.
+ * @param key Ключ; 0 - выборка по счётчику места вызова.
+ */
+void Logger::setSamplingKey(std::uint64_t key) {
+    samplingKey = key;
+}
+
+/**
+ * @brief Решает, попадает ли сообщение в выборку 1 из sampleRate.
+ *
+ * Ключ перемешивается (splitmix64), чтобы последовательные
+ * идентификаторы запросов распределялись равномерно.
+ *
+ * @param site Место вызова.
+ * @param sampleRate Действующее N.
+ * @return true, если сообщение нужно записать.
+ */
+bool Logger::sampleHit(const LogSite& site, std::uint32_t sampleRate) {
+    std::uint64_t key = samplingKey;
+    if (key != 0) {
+        key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ull;
+        key = (key ^ (key >> 27)) * 0x94D049BB133111EBull;
+        key ^= key >> 31;
+        return key % sampleRate == 0;
+    }
+    if (site.state == nullptr) return true;
+    return site.state->sampled.fetch_add(1, std::memory_order_relaxed) % sampleRate == 0;
+}
+
+/**
+ * @brief Включает сворачивание повторяющихся сообщений.
+ * @param enabled Включить или выключить.
+ * @param reportInterval Наибольшее время между отчётами о повторах.
+ */
+void Logger::setDuplicateCollapsing(bool enabled, std::chrono::milliseconds reportInterval) {
+    updateConfig([enabled, reportInterval](LoggerConfig& next) {
+        next.collapseDuplicates = enabled;
+        next.repeatReportInterval = reportInterval;
+        });
+}
+
+/**
+ * @brief Форматирует сообщение согласно разобранному шаблону или как JSON-объект.
+ * @param site Место вызова.
+ * @param time Момент вызова лога.
+ * @param payload Аргументы сообщения.
+ * @param out Буфер, в конец которого дописывается результат.
+ */
+void Logger::formatLogMessage(const LogSite& site, std::chrono::system_clock::time_point time,
+    std::string_view payload, std::string& out) {
+    if (workerConfig->lineFormat == LineFormat::JsonLines) {
+        formatJsonRecord(timestampCache, site, time, payload, out, formatScratch);
+    }
+    else {
+        formatRecord(workerConfig->formatTemplate, timestampCache, site, time, payload, out);
+    }
+}
+
+/**
+ * @brief Логирует сообщение, если уровень не ниже текущего.
+ * @param level Уровень сообщения.
+ * @param message Текст сообщения.
+ * @param file Имя файла вызова.
+ * @param line Номер строки.
+ */
+void Logger::log(LogLevel level, const std::string& message,
+    const char* file, int line) {
+    if (!isEnabled(level, file)) return;
+
+    const LogSite& site = internSite(level, file, line);
+    if (std::uint32_t sampleRate = admit(site)) {
+        logSampled(site, sampleRate, message);
+    }
+}
+
+/**
+ * @brief Возвращает место вызова для log() без макроса.
+ *
+ * Место ищется по указателю имени файла, строке и уровню, без выделения
+ * памяти: сначала в кэше текущего потока (прямое отображение, ключ
+ * включает loggerId, поэтому записи удалённых логгеров не совпадают),
+ * при промахе - в реестре логгера под siteMutex. Имя файла копируется
+ * один раз при создании места, поэтому поток обработки не зависит
+ * от времени жизни переданной строки.
+ *
+ * @param level Уровень сообщения.
+ * @param file Имя файла вызова.
+ * @param line Номер строки.
+ * @return Метаданные со временем жизни логгера.
+ */
+const LogSite& Logger::internSite(LogLevel level, const char* file, int line) {
+    struct CachedSite {
+        std::uint64_t loggerId = 0;
+        SiteKey key{};
+        const LogSite* site = nullptr;
+    };
+    thread_local CachedSite cache[SiteCacheSlots];
+
+    SiteKey key{ file, line, level };
+    CachedSite& cached = cache[SiteKeyHash{}(key) % SiteCacheSlots];
+    if (cached.loggerId == loggerId && cached.key == key) return *cached.site;
+
+    std::lock_guard<std::mutex> lock(siteMutex);
+    std::unique_ptr<InternedSite>& entry = internedSites[key];
+    if (!entry) {
+        entry = std::make_unique<InternedSite>();
+        entry->file = file;
+        entry->site = LogSite{ level, entry->file.c_str(), line, &entry->state };
+    }
+    cached = { loggerId, key, &entry->site };
+    return entry->site;
+}
+
+/**
+ * @brief Ставит в очередь сообщение с уже сериализованными аргументами.
+ * @param msg Сообщение с заполненными site, time и payload.
+ */
+void Logger::submit(LogMessage&& msg) {
+    enqueueLog(std::move(msg));
+}
+
+/**
+ * @brief Возвращает буфер сообщений текущего потока.
+ *
+ * При первом обращении потока к логгеру буфер создаётся и регистрируется
+ * в списке, который опрашивает поток обработки.
+ *
+ * @return Буфер текущего потока.
+ */
+Logger::ThreadBuffer& Logger::localBuffer() {
+    thread_local ThreadBufferCache cache;
+    if (cache.lastLoggerId == loggerId) {
+        return *cache.lastBuffer;
+    }
+
+    ThreadBuffer* buffer = nullptr;
+    for (auto& entry : cache.buffers) {
+        if (entry.first == loggerId) {
+            buffer = entry.second.get();
+            break;
+        }
+    }
+
+    if (buffer == nullptr) {
+        auto created = std::make_shared<ThreadBuffer>(threadBufferCapacity);
+        buffer = created.get();
+        for (int i = 0; i < MaxCrashBuffers; ++i) {
+            ThreadBuffer* expected = nullptr;
+            if (crashBuffers[i].compare_exchange_strong(expected, buffer)) {
+                buffer->crashSlot = i;
+                break;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(buffersMutex);
+            threadBuffers.push_back(created);
+        }
+        buffersChanged.store(true, std::memory_order_release);
+        cache.buffers.emplace_back(loggerId, std::move(created));
+    }
+
+    cache.lastLoggerId = loggerId;
+    cache.lastBuffer = buffer;
+    return *buffer;
+}
+
+/**
+ * @brief Добавляет сообщение в буфер текущего потока для асинхронной обработки.
+ *
+ * Вставка выполняется без блокировок. Если буфер заполнен,
+ * применяется текущая политика переполнения: сообщение отбрасывается,
+ * вытесняет самое старое, либо производитель будит поток обработки
+ * и уступает процессор до освобождения места. Счётчики и каждое
+ * 16-е измерение задержки пишутся в буфер текущего потока.
+ *
+ * @param msg Сообщение для добавления.
+ */
+void Logger::enqueueLog(LogMessage&& msg) {
+    ThreadBuffer& buffer = localBuffer();
+    ProducerCounters& counters = buffer.counters;
+    RingBuffer<LogMessage>& queue = buffer.queue;
+    auto level = static_cast<std::size_t>(msg.site->level);
+    auto start = msg.time;
+    while (!queue.tryPush(std::move(msg))) {
+        switch (backpressurePolicy.load(std::memory_order_acquire)) {
+        case BackpressurePolicy::DropNewest:
+            addRelaxed(counters.droppedNewest);
+            return;
+
+        case BackpressurePolicy::DropOldest: {
+            LogMessage oldest;
+            if (queue.tryPop(oldest)) {
+                addRelaxed(counters.droppedOldest);
+            }
+            continue;
+        }
+
+        case BackpressurePolicy::DropBelowLevel:
+            if (msg.site->level < backpressureLevel.load(std::memory_order_relaxed)) {
+                addRelaxed(counters.droppedBelowLevel);
+                return;
+            }
+            break;
+
+        case BackpressurePolicy::Block:
+        default:
+            if (workerStopped.load(std::memory_order_acquire)) {
+                // Логгер завершается: ждать освобождения места некому
+                addRelaxed(counters.droppedNewest);
+                return;
+            }
+            break;
+        }
+
+        wakeWorker();
+        std::this_thread::yield();
+    }
+    wakeWorker();
+
+    addRelaxed(counters.enqueued[level]);
+    if ((counters.calls++ & LatencySampleMask) == 0) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now() - start);
+        counters.latency.add(static_cast<std::uint64_t>((std::max)(elapsed.count(), std::int64_t(0))));
+    }
+}
+
+/**
+ * @brief Будит поток обработки, только если он действительно простаивает.
+ *
+ * Барьер упорядочивает публикацию сообщения и чтение флага workerIdle
+ * относительно аналогичной пары операций в waitForMessages(),
+ * поэтому пробуждение не может быть потеряно.
+ */
+void Logger::wakeWorker() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    WorkerWakeSignal& signal = *wakeSignal;
+    if (signal.idle.load(std::memory_order_relaxed) &&
+        signal.idle.exchange(false, std::memory_order_acq_rel)) {
+        signal.epoch.fetch_add(1, std::memory_order_release);
+        signal.epoch.notify_one();
+    }
+}
+
+/**
+ * @brief Ждёт публикации нового сообщения или сигнала выхода.
+ *
+ * Сначала, если позволяет стратегия, очереди опрашиваются без сна.
+ * Сон выполняется на счётчике epoch сигнала (futex / WaitOnAddress),
+ * производители обращаются к нему только когда установлен флаг idle,
+ * поэтому пока поток опрашивает очереди, они его не будят.
+ *
+ * @param options Параметры потока.
+ */
+void Logger::waitForMessages(const WorkerOptions& options) {
+    if (spinWait(options, [this]() { return hasWork() || exitFlag.load(std::memory_order_relaxed); })) return;
+
+    std::uint32_t epoch = ownSignal.epoch.load(std::memory_order_acquire);
+    ownSignal.idle.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (!hasWork() && !exitFlag.load(std::memory_order_relaxed)) {
+        ownSignal.epoch.wait(epoch, std::memory_order_acquire);
+    }
+    ownSignal.idle.store(false, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Есть ли у потока обработки работа: сообщения или невыполненный flush().
+ * @return true, если засыпать нельзя.
+ */
+bool Logger::hasWork() const {
+    return !buffersEmpty() ||
+        flushRequested.load(std::memory_order_acquire) != flushCompleted.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Проверяет, что во всех буферах потоков нет сообщений.
+ *
+ * Новый, ещё не попавший в снимок буфер считается непустым.
+ *
+ * @return true, если забирать нечего.
+ */
+bool Logger::buffersEmpty() const {
+    if (buffersChanged.load(std::memory_order_acquire)) return false;
+
+    for (const auto& buffer : workerBuffers) {
+        if (!buffer->queue.empty()) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Забирает сообщения из буферов всех потоков (не более MaxBatchSize).
+ *
+ * Опрос начинается каждый раз со следующего буфера, чтобы активный поток
+ * не вытеснял остальные. Пока есть неприменённый снимок настроек,
+ * из буферов извлекаются только сообщения, поставленные до его публикации. Собранные сообщения упорядочиваются
+ * по времени в batchOrder; порядок внутри одного потока сохраняется.
+ * Попутно по заполнению буферов обновляется множитель адаптивной выборки.
+ *
+ * @param batch Приёмник сообщений.
+ */
+void Logger::collectBatch(std::vector<LogMessage>& batch) {
+    if (buffersChanged.exchange(false, std::memory_order_acq_rel)) {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        workerBuffers = threadBuffers;
+    }
+
+    LogMessage msg;
+    std::size_t sources = 0;
+    std::size_t fullQuarters = 0;
+    std::size_t depth = 0;
+    std::size_t count = workerBuffers.size();
+    for (std::size_t i = 0; i < count && batch.size() < MaxBatchSize; ++i) {
+        RingBuffer<LogMessage>& queue = workerBuffers[(nextBufferIndex + i) % count]->queue;
+        std::size_t popped = queue.popPosition();
+        std::size_t queued = queueDepth(queue.pushPosition(), popped);
+        depth += queued;
+        fullQuarters = (std::max)(fullQuarters, queued * 4 / queue.capacity());
+        std::size_t before = batch.size();
+        std::size_t limit = collectLimit(*workerBuffers[(nextBufferIndex + i) % count]);
+        while (batch.size() < MaxBatchSize && queue.tryPopBefore(msg, limit)) {
+            batch.push_back(std::move(msg));
+        }
+        if (batch.size() != before) ++sources;
+    }
+    if (count != 0) nextBufferIndex = (nextBufferIndex + 1) % count;
+    if (depth > peakDepth.load(std::memory_order_relaxed)) peakDepth.store(depth, std::memory_order_relaxed);
+
+    if (sampleAdaptive.load(std::memory_order_relaxed)) {
+        // Каждая заполненная четверть самого полного буфера удваивает N выборки
+        auto shift = static_cast<std::uint32_t>((std::min)(fullQuarters, std::size_t(3)));
+        if (shift != sampleShift.load(std::memory_order_relaxed)) {
+            sampleShift.store(shift, std::memory_order_relaxed);
+        }
+    }
+
+    batchOrder.resize(batch.size());
+    for (std::uint32_t i = 0; i < batchOrder.size(); ++i) {
+        batchOrder[i] = i;
+    }
+    if (sources > 1) {
+        std::sort(batchOrder.begin(), batchOrder.end(), [&batch](std::uint32_t a, std::uint32_t b) {
+            return batch[a].time != batch[b].time ? batch[a].time < batch[b].time : a < b;
+            });
+    }
+}
+
+/**
+ * @brief Удаляет буферы завершившихся потоков, которые уже дочитаны.
+ *
+ * Флаг retired проверяется до пустоты буфера: поток устанавливает его
+ * после последней записи, поэтому пустой retired-буфер больше не пополнится.
+ * Счётчики буфера переносятся в retiredCounters под тем же мьютексом.
+ * Ячейка crashBuffers очищается до удаления буфера; если аварийная
+ * выгрузка уже началась, она могла успеть прочитать ячейку, и буферы
+ * не удаляются (обе стороны используют seq_cst, поэтому хотя бы одна
+ * видит запись другой).
+ */
+void Logger::reclaimRetiredBuffers() {
+    auto drained = [](const std::shared_ptr<ThreadBuffer>& buffer) {
+        return buffer->retired.load(std::memory_order_acquire) && buffer->queue.empty();
+        };
+    if (std::none_of(workerBuffers.begin(), workerBuffers.end(), drained)) return;
+
+    for (const auto& buffer : workerBuffers) {
+        if (drained(buffer) && buffer->crashSlot >= 0) {
+            crashBuffers[buffer->crashSlot].store(nullptr, std::memory_order_seq_cst);
+        }
+    }
+    if (crashInProgress.load(std::memory_order_seq_cst)) return;
+
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        for (const auto& buffer : workerBuffers) {
+            if (drained(buffer)) retiredCounters.merge(buffer->counters);
+        }
+        threadBuffers.erase(std::remove_if(threadBuffers.begin(), threadBuffers.end(), drained), threadBuffers.end());
+    }
+    workerBuffers.erase(std::remove_if(workerBuffers.begin(), workerBuffers.end(), drained), workerBuffers.end());
+    nextBufferIndex = 0;
+}
+
+/**
+ * @brief Форматирует пачку и передаёт её приёмникам.
+ *
+ * Сообщения форматируются один раз в непрерывный буфер; каждый приёмник
+ * получает его целиком и сам отбрасывает строки ниже своего уровня.
+ * Если текст не нужен ни одному приёмнику (например, только двоичный
+ * файл), форматирование пропускается. При сворачивании повторов
+ * сообщение, совпадающее с предыдущим записанным, только учитывается.
+ *
+ * @param batch Сообщения для записи.
+ */
+void Logger::writeBatch(const std::vector<LogMessage>& batch) {
+    std::uint64_t levels[LogLevelCount] = {};
+    for (const LogMessage& msg : batch) {
+        ++levels[static_cast<std::size_t>(msg.site->level)];
+    }
+    for (std::size_t i = 0; i < LogLevelCount; ++i) {
+        if (levels[i] != 0) addRelaxed(writtenCount[i], levels[i]);
+    }
+    if (activeSinks.empty()) return;
+
+    beginFormattedBatch();
+    bool collapse = workerConfig->collapseDuplicates;
+    for (std::uint32_t index : batchOrder) {
+        const LogMessage& msg = batch[index];
+        std::string_view payload = msg.payload.view();
+
+        if (collapse && msg.site == repeatSite && payload == repeatPayload) {
+            addRelaxed(collapsedCount);
+            if (repeatCount++ == 0) repeatSince = msg.time;
+            repeatLast = msg.time;
+            if (repeatLast - repeatSince >= workerConfig->repeatReportInterval) appendRepeatRecord();
+            continue;
+        }
+
+        appendRepeatRecord();
+        appendRecord(*msg.site, msg.time, payload);
+        if (collapse) {
+            repeatSite = msg.site;
+            repeatPayload.assign(payload);
+        }
+    }
+    if (!collapse) repeatSite = nullptr;
+
+    writeFormattedBatch();
+}
+
+/**
+ * @brief Начинает новую отформатированную пачку.
+ */
+void Logger::beginFormattedBatch() {
+    formattedBatch.clear();
+    syntheticPayloads.clear();
+    batchMaxLevel = LogLevel::TRACE;
+    batchNeedsText = std::any_of(activeSinks.begin(), activeSinks.end(),
+        [](const LogSink* sink) { return sink->needsText(); });
+}
+
+/**
+ * @brief Добавляет сообщение в отформатированную пачку.
+ * @param site Место вызова.
+ * @param time Момент вызова лога.
+ * @param payload Аргументы; должны жить до writeFormattedBatch().
+ */
+void Logger::appendRecord(const LogSite& site, std::chrono::system_clock::time_point time, std::string_view payload) {
+    std::size_t offset = formattedBatch.text.size();
+    if (batchNeedsText) {
+        formatLogMessage(site, time, payload, formattedBatch.text);
+        formattedBatch.text += '\n';
+    }
+    formattedBatch.records.push_back({ &site, time, payload });
+
+    formattedBatch.lines.push_back({ static_cast<std::uint32_t>(offset),
+        static_cast<std::uint32_t>(formattedBatch.text.size() - offset), site.level });
+    if (site.level < formattedBatch.minLevel) formattedBatch.minLevel = site.level;
+    if (site.level > batchMaxLevel) batchMaxLevel = site.level;
+}
+
+/**
+ * @brief Добавляет строку "last message repeated N times", если есть несообщённые повторы.
+ *
+ * Строка получает место вызова и уровень повторённого сообщения
+ * и время последнего повтора.
+ */
+void Logger::appendRepeatRecord() {
+    if (repeatCount == 0) return;
+
+    PayloadBuffer& note = syntheticPayloads.emplace_back();
+    ArgumentWriter writer(note);
+    writer.write(LogLiteral("last message repeated "));
+    writer.write(repeatCount);
+    writer.write(LogLiteral(" times"));
+    appendRecord(*repeatSite, repeatLast, note.view());
+    repeatCount = 0;
+}
+
+/**
+ * @brief Передаёт отформатированную пачку приёмникам.
+ */
+void Logger::writeFormattedBatch() {
+    if (formattedBatch.records.empty()) return;
+
+    for (LogSink* sink : activeSinks) {
+        if (!sink->diagnosticsEnabled()) {
+            sink->write(formattedBatch);
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        sink->write(formattedBatch);
+        sink->countWriteTime(std::chrono::steady_clock::now() - start);
+    }
+    sinksDirty = true;
+    flushSinks(batchMaxLevel >= workerConfig->flushLevel);
+}
+
+/**
+ * @brief Записывает отчёт о повторах отдельной пачкой.
+ *
+ * При простое отчёт пишется, только если повторы копятся дольше
+ * repeatReportInterval: иначе редкие одиночные повторы порождали бы
+ * по строке отчёта каждый.
+ *
+ * @param force Записать независимо от интервала (flush(), завершение).
+ */
+void Logger::flushRepeats(bool force) {
+    if (repeatCount == 0 || activeSinks.empty()) return;
+    if (!force && std::chrono::system_clock::now() - repeatSince < workerConfig->repeatReportInterval) return;
+
+    beginFormattedBatch();
+    appendRepeatRecord();
+    writeFormattedBatch();
+}
+
+/**
+ * @brief Записывает строку статистики отдельной пачкой, если истёк её период.
+ *
+ * Перед строкой пишется отчёт о несообщённых повторах, чтобы он
+ * не оказался после строки статистики и не отнёсся к ней.
+ */
+void Logger::reportStats() {
+    std::chrono::milliseconds interval = workerConfig->statsInterval;
+    if (interval.count() == 0 || activeSinks.empty()) return;
+
+    auto now = std::chrono::steady_clock::now();
+    if (lastStatsReport == std::chrono::steady_clock::time_point{}) {
+        lastStatsReport = now;
+        return;
+    }
+    if (now - lastStatsReport < interval) return;
+    lastStatsReport = now;
+
+    LoggerStats stats = getStats();
+    std::uint64_t enqueued = 0;
+    std::uint64_t written = 0;
+    for (std::size_t i = 0; i < LogLevelCount; ++i) {
+        enqueued += stats.enqueued[i];
+        written += stats.written[i];
+    }
+    const DropCounters& drops = stats.drops;
+
+    beginFormattedBatch();
+    appendRepeatRecord();
+    PayloadBuffer& payload = syntheticPayloads.emplace_back();
+    ArgumentWriter writer(payload);
+    writer.write(LogLiteral("logger stats"));
+    writer.write(kv("queue", stats.queueDepth));
+    writer.write(kv("peak", stats.peakQueueDepth));
+    writer.write(kv("enqueued", enqueued));
+    writer.write(kv("written", written));
+    writer.write(kv("dropped", drops.droppedNewest + drops.droppedOldest + drops.droppedBelowLevel + drops.rateLimited));
+    writer.write(kv("latency_p50_ns", stats.enqueueLatency.percentile(0.5)));
+    writer.write(kv("latency_p99_ns", stats.enqueueLatency.percentile(0.99)));
+    writer.write(kv("batch_p99", stats.batchSizes.percentile(0.99)));
+    appendRecord(StatsSite, std::chrono::system_clock::now(), payload.view());
+    writeFormattedBatch();
+}
+
+/**
+ * @brief Сбрасывает приёмники, если истёк интервал сброса.
+ * @param force Сбросить независимо от интервала.
+ */
+void Logger::flushSinks(bool force) {
+    if (!sinksDirty) return;
+
+    auto now = std::chrono::steady_clock::now();
+    if (force || now - lastFlush >= workerConfig->flushInterval) {
+        for (LogSink* sink : activeSinks) {
+            sink->flush();
+        }
+        lastFlush = now;
+        sinksDirty = false;
+    }
+}
+
+/**
+ * @brief Применяет опубликованные снимки настроек, сообщения до которых извлечены.
+ *
+ * Вызывается потоком обработки между пачками. Снимки применяются по порядку
+ * публикации; ближайший неприменённый остаётся в nextConfig, и collectBatch()
+ * не извлекает сообщения за его границей. Мьютекс очереди снимков
+ * удерживается только на время извлечения из неё.
+ */
+void Logger::refreshConfig() {
+    for (;;) {
+        if (nextConfig == nullptr) {
+            if (!configPending.load(std::memory_order_acquire)) return;
+            std::lock_guard<std::mutex> lock(pendingConfigsMutex);
+            if (pendingConfigs.empty()) return;
+            nextConfig = std::move(pendingConfigs.front());
+            pendingConfigs.pop_front();
+            configPending.store(!pendingConfigs.empty(), std::memory_order_release);
+        }
+
+        bool reached = std::all_of(nextConfig->boundary.begin(), nextConfig->boundary.end(), [](const auto& target) {
+            return target.first->queue.popPosition() >= target.second;
+            });
+        if (!reached) return;
+
+        std::shared_ptr<const LoggerConfig> latest = nextConfig->config;
+        nextConfig.reset();
+        applyConfig(std::move(latest));
+    }
+}
+
+/**
+ * @brief Граница извлечения из буфера, пока nextConfig не применён.
+ * @param buffer Буфер потока.
+ * @return Позиция записи буфера при публикации nextConfig; 0 для буферов,
+ *         созданных позже; без неприменённого снимка - без ограничения.
+ */
+std::size_t Logger::collectLimit(const ThreadBuffer& buffer) const {
+    if (nextConfig == nullptr) return (std::numeric_limits<std::size_t>::max)();
+    for (const auto& target : nextConfig->boundary) {
+        if (target.first.get() == &buffer) return target.second;
+    }
+    return 0;
+}
+
+/**
+ * @brief Переходит на снимок настроек.
+ *
+ * Приёмники старого снимка сбрасываются до того, как снимок будет отпущен;
+ * настройки файла применяются к встроенному приёмнику здесь же, поэтому
+ * файл никогда не открывается заново параллельно с записью в него.
+ *
+ * @param latest Новый снимок.
+ */
+void Logger::applyConfig(std::shared_ptr<const LoggerConfig> latest) {
+    if (latest == workerConfig) return;
+
+    flushSinks(true);
+
+    const LoggerConfig* previous = workerConfig.get();
+    LogFile& file = fileSink->file();
+    file.setBackend(latest->fileBackend, latest->segmentSize);
+    file.setIndexInterval(latest->fileIndexInterval);
+    if (fileSink->getFormat() != latest->fileFormat) fileSink->setFormat(latest->fileFormat);
+
+    RotationPolicy rotation = previous != nullptr ? previous->rotation : RotationPolicy{};
+    if (rotation.maxFileSize != latest->rotation.maxFileSize || rotation.interval != latest->rotation.interval ||
+        rotation.maxFiles != latest->rotation.maxFiles || rotation.compress != latest->rotation.compress) {
+        file.setRotation(latest->rotation);
+    }
+    if (!latest->filePath.empty() && (previous == nullptr || previous->fileGeneration != latest->fileGeneration)) {
+        file.open(latest->filePath, latest->fileAppend);
+    }
+    timestampCache.setPrecision(latest->timestampPrecision);
+
+    int target = static_cast<int>(latest->outputTarget);
+    activeSinks.clear();
+    if ((target & static_cast<int>(OutputTarget::Console)) != 0) activeSinks.push_back(consoleSink.get());
+    if ((target & static_cast<int>(OutputTarget::File)) != 0) activeSinks.push_back(fileSink.get());
+    for (const auto& sink : latest->sinks) activeSinks.push_back(sink.get());
+
+    workerConfig = std::move(latest);
+}
+
+/**
+ * @brief Повторяет запись у приёмников с неотправленными данными.
+ * @return true, если данные ещё остались.
+ */
+bool Logger::retryPendingSinks() {
+    bool pending = false;
+    for (LogSink* sink : activeSinks) {
+        if (!sink->hasPending()) continue;
+        sink->flush();
+        pending = pending || sink->hasPending();
+    }
+    return pending;
+}
+
+/**
+ * @brief Один шаг обработки очереди.
+ *
+ * Применяет снимки настроек, сообщения до которых уже записаны, забирает из буферов потоков доступные сообщения (не более MaxBatchSize)
+ * и записывает их одной пачкой. Если забирать нечего, сбрасывает
+ * приёмники, повторяет отложенную запись и освобождает буферы
+ * завершившихся потоков. Вызывается только одним потоком одновременно:
+ * собственным потоком логгера или потоком пула.
+ *
+ * @return Что было сделано.
+ */
+Logger::DrainResult Logger::drainOnce() {
+    drainingThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    refreshConfig();
+    collectBatch(workerBatch);
+
+    if (!workerBatch.empty()) {
+        addRelaxed(batchCount);
+        batchSizes.add(workerBatch.size());
+        writeBatch(workerBatch);
+        workerBatch.clear();
+        reportStats();
+        completeFlushRequest();
+        return DrainResult::Wrote;
+    }
+
+    flushRepeats(false);
+    reportStats();
+    flushSinks(true);
+    completeFlushRequest();
+    bool pending = retryPendingSinks();
+
+    reclaimRetiredBuffers();
+    return pending ? DrainResult::Pending : DrainResult::Idle;
+}
+
+/**
+ * @brief Обрабатывает очередь до конца.
+ *
+ * Используется деструктором, когда поток обработки уже не обращается
+ * к логгеру; в конце пишет отчёт о повторах и сбрасывает приёмники.
+ */
+void Logger::drainAll() {
+    while (drainOnce() == DrainResult::Wrote || !buffersEmpty()) {
+    }
+    flushRepeats(true);
+    flushSinks(true);
+}
+
+/**
+ * @brief Функция собственного потока обработки.
+ *
+ * Повторяет drainOnce(), пока есть сообщения, и ждёт появления
+ * новых сообщений или сигнала выхода. Новые ядра и приоритет из
+ * снимка настроек поток применяет к себе после шага обработки.
+ */
+void Logger::workerFunc() {
+    WorkerOptions applied;
+    for (;;) {
+        DrainResult result = drainOnce();
+        if (workerConfig->worker != applied) {
+            applied = workerConfig->worker;
+            applyThreadOptions(applied);
+        }
+        if (result == DrainResult::Wrote) continue;
+
+        // Выход только после того, как все буферы опустели
+        if (exitFlag.load(std::memory_order_acquire) && buffersEmpty()) {
+            break;
+        }
+        if (result == DrainResult::Pending) {
+            // Приёмнику есть что дописать (например, сеть недоступна): не засыпаем надолго
+            std::this_thread::sleep_for(PendingRetryInterval);
+        }
+        else {
+            waitForMessages(applied);
+        }
     }
 }
@@ -4,10 +4,20 @@
 #include <fstream>
 #include <mutex>
 #include <sstream>
-#include <queue>
 #include <thread>
-#include <condition_variable>
 #include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <deque>
+#include <unordered_map>
+
+#include "LogFile.h"
+#include "LogFormat.h"
+#include "LogSink.h"
+#include "LogStats.h"
+#include "RingBuffer.h"
 
 /**
  * @brief Конвертирует строку в кодировке UTF-8 в широкую строку (wstring).
@@ -16,29 +26,149 @@
  */
 std::wstring utf8_to_wstring(const std::string& utf8Str);
 
-/**
- * @enum LogLevel
- * @brief Уровни логирования.
- */
-enum class LogLevel {
-    TRACE,    /**< Трассировка */
-    DEBUG,    /**< Отладка */
-    INFO,     /**< Информация */
-    WARNING,  /**< Предупреждение */
-    ERROR_,   /**< Ошибка */
-    CRITICAL  /**< Критическая ошибка */
-};
-
 /**
  * @enum OutputTarget
  * @brief Места вывода логов.
  */
 enum class OutputTarget {
+    None = 0,       /**< Только приёмники, добавленные через addSink() */
     Console = 1,    /**< Вывод в консоль */
     File = 2,       /**< Вывод в файл */
     Both = Console | File  /**< Вывод и в консоль, и в файл */
 };
 
+/**
+ * @def LOGGER_QUEUE_CAPACITY
+ * @brief Ёмкость буфера сообщений одного потока по умолчанию (в том числе для LoggerInstance).
+ *
+ * Ёмкость задаётся на поток, а не на всю очередь: каждый поток, писавший
+ * в логгер, держит собственный буфер из стольких ячеек (около 320 байт
+ * каждая), поэтому память растёт как потоки x логгеры. 256 ячеек - около
+ * 80 КБ на поток и логгер.
+ */
+#ifndef LOGGER_QUEUE_CAPACITY
+#define LOGGER_QUEUE_CAPACITY 256
+#endif
+
+class LoggerWorkerPool;
+
+/**
+ * @struct WorkerWakeSignal
+ * @brief Пробуждение потока обработки: флаг простоя и счётчик для atomic::wait.
+ *
+ * У логгера с собственным потоком свой сигнал, логгеры одного потока
+ * пула LoggerWorkerPool делят сигнал этого потока.
+ */
+struct WorkerWakeSignal {
+    alignas(CacheLineSize) std::atomic<bool> idle{ false };  /**< Поток обработки ждёт пробуждения */
+    std::atomic<std::uint32_t> epoch{ 0 };  /**< Счётчик пробуждений */
+};
+
+/**
+ * @enum WorkerPriority
+ * @brief Приоритет потока обработки.
+ */
+enum class WorkerPriority {
+    Lowest,       /**< THREAD_PRIORITY_LOWEST */
+    BelowNormal,  /**< THREAD_PRIORITY_BELOW_NORMAL */
+    Normal,       /**< Приоритет по умолчанию */
+    AboveNormal,  /**< THREAD_PRIORITY_ABOVE_NORMAL */
+    Highest       /**< THREAD_PRIORITY_HIGHEST */
+};
+
+/**
+ * @enum WaitStrategy
+ * @brief Как простаивающий поток обработки ждёт новых сообщений.
+ */
+enum class WaitStrategy {
+    Sleep,          /**< Сразу засыпать; производитель будит поток системным вызовом */
+    SpinThenSleep,  /**< Опрашивать очереди spinTime, затем заснуть */
+    BusyPoll        /**< Никогда не засыпать: поток занимает ядро, производители не делают системных вызовов */
+};
+
+/**
+ * @struct WorkerOptions
+ * @brief Параметры потока обработки: ядра, приоритет, способ ожидания.
+ */
+struct WorkerOptions {
+    std::uint64_t affinityMask = 0;   /**< Маска ядер (бит i - ядро i); 0 - все ядра процесса */
+    WorkerPriority priority = WorkerPriority::Normal;  /**< Приоритет */
+    WaitStrategy wait = WaitStrategy::Sleep;           /**< Способ ожидания */
+    std::chrono::microseconds spinTime{ 50 };          /**< Время опроса перед сном для SpinThenSleep */
+
+    bool operator==(const WorkerOptions&) const = default;
+};
+
+/**
+ * @struct LoggerConfig
+ * @brief Неизменяемый снимок настроек вывода логгера.
+ *
+ * Методы настройки копируют текущий снимок, изменяют копию и публикуют
+ * её одной атомарной заменой указателя. Поток обработки применяет новый
+ * снимок между пачками, как только запишет сообщения, поставленные
+ * до публикации, и держит его, пока пишет пачку, поэтому ни производители,
+ * ни поток обработки, ни сам настраивающий поток никого не ждут,
+ * а удалённый приёмник живёт, пока поток обработки не отпустит старый снимок.
+ *
+ * Уровень логирования, режим форматирования и политика переполнения
+ * читаются производителями при каждом вызове и остаются отдельными
+ * атомарными переменными логгера.
+ */
+struct LoggerConfig {
+    OutputTarget outputTarget = OutputTarget::Console;  /**< Встроенные приёмники */
+    std::vector<std::shared_ptr<LogSink>> sinks;  /**< Приёмники, добавленные через addSink() */
+    FormatTemplate formatTemplate;                /**< Разобранный шаблон форматирования */
+    LineFormat lineFormat = LineFormat::Template; /**< Вид строки лога */
+    TimestampPrecision timestampPrecision = TimestampPrecision::Seconds;  /**< Точность временной метки */
+    std::chrono::milliseconds flushInterval{ 0 };  /**< Интервал сброса приёмников */
+    LogLevel flushLevel = LogLevel::CRITICAL;      /**< Уровень немедленного сброса */
+    bool collapseDuplicates = false;               /**< Сворачивать подряд идущие одинаковые сообщения */
+    std::chrono::milliseconds repeatReportInterval{ 30000 };  /**< Как часто сообщать о повторах при непрерывном потоке */
+    std::chrono::milliseconds statsInterval{ 0 };  /**< Период строки статистики; 0 - не писать */
+    WorkerOptions worker;                          /**< Параметры собственного потока обработки */
+
+    std::string filePath;           /**< Файл лога; пустая строка - файл не открывается */
+    bool fileAppend = true;         /**< Дописывать файл или перезаписывать */
+    std::uint64_t fileGeneration = 0;  /**< Номер вызова init(): файл открывается заново при его смене */
+    RotationPolicy rotation;        /**< Условия ротации */
+    FileBackend fileBackend = FileBackend::Stream;  /**< Способ записи новых файлов */
+    std::uint64_t segmentSize = DefaultMappedSegmentSize;  /**< Шаг увеличения отображаемого файла */
+    FileFormat fileFormat = FileFormat::Text;  /**< Формат новых файлов */
+    std::uint64_t fileIndexInterval = 0;  /**< Размер блока индекса времени; 0 - без индекса */
+};
+
+/**
+ * @struct SinkStats
+ * @brief Счётчики одного приёмника в снимке статистики логгера.
+ */
+struct SinkStats {
+    std::shared_ptr<LogSink> sink;  /**< Приёмник */
+    SinkCounters counters;          /**< Его диагностические счётчики */
+};
+
+/**
+ * @struct LoggerStats
+ * @brief Снимок статистики логгера (Logger::getStats()).
+ *
+ * Счётчики производителей ведутся в буфере каждого потока, счётчики
+ * записи - потоком обработки, поэтому сбор статистики не добавляет
+ * общих изменяемых кэш-линий. Снимок не атомарен: значения разных
+ * счётчиков могут относиться к немного разным моментам.
+ */
+struct LoggerStats {
+    std::size_t threads = 0;          /**< Потоков, у которых есть буфер */
+    std::size_t queueDepth = 0;       /**< Сообщений во всех буферах сейчас */
+    std::size_t peakQueueDepth = 0;   /**< Наибольшая глубина, которую видел поток обработки */
+    std::uint64_t enqueued[LogLevelCount] = {};  /**< Поставлено в очередь по уровням */
+    std::uint64_t written[LogLevelCount] = {};   /**< Обработано потоком обработки по уровням (включая свёрнутые повторы) */
+    std::uint64_t collapsed = 0;      /**< Из них свёрнуто как повторы */
+    std::uint64_t batches = 0;        /**< Записанных пачек */
+    DropCounters drops;               /**< Отброшенные сообщения */
+    LatencyHistogram enqueueLatency;  /**< Длительность log() в потоке вызова, нс (каждый 16-й вызов) */
+    LatencyHistogram batchSizes;      /**< Размеры пачек, сообщений */
+    std::vector<SinkStats> sinks;     /**< Активные приёмники; bytes и writeLatency - при включённой диагностике */
+};
+
 /**
  * @class Logger
  * @brief Класс для асинхронного многопоточного логирования с поддержкой пользовательских шаблонов.
@@ -46,21 +176,57 @@ enum class OutputTarget {
  * Позволяет логировать сообщения разных уровней с указанием файла и строки,
  * поддерживает вывод в консоль, файл или оба варианта,
  * а также форматирование сообщений по настраиваемому шаблону.
+ *
+ * Каждый поток при первом вызове лога получает собственный кольцевой буфер,
+ * поэтому производители не делят между собой ни одной изменяемой кэш-линии.
+ * Поток обработки опрашивает буферы всех потоков и объединяет сообщения
+ * пачки в порядке временных меток.
+ *
+ * Логгеров может быть несколько: у каждого своя очередь, свои приёмники
+ * и свой поток обработки либо общий поток из LoggerWorkerPool.
+ * Именованные логгеры хранит LoggerRegistry, макросы LOGx_TO пишут в
+ * указанный логгер, макросы LOGx - в LoggerInstance.
  */
 class Logger {
 public:
     /**
      * @brief Конструктор. Запускает поток обработки логов.
+     *
+     * Очередь логгера - это отдельные буферы потоков-производителей,
+     * поэтому queueCapacity ограничивает буфер каждого потока, а общая
+     * вместимость равна queueCapacity, умноженной на число пишущих потоков.
+     *
+     * @param queueCapacity Максимальное число сообщений в буфере одного потока
+     *        (округляется вверх до степени двойки).
+     */
+    explicit Logger(std::size_t queueCapacity = LOGGER_QUEUE_CAPACITY);
+
+    /**
+     * @brief Конструктор логгера, обрабатываемого общим пулом потоков.
+     *
+     * Собственный поток не создаётся: сообщения забирает один из потоков
+     * пула, поочерёдно с другими логгерами этого потока, поэтому шумный
+     * логгер не задерживает остальные дольше одной пачки.
+     *
+     * @param queueCapacity Максимальное число сообщений в буфере одного потока.
+     * @param pool Пул потоков обработки; живёт, пока жив хотя бы один его логгер.
      */
-    Logger();
+    Logger(std::size_t queueCapacity, std::shared_ptr<LoggerWorkerPool> pool);
 
     /**
-     * @brief Деструктор. Завершает поток обработки и закрывает файл.
+     * @brief Деструктор. Дописывает очередь, завершает поток обработки и закрывает файл.
      */
     ~Logger();
 
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
     /**
      * @brief Инициализация логгера.
+     *
+     * Уровень меняется сразу, файл открывает поток обработки перед
+     * следующей пачкой (или flush()); каталог файла создаётся в вызывающем потоке.
+     *
      * @param level Минимальный уровень логирования.
      * @param filePath Имя файла лога.
      * @param append Добавлять в конец файла (true) или перезаписывать (false).
@@ -74,12 +240,351 @@ public:
      */
     void setLogLevel(LogLevel level);
 
+    /**
+     * @brief Переопределяет минимальный уровень для одного исходного файла.
+     *
+     * Файл сопоставляется по окончанию пути, начиная с границы каталога:
+     * "Network.cpp" совпадёт с "C:\src\Network.cpp", но не с "MyNetwork.cpp".
+     *
+     * @param file Имя или окончание пути исходного файла.
+     * @param level Минимальный уровень для этого файла.
+     */
+    void setFileLogLevel(const std::string& file, LogLevel level);
+
+    /**
+     * @brief Удаляет все переопределения уровня по файлам.
+     */
+    void clearFileLogLevels();
+
+    /**
+     * @brief Проверяет, будет ли записано сообщение указанного уровня.
+     *
+     * Без переопределений по файлам это одно relaxed-чтение атомарного уровня.
+     * Иначе уровень файла ищется без блокировок в небольшой таблице
+     * по значению указателя __FILE__.
+     *
+     * @param level Уровень сообщения.
+     * @param file Имя файла вызова (__FILE__) или nullptr.
+     * @return true, если уровень не ниже действующего.
+     */
+    bool isEnabled(LogLevel level, const char* file = nullptr) const {
+        if (file == nullptr || !hasFileLevels.load(std::memory_order_relaxed)) {
+            return level >= currentLevel.load(std::memory_order_relaxed);
+        }
+        return level >= fileLevel(file);
+    }
+
+    /**
+     * @brief Проверяет, будет ли записано сообщение места вызова.
+     * @param site Метаданные места вызова.
+     * @return true, если уровень места вызова не ниже действующего.
+     */
+    bool isEnabled(const LogSite& site) const {
+        return isEnabled(site.level, site.file);
+    }
+
+    /**
+     * @brief Решает, пишется ли сообщение места вызова: выборка и ограничение частоты.
+     *
+     * Без выборки и ограничения - два relaxed-чтения одной кэш-линии.
+     * Выборка (setSampling()) стоит одного fetch_add счётчика места вызова
+     * или хеша ключа setSamplingKey(); ограничение частоты - чтения
+     * и compare_exchange состояния места, отброшенное им сообщение
+     * учитывается в счётчике места и в DropCounters::rateLimited.
+     *
+     * @param site Метаданные места вызова.
+     * @return 0, если сообщение отброшено, иначе частота выборки N
+     *         (сообщение представляет N сообщений; 1 - без выборки).
+     */
+    std::uint32_t admit(const LogSite& site) {
+        std::uint32_t sampleRate = 1;
+        if (static_cast<int>(site.level) <= sampledLevel.load(std::memory_order_relaxed)) {
+            sampleRate = sampleBase.load(std::memory_order_relaxed) << sampleShift.load(std::memory_order_relaxed);
+            if (!sampleHit(site, sampleRate)) return 0;
+        }
+
+        std::int64_t interval = rateInterval.load(std::memory_order_relaxed);
+        if (interval == 0 || site.state == nullptr) return sampleRate;
+        return admitLimited(*site.state, interval) ? sampleRate : 0;
+    }
+
     /**
      * @brief Устанавливает место вывода логов.
-     * @param target Место вывода (консоль, файл, оба).
+     *
+     * Включает встроенные приёмники консоли и файла. Приёмники,
+     * добавленные через addSink(), получают сообщения независимо от target.
+     *
+     * @param target Место вывода (консоль, файл, оба или ни один из встроенных).
      */
     void setOutputTarget(OutputTarget target);
 
+    /**
+     * @brief Добавляет приёмник сообщений.
+     * @param sink Приёмник; вызывается потоком обработки для каждой пачки.
+     */
+    void addSink(std::shared_ptr<LogSink> sink);
+
+    /**
+     * @brief Удаляет приёмник, добавленный через addSink().
+     *
+     * Пачка, которую поток обработки пишет в момент вызова, ещё может
+     * попасть в приёмник; после flush() он гарантированно не используется.
+     *
+     * @param sink Приёмник.
+     */
+    void removeSink(const std::shared_ptr<LogSink>& sink);
+
+    /**
+     * @brief Встроенный приёмник консоли (например, для setLevel()).
+     */
+    std::shared_ptr<ConsoleSink> getConsoleSink() const { return consoleSink; }
+
+    /**
+     * @brief Встроенный приёмник файла, которым управляют init() и setRotation().
+     */
+    std::shared_ptr<FileSink> getFileSink() const { return fileSink; }
+
+    /**
+     * @brief Устанавливает точность временной метки {t}.
+     *
+     * Место вызова лога снимает только значение часов, метка
+     * форматируется потоком обработки с кэшированием префикса по секундам.
+     *
+     * @param precision Секунды, миллисекунды или микросекунды.
+     */
+    void setTimestampPrecision(TimestampPrecision precision);
+
+    /**
+     * @brief Устанавливает интервал сброса файла лога на диск.
+     *
+     * При нулевом интервале файл сбрасывается после каждой пачки сообщений.
+     * Независимо от интервала файл сбрасывается, когда очередь опустела.
+     *
+     * @param interval Минимальный интервал между сбросами под нагрузкой.
+     */
+    void setFlushInterval(std::chrono::milliseconds interval);
+
+    /**
+     * @brief Дожидается записи всех сообщений, поставленных в очередь до вызова.
+     *
+     * Возвращает управление, когда поток обработки записал эти сообщения
+     * и сбросил приёмники (данные переданы ОС и переживут аварийное
+     * завершение процесса). Сообщения, поставленные после вызова,
+     * не задерживают возврат. Нельзя вызывать из приёмника.
+     */
+    void flush();
+
+    /**
+     * @brief То же, что flush(), но не дольше timeout.
+     * @param timeout Наибольшее время ожидания.
+     * @return false, если время истекло раньше.
+     */
+    bool flush(std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Задаёт уровень, сообщения которого сбрасываются сразу.
+     *
+     * Пачка, содержащая сообщение этого уровня или выше, сбрасывается
+     * независимо от setFlushInterval(). По умолчанию LogLevel::CRITICAL.
+     *
+     * @param level Уровень немедленного сброса.
+     */
+    void setFlushLevel(LogLevel level);
+
+    /**
+     * @brief Устанавливает обработчики сбоев, выгружающие очереди всех логгеров.
+     *
+     * Перехватываются необработанные исключения SEH (Windows) и сигналы
+     * SIGSEGV, SIGILL, SIGFPE, SIGABRT. Обработчик сначала просит потоки обработки
+     * дописать очереди и сбросить приёмники; если за отведённое время этого
+     * не случилось (или сбой произошёл в самом потоке обработки), оставшиеся
+     * сообщения форматируются без выделения памяти (formatEmergencyRecord)
+     * и дописываются в файл лога прямыми системными вызовами. Затем
+     * вызывается прежний обработчик. Позволяет не сбрасывать файл после
+     * каждой пачки, не теряя последние строки перед сбоем.
+     *
+     * @param budget Наибольшее время выгрузки всех логгеров.
+     */
+    static void installCrashHandler(std::chrono::milliseconds budget = std::chrono::milliseconds(500));
+
+    /**
+     * @brief Аварийно выгружает очереди всех живых логгеров (для собственных обработчиков сбоев).
+     *
+     * Повторные и одновременные вызовы ничего не делают.
+     *
+     * @param budget Наибольшее время выгрузки.
+     */
+    static void emergencyFlushAll(std::chrono::milliseconds budget);
+
+    /**
+     * @brief Устанавливает условия ротации файла лога.
+     *
+     * Файл сменяется между пачками сообщений, когда следующая пачка не
+     * помещается в maxFileSize или наступила граница interval. Старые файлы
+     * сверх maxFiles удаляются фоновым потоком. При policy.compress закрытые
+     * файлы сжимаются в "имя.log.gz" потоком с пониженным приоритетом.
+     *
+     * @param policy Условия ротации.
+     */
+    void setRotation(const RotationPolicy& policy);
+
+    /**
+     * @brief Выбирает способ записи файла лога.
+     *
+     * FileBackend::MemoryMapped копирует пачки прямо в отображённый в память
+     * файл, который растёт сегментами segmentSize. Настройка применяется
+     * к файлам, открытым после вызова, поэтому её нужно задавать до init().
+     *
+     * @param backend Поток или отображение в память.
+     * @param segmentSize Шаг увеличения отображаемого файла в байтах.
+     */
+    void setFileBackend(FileBackend backend, std::uint64_t segmentSize = DefaultMappedSegmentSize);
+
+    /**
+     * @brief Выбирает формат файла лога.
+     *
+     * FileFormat::Binary записывает место вызова, время и типизированные
+     * аргументы без форматирования; имена файлов и строки LogLiteral
+     * попадают в файл один раз. Текст восстанавливает LogDecoder с тем же шаблоном.
+     * Наибольший выигрыш даёт вместе с FormattingMode::Deferred: в режиме
+     * Immediate текст сообщения уже собран и хранится строкой.
+     * Настройка применяется к файлам, открытым после вызова.
+     *
+     * @param format Текстовый или двоичный формат.
+     */
+    void setFileFormat(FileFormat format);
+
+    /**
+     * @brief Включает индекс времени рядом с файлом лога.
+     *
+     * Рядом с каждым файлом ("app.log.idx") для каждых blockSize байт
+     * записывается смещение блока, диапазон времени и уровни его сообщений.
+     * LogQuery по индексу читает только блоки, попадающие в запрошенный
+     * интервал времени и уровень, а не весь файл. Индекс сменяется
+     * и удаляется вместе с файлом при ротации. Настройка применяется
+     * к файлам, открытым после вызова, поэтому её нужно задавать до init().
+     *
+     * @param blockSize Размер блока в байтах; 0 отключает индекс.
+     */
+    void setFileIndex(std::uint64_t blockSize = DefaultIndexInterval);
+
+    /**
+     * @brief Устанавливает политику поведения при заполненной очереди.
+     * @param policy Политика переполнения.
+     * @param minKeptLevel Для DropBelowLevel: сообщения этого уровня и выше не отбрасываются.
+     */
+    void setBackpressurePolicy(BackpressurePolicy policy, LogLevel minKeptLevel = LogLevel::ERROR_);
+
+    /**
+     * @brief Ограничивает частоту сообщений каждого места вызова.
+     *
+     * Каждое место вызова (раскрытие макроса LOGx или пара файл-строка
+     * для log()) получает собственное ведро токенов: burst сообщений
+     * подряд, затем не чаще messagesPerSecond. Лишние сообщения
+     * отбрасываются до вычисления аргументов; следующее пропущенное
+     * сообщение места получает поле kv("suppressed", N) с их числом.
+     *
+     * @param messagesPerSecond Средняя частота; 0 снимает ограничение.
+     * @param burst Сколько сообщений можно записать подряд.
+     */
+    void setRateLimit(double messagesPerSecond, std::uint32_t burst = 10);
+
+    /**
+     * @brief Включает выборку 1 из N для сообщений низких уровней.
+     *
+     * Решение принимается в макросе до вычисления аргументов: по счётчику
+     * места вызова (каждое N-е сообщение места) или, если поток задал ключ
+     * setSamplingKey(), по хешу ключа - тогда запрос либо попадает в выборку
+     * целиком, либо не попадает. При adaptive N удваивается, когда буферы
+     * потоков заполнены больше чем на четверть, и так до 8N при заполнении
+     * от трёх четвертей; выборки при большем N вложены в выборки при меньшем.
+     * Каждая записанная выборкой запись содержит поле sample_rate.
+     *
+     * @param maxLevel Наибольший уровень, к которому применяется выборка (обычно DEBUG).
+     * @param oneIn Базовое N; 0 или 1 выключает выборку.
+     * @param adaptive Увеличивать N при заполнении очереди.
+     */
+    void setSampling(LogLevel maxLevel, std::uint32_t oneIn, bool adaptive = true);
+
+    /**
+     * @brief Задаёт ключ выборки текущего потока (например, идентификатор запроса).
+     * @param key Ключ; 0 - выборка по счётчику места вызова.
+     */
+    static void setSamplingKey(std::uint64_t key);
+
+    /**
+     * @brief Включает сворачивание повторяющихся сообщений.
+     *
+     * Поток обработки не пишет сообщение, если оно совпадает с предыдущим
+     * записанным (то же место вызова и те же аргументы), а считает повторы.
+     * Строка "last message repeated N times" с уровнем и местом повторённого
+     * сообщения пишется перед следующим другим сообщением, при flush()
+     * и завершении логгера, а пока повторы продолжаются - не реже reportInterval.
+     *
+     * @param enabled Включить или выключить.
+     * @param reportInterval Наибольшее время между отчётами о повторах.
+     */
+    void setDuplicateCollapsing(bool enabled, std::chrono::milliseconds reportInterval = std::chrono::seconds(30));
+
+    /**
+     * @brief Возвращает счётчики отброшенных сообщений.
+     * @return Снимок счётчиков по политикам.
+     */
+    DropCounters getDropCounters() const;
+
+    /**
+     * @brief Возвращает снимок статистики.
+     *
+     * Встроенные приёмники ведут диагностику всегда, для добавленных
+     * через addSink() её включает LogSink::enableDiagnostics(true).
+     *
+     * @return Глубина очереди, счётчики по уровням, потери, гистограммы.
+     */
+    LoggerStats getStats() const;
+
+    /**
+     * @brief Включает периодическую строку статистики в самом логе.
+     *
+     * Поток обработки не чаще interval пишет сообщение INFO "logger stats"
+     * с полями queue, peak, enqueued, written, dropped, latency_p50_ns,
+     * latency_p99_ns, batch_p99. Пока очередь пуста, поток обработки
+     * спит, и строка появляется со следующей пачкой.
+     *
+     * @param interval Период; 0 выключает.
+     */
+    void setStatsInterval(std::chrono::milliseconds interval);
+
+    /**
+     * @brief Задаёт ядра, приоритет и способ ожидания собственного потока обработки.
+     *
+     * Поток применяет параметры к себе перед следующим ожиданием. Закрепив
+     * поток на отдельном ядре с WaitStrategy::BusyPoll, можно обменять это
+     * ядро на наименьшую задержку от вызова лога до записи: поток
+     * не засыпает, а производители никогда не будят его системным вызовом.
+     * Для логгеров пула параметры задаются при создании LoggerWorkerPool
+     * и здесь не действуют.
+     *
+     * @param options Параметры потока.
+     */
+    void setWorkerOptions(const WorkerOptions& options);
+
+    /**
+     * @brief Ёмкость буфера сообщений одного потока.
+     */
+    std::size_t queueCapacity() const { return threadBufferCapacity; }
+
+    /**
+     * @brief Устанавливает режим формирования текста сообщений.
+     *
+     * В режиме Deferred вариативный log() сериализует аргументы в очередь
+     * (целые, double, копии строк, LogLiteral - без копирования),
+     * а форматирование выполняется потоком обработки.
+     * Манипуляторы потока (std::hex и т.п.) в этом режиме не поддерживаются.
+     *
+     * @param mode Режим форматирования.
+     */
+    void setFormattingMode(FormattingMode mode);
+
     /**
      * @brief Устанавливает пользовательский шаблон форматирования лог-сообщений.
      *
@@ -94,65 +599,471 @@ public:
      */
     void setFormatTemplate(const std::string& formatTemplate);
 
+    /**
+     * @brief Выбирает вид строки лога.
+     *
+     * LineFormat::JsonLines пишет каждое сообщение одним JSON-объектом
+     * с полями time, level, file, line, message; поля kv() становятся
+     * свойствами объекта с типизированными значениями. Шаблон
+     * форматирования в этом режиме не используется.
+     *
+     * @param format Вид строки.
+     */
+    void setLineFormat(LineFormat format);
+
+    /**
+     * @brief Текущий снимок настроек вывода.
+     * @return Снимок; остаётся неизменным после последующих настроек.
+     */
+    std::shared_ptr<const LoggerConfig> getConfig() const { return config.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Изменяет несколько настроек одним снимком.
+     *
+     * Поток обработки увидит либо все изменения, либо ни одного:
+     * logger.updateConfig([](LoggerConfig& c) { c.sinks.clear(); c.lineFormat = LineFormat::JsonLines; }).
+     * Вместе со снимком запоминаются позиции записи буферов потоков:
+     * сообщения, поставленные до вызова, записываются по прежним
+     * настройкам, а следующие - по новым. Вызов не ждёт потока обработки.
+     * Чтобы дождаться применения снимка (например, открытия файла),
+     * достаточно вызвать flush().
+     *
+     * @tparam Mutator Вызываемый объект void(LoggerConfig&).
+     * @param mutate Изменяет копию текущего снимка.
+     */
+    template<typename Mutator>
+    void updateConfig(Mutator&& mutate) {
+        std::lock_guard<std::mutex> lock(configMutex);
+        auto next = std::make_shared<LoggerConfig>(*config.load(std::memory_order_relaxed));
+        mutate(*next);
+        publishConfig(std::move(next));
+    }
+
     /**
      * @brief Логирует сообщение с указанным уровнем, файлом и строкой.
      * @param level Уровень логирования.
      * @param message Текст сообщения.
-     * @param file Имя файла, откуда вызван лог.
+     * @param file Имя файла, откуда вызван лог (__FILE__ или другая строка, неизменная
+     *        до конца работы логгера: место вызова ищется по указателю).
      * @param line Номер строки в файле.
      */
     void log(LogLevel level, const std::string& message,
-        const std::string& file, int line);
+        const char* file, int line);
 
     /**
      * @brief Шаблонный метод для логирования с произвольным количеством параметров.
      * @tparam Args Типы параметров.
      * @param level Уровень логирования.
-     * @param file Имя файла, откуда вызван лог.
+     * @param file Имя файла, откуда вызван лог (__FILE__ или другая строка, неизменная
+     *        до конца работы логгера: место вызова ищется по указателю).
      * @param line Номер строки.
      * @param args Параметры для формирования сообщения.
      */
     template<typename... Args>
-    void log(LogLevel level, const std::string& file, int line, Args&&... args) {
-        std::ostringstream oss;
-        (oss << ... << std::forward<Args>(args));
-        log(level, oss.str(), file, line);
+    void log(LogLevel level, const char* file, int line, Args&&... args) {
+        if (!isEnabled(level, file)) return;
+        const LogSite& site = internSite(level, file, line);
+        if (std::uint32_t sampleRate = admit(site)) {
+            logSampled(site, sampleRate, std::forward<Args>(args)...);
+        }
+    }
+
+    /**
+     * @brief Логирует сообщение статического места вызова.
+     *
+     * Ни уровень, ни выборка, ни ограничение частоты не проверяются:
+     * вызывающий код сам решает, вызывать ли isEnabled(site) и admit(site).
+     *
+     * @tparam Args Типы параметров.
+     * @param site Метаданные места вызова со статическим временем жизни.
+     * @param args Параметры для формирования сообщения.
+     */
+    template<typename... Args>
+    void log(const LogSite& site, Args&&... args) {
+        logSampled(site, 1, std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Логирует сообщение, прошедшее admit() (используется макросами LOGx).
+     *
+     * При частоте выборки больше 1 запись получает поле kv("sample_rate", N),
+     * чтобы при анализе можно было умножить на него число сообщений.
+     *
+     * @tparam Args Типы параметров.
+     * @param site Метаданные места вызова со статическим временем жизни.
+     * @param sampleRate Результат admit(site).
+     * @param args Параметры для формирования сообщения.
+     */
+    template<typename... Args>
+    void logSampled(const LogSite& site, std::uint32_t sampleRate, Args&&... args) {
+        LogMessage msg;
+        msg.site = &site;
+        msg.time = std::chrono::system_clock::now();
+
+        ArgumentWriter writer(msg.payload);
+        if constexpr (HasLogFields<Args...>) {
+            // Поля kv() имеют смысл только в типизированном виде.
+            (writer.write(std::forward<Args>(args)), ...);
+        }
+        else if (formattingMode.load(std::memory_order_relaxed) == FormattingMode::Deferred) {
+            (writer.write(std::forward<Args>(args)), ...);
+        }
+        else {
+            writer.writeStreamed(std::forward<Args>(args)...);
+        }
+        if (site.state != nullptr && site.state->suppressed.load(std::memory_order_relaxed) != 0) {
+            std::uint32_t suppressed = site.state->suppressed.exchange(0, std::memory_order_relaxed);
+            writer.write(kv("suppressed", suppressed));
+        }
+        if (sampleRate > 1) {
+            writer.write(kv("sample_rate", sampleRate));
+        }
+        submit(std::move(msg));
+    }
+
+    /**
+     * @brief Логирует замер интервала, прошедший admit() (используется LogScope).
+     *
+     * Сообщение всегда типизированное, независимо от setFormattingMode():
+     * имя (литерал, без копирования) и ArgType::Span с началом, концом
+     * и номером потока. Текст длительности или событие трассировки
+     * формирует поток обработки. Время сообщения - момент конца замера.
+     *
+     * @param site Метаданные места вызова со статическим временем жизни.
+     * @param sampleRate Результат admit(site).
+     * @param name Имя замера.
+     * @param start Начало, наносекунды steady_clock.
+     * @param end Конец, наносекунды steady_clock.
+     */
+    void logSpan(const LogSite& site, std::uint32_t sampleRate, LogLiteral name, std::int64_t start, std::int64_t end) {
+        LogMessage msg;
+        msg.site = &site;
+        msg.time = std::chrono::system_clock::now();
+
+        ArgumentWriter writer(msg.payload);
+        writer.write(name);
+        writer.writeSpan(start, end, platform::currentThreadId());
+        if (site.state != nullptr && site.state->suppressed.load(std::memory_order_relaxed) != 0) {
+            std::uint32_t suppressed = site.state->suppressed.exchange(0, std::memory_order_relaxed);
+            writer.write(kv("suppressed", suppressed));
+        }
+        if (sampleRate > 1) {
+            writer.write(kv("sample_rate", sampleRate));
+        }
+        submit(std::move(msg));
     }
 
 private:
+    friend class LoggerWorkerPool;
+
+    /**
+     * @enum DrainResult
+     * @brief Итог одного шага обработки очереди.
+     */
+    enum class DrainResult {
+        Wrote,    /**< Записана пачка; возможно, есть ещё */
+        Idle,     /**< Очередь пуста, приёмники сброшены */
+        Pending   /**< Очередь пуста, но у приёмника остались неотправленные данные */
+    };
+
+    /**
+     * @struct LogMessage
+     * @brief Элемент очереди фиксированного размера; только перемещается.
+     */
     struct LogMessage {
-        LogLevel level;         /**< Уровень логирования */
-        std::string message;    /**< Текст сообщения */
-        std::string file;       /**< Имя файла */
-        int line;               /**< Номер строки */
-        std::string timestamp;  /**< Временная метка */
+        const LogSite* site = nullptr;  /**< Место вызова (уровень, файл, строка) */
+        std::chrono::system_clock::time_point time;  /**< Момент вызова лога */
+        PayloadBuffer payload;  /**< Аргументы сообщения (см. ArgumentWriter) */
+    };
+
+    /**
+     * @struct InternedSite
+     * @brief Место вызова, созданное для log() без макроса; владеет копией имени файла.
+     */
+    struct InternedSite {
+        std::string file;   /**< Копия имени файла */
+        LogSiteState state; /**< Состояние ограничения частоты */
+        LogSite site;       /**< Метаданные, ссылающиеся на file и state */
+    };
+
+    /**
+     * @struct SiteKey
+     * @brief Ключ места вызова log() без макроса: указатель имени файла, строка и уровень.
+     */
+    struct SiteKey {
+        const char* file;   /**< Указатель имени файла (__FILE__) */
+        int line;           /**< Номер строки */
+        LogLevel level;     /**< Уровень */
+
+        bool operator==(const SiteKey& other) const = default;
     };
 
-    LogLevel currentLevel = LogLevel::TRACE;   /**< Текущий уровень логирования */
-    OutputTarget outputTarget = OutputTarget::Console;  /**< Текущий таргет вывода */
+    /**
+     * @struct SiteKeyHash
+     * @brief Хеш SiteKey без обращения к тексту имени файла.
+     */
+    struct SiteKeyHash {
+        std::size_t operator()(const SiteKey& key) const {
+            auto value = (reinterpret_cast<std::uintptr_t>(key.file) >> 3) ^
+                (static_cast<std::uint64_t>(key.line) << 3) ^ static_cast<std::uint64_t>(key.level);
+            return static_cast<std::size_t>(value * 0x9E3779B97F4A7C15ull);
+        }
+    };
+
+    /**
+     * @struct FileLevelSlot
+     * @brief Ячейка кэша уровней по файлам (открытая адресация по указателю __FILE__).
+     *
+     * Ячейку занимает CAS указателя; до записи уровня в ней стоит
+     * FileLevelPending, и читатель вычисляет уровень сам.
+     */
+    struct FileLevelSlot {
+        std::atomic<const char*> file{ nullptr };  /**< Указатель __FILE__ или nullptr */
+        std::atomic<int> level{ -2 };              /**< Уровень файла, -1 - глобальный уровень */
+    };
+
+    static constexpr int FileLevelPending = -2;         /**< Уровень ячейки ещё не записан */
+    static constexpr std::size_t FileLevelSlots = 256;  /**< Размер кэша уровней по файлам */
+    static constexpr std::size_t FileLevelProbes = 16;  /**< Наибольшая длина поиска в кэше */
 
-    std::ofstream logFileStream;    /**< Поток файла лога */
+    /**
+     * @struct FileLevelTable
+     * @brief Неизменяемый снимок переопределений уровня по файлам с собственным кэшем.
+     *
+     * setFileLogLevel() публикует новый снимок с пустым кэшем, поэтому
+     * ячейки существующего снимка никогда не сбрасываются под читателями.
+     * Снимки живут до удаления логгера: читатель мог загрузить прежний указатель.
+     */
+    struct FileLevelTable {
+        std::vector<std::pair<std::string, LogLevel>> overrides;  /**< Переопределения по имени файла */
+        mutable FileLevelSlot slots[FileLevelSlots];  /**< Кэш уровней по указателю __FILE__ */
+    };
+    static constexpr std::size_t SiteCacheSlots = 64;   /**< Размер кэша мест вызова log() в каждом потоке */
+
+    std::atomic<LogLevel> currentLevel{ LogLevel::TRACE };   /**< Текущий уровень логирования */
+    std::atomic<bool> hasFileLevels{ false };  /**< Есть переопределения уровня по файлам */
+    std::atomic<const FileLevelTable*> fileLevels{ nullptr };  /**< Действующий снимок уровней по файлам */
+    std::mutex fileLevelMutex;      /**< Упорядочивает изменения переопределений уровня по файлам */
+    std::vector<std::unique_ptr<FileLevelTable>> fileLevelTables;  /**< Все опубликованные снимки */
+
+    std::mutex siteMutex;           /**< Мьютекс реестра мест вызова */
+    std::unordered_map<SiteKey, std::unique_ptr<InternedSite>, SiteKeyHash> internedSites;  /**< Места вызова log() без макроса */
+    std::atomic<FormattingMode> formattingMode{ FormattingMode::Immediate };  /**< Режим форматирования */
+
+    const std::shared_ptr<ConsoleSink> consoleSink;  /**< Встроенный приёмник консоли */
+    const std::shared_ptr<FileSink> fileSink;        /**< Встроенный приёмник файла */
+    std::mutex configMutex;         /**< Упорядочивает изменения настроек; поток обработки его не берёт */
+    std::atomic<std::shared_ptr<const LoggerConfig>> config{ std::make_shared<const LoggerConfig>() };  /**< Опубликованный снимок настроек */
+    std::shared_ptr<const LoggerConfig> workerConfig;  /**< Снимок, по которому пишет поток обработки */
+    std::vector<LogSink*> activeSinks;  /**< Приёмники снимка workerConfig (поток обработки) */
     std::string startupTime;        /**< Время запуска программы */
-    std::string logFilePath;        /**< Путь к файлу лога */
 
-    std::mutex queueMutex;          /**< Мьютекс для очереди сообщений */
-    std::condition_variable cv;     /**< Условная переменная для уведомления */
-    std::queue<LogMessage> messageQueue;  /**< Очередь сообщений */
+    static constexpr std::size_t MaxBatchSize = 4096;  /**< Максимальный размер пачки сообщений */
+    static constexpr std::chrono::milliseconds PendingRetryInterval{ 20 };  /**< Период повторной записи при простое */
+    static constexpr std::chrono::milliseconds BusyPollSlice{ 1 };  /**< Наибольший непрерывный опрос BusyPoll между шагами обработки */
+
+    std::chrono::steady_clock::time_point lastFlush;  /**< Время последнего сброса приёмников */
+    bool sinksDirty = false;        /**< В приёмниках есть несброшенные данные */
+    LogBatch formattedBatch;        /**< Отформатированная пачка (поток обработки) */
+
+    /**
+     * @struct ProducerCounters
+     * @brief Счётчики одного потока-производителя.
+     *
+     * Пишет их только поток-владелец (addRelaxed), остальные только читают.
+     * Счётчики завершившихся потоков поток обработки переносит в retiredCounters.
+     */
+    struct ProducerCounters {
+        std::atomic<std::uint64_t> enqueued[LogLevelCount] = {};  /**< Поставлено в очередь по уровням */
+        std::atomic<std::uint64_t> droppedNewest{ 0 };      /**< Счётчик DropNewest */
+        std::atomic<std::uint64_t> droppedOldest{ 0 };      /**< Счётчик DropOldest */
+        std::atomic<std::uint64_t> droppedBelowLevel{ 0 };  /**< Счётчик DropBelowLevel */
+        std::atomic<std::uint64_t> rateLimited{ 0 };        /**< Счётчик ограничения частоты */
+        HistogramCounters latency;          /**< Длительность log(), нс */
+        std::uint32_t calls = 0;            /**< Вызовов для выборки измерений задержки */
+
+        void merge(const ProducerCounters& other);  /**< Добавить счётчики другого потока */
+        void addTo(LoggerStats& stats) const;       /**< Добавить счётчики к снимку */
+    };
 
-    std::thread workerThread;       /**< Поток обработки логов */
+    static constexpr std::uint32_t LatencySampleMask = 15;  /**< Задержка измеряется у каждого 16-го вызова */
+
+    /**
+     * @struct ThreadBuffer
+     * @brief Буфер сообщений одного потока-производителя.
+     *
+     * Совместно принадлежит логгеру и потоку. При завершении потока буфер
+     * помечается retired; поток обработки дочитывает его и удаляет из списка.
+     */
+    struct ThreadBuffer {
+        explicit ThreadBuffer(std::size_t capacity) : queue(capacity) {}
+
+        RingBuffer<LogMessage> queue;       /**< Сообщения потока */
+        std::atomic<bool> retired{ false }; /**< Поток-владелец завершился */
+        int crashSlot = -1;                 /**< Ячейка в crashBuffers или -1 */
+        alignas(CacheLineSize) ProducerCounters counters;  /**< Счётчики потока */
+    };
+
+    struct ThreadBufferCache;
+
+    /**
+     * @struct PendingConfig
+     * @brief Опубликованный снимок настроек, который поток обработки ещё не применил.
+     *
+     * boundary - позиции записи буферов потоков в момент публикации:
+     * сообщения до них пишутся по предыдущему снимку. Буферы, созданные
+     * позже, в списке отсутствуют, и все их сообщения относятся к этому снимку.
+     */
+    struct PendingConfig {
+        std::shared_ptr<const LoggerConfig> config;  /**< Снимок */
+        std::vector<std::pair<std::shared_ptr<ThreadBuffer>, std::size_t>> boundary;  /**< Позиции записи при публикации */
+    };
+
+    std::mutex pendingConfigsMutex;  /**< Мьютекс очереди pendingConfigs; удерживается только на вставку и извлечение */
+    std::deque<std::shared_ptr<const PendingConfig>> pendingConfigs;  /**< Снимки в порядке публикации */
+    std::atomic<bool> configPending{ false };  /**< Очередь pendingConfigs не пуста */
+    std::shared_ptr<const PendingConfig> nextConfig;  /**< Ближайший неприменённый снимок (поток обработки) */
+
+    const std::uint64_t loggerId;   /**< Уникальный идентификатор логгера (ключ кэша потоков) */
+    const std::size_t threadBufferCapacity;  /**< Ёмкость буфера одного потока */
+    mutable std::mutex buffersMutex;  /**< Мьютекс списка буферов потоков и retiredCounters */
+    std::vector<std::shared_ptr<ThreadBuffer>> threadBuffers;  /**< Буферы всех потоков */
+    std::atomic<bool> buffersChanged{ false };  /**< Список буферов изменился */
+
+    std::vector<std::shared_ptr<ThreadBuffer>> workerBuffers;  /**< Снимок списка буферов (поток обработки) */
+
+    /**
+     * @brief Буферы потоков для аварийной выгрузки.
+     *
+     * Фиксированный массив атомарных указателей обходится из обработчика
+     * сигнала без блокировок. Буфер занимает свободную ячейку при создании
+     * и освобождает её перед удалением; буферы сверх MaxCrashBuffers
+     * аварийно не выгружаются.
+     */
+    static constexpr int MaxCrashBuffers = 256;
+    std::atomic<ThreadBuffer*> crashBuffers[MaxCrashBuffers] = {};
+    std::vector<std::uint32_t> batchOrder;  /**< Порядок сообщений пачки по времени (поток обработки) */
+    std::size_t nextBufferIndex = 0;  /**< Буфер, с которого начинается следующий опрос */
+
+    std::atomic<BackpressurePolicy> backpressurePolicy{ BackpressurePolicy::Block };  /**< Политика переполнения */
+    std::atomic<LogLevel> backpressureLevel{ LogLevel::ERROR_ };  /**< Порог уровня для DropBelowLevel */
+
+    ProducerCounters retiredCounters;  /**< Счётчики удалённых буферов (пишет поток обработки) */
+    alignas(CacheLineSize) std::atomic<std::uint64_t> writtenCount[LogLevelCount] = {};  /**< Обработано по уровням */
+    std::atomic<std::uint64_t> collapsedCount{ 0 };   /**< Свёрнуто как повторы */
+    std::atomic<std::uint64_t> batchCount{ 0 };       /**< Записанных пачек */
+    std::atomic<std::size_t> peakDepth{ 0 };          /**< Наибольшая наблюдавшаяся глубина очереди */
+    HistogramCounters batchSizes;                     /**< Размеры пачек */
+    std::chrono::steady_clock::time_point lastStatsReport;  /**< Время последней строки статистики */
+
+    alignas(CacheLineSize) std::atomic<std::int64_t> rateInterval{ 0 };  /**< Интервал между сообщениями места, нс; 0 - без ограничения */
+    std::atomic<std::int64_t> rateTolerance{ 0 };  /**< Запас на burst сообщений подряд, нс */
+    std::atomic<int> sampledLevel{ -1 };           /**< Наибольший уровень выборки; -1 - выборка выключена */
+    std::atomic<std::uint32_t> sampleBase{ 1 };    /**< Базовое N выборки */
+    std::atomic<bool> sampleAdaptive{ false };     /**< Увеличивать N по заполнению очереди */
+    alignas(CacheLineSize) std::atomic<std::uint32_t> sampleShift{ 0 };  /**< log2 множителя N (пишет поток обработки) */
+
+    WorkerWakeSignal ownSignal;     /**< Сигнал собственного потока обработки */
+    WorkerWakeSignal* wakeSignal = &ownSignal;  /**< Сигнал потока, который обрабатывает логгер */
+    const std::shared_ptr<LoggerWorkerPool> workerPool;  /**< Пул потоков обработки или nullptr */
+
+    alignas(CacheLineSize) std::atomic<std::uint64_t> flushRequested{ 0 };  /**< Номер последнего запроса flush() */
+    std::atomic<std::uint64_t> flushCompleted{ 0 };  /**< Номер последнего выполненного запроса */
+    std::atomic<bool> emergencyRequested{ false };   /**< Запрос аварийной выгрузки */
+    std::atomic<std::thread::id> drainingThread{};   /**< Поток, выполняющий drainOnce() */
+    std::atomic<bool> workerStopped{ false };   /**< Поток обработки больше не забирает сообщения */
+    int crashSlot = -1;             /**< Ячейка в списке логгеров обработчика сбоев */
+
+    std::thread workerThread;       /**< Собственный поток обработки логов */
+    std::vector<LogMessage> workerBatch;  /**< Буфер пачки (поток обработки) */
     std::atomic<bool> exitFlag{ false };  /**< Флаг завершения */
 
-    std::string formatTemplate = "{t} | {L} | {f}:{l} -> {m}";  /**< Шаблон форматирования */
+    TimestampCache timestampCache;  /**< Кэш форматирования временных меток (поток обработки) */
+    std::string formatScratch;      /**< Буфер форматирования аргументов JSON (поток обработки) */
+    bool batchNeedsText = false;    /**< Текущей пачке нужен текст (поток обработки) */
+    LogLevel batchMaxLevel = LogLevel::TRACE;  /**< Наибольший уровень текущей пачки */
+
+    const LogSite* repeatSite = nullptr;  /**< Место последнего записанного сообщения (сворачивание повторов) */
+    std::string repeatPayload;      /**< Аргументы последнего записанного сообщения */
+    std::uint64_t repeatCount = 0;  /**< Повторов, о которых ещё не сообщено */
+    std::chrono::system_clock::time_point repeatSince;  /**< Время первого несообщённого повтора */
+    std::chrono::system_clock::time_point repeatLast;   /**< Время последнего повтора */
+    std::deque<PayloadBuffer> syntheticPayloads;  /**< Аргументы строк логгера (повторы, статистика) текущей пачки */
 
     void workerFunc();              /**< Функция потока обработки сообщений */
+    DrainResult drainOnce();        /**< Записать одну пачку или, если писать нечего, сбросить приёмники */
+    void refreshConfig();           /**< Применить снимки настроек, сообщения до которых записаны */
+    void applyConfig(std::shared_ptr<const LoggerConfig> latest);  /**< Перейти на снимок настроек */
+    std::size_t collectLimit(const ThreadBuffer& buffer) const;  /**< Граница извлечения из буфера до применения nextConfig */
+    void drainAll();                /**< Обработать очередь до конца (логгер пула при удалении) */
+    bool hasWork() const;           /**< Есть сообщения или невыполненный запрос сброса */
+    void completeFlushRequest();    /**< Выполнить запрос flush(), если он есть */
+    std::uint64_t requestFlush();   /**< Зарегистрировать запрос сброса и разбудить поток обработки */
+    bool waitFlushed(std::uint64_t ticket, std::chrono::steady_clock::time_point deadline);  /**< Дождаться выполнения запроса */
+    bool flushUntil(std::chrono::steady_clock::time_point deadline);  /**< Реализация flush() */
+    void emergencyFlush(std::chrono::steady_clock::time_point deadline);  /**< Аварийная выгрузка логгера */
+    void emergencyWrite(std::chrono::steady_clock::time_point deadline);  /**< Выгрузка очереди в файл из потока сбоя */
+    void waitForMessages(const WorkerOptions& options);  /**< Дождаться сообщений выбранным способом */
+    static void applyThreadOptions(const WorkerOptions& options);  /**< Применить ядра и приоритет к текущему потоку */
+    static void cpuRelax();         /**< Подсказка процессору в цикле опроса (pause) */
+
+    /**
+     * @brief Опрашивает готовность работы перед сном согласно стратегии ожидания.
+     *
+     * SpinThenSleep опрашивает не дольше spinTime; BusyPoll - не дольше
+     * BusyPollSlice, после чего поток возвращается к шагу обработки
+     * (там же применяются новые настройки), но не засыпает.
+     *
+     * @tparam Ready Вызываемый объект bool().
+     * @param options Параметры потока.
+     * @param ready Есть ли работа.
+     * @return true, если засыпать не нужно.
+     */
+    template<typename Ready>
+    static bool spinWait(const WorkerOptions& options, Ready&& ready) {
+        if (options.wait == WaitStrategy::Sleep) return false;
+
+        auto limit = options.wait == WaitStrategy::BusyPoll
+            ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(BusyPollSlice)
+            : std::chrono::duration_cast<std::chrono::steady_clock::duration>(options.spinTime);
+        auto deadline = std::chrono::steady_clock::now() + limit;
+        for (std::uint32_t i = 1;; ++i) {
+            if (ready()) return true;
+            // Часы читаются редко: опрос должен замечать сообщение за десятки наносекунд
+            if ((i & 63) == 0 && std::chrono::steady_clock::now() >= deadline) {
+                return options.wait == WaitStrategy::BusyPoll;
+            }
+            cpuRelax();
+        }
+    }
+    void collectBatch(std::vector<LogMessage>& batch);  /**< Забрать сообщения из буферов потоков */
+    bool buffersEmpty() const;      /**< Все буферы потоков пусты */
+    void reclaimRetiredBuffers();   /**< Удалить дочитанные буферы завершившихся потоков */
+    ThreadBuffer& localBuffer();    /**< Буфер текущего потока (создаётся при первом вызове) */
+    void wakeWorker();              /**< Разбудить поток обработки, если он простаивает */
 
-    std::string getTimestamp() const;  /**< Получить текущую временную метку */
-    std::string levelToString(LogLevel level) const;  /**< Преобразовать уровень в строку */
 
-    std::string formatLogMessage(const LogMessage& msg) const;  /**< Форматировать сообщение по шаблону */
+    void formatLogMessage(const LogSite& site, std::chrono::system_clock::time_point time,
+        std::string_view payload, std::string& out);  /**< Дописать сообщение по шаблону или как JSON в буфер */
 
-    void writeLog(const LogMessage& msg);  /**< Записать сообщение в вывод */
-    void enqueueLog(const LogMessage& msg);  /**< Добавить сообщение в очередь */
+    void writeBatch(const std::vector<LogMessage>& batch);  /**< Отформатировать пачку и передать приёмникам */
+    void beginFormattedBatch();     /**< Начать новую отформатированную пачку */
+    void appendRecord(const LogSite& site, std::chrono::system_clock::time_point time, std::string_view payload);  /**< Добавить сообщение в пачку */
+    void appendRepeatRecord();      /**< Добавить строку о несообщённых повторах */
+    void writeFormattedBatch();     /**< Передать пачку приёмникам */
+    void flushRepeats(bool force);  /**< Записать отчёт о повторах отдельной пачкой */
+    void reportStats();             /**< Записать строку статистики, если подошёл срок */
+    bool admitLimited(LogSiteState& state, std::int64_t interval);  /**< admit() при включённом ограничении */
+    bool sampleHit(const LogSite& site, std::uint32_t sampleRate);  /**< Попадает ли сообщение в выборку */
+    void flushSinks(bool force);    /**< Сбросить приёмники согласно интервалу */
+    bool retryPendingSinks();       /**< Дописать данные, которые приёмники не смогли записать сразу */
+    LogLevel fileLevel(const char* file) const;  /**< Действующий уровень для файла вызова */
+    static int resolveFileLevel(const FileLevelTable& table, const char* file);  /**< Найти уровень файла по имени; -1 - глобальный */
+    void publishFileLevels(std::vector<std::pair<std::string, LogLevel>> overrides);  /**< Опубликовать новый снимок уровней по файлам */
+    const LogSite& internSite(LogLevel level, const char* file, int line);  /**< Место вызова для log() без макроса */
+    void submit(LogMessage&& msg);  /**< Поставить сериализованное сообщение в очередь */
+    void publishConfig(std::shared_ptr<const LoggerConfig> next);  /**< Опубликовать снимок с позициями записи буферов */
+    void enqueueLog(LogMessage&& msg);  /**< Добавить сообщение в очередь */
 };
 
 /**
@@ -160,38 +1071,286 @@ private:
  */
 extern Logger LoggerInstance;
 
+/**
+ * @def LOGGER_MIN_LEVEL
+ * @brief Минимальный уровень, компилируемый в программу.
+ *
+ * Макросы уровней ниже LOGGER_MIN_LEVEL раскрываются в пустое выражение:
+ * аргументы не вычисляются и код вызова не генерируется.
+ * Значение задаётся одной из констант LOGGER_LEVEL_*, например /DLOGGER_MIN_LEVEL=2.
+ */
+#define LOGGER_LEVEL_TRACE    0
+#define LOGGER_LEVEL_DEBUG    1
+#define LOGGER_LEVEL_INFO     2
+#define LOGGER_LEVEL_WARNING  3
+#define LOGGER_LEVEL_ERROR    4
+#define LOGGER_LEVEL_CRITICAL 5
+
+#ifndef LOGGER_MIN_LEVEL
+#define LOGGER_MIN_LEVEL LOGGER_LEVEL_TRACE
+#endif
+
+/**
+ * @def LOGGER_LOG_(level, ...)
+ * @brief Общая часть макросов LOGx.
+ *
+ * Уровень, выборка и ограничение частоты проверяются до вычисления аргументов,
+ * поэтому отключённый или отброшенный вызов не форматирует и не выделяет
+ * память. Метаданные места вызова хранятся в static constexpr LogSite
+ * и передаются в очередь указателем.
+ */
+#define LOGGER_LOG_(level, ...) LOGGER_LOG_TO_(LoggerInstance, level, __VA_ARGS__)
+
+/**
+ * @brief Логгер по ссылке, указателю или shared_ptr (для макросов LOGx_TO).
+ */
+inline Logger& loggerRef(Logger& logger) { return logger; }
+inline Logger& loggerRef(Logger* logger) { return *logger; }
+inline Logger& loggerRef(const std::shared_ptr<Logger>& logger) { return *logger; }
+
+/**
+ * @def LOGGER_LOG_TO_(logger, level, ...)
+ * @brief Общая часть макросов LOGx_TO; logger вычисляется один раз.
+ */
+#define LOGGER_LOG_TO_(logger, level, ...) \
+    do { \
+        static LogSiteState loggerSiteState_; \
+        static constexpr LogSite loggerSite_{ level, __FILE__, __LINE__, &loggerSiteState_ }; \
+        Logger& loggerTarget_ = loggerRef(logger); \
+        if (loggerTarget_.isEnabled(loggerSite_)) { \
+            if (std::uint32_t loggerSampleRate_ = loggerTarget_.admit(loggerSite_)) { \
+                loggerTarget_.logSampled(loggerSite_, loggerSampleRate_, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
 /**
  * @def LOGT(...)
  * @brief Макрос для логирования сообщений уровня TRACE.
  */
-#define LOGT(...) LoggerInstance.log(LogLevel::TRACE, __FILE__, __LINE__, __VA_ARGS__)
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_TRACE
+#define LOGT(...) LOGGER_LOG_(LogLevel::TRACE, __VA_ARGS__)
+#else
+#define LOGT(...) ((void)0)
+#endif
 
  /**
   * @def LOGD(...)
   * @brief Макрос для логирования сообщений уровня DEBUG.
   */
-#define LOGD(...) LoggerInstance.log(LogLevel::DEBUG, __FILE__, __LINE__, __VA_ARGS__)
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_DEBUG
+#define LOGD(...) LOGGER_LOG_(LogLevel::DEBUG, __VA_ARGS__)
+#else
+#define LOGD(...) ((void)0)
+#endif
 
   /**
    * @def LOGI(...)
    * @brief Макрос для логирования сообщений уровня INFO.
    */
-#define LOGI(...) LoggerInstance.log(LogLevel::INFO, __FILE__, __LINE__, __VA_ARGS__)
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_INFO
+#define LOGI(...) LOGGER_LOG_(LogLevel::INFO, __VA_ARGS__)
+#else
+#define LOGI(...) ((void)0)
+#endif
 
    /**
     * @def LOGW(...)
     * @brief Макрос для логирования сообщений уровня WARNING.
     */
-#define LOGW(...) LoggerInstance.log(LogLevel::WARNING, __FILE__, __LINE__, __VA_ARGS__)
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_WARNING
+#define LOGW(...) LOGGER_LOG_(LogLevel::WARNING, __VA_ARGS__)
+#else
+#define LOGW(...) ((void)0)
+#endif
 
     /**
      * @def LOGE(...)
      * @brief Макрос для логирования сообщений уровня ERROR.
      */
-#define LOGE(...) LoggerInstance.log(LogLevel::ERROR_, __FILE__, __LINE__, __VA_ARGS__)
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_ERROR
+#define LOGE(...) LOGGER_LOG_(LogLevel::ERROR_, __VA_ARGS__)
+#else
+#define LOGE(...) ((void)0)
+#endif
 
      /**
       * @def LOGC(...)
       * @brief Макрос для логирования сообщений уровня CRITICAL.
       */
-#define LOGC(...) LoggerInstance.log(LogLevel::CRITICAL, __FILE__, __LINE__, __VA_ARGS__)
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_CRITICAL
+#define LOGC(...) LOGGER_LOG_(LogLevel::CRITICAL, __VA_ARGS__)
+#else
+#define LOGC(...) ((void)0)
+#endif
+
+/**
+ * @def LOGT_TO(logger, ...) LOGD_TO LOGI_TO LOGW_TO LOGE_TO LOGC_TO
+ * @brief Макросы уровней для указанного логгера: LOGI_TO(tracer, "запрос ", id).
+ *
+ * logger - Logger&, Logger* или std::shared_ptr<Logger>, например
+ * результат LoggerRegistry::instance().get("tracer").
+ * LOGGER_MIN_LEVEL действует так же, как на LOGx.
+ */
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_TRACE
+#define LOGT_TO(logger, ...) LOGGER_LOG_TO_(logger, LogLevel::TRACE, __VA_ARGS__)
+#else
+#define LOGT_TO(logger, ...) ((void)0)
+#endif
+
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_DEBUG
+#define LOGD_TO(logger, ...) LOGGER_LOG_TO_(logger, LogLevel::DEBUG, __VA_ARGS__)
+#else
+#define LOGD_TO(logger, ...) ((void)0)
+#endif
+
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_INFO
+#define LOGI_TO(logger, ...) LOGGER_LOG_TO_(logger, LogLevel::INFO, __VA_ARGS__)
+#else
+#define LOGI_TO(logger, ...) ((void)0)
+#endif
+
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_WARNING
+#define LOGW_TO(logger, ...) LOGGER_LOG_TO_(logger, LogLevel::WARNING, __VA_ARGS__)
+#else
+#define LOGW_TO(logger, ...) ((void)0)
+#endif
+
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_ERROR
+#define LOGE_TO(logger, ...) LOGGER_LOG_TO_(logger, LogLevel::ERROR_, __VA_ARGS__)
+#else
+#define LOGE_TO(logger, ...) ((void)0)
+#endif
+
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_CRITICAL
+#define LOGC_TO(logger, ...) LOGGER_LOG_TO_(logger, LogLevel::CRITICAL, __VA_ARGS__)
+#else
+#define LOGC_TO(logger, ...) ((void)0)
+#endif
+
+/**
+ * @class LogScope
+ * @brief Замер времени от создания до уничтожения объекта (макросы LOGx_SCOPE).
+ *
+ * Конструктор проверяет уровень, выборку и ограничение частоты места
+ * вызова и запоминает момент steady_clock; деструктор ставит в очередь
+ * одно сообщение с именем и двумя отметками времени (Logger::logSpan()).
+ * Ни форматирования, ни выделения памяти в потоке вызова нет: текстовые
+ * приёмники получают строку "имя took 12.345 us", JSON lines - свойство
+ * duration_ns, TraceSink - событие Chrome trace.
+ */
+class LogScope {
+public:
+    /**
+     * @brief Начинает замер.
+     * @param logger Логгер.
+     * @param site Место вызова со статическим временем жизни.
+     * @param name Имя замера: строковый литерал или __func__.
+     */
+    LogScope(Logger& logger, const LogSite& site, LogLiteral name)
+        : site(site), name(name) {
+        if (!logger.isEnabled(site)) return;
+        sampleRate = logger.admit(site);
+        if (sampleRate == 0) return;
+        target = &logger;
+        start = now();
+    }
+
+    /**
+     * @brief Заканчивает замер и ставит его в очередь.
+     */
+    ~LogScope() {
+        if (target != nullptr) target->logSpan(site, sampleRate, name, start, now());
+    }
+
+    LogScope(const LogScope&) = delete;
+    LogScope& operator=(const LogScope&) = delete;
+
+    /**
+     * @brief Текущий момент steady_clock в наносекундах.
+     */
+    static std::int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    Logger* target = nullptr;    /**< Логгер; nullptr, если замер отключён */
+    const LogSite& site;         /**< Место вызова */
+    LogLiteral name;             /**< Имя замера */
+    std::uint32_t sampleRate = 0;  /**< Результат admit() */
+    std::int64_t start = 0;      /**< Начало, наносекунды steady_clock */
+};
+
+#define LOGGER_CONCAT_IMPL_(a, b) a##b
+#define LOGGER_CONCAT_(a, b) LOGGER_CONCAT_IMPL_(a, b)
+
+/**
+ * @def LOGGER_SCOPE_TO_(logger, level, name)
+ * @brief Общая часть макросов LOGx_SCOPE: объявляет LogScope до конца блока.
+ *
+ * Имена переменных включают номер строки, поэтому в одном блоке
+ * можно открыть несколько замеров на разных строках.
+ */
+#define LOGGER_SCOPE_TO_(logger, level, name) \
+    static LogSiteState LOGGER_CONCAT_(loggerScopeState_, __LINE__); \
+    static constexpr LogSite LOGGER_CONCAT_(loggerScopeSite_, __LINE__){ level, __FILE__, __LINE__, &LOGGER_CONCAT_(loggerScopeState_, __LINE__) }; \
+    LogScope LOGGER_CONCAT_(loggerScope_, __LINE__)(loggerRef(logger), LOGGER_CONCAT_(loggerScopeSite_, __LINE__), name)
+
+/**
+ * @def LOGT_SCOPE(name) LOGD_SCOPE LOGI_SCOPE LOGW_SCOPE LOGE_SCOPE LOGC_SCOPE
+ * @brief Замер времени до конца текущего блока: LOGD_SCOPE("parse").
+ *
+ * name - строковый литерал или __func__. Вместо двух сообщений на входе
+ * и выходе в очередь попадает одно с именем и отметками steady_clock,
+ * длительность вычисляет поток обработки. LOGGER_MIN_LEVEL действует
+ * так же, как на LOGx; варианты LOGx_SCOPE_TO(logger, name) пишут
+ * в указанный логгер.
+ */
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_TRACE
+#define LOGT_SCOPE(name) LOGGER_SCOPE_TO_(LoggerInstance, LogLevel::TRACE, name)
+#define LOGT_SCOPE_TO(logger, name) LOGGER_SCOPE_TO_(logger, LogLevel::TRACE, name)
+#else
+#define LOGT_SCOPE(name) ((void)0)
+#define LOGT_SCOPE_TO(logger, name) ((void)0)
+#endif
+
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_DEBUG
+#define LOGD_SCOPE(name) LOGGER_SCOPE_TO_(LoggerInstance, LogLevel::DEBUG, name)
+#define LOGD_SCOPE_TO(logger, name) LOGGER_SCOPE_TO_(logger, LogLevel::DEBUG, name)
+#else
+#define LOGD_SCOPE(name) ((void)0)
+#define LOGD_SCOPE_TO(logger, name) ((void)0)
+#endif
+
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_INFO
+#define LOGI_SCOPE(name) LOGGER_SCOPE_TO_(LoggerInstance, LogLevel::INFO, name)
+#define LOGI_SCOPE_TO(logger, name) LOGGER_SCOPE_TO_(logger, LogLevel::INFO, name)
+#else
+#define LOGI_SCOPE(name) ((void)0)
+#define LOGI_SCOPE_TO(logger, name) ((void)0)
+#endif
+
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_WARNING
+#define LOGW_SCOPE(name) LOGGER_SCOPE_TO_(LoggerInstance, LogLevel::WARNING, name)
+#define LOGW_SCOPE_TO(logger, name) LOGGER_SCOPE_TO_(logger, LogLevel::WARNING, name)
+#else
+#define LOGW_SCOPE(name) ((void)0)
+#define LOGW_SCOPE_TO(logger, name) ((void)0)
+#endif
+
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_ERROR
+#define LOGE_SCOPE(name) LOGGER_SCOPE_TO_(LoggerInstance, LogLevel::ERROR_, name)
+#define LOGE_SCOPE_TO(logger, name) LOGGER_SCOPE_TO_(logger, LogLevel::ERROR_, name)
+#else
+#define LOGE_SCOPE(name) ((void)0)
+#define LOGE_SCOPE_TO(logger, name) ((void)0)
+#endif
+
+#if LOGGER_MIN_LEVEL <= LOGGER_LEVEL_CRITICAL
+#define LOGC_SCOPE(name) LOGGER_SCOPE_TO_(LoggerInstance, LogLevel::CRITICAL, name)
+#define LOGC_SCOPE_TO(logger, name) LOGGER_SCOPE_TO_(logger, LogLevel::CRITICAL, name)
+#else
+#define LOGC_SCOPE(name) ((void)0)
+#define LOGC_SCOPE_TO(logger, name) ((void)0)
+#endif
@@ -0,0 +1,202 @@
+﻿#include "LoggerRegistry.h"
+#include <algorithm>
+
+/**
+ * @brief Конструктор. Запускает потоки пула.
+ * @param threads Число потоков.
+ * @param options Параметры потоков.
+ */
+LoggerWorkerPool::LoggerWorkerPool(std::size_t threads, const WorkerOptions& options)
+    : options(options) {
+    workers.reserve((std::max)(threads, std::size_t(1)));
+    for (std::size_t i = 0; i < workers.capacity(); ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (auto& worker : workers) {
+        worker->thread = std::thread(&LoggerWorkerPool::run, this, std::ref(*worker));
+    }
+}
+
+/**
+ * @brief Деструктор. Останавливает и дожидается потоков пула.
+ */
+LoggerWorkerPool::~LoggerWorkerPool() {
+    exitFlag.store(true, std::memory_order_release);
+    for (auto& worker : workers) {
+        wake(*worker);
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+/**
+ * @brief Закрепляет логгер за очередным потоком пула.
+ * @param logger Полностью сконструированный логгер.
+ * @return Сигнал пробуждения потока, который будет обрабатывать логгер.
+ */
+WorkerWakeSignal& LoggerWorkerPool::attach(Logger& logger) {
+    Worker& worker = *workers[nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.loggers.push_back(&logger);
+    }
+    return worker.signal;
+}
+
+/**
+ * @brief Открепляет логгер.
+ *
+ * Мьютекс потока удерживается на время его шага обработки, поэтому
+ * после возврата поток пула гарантированно не работает с логгером.
+ *
+ * @param logger Логгер.
+ */
+void LoggerWorkerPool::detach(Logger& logger) {
+    for (auto& worker : workers) {
+        if (&worker->signal != logger.wakeSignal) continue;
+
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        auto it = std::find(worker->loggers.begin(), worker->loggers.end(), &logger);
+        if (it != worker->loggers.end()) worker->loggers.erase(it);
+        return;
+    }
+}
+
+/**
+ * @brief Будит поток пула, даже если он ещё не успел отметить простой.
+ * @param worker Поток.
+ */
+void LoggerWorkerPool::wake(Worker& worker) {
+    worker.signal.epoch.fetch_add(1, std::memory_order_release);
+    worker.signal.epoch.notify_one();
+}
+
+/**
+ * @brief Функция потока пула.
+ *
+ * За один проход выполняет по одному шагу Logger::drainOnce() для каждого
+ * логгера. Ждёт, как и собственный поток логгера, по стратегии options.wait
+ * и на счётчике сигнала, когда очереди всех логгеров пусты; если у приёмников
+ * остались неотправленные данные, вместо сна делает паузу PendingRetryInterval.
+ *
+ * @param worker Данные потока.
+ */
+void LoggerWorkerPool::run(Worker& worker) {
+    WorkerWakeSignal& signal = worker.signal;
+    Logger::applyThreadOptions(options);
+
+    auto hasWork = [this, &worker]() {
+        if (exitFlag.load(std::memory_order_relaxed)) return true;
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        return std::any_of(worker.loggers.begin(), worker.loggers.end(),
+            [](const Logger* logger) { return logger->hasWork(); });
+        };
+
+    for (;;) {
+        bool wrote = false;
+        bool pending = false;
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            for (Logger* logger : worker.loggers) {
+                Logger::DrainResult result = logger->drainOnce();
+                wrote = wrote || result == Logger::DrainResult::Wrote;
+                pending = pending || result == Logger::DrainResult::Pending;
+            }
+        }
+        if (wrote) continue;
+        if (exitFlag.load(std::memory_order_acquire)) break;
+
+        if (pending) {
+            std::this_thread::sleep_for(Logger::PendingRetryInterval);
+            continue;
+        }
+        if (Logger::spinWait(options, hasWork)) continue;
+
+        std::uint32_t epoch = signal.epoch.load(std::memory_order_acquire);
+        signal.idle.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (!hasWork()) {
+            signal.epoch.wait(epoch, std::memory_order_acquire);
+        }
+        signal.idle.store(false, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Единственный реестр процесса.
+ * @return Реестр, созданный при первом обращении.
+ */
+LoggerRegistry& LoggerRegistry::instance() {
+    static LoggerRegistry registry;
+    return registry;
+}
+
+/**
+ * @brief Возвращает логгер, создавая его при первом обращении.
+ * @param name Имя логгера.
+ * @return Логгер.
+ */
+std::shared_ptr<Logger> LoggerRegistry::get(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = loggers.find(name);
+    if (it != loggers.end()) return it->second;
+
+    auto logger = std::make_shared<Logger>(LOGGER_QUEUE_CAPACITY, workerPool);
+    loggers.emplace(name, logger);
+    return logger;
+}
+
+/**
+ * @brief Создаёт логгер с указанной ёмкостью очередей.
+ * @param name Имя логгера.
+ * @param queueCapacity Ёмкость буфера одного потока.
+ * @return Новый логгер или nullptr, если имя занято.
+ */
+std::shared_ptr<Logger> LoggerRegistry::create(const std::string& name, std::size_t queueCapacity) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (loggers.count(name) != 0) return nullptr;
+
+    auto logger = std::make_shared<Logger>(queueCapacity, workerPool);
+    loggers.emplace(name, logger);
+    return logger;
+}
+
+/**
+ * @brief Ищет логгер, не создавая его.
+ * @param name Имя логгера.
+ * @return Логгер или nullptr.
+ */
+std::shared_ptr<Logger> LoggerRegistry::find(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = loggers.find(name);
+    return it != loggers.end() ? it->second : nullptr;
+}
+
+/**
+ * @brief Удаляет логгер из реестра.
+ * @param name Имя логгера.
+ * @return false, если логгера нет.
+ */
+bool LoggerRegistry::remove(const std::string& name) {
+    std::shared_ptr<Logger> removed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = loggers.find(name);
+        if (it == loggers.end()) return false;
+        removed = std::move(it->second);
+        loggers.erase(it);
+    }
+    // Последняя ссылка освобождается вне мьютекса: деструктор дописывает очередь
+    return true;
+}
+
+/**
+ * @brief Задаёт пул потоков для новых логгеров.
+ * @param pool Пул или nullptr.
+ */
+void LoggerRegistry::setWorkerPool(std::shared_ptr<LoggerWorkerPool> pool) {
+    std::lock_guard<std::mutex> lock(mutex);
+    workerPool = std::move(pool);
+}
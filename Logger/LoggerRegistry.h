@@ -0,0 +1,138 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Logger.h"
+
+/**
+ * @class LoggerWorkerPool
+ * @brief Общие потоки обработки для нескольких логгеров.
+ *
+ * Каждый логгер закрепляется за одним потоком пула (по кругу).
+ * Поток поочерёдно записывает по одной пачке каждого своего логгера,
+ * поэтому ни один логгер не занимает поток дольше одной пачки подряд.
+ * Пул создаётся через std::make_shared и передаётся в конструктор Logger
+ * или LoggerRegistry::setWorkerPool(); логгеры держат пул, пока живы.
+ */
+class LoggerWorkerPool {
+public:
+    /**
+     * @brief Конструктор. Запускает потоки пула.
+     *
+     * Все потоки получают одинаковые параметры; при маске из нескольких
+     * ядер система распределяет их по этим ядрам.
+     *
+     * @param threads Число потоков (не меньше одного).
+     * @param options Ядра, приоритет и способ ожидания потоков пула.
+     */
+    explicit LoggerWorkerPool(std::size_t threads = 1, const WorkerOptions& options = {});
+
+    /**
+     * @brief Деструктор. Останавливает потоки; к этому моменту логгеров в пуле нет.
+     */
+    ~LoggerWorkerPool();
+
+    LoggerWorkerPool(const LoggerWorkerPool&) = delete;
+    LoggerWorkerPool& operator=(const LoggerWorkerPool&) = delete;
+
+    /**
+     * @brief Число потоков пула.
+     */
+    std::size_t size() const { return workers.size(); }
+
+private:
+    friend class Logger;
+
+    /**
+     * @struct Worker
+     * @brief Поток пула и закреплённые за ним логгеры.
+     */
+    struct Worker {
+        WorkerWakeSignal signal;        /**< Пробуждение потока производителями всех его логгеров */
+        std::mutex mutex;               /**< Защищает loggers; удерживается на время обработки */
+        std::vector<Logger*> loggers;   /**< Логгеры потока */
+        std::thread thread;             /**< Поток */
+    };
+
+    WorkerWakeSignal& attach(Logger& logger);  /**< Закрепить логгер за потоком, вернуть сигнал потока */
+    void detach(Logger& logger);    /**< Открепить логгер; после возврата пул к нему не обращается */
+    void run(Worker& worker);       /**< Функция потока пула */
+    void wake(Worker& worker);      /**< Разбудить поток независимо от флага простоя */
+
+    std::vector<std::unique_ptr<Worker>> workers;  /**< Потоки пула */
+    std::atomic<std::size_t> nextWorker{ 0 };      /**< Поток для следующего логгера */
+    std::atomic<bool> exitFlag{ false };           /**< Флаг завершения */
+    const WorkerOptions options;                   /**< Параметры потоков */
+};
+
+/**
+ * @class LoggerRegistry
+ * @brief Реестр именованных логгеров процесса.
+ *
+ * Позволяет подсистемам писать в отдельные логгеры со своими очередями,
+ * приёмниками и уровнями, не передавая их по коду:
+ * LOGI_TO(LoggerRegistry::instance().get("tracer"), "запрос ", id).
+ * Для горячих мест результат get() стоит сохранить, так как поиск по имени
+ * выполняется под мьютексом.
+ * Реестр создаётся при первом обращении, поэтому его можно использовать
+ * и при статической инициализации.
+ */
+class LoggerRegistry {
+public:
+    /**
+     * @brief Единственный реестр процесса.
+     */
+    static LoggerRegistry& instance();
+
+    /**
+     * @brief Возвращает логгер с указанным именем, создавая его при первом обращении.
+     * @param name Имя логгера.
+     * @return Логгер; новый логгер выводит в консоль, как Logger по умолчанию.
+     */
+    std::shared_ptr<Logger> get(const std::string& name);
+
+    /**
+     * @brief Создаёт логгер с указанной ёмкостью очередей.
+     * @param name Имя логгера.
+     * @param queueCapacity Ёмкость буфера одного потока.
+     * @return Новый логгер или nullptr, если имя уже занято.
+     */
+    std::shared_ptr<Logger> create(const std::string& name, std::size_t queueCapacity = LOGGER_QUEUE_CAPACITY);
+
+    /**
+     * @brief Ищет логгер, не создавая его.
+     * @param name Имя логгера.
+     * @return Логгер или nullptr.
+     */
+    std::shared_ptr<Logger> find(const std::string& name) const;
+
+    /**
+     * @brief Удаляет логгер из реестра.
+     *
+     * Логгер завершится, когда будет освобождена последняя ссылка на него.
+     *
+     * @param name Имя логгера.
+     * @return false, если логгера с таким именем нет.
+     */
+    bool remove(const std::string& name);
+
+    /**
+     * @brief Задаёт пул потоков для логгеров, создаваемых после вызова.
+     * @param pool Пул или nullptr, чтобы у каждого логгера был свой поток.
+     */
+    void setWorkerPool(std::shared_ptr<LoggerWorkerPool> pool);
+
+private:
+    LoggerRegistry() = default;
+
+    mutable std::mutex mutex;  /**< Мьютекс реестра */
+    std::shared_ptr<LoggerWorkerPool> workerPool;  /**< Пул для новых логгеров */
+    std::unordered_map<std::string, std::shared_ptr<Logger>> loggers;  /**< Логгеры по имени */
+};
@@ -0,0 +1,178 @@
+﻿#include "MappedFile.h"
+#include <cstring>
+
+namespace {
+
+/** @brief Начало заголовка: BOM UTF-8 и метка формата. */
+constexpr char HeaderPrefix[] = "\xEF\xBB\xBF#mmap-log valid=";
+constexpr std::size_t HeaderPrefixSize = sizeof(HeaderPrefix) - 1;
+constexpr std::size_t LengthDigits = 16;
+
+static_assert(HeaderPrefixSize + LengthDigits < MappedFile::HeaderSize, "Заголовок не помещается");
+
+}
+
+/**
+ * @brief Деструктор. Закрывает файл.
+ */
+MappedFile::~MappedFile() {
+    close();
+}
+
+/**
+ * @brief Открывает или создаёт файл.
+ *
+ * В режиме дописывания существующий файл должен начинаться с заголовка,
+ * иначе открытие не выполняется: запись поверх чужих данных испортила бы их.
+ *
+ * @param path Путь к файлу.
+ * @param append Продолжить запись после данных существующего файла.
+ * @param segmentSize Шаг увеличения файла.
+ * @return true, если файл открыт.
+ */
+bool MappedFile::open(const std::string& path, bool append, std::uint64_t segmentSize) {
+    close();
+
+    platform::FileHandle opened = platform::openReadWrite(path.c_str(), !append);
+    if (opened == platform::InvalidFile) return false;
+
+    std::uint64_t fileSize = 0;
+    if (!platform::fileSize(opened, fileSize)) {
+        platform::closeFile(opened);
+        return false;
+    }
+
+    file = opened;
+    segment = segmentSize < HeaderSize ? HeaderSize : segmentSize;
+    dataLength = 0;
+
+    if (fileSize == 0) {
+        if (!map(segment)) {
+            close();
+            return false;
+        }
+        std::memset(view.data, ' ', HeaderSize);
+        std::memcpy(view.data, HeaderPrefix, HeaderPrefixSize);
+        view.data[HeaderSize - 1] = '\n';
+        storeLength();
+        return true;
+    }
+
+    if (fileSize < HeaderSize || !map(fileSize) || !parseHeader(view.data, dataLength) || dataLength > fileSize - HeaderSize) {
+        close();
+        return false;
+    }
+
+    if (fileSize - HeaderSize - dataLength < segment) {
+        std::uint64_t target = size() + segment;
+        unmap();
+        if (!map(target)) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Снимает отображение и обрезает файл до записанных данных.
+ */
+void MappedFile::close() {
+    if (file == platform::InvalidFile) return;
+
+    bool truncate = view.data != nullptr;
+    std::uint64_t finalSize = size();
+    unmap();
+
+    if (truncate) {
+        platform::resizeFile(file, finalSize);
+    }
+
+    platform::closeFile(file);
+    file = platform::InvalidFile;
+    dataLength = 0;
+}
+
+/**
+ * @brief Копирует данные в отображение.
+ *
+ * Длина в заголовке обновляется после копирования, поэтому в заголовке
+ * никогда не учтены байты, которые ещё не записаны.
+ *
+ * @param data Данные.
+ * @param size Размер данных.
+ * @return true при успехе.
+ */
+bool MappedFile::write(const char* data, std::size_t size) {
+    if (view.data == nullptr) return false;
+
+    std::uint64_t required = this->size() + size;
+    if (required > view.size) {
+        std::uint64_t target = view.size;
+        while (target < required) target += segment;
+        unmap();
+        if (!map(target)) return false;
+    }
+
+    std::memcpy(view.data + HeaderSize + dataLength, data, size);
+    dataLength += size;
+    storeLength();
+    return true;
+}
+
+/**
+ * @brief Инициирует запись изменённых страниц на диск.
+ */
+void MappedFile::flush() {
+    platform::flushFileView(view);
+}
+
+/**
+ * @brief Отображает файл, увеличивая его до size байт.
+ * @param size Размер отображения.
+ * @return true при успехе.
+ */
+bool MappedFile::map(std::uint64_t size) {
+    return platform::mapFile(file, size, view);
+}
+
+/**
+ * @brief Снимает отображение.
+ */
+void MappedFile::unmap() {
+    platform::unmapFile(view);
+}
+
+/**
+ * @brief Записывает длину данных в заголовок шестнадцатеричными цифрами.
+ */
+void MappedFile::storeLength() {
+    static const char hex[] = "0123456789abcdef";
+    char* digits = view.data + HeaderPrefixSize;
+    std::uint64_t value = dataLength;
+    for (std::size_t i = LengthDigits; i-- > 0;) {
+        digits[i] = hex[value & 0xF];
+        value >>= 4;
+    }
+}
+
+/**
+ * @brief Проверяет метку заголовка и читает длину данных.
+ * @param header Начало файла (не менее HeaderSize байт).
+ * @param length Прочитанная длина данных.
+ * @return false, если файл записан не этим классом.
+ */
+bool MappedFile::parseHeader(const char* header, std::uint64_t& length) {
+    if (std::memcmp(header, HeaderPrefix, HeaderPrefixSize) != 0) return false;
+
+    length = 0;
+    for (std::size_t i = 0; i < LengthDigits; ++i) {
+        char c = header[HeaderPrefixSize + i];
+        unsigned digit;
+        if (c >= '0' && c <= '9') digit = static_cast<unsigned>(c - '0');
+        else if (c >= 'a' && c <= 'f') digit = static_cast<unsigned>(c - 'a' + 10);
+        else return false;
+        length = (length << 4) | digit;
+    }
+    return true;
+}
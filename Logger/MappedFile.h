@@ -0,0 +1,87 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Platform.h"
+
+/**
+ * @class MappedFile
+ * @brief Файл лога, отображённый в память сегментами фиксированного размера.
+ *
+ * Строки копируются прямо в отображение, без системного вызова на каждую
+ * пачку. Когда место заканчивается, файл увеличивается ещё на один сегмент
+ * и отображается заново.
+ *
+ * Первые HeaderSize байт файла - текстовая строка заголовка
+ * "#mmap-log valid=<16 hex-цифр>", в которой хранится длина записанных данных.
+ * Длина обновляется после копирования каждой пачки, поэтому после аварийного
+ * завершения процесса читатель знает, где кончаются данные и начинаются
+ * нули незаполненного сегмента. При закрытии файл обрезается до этой длины.
+ */
+class MappedFile {
+public:
+    static constexpr std::size_t HeaderSize = 64;  /**< Размер заголовка в начале файла */
+
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Открывает или создаёт файл.
+     * @param path Путь к файлу.
+     * @param append Продолжить запись после данных существующего файла.
+     * @param segmentSize Шаг увеличения файла в байтах.
+     * @return false, если файл не открыт или существующий файл не имеет заголовка.
+     */
+    bool open(const std::string& path, bool append, std::uint64_t segmentSize);
+
+    /**
+     * @brief Снимает отображение и обрезает файл до записанных данных.
+     */
+    void close();
+
+    /**
+     * @brief Открыт ли файл.
+     */
+    bool isOpen() const { return view.data != nullptr; }
+
+    /**
+     * @brief Копирует данные в отображение, при необходимости увеличив файл.
+     * @param data Данные.
+     * @param size Размер данных.
+     * @return false, если файл не удалось увеличить.
+     */
+    bool write(const char* data, std::size_t size);
+
+    /**
+     * @brief Инициирует запись изменённых страниц на диск.
+     */
+    void flush();
+
+    /**
+     * @brief Размер файла с учётом заголовка и только записанных данных.
+     */
+    std::uint64_t size() const { return HeaderSize + dataLength; }
+
+    /**
+     * @brief Проверяет метку заголовка и читает длину данных.
+     * @param header Начало файла (не менее HeaderSize байт).
+     * @param length Прочитанная длина данных.
+     * @return false, если файл записан не этим классом.
+     */
+    static bool parseHeader(const char* header, std::uint64_t& length);
+
+private:
+    bool map(std::uint64_t size);    /**< Отобразить файл размером size */
+    void unmap();                    /**< Снять отображение */
+    void storeLength();              /**< Записать длину данных в заголовок */
+
+    platform::FileHandle file = platform::InvalidFile;  /**< Дескриптор файла */
+    platform::FileView view;         /**< Отображение файла */
+    std::uint64_t dataLength = 0;    /**< Длина записанных данных после заголовка */
+    std::uint64_t segment = 0;       /**< Шаг увеличения файла */
+};
@@ -0,0 +1,456 @@
+﻿#include "NetworkSink.h"
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <climits>
+#include <string>
+
+namespace {
+
+#ifdef _WIN32
+using SocketLength = int;
+constexpr int SendFlags = 0;
+constexpr int MessageTooLong = WSAEMSGSIZE;
+
+/**
+ * @brief Код последней ошибки сокета.
+ */
+int socketError() {
+    return WSAGetLastError();
+}
+
+/**
+ * @brief Операция не выполнена, потому что сокет неблокирующий (в том числе начатый connect()).
+ */
+bool wouldBlock(int error) {
+    return error == WSAEWOULDBLOCK;
+}
+
+/**
+ * @brief Переводит сокет в неблокирующий режим.
+ */
+bool setNonBlocking(SOCKET s) {
+    u_long nonBlocking = 1;
+    return ioctlsocket(s, FIONBIO, &nonBlocking) == 0;
+}
+#else
+using SOCKET = int;
+using SocketLength = socklen_t;
+constexpr SOCKET INVALID_SOCKET = -1;
+constexpr int SOCKET_ERROR = -1;
+constexpr int SendFlags = MSG_NOSIGNAL;  /**< Разрыв соединения - ошибка send(), а не SIGPIPE */
+constexpr int MessageTooLong = EMSGSIZE;
+
+int socketError() {
+    return errno;
+}
+
+bool wouldBlock(int error) {
+    return error == EWOULDBLOCK || error == EAGAIN || error == EINPROGRESS;
+}
+
+bool setNonBlocking(SOCKET s) {
+    int flags = fcntl(s, F_GETFL, 0);
+    return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+int closesocket(SOCKET s) {
+    return close(s);
+}
+#endif
+
+/**
+ * @brief Отправляет байты в сокет.
+ * @return Отправлено байт или SOCKET_ERROR.
+ */
+int sendBytes(SOCKET s, const char* data, std::size_t size) {
+    int length = static_cast<int>((std::min)(size, static_cast<std::size_t>(INT_MAX)));
+    return static_cast<int>(::send(s, data, length, SendFlags));
+}
+
+}
+
+/**
+ * @brief Конструктор. Инициализирует Winsock (Windows) и разрешает адрес коллектора.
+ * @param protocol UDP или TCP.
+ * @param host Имя или адрес коллектора.
+ * @param port Порт коллектора.
+ * @param format Текстовый или двоичный формат.
+ */
+NetworkSink::NetworkSink(NetworkProtocol protocol, const std::string& host, std::uint16_t port, FileFormat format)
+    : protocol(protocol),
+    format(format),
+    host(host),
+    port(port),
+    chunkSize(protocol == NetworkProtocol::Udp ? DefaultDatagramSize : DefaultStreamChunkSize),
+    socketHandle(static_cast<std::uintptr_t>(INVALID_SOCKET)),
+    reconnectDelay(minReconnectDelay) {
+#ifdef _WIN32
+    WSADATA data;
+    socketsReady = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+    socketsReady = true;
+#endif
+    if (socketsReady) resolve();
+}
+
+/**
+ * @brief Деструктор. Последняя неблокирующая попытка отправки; неотправленное теряется.
+ */
+NetworkSink::~NetworkSink() {
+    sendPending();
+    if (socketHandle != static_cast<std::uintptr_t>(INVALID_SOCKET)) closesocket(static_cast<SOCKET>(socketHandle));
+#ifdef _WIN32
+    if (socketsReady) WSACleanup();
+#endif
+}
+
+/**
+ * @brief Настраивает буфер повторной отправки.
+ * @param capacity Ёмкость в байтах.
+ * @param policy Политика переполнения.
+ * @param minKeptLevel Порог уровня для DropBelowLevel.
+ */
+void NetworkSink::setRetryBuffer(std::size_t capacity, BackpressurePolicy policy, LogLevel minKeptLevel) {
+    retryCapacity = capacity;
+    retryPolicy = policy;
+    retryLevel = minKeptLevel;
+}
+
+/**
+ * @brief Задаёт паузы между попытками подключения.
+ * @param minDelay Начальная пауза.
+ * @param maxDelay Предельная пауза.
+ */
+void NetworkSink::setReconnectDelay(std::chrono::milliseconds minDelay, std::chrono::milliseconds maxDelay) {
+    minReconnectDelay = minDelay;
+    maxReconnectDelay = (std::max)(minDelay, maxDelay);
+    reconnectDelay = minReconnectDelay;
+}
+
+/**
+ * @brief Счётчики сообщений, отброшенных буфером повторной отправки.
+ * @return Снимок счётчиков.
+ */
+DropCounters NetworkSink::getDropCounters() const {
+    DropCounters counters;
+    counters.droppedNewest = droppedNewest.load(std::memory_order_relaxed);
+    counters.droppedOldest = droppedOldest.load(std::memory_order_relaxed);
+    counters.droppedBelowLevel = droppedBelowLevel.load(std::memory_order_relaxed);
+    return counters;
+}
+
+/**
+ * @brief Ставит пачку в буфер повторной отправки и отправляет, сколько примет сокет.
+ * @param batch Пачка сообщений.
+ */
+void NetworkSink::write(const LogBatch& batch) {
+    if (format == FileFormat::Binary) appendBinary(batch);
+    else appendText(batch);
+    sendPending();
+}
+
+/**
+ * @brief Продолжает отправку буфера; вызывается и когда новых сообщений нет.
+ */
+void NetworkSink::flush() {
+    sendPending();
+}
+
+/**
+ * @brief Нарезает строки пачки на куски не больше chunkSize.
+ * @param batch Пачка сообщений.
+ */
+void NetworkSink::appendText(const LogBatch& batch) {
+    LogLevel threshold = level();
+
+    beginChunk();
+    for (const FormattedLine& line : batch.lines) {
+        if (line.level < threshold) continue;
+
+        std::string_view text = batch.line(line);
+        if (current.messages > 0 && current.data.size() + text.size() > chunkSize) {
+            finishChunk();
+            beginChunk();
+        }
+        current.data += text;
+        ++current.messages;
+        if (line.level > current.maxLevel) current.maxLevel = line.level;
+    }
+    if (current.messages > 0) finishChunk();
+}
+
+/**
+ * @brief Кодирует сообщения пачки кусками, у каждого из которых свой словарь.
+ *
+ * Сообщение, которое не помещается в текущий кусок, кодируется заново
+ * в следующем, чтобы его записи Site и String попали вместе с ним.
+ *
+ * @param batch Пачка сообщений.
+ */
+void NetworkSink::appendBinary(const LogBatch& batch) {
+    LogLevel threshold = level();
+
+    beginChunk();
+    for (const BatchRecord& entry : batch.records) {
+        if (entry.site->level < threshold) continue;
+
+        record.clear();
+        if (!encoder.encodeRecord(entry, record)) continue;
+        if (current.messages > 0 && current.data.size() + record.size() > chunkSize) {
+            finishChunk();
+            beginChunk();
+            record.clear();
+            encoder.encodeRecord(entry, record);
+        }
+        current.data += record;
+        ++current.messages;
+        if (entry.site->level > current.maxLevel) current.maxLevel = entry.site->level;
+    }
+    if (current.messages > 0) finishChunk();
+}
+
+/**
+ * @brief Начинает новый кусок: датаграмма двоичного формата получает метку, словарь сбрасывается.
+ */
+void NetworkSink::beginChunk() {
+    current.data.clear();
+    current.messages = 0;
+    current.maxLevel = LogLevel::TRACE;
+    encoder.reset();
+    if (format == FileFormat::Binary && protocol == NetworkProtocol::Udp) {
+        current.data += BinaryLogMagic;
+    }
+}
+
+/**
+ * @brief Ставит собранный кусок в буфер повторной отправки.
+ *
+ * При нехватке места применяется retryPolicy. Первый кусок,
+ * уже начатый в TCP-потоке, не вытесняется.
+ */
+void NetworkSink::finishChunk() {
+    std::size_t size = current.data.size();
+    std::size_t locked = frontSent > 0 ? 1 : 0;
+
+    auto evict = [this](std::deque<Chunk>::iterator it, std::atomic<std::uint64_t>& counter) {
+        counter.fetch_add(it->messages, std::memory_order_relaxed);
+        pendingBytes -= it->data.size();
+        return pending.erase(it);
+        };
+
+    if (pendingBytes + size > retryCapacity) {
+        switch (retryPolicy) {
+        case BackpressurePolicy::DropOldest:
+            while (pending.size() > locked && pendingBytes + size > retryCapacity) {
+                evict(pending.begin() + locked, droppedOldest);
+            }
+            break;
+        case BackpressurePolicy::DropBelowLevel:
+            for (auto it = pending.begin() + locked; it != pending.end() && pendingBytes + size > retryCapacity;) {
+                if (it->maxLevel < retryLevel) it = evict(it, droppedBelowLevel);
+                else ++it;
+            }
+            if (current.maxLevel >= retryLevel) {
+                while (pending.size() > locked && pendingBytes + size > retryCapacity) {
+                    evict(pending.begin() + locked, droppedOldest);
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (pendingBytes + size > retryCapacity) {
+        std::atomic<std::uint64_t>& counter = retryPolicy == BackpressurePolicy::DropBelowLevel && current.maxLevel < retryLevel
+            ? droppedBelowLevel : droppedNewest;
+        counter.fetch_add(current.messages, std::memory_order_relaxed);
+        return;
+    }
+
+    pendingBytes += size;
+    pending.push_back(std::move(current));
+    current = Chunk();
+}
+
+/**
+ * @brief Отправляет куски, пока сокет их принимает.
+ *
+ * Ошибка соединения закрывает сокет; данные остаются в буфере
+ * до следующего подключения. Датаграмма, слишком большая для сети,
+ * отбрасывается.
+ */
+void NetworkSink::sendPending() {
+    if (pending.empty() || !ensureConnected()) return;
+
+    SOCKET s = static_cast<SOCKET>(socketHandle);
+    if (protocol == NetworkProtocol::Tcp && format == FileFormat::Binary) {
+        while (preambleSent < BinaryLogMagic.size()) {
+            int sent = sendBytes(s, BinaryLogMagic.data() + preambleSent, BinaryLogMagic.size() - preambleSent);
+            if (sent == SOCKET_ERROR) {
+                if (!wouldBlock(socketError())) disconnect();
+                return;
+            }
+            preambleSent += static_cast<std::size_t>(sent);
+        }
+    }
+
+    while (!pending.empty()) {
+        Chunk& chunk = pending.front();
+        int sent = sendBytes(s, chunk.data.data() + frontSent, chunk.data.size() - frontSent);
+        if (sent == SOCKET_ERROR) {
+            int error = socketError();
+            if (wouldBlock(error)) return;
+            countFailure();
+            if (protocol == NetworkProtocol::Udp && error == MessageTooLong) {
+                droppedNewest.fetch_add(chunk.messages, std::memory_order_relaxed);
+                pendingBytes -= chunk.data.size();
+                pending.pop_front();
+                continue;
+            }
+            disconnect();
+            return;
+        }
+
+        frontSent += static_cast<std::size_t>(sent);
+        if (protocol == NetworkProtocol::Tcp && frontSent < chunk.data.size()) continue;
+
+        countWrite(chunk.data.size());
+        pendingBytes -= chunk.data.size();
+        pending.pop_front();
+        frontSent = 0;
+    }
+}
+
+/**
+ * @brief Продвигает подключение, не блокируя поток.
+ *
+ * UDP-сокет связывается с адресом сразу (connect() для датаграмм
+ * только запоминает получателя). TCP-подключение запускается
+ * неблокирующим connect() и проверяется select() с нулевым ожиданием.
+ *
+ * @return true, если можно отправлять.
+ */
+bool NetworkSink::ensureConnected() {
+    State observed = state.load(std::memory_order_relaxed);
+    if (observed == State::Connected) return true;
+    if (!socketsReady) return false;
+
+    if (observed == State::Disconnected) {
+        if (std::chrono::steady_clock::now() < nextAttempt) return false;
+        if (address.empty() && !resolve()) {
+            disconnect();
+            return false;
+        }
+
+        const sockaddr* target = reinterpret_cast<const sockaddr*>(address.data());
+        SOCKET s = ::socket(target->sa_family,
+            protocol == NetworkProtocol::Udp ? SOCK_DGRAM : SOCK_STREAM,
+            protocol == NetworkProtocol::Udp ? IPPROTO_UDP : IPPROTO_TCP);
+        if (s == INVALID_SOCKET) {
+            disconnect();
+            return false;
+        }
+        socketHandle = static_cast<std::uintptr_t>(s);
+
+        if (!setNonBlocking(s)) {
+            disconnect();
+            return false;
+        }
+        if (protocol == NetworkProtocol::Tcp) {
+            int noDelay = 1;
+            setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+        }
+
+        if (::connect(s, target, static_cast<SocketLength>(address.size())) == 0) {
+            state.store(State::Connected, std::memory_order_relaxed);
+        }
+        else if (protocol == NetworkProtocol::Tcp && wouldBlock(socketError())) {
+            state.store(State::Connecting, std::memory_order_relaxed);
+        }
+        else {
+            disconnect();
+            return false;
+        }
+    }
+
+    if (state.load(std::memory_order_relaxed) == State::Connecting) {
+        SOCKET s = static_cast<SOCKET>(socketHandle);
+        fd_set writable;
+        fd_set failed;
+        FD_ZERO(&writable);
+        FD_ZERO(&failed);
+        FD_SET(s, &writable);
+        FD_SET(s, &failed);
+        timeval immediately{ 0, 0 };
+        if (select(static_cast<int>(s) + 1, nullptr, &writable, &failed, &immediately) <= 0) return false;
+
+        int error = 0;
+        SocketLength length = sizeof(error);
+        if (FD_ISSET(s, &failed) || getsockopt(s, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &length) != 0
+            || error != 0) {
+            disconnect();
+            return false;
+        }
+        state.store(State::Connected, std::memory_order_relaxed);
+    }
+
+    reconnectDelay = minReconnectDelay;
+    preambleSent = 0;
+    frontSent = 0;
+    return true;
+}
+
+/**
+ * @brief Закрывает сокет и назначает следующую попытку с удвоенной паузой.
+ *
+ * Начатый в TCP-потоке кусок будет отправлен целиком заново: новое
+ * соединение начинается с чистого потока.
+ */
+void NetworkSink::disconnect() {
+    if (socketHandle != static_cast<std::uintptr_t>(INVALID_SOCKET)) {
+        closesocket(static_cast<SOCKET>(socketHandle));
+        socketHandle = static_cast<std::uintptr_t>(INVALID_SOCKET);
+    }
+    state.store(State::Disconnected, std::memory_order_relaxed);
+    frontSent = 0;
+    preambleSent = 0;
+
+    nextAttempt = std::chrono::steady_clock::now() + reconnectDelay;
+    reconnectDelay = (std::min)(reconnectDelay * 2, maxReconnectDelay);
+}
+
+/**
+ * @brief Разрешает адрес коллектора через getaddrinfo.
+ *
+ * Вызывается из конструктора; поток обработки повторяет разрешение
+ * только если оно ещё не удалось (оно может занять время на DNS).
+ *
+ * @return false, если адрес не найден.
+ */
+bool NetworkSink::resolve() {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = protocol == NetworkProtocol::Udp ? SOCK_DGRAM : SOCK_STREAM;
+
+    addrinfo* result = nullptr;
+    std::string service = std::to_string(port);
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &result) != 0 || result == nullptr) {
+        return false;
+    }
+    address.assign(reinterpret_cast<const char*>(result->ai_addr), result->ai_addrlen);
+    freeaddrinfo(result);
+    return true;
+}
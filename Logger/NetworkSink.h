@@ -0,0 +1,166 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+#include "BinaryLog.h"
+#include "LogSink.h"
+
+/**
+ * @enum NetworkProtocol
+ * @brief Транспорт сетевого приёмника.
+ */
+enum class NetworkProtocol {
+    Udp,  /**< Датаграммы; каждая содержит целые строки или самодостаточные двоичные записи */
+    Tcp   /**< Поток; при каждом подключении начинается заново */
+};
+
+/**
+ * @class NetworkSink
+ * @brief Отправка сообщений коллектору по UDP или TCP.
+ *
+ * Пачка режется на куски не больше chunkSize байт (целые строки
+ * или двоичные записи), куски попадают в буфер повторной отправки
+ * и отправляются через неблокирующий сокет из write() и flush().
+ * Поток обработки никогда не ждёт сеть: если сокет не готов или
+ * соединение потеряно, данные остаются в буфере, а подключение
+ * повторяется с экспоненциально растущей паузой.
+ *
+ * В двоичном формате каждый кусок кодируется с собственным словарём,
+ * поэтому после переподключения или потери датаграммы остальные
+ * данные читаются без потерь. Каждая датаграмма UDP и каждое новое
+ * TCP-соединение начинаются с BinaryLogMagic.
+ *
+ * Настройки задаются до передачи приёмника в Logger::addSink().
+ */
+class NetworkSink : public LogSink {
+public:
+    static constexpr std::size_t DefaultDatagramSize = 8 * 1024;    /**< Размер куска для UDP */
+    static constexpr std::size_t DefaultStreamChunkSize = 64 * 1024;  /**< Размер куска для TCP */
+    static constexpr std::size_t DefaultRetryBufferSize = 4 * 1024 * 1024;  /**< Ёмкость буфера повторной отправки */
+
+    /**
+     * @brief Конструктор. Разрешает адрес коллектора; подключение выполняет поток обработки.
+     * @param protocol UDP или TCP.
+     * @param host Имя или адрес коллектора.
+     * @param port Порт коллектора.
+     * @param format Текстовые строки или двоичные записи (BinaryLog.h).
+     */
+    NetworkSink(NetworkProtocol protocol, const std::string& host, std::uint16_t port,
+        FileFormat format = FileFormat::Text);
+    ~NetworkSink() override;
+
+    NetworkSink(const NetworkSink&) = delete;
+    NetworkSink& operator=(const NetworkSink&) = delete;
+
+    void write(const LogBatch& batch) override;
+    void flush() override;
+    bool needsText() const override { return format == FileFormat::Text; }
+    bool hasPending() const override { return !pending.empty(); }
+
+    /**
+     * @brief Задаёт наибольший размер куска (датаграммы или одной записи в поток).
+     *
+     * Строка или запись длиннее куска отправляется отдельным куском.
+     *
+     * @param size Размер в байтах.
+     */
+    void setChunkSize(std::size_t size) { chunkSize = size > 0 ? size : 1; }
+
+    /**
+     * @brief Настраивает буфер повторной отправки.
+     *
+     * Политики переполнения те же, что у очереди логгера, но поток
+     * обработки не блокируется: Block ведёт себя как DropNewest.
+     * DropBelowLevel сначала вытесняет самые старые куски без сообщений
+     * уровня minKeptLevel и выше, а новый кусок без таких сообщений отбрасывает.
+     *
+     * @param capacity Ёмкость в байтах.
+     * @param policy Политика переполнения.
+     * @param minKeptLevel Порог уровня для DropBelowLevel.
+     */
+    void setRetryBuffer(std::size_t capacity, BackpressurePolicy policy = BackpressurePolicy::DropOldest,
+        LogLevel minKeptLevel = LogLevel::ERROR_);
+
+    /**
+     * @brief Задаёт паузы между попытками подключения.
+     * @param minDelay Пауза после первой неудачи и после успешного подключения.
+     * @param maxDelay Предел, до которого пауза удваивается.
+     */
+    void setReconnectDelay(std::chrono::milliseconds minDelay, std::chrono::milliseconds maxDelay);
+
+    /**
+     * @brief Сколько сообщений отброшено при переполнении буфера повторной отправки.
+     */
+    DropCounters getDropCounters() const;
+
+    /**
+     * @brief Подключён ли сокет к коллектору.
+     */
+    bool isConnected() const { return state.load(std::memory_order_relaxed) == State::Connected; }
+
+private:
+    /**
+     * @enum State
+     * @brief Состояние соединения.
+     */
+    enum class State {
+        Disconnected,  /**< Сокета нет, ждём времени следующей попытки */
+        Connecting,    /**< Неблокирующее подключение TCP в процессе */
+        Connected      /**< Можно отправлять */
+    };
+
+    /**
+     * @struct Chunk
+     * @brief Кусок данных в буфере повторной отправки.
+     */
+    struct Chunk {
+        std::string data;               /**< Байты для отправки */
+        std::uint32_t messages = 0;     /**< Сообщений в куске */
+        LogLevel maxLevel = LogLevel::TRACE;  /**< Наибольший уровень среди сообщений */
+    };
+
+    void appendText(const LogBatch& batch);    /**< Нарезать текст пачки на куски */
+    void appendBinary(const LogBatch& batch);  /**< Закодировать пачку кусками */
+    void beginChunk();                         /**< Начать новый кусок в current */
+    void finishChunk();                        /**< Поставить current в буфер с учётом политики */
+    void sendPending();                        /**< Отправить всё, что принимает сокет */
+    bool ensureConnected();                    /**< Довести подключение до State::Connected */
+    void disconnect();                         /**< Закрыть сокет и отложить следующую попытку */
+    bool resolve();                            /**< Разрешить адрес коллектора */
+
+    const NetworkProtocol protocol;  /**< Транспорт */
+    const FileFormat format;         /**< Формат данных */
+    const std::string host;          /**< Имя коллектора */
+    const std::uint16_t port;        /**< Порт коллектора */
+
+    std::size_t chunkSize;           /**< Наибольший размер куска */
+    std::size_t retryCapacity = DefaultRetryBufferSize;  /**< Ёмкость буфера повторной отправки */
+    BackpressurePolicy retryPolicy = BackpressurePolicy::DropOldest;  /**< Политика переполнения */
+    LogLevel retryLevel = LogLevel::ERROR_;  /**< Порог уровня для DropBelowLevel */
+    std::chrono::milliseconds minReconnectDelay{ 100 };   /**< Начальная пауза переподключения */
+    std::chrono::milliseconds maxReconnectDelay{ 30000 }; /**< Предельная пауза переподключения */
+
+    bool socketsReady = false;       /**< Сокеты доступны (в Windows - выполнен WSAStartup) */
+    std::string address;             /**< Разрешённый адрес (sockaddr) */
+    std::uintptr_t socketHandle;     /**< Сокет (SOCKET или дескриптор) либо INVALID_SOCKET */
+    std::atomic<State> state{ State::Disconnected };  /**< Состояние соединения */
+    std::chrono::steady_clock::time_point nextAttempt{};  /**< Время следующей попытки подключения */
+    std::chrono::milliseconds reconnectDelay;  /**< Текущая пауза переподключения */
+    std::size_t preambleSent = 0;    /**< Сколько байт BinaryLogMagic уже отправлено в TCP-соединение */
+
+    std::deque<Chunk> pending;       /**< Буфер повторной отправки */
+    std::size_t pendingBytes = 0;    /**< Байт в pending */
+    std::size_t frontSent = 0;       /**< Сколько байт первого куска уже ушло в TCP-поток */
+    Chunk current;                   /**< Собираемый кусок */
+    std::string record;              /**< Запись одного сообщения (двоичный формат) */
+    BinaryLogEncoder encoder;        /**< Словарь текущего куска */
+
+    std::atomic<std::uint64_t> droppedNewest{ 0 };      /**< Отброшено новых сообщений */
+    std::atomic<std::uint64_t> droppedOldest{ 0 };      /**< Вытеснено старых сообщений */
+    std::atomic<std::uint64_t> droppedBelowLevel{ 0 };  /**< Отброшено по уровню */
+};
@@ -0,0 +1,139 @@
+﻿#include "Payload.h"
+
+/**
+ * @brief Общий пул процесса.
+ * @return Пул, существующий до завершения процесса.
+ */
+SpillArena& SpillArena::instance() {
+    static SpillArena* arena = new SpillArena();
+    return *arena;
+}
+
+/**
+ * @brief Индекс класса размеров.
+ * @param size Требуемый размер.
+ * @return Индекс класса или ClassCount, если размер больше максимального класса.
+ */
+std::size_t SpillArena::classIndex(std::size_t size) {
+    std::size_t index = 0;
+    std::size_t blockSize = MinBlockSize;
+    while (blockSize < size && index < ClassCount) {
+        blockSize <<= 1;
+        ++index;
+    }
+    return index;
+}
+
+/**
+ * @brief Выделяет блок из списка свободных или из кучи.
+ * @param minSize Минимальный размер.
+ * @param capacity Фактический размер блока.
+ * @return Блок памяти.
+ */
+char* SpillArena::allocate(std::size_t minSize, std::size_t& capacity) {
+    std::size_t index = classIndex(minSize);
+    if (index >= ClassCount) {
+        capacity = minSize;
+        return new char[minSize];
+    }
+
+    capacity = MinBlockSize << index;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<char*>& blocks = freeBlocks[index];
+        if (!blocks.empty()) {
+            char* block = blocks.back();
+            blocks.pop_back();
+            return block;
+        }
+    }
+    return new char[capacity];
+}
+
+/**
+ * @brief Возвращает блок в список свободных своего класса.
+ * @param block Блок памяти.
+ * @param capacity Размер блока.
+ */
+void SpillArena::release(char* block, std::size_t capacity) {
+    std::size_t index = classIndex(capacity);
+    if (index < ClassCount && (MinBlockSize << index) == capacity) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<char*>& blocks = freeBlocks[index];
+        if (blocks.size() < MaxCachedPerClass) {
+            blocks.push_back(block);
+            return;
+        }
+    }
+    delete[] block;
+}
+
+/**
+ * @brief Переносит данные в блок SpillArena достаточного размера.
+ * @param needed Требуемая ёмкость.
+ */
+void PayloadBuffer::grow(std::size_t needed) {
+    std::size_t newCapacity = 0;
+    char* block = SpillArena::instance().allocate(needed < 2 * capacity() ? 2 * capacity() : needed, newCapacity);
+    std::char_traits<char>::copy(block, data(), length);
+
+    if (spill) {
+        SpillArena::instance().release(spill, spillCapacity);
+    }
+    spill = block;
+    spillCapacity = newCapacity;
+}
+
+/**
+ * @brief Подключает поток вывода к буферу.
+ *
+ * Общий экземпляр потока выполнения занят, пока жив Scope; вложенный
+ * Scope (лог из operator<<) создаёт свой поток, чтобы не перенаправить
+ * и не сбросить поток внешнего сообщения.
+ *
+ * @param target Буфер для текста.
+ */
+PayloadStream::Scope::Scope(PayloadBuffer& target) {
+    thread_local PayloadStream instance;
+
+    if (instance.buffer.target == nullptr) {
+        active = &instance;
+    }
+    else {
+        nested.reset(new PayloadStream());
+        active = nested.get();
+    }
+    active->buffer.target = &target;
+
+    std::ostream& stream = active->stream;
+    stream.clear();
+    stream.flags(std::ios_base::skipws | std::ios_base::dec);
+    stream.precision(6);
+    stream.width(0);
+    stream.fill(' ');
+}
+
+/**
+ * @brief Отключает поток от буфера и освобождает общий экземпляр.
+ */
+PayloadStream::Scope::~Scope() {
+    active->buffer.target = nullptr;
+}
+
+/**
+ * @brief Записывает один символ в подключённый буфер.
+ */
+PayloadStream::StreamBuf::int_type PayloadStream::StreamBuf::overflow(int_type ch) {
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        target->push_back(traits_type::to_char_type(ch));
+    }
+    return traits_type::not_eof(ch);
+}
+
+/**
+ * @brief Записывает последовательность символов в подключённый буфер.
+ */
+std::streamsize PayloadStream::StreamBuf::xsputn(const char* s, std::streamsize count) {
+    target->append(s, static_cast<std::size_t>(count));
+    return count;
+}
@@ -0,0 +1,210 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class SpillArena
+ * @brief Пул блоков для редких сообщений, не помещающихся во встроенный буфер.
+ *
+ * Блоки выделяются классами размеров (степени двойки от 1 КБ до 128 КБ)
+ * и после освобождения возвращаются в список свободных, так что в установившемся
+ * режиме даже длинные сообщения не обращаются к куче. Блоки крупнее
+ * максимального класса выделяются и освобождаются напрямую.
+ */
+class SpillArena {
+public:
+    /**
+     * @brief Общий пул процесса. Не разрушается при завершении,
+     * чтобы его можно было использовать из деструкторов глобальных логгеров.
+     */
+    static SpillArena& instance();
+
+    /**
+     * @brief Выделяет блок не меньше заданного размера.
+     * @param minSize Минимальный размер блока.
+     * @param capacity Фактический размер выделенного блока.
+     * @return Указатель на блок.
+     */
+    char* allocate(std::size_t minSize, std::size_t& capacity);
+
+    /**
+     * @brief Возвращает блок в пул.
+     * @param block Блок, полученный от allocate().
+     * @param capacity Размер блока, возвращённый allocate().
+     */
+    void release(char* block, std::size_t capacity);
+
+private:
+    static constexpr std::size_t MinBlockSize = 1024;        /**< Размер наименьшего класса */
+    static constexpr std::size_t ClassCount = 8;             /**< Количество классов (до 128 КБ) */
+    static constexpr std::size_t MaxCachedPerClass = 64;     /**< Предел свободных блоков в классе */
+
+    static std::size_t classIndex(std::size_t size);  /**< Индекс класса для размера */
+
+    std::mutex mutex;                           /**< Мьютекс списков свободных блоков */
+    std::vector<char*> freeBlocks[ClassCount];  /**< Свободные блоки по классам */
+};
+
+/**
+ * @class PayloadBuffer
+ * @brief Буфер аргументов сообщения со встроенным хранилищем.
+ *
+ * До InlineCapacity байт хранятся внутри объекта, поэтому элемент очереди
+ * имеет фиксированный размер и не требует выделений памяти. Более длинные
+ * данные переносятся в блок SpillArena. Буфер только перемещается:
+ * перемещение копирует занятые байты встроенной части либо передаёт блок.
+ */
+class PayloadBuffer {
+public:
+    static constexpr std::size_t InlineCapacity = 256;  /**< Размер встроенного хранилища */
+
+    PayloadBuffer() = default;
+    ~PayloadBuffer() { reset(); }
+
+    PayloadBuffer(PayloadBuffer&& other) noexcept { moveFrom(other); }
+    PayloadBuffer& operator=(PayloadBuffer&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    PayloadBuffer(const PayloadBuffer&) = delete;
+    PayloadBuffer& operator=(const PayloadBuffer&) = delete;
+
+    /**
+     * @brief Дописывает байты в конец буфера.
+     * @param bytes Данные.
+     * @param count Количество байт.
+     */
+    void append(const char* bytes, std::size_t count) {
+        if (length + count > capacity()) grow(length + count);
+        std::char_traits<char>::copy(data() + length, bytes, count);
+        length += static_cast<std::uint32_t>(count);
+    }
+
+    /**
+     * @brief Дописывает один байт.
+     * @param byte Байт.
+     */
+    void push_back(char byte) {
+        if (length == capacity()) grow(length + 1);
+        data()[length++] = byte;
+    }
+
+    /**
+     * @brief Указатель на начало данных.
+     */
+    char* data() { return spill ? spill : inlineData; }
+    const char* data() const { return spill ? spill : inlineData; }
+
+    /**
+     * @brief Количество занятых байт.
+     */
+    std::size_t size() const { return length; }
+
+    /**
+     * @brief Содержимое буфера.
+     */
+    std::string_view view() const { return std::string_view(data(), length); }
+
+    /**
+     * @brief Освобождает внешний блок и очищает буфер.
+     */
+    void reset() {
+        if (spill) {
+            SpillArena::instance().release(spill, spillCapacity);
+            spill = nullptr;
+            spillCapacity = 0;
+        }
+        length = 0;
+    }
+
+private:
+    std::size_t capacity() const { return spill ? spillCapacity : InlineCapacity; }
+
+    void grow(std::size_t needed);  /**< Перенести данные в блок SpillArena нужного размера */
+
+    void moveFrom(PayloadBuffer& other) noexcept {
+        length = other.length;
+        spill = other.spill;
+        spillCapacity = other.spillCapacity;
+        if (!spill) {
+            std::char_traits<char>::copy(inlineData, other.inlineData, length);
+        }
+        other.spill = nullptr;
+        other.spillCapacity = 0;
+        other.length = 0;
+    }
+
+    char* spill = nullptr;          /**< Внешний блок или nullptr */
+    std::size_t spillCapacity = 0;  /**< Размер внешнего блока */
+    std::uint32_t length = 0;       /**< Количество занятых байт */
+    char inlineData[InlineCapacity];  /**< Встроенное хранилище */
+};
+
+/**
+ * @class PayloadStream
+ * @brief std::ostream, пишущий напрямую в PayloadBuffer.
+ *
+ * Используется для форматирования через operator<< без промежуточной
+ * std::string. Экземпляр на поток переиспользуется, состояние потока
+ * (флаги, точность, ширина) сбрасывается при каждом подключении буфера.
+ * Если operator<< сам пишет в лог, вложенный вызов получает собственный
+ * поток, а общий остаётся подключённым к буферу внешнего сообщения.
+ */
+class PayloadStream {
+public:
+    /**
+     * @class Scope
+     * @brief Подключение потока к буферу на время форматирования одного аргумента.
+     *
+     * Первое подключение в потоке выполнения занимает общий экземпляр,
+     * вложенное (из operator<<, который пишет в лог) создаёт свой.
+     * Деструктор освобождает общий экземпляр, в том числе при исключении.
+     */
+    class Scope {
+    public:
+        /**
+         * @brief Подключает поток к буферу.
+         * @param target Буфер, в который пишется текст.
+         */
+        explicit Scope(PayloadBuffer& target);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        /**
+         * @brief Поток со сброшенным состоянием, пишущий в буфер.
+         */
+        std::ostream& stream() { return active->stream; }
+
+    private:
+        PayloadStream* active;                  /**< Подключённый поток */
+        std::unique_ptr<PayloadStream> nested;  /**< Собственный поток вложенного подключения */
+    };
+
+private:
+    class StreamBuf : public std::streambuf {
+    public:
+        PayloadBuffer* target = nullptr;  /**< Текущий буфер */
+
+    protected:
+        int_type overflow(int_type ch) override;
+        std::streamsize xsputn(const char* s, std::streamsize count) override;
+    };
+
+    PayloadStream() : stream(&buffer) {}
+
+    StreamBuf buffer;       /**< Буфер потока */
+    std::ostream stream;    /**< Поток вывода */
+};
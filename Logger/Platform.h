@@ -0,0 +1,307 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Обёртки над системными вызовами Windows и Linux.
+ *
+ * Файлы, консоль, потоки и время логгер получает только через эти функции
+ * (сокеты NetworkSink совпадают на обеих платформах почти полностью и
+ * различаются прямо в NetworkSink.cpp). Реализация для Windows находится
+ * в PlatformWindows.cpp, для Linux и других POSIX-систем - в PlatformPosix.cpp.
+ * Оба файла входят в сборку, каждый компилируется только на своей платформе.
+ */
+namespace platform {
+
+/**
+ * @brief Дескриптор открытого файла: HANDLE в Windows, номер дескриптора в POSIX.
+ */
+using FileHandle = std::intptr_t;
+
+/**
+ * @brief Недействительный дескриптор (INVALID_HANDLE_VALUE или -1).
+ */
+inline constexpr FileHandle InvalidFile = -1;
+
+/**
+ * @brief Местное время для момента time.
+ * @param time Секунды от эпохи.
+ * @param out Разложенное время.
+ * @return false, если время не представимо.
+ */
+bool localTime(std::time_t time, std::tm& out);
+
+/**
+ * @brief Время UTC для момента time.
+ * @param time Секунды от эпохи.
+ * @param out Разложенное время.
+ * @return false, если время не представимо.
+ */
+bool utcTime(std::time_t time, std::tm& out);
+
+/**
+ * @brief Конвертирует UTF-8 в UTF-16 (Windows) или UTF-32 (POSIX).
+ *
+ * Некорректные последовательности заменяются символом U+FFFD.
+ *
+ * @param utf8 Строка UTF-8.
+ * @return Широкая строка.
+ */
+std::wstring utf8ToWide(std::string_view utf8);
+
+/**
+ * @brief Привязывает текущий поток к ядрам.
+ * @param mask Битовая маска ядер; 0 - все ядра, доступные процессу.
+ */
+void setThreadAffinity(std::uint64_t mask);
+
+/**
+ * @brief Меняет приоритет текущего потока.
+ *
+ * В Linux уровень переводится в значение nice потока; повышение
+ * приоритета без CAP_SYS_NICE молча не выполняется.
+ *
+ * @param level От -2 (самый низкий) до 2 (самый высокий); 0 - обычный.
+ */
+void setThreadPriority(int level);
+
+/**
+ * @brief Подсказка процессору, что поток крутится в цикле опроса (pause, yield).
+ */
+void cpuRelax();
+
+/**
+ * @brief Системный номер текущего потока (GetCurrentThreadId, gettid).
+ *
+ * Номер запоминается в thread_local при первом вызове, поэтому повторные
+ * вызовы не обращаются к системе.
+ */
+std::uint32_t currentThreadId();
+
+/**
+ * @brief Системный номер текущего процесса.
+ */
+std::uint32_t currentProcessId();
+
+/**
+ * @brief Устанавливает функцию, вызываемую при необработанном исключении SEH.
+ *
+ * Прежний фильтр вызывается после hook. В POSIX сбои приходят только
+ * сигналами, и функция ничего не делает.
+ *
+ * @param hook Функция аварийной выгрузки.
+ */
+void installExceptionHook(void (*hook)());
+
+/**
+ * @brief Открывает файл для дописывания или создаёт его.
+ *
+ * Не выделяет память, поэтому пригоден для обработчика сбоя.
+ *
+ * @param path Путь к файлу.
+ * @return Дескриптор или InvalidFile.
+ */
+FileHandle openForAppend(const char* path);
+
+/**
+ * @brief Открывает файл для чтения и записи или создаёт его.
+ * @param path Путь к файлу.
+ * @param truncate Обрезать существующий файл.
+ * @return Дескриптор или InvalidFile.
+ */
+FileHandle openReadWrite(const char* path, bool truncate);
+
+/**
+ * @brief Закрывает дескриптор.
+ * @param file Дескриптор; InvalidFile игнорируется.
+ */
+void closeFile(FileHandle file);
+
+/**
+ * @brief Размер файла.
+ * @param file Дескриптор.
+ * @param size Размер в байтах.
+ * @return false при ошибке.
+ */
+bool fileSize(FileHandle file, std::uint64_t& size);
+
+/**
+ * @brief Устанавливает размер файла (обрезает или дополняет нулями).
+ * @param file Дескриптор.
+ * @param size Новый размер.
+ * @return false при ошибке.
+ */
+bool resizeFile(FileHandle file, std::uint64_t size);
+
+/**
+ * @brief Записывает все байты синхронно, повторяя частичные записи.
+ *
+ * Не выделяет память; в POSIX безопасна в обработчике сигнала.
+ *
+ * @param file Дескриптор.
+ * @param data Данные.
+ * @param size Размер данных.
+ * @return false, если запись не удалась.
+ */
+bool writeAll(FileHandle file, const char* data, std::size_t size);
+
+/**
+ * @brief Дескриптор stdout или InvalidFile.
+ */
+FileHandle standardOutput();
+
+/**
+ * @brief Дескриптор stderr или InvalidFile.
+ */
+FileHandle standardError();
+
+/**
+ * @brief Готовит дескриптор к выводу UTF-8, если это консоль.
+ *
+ * В Windows переключает кодовую страницу вывода консоли на UTF-8.
+ *
+ * @param file Дескриптор stdout.
+ * @return true, если дескриптор - консоль (терминал), а не файл или канал.
+ */
+bool prepareConsole(FileHandle file);
+
+/**
+ * @brief Выводит байты UTF-8 в консоль.
+ *
+ * В Windows - WriteConsoleA частями, так как старые версии ограничивают
+ * размер одного вызова; в POSIX совпадает с writeAll().
+ *
+ * @param file Дескриптор консоли.
+ * @param data Данные.
+ * @param size Размер данных.
+ * @return false, если вывод не удался.
+ */
+bool writeConsole(FileHandle file, const char* data, std::size_t size);
+
+/**
+ * @struct FileView
+ * @brief Отображение файла в память.
+ */
+struct FileView {
+    char* data = nullptr;        /**< Начало отображения */
+    std::uint64_t size = 0;      /**< Размер отображения */
+    FileHandle mapping = InvalidFile;  /**< Объект отображения (Windows) */
+};
+
+/**
+ * @brief Отображает файл в память для записи, увеличивая его до size байт.
+ * @param file Дескриптор, открытый openReadWrite().
+ * @param size Размер отображения.
+ * @param view Заполняемое отображение.
+ * @return false при ошибке.
+ */
+bool mapFile(FileHandle file, std::uint64_t size, FileView& view);
+
+/**
+ * @brief Снимает отображение. Пустое отображение игнорируется.
+ * @param view Отображение.
+ */
+void unmapFile(FileView& view);
+
+/**
+ * @brief Инициирует запись изменённых страниц отображения, не дожидаясь её.
+ * @param view Отображение.
+ */
+void flushFileView(const FileView& view);
+
+/**
+ * @class AppendFile
+ * @brief Файл, в который данные только дописываются прямыми системными вызовами.
+ *
+ * Каждая запись - один системный вызов без промежуточного буфера
+ * библиотеки: текст пачки уже собран потоком обработки.
+ *
+ * Linux: O_APPEND и writev (несколько частей одной записью), место
+ * резервируется fallocate(FALLOC_FL_KEEP_SIZE) шагами PreallocationStep,
+ * чтобы файловая система не выделяла блоки на каждую пачку; при закрытии
+ * неиспользованный резерв освобождается.
+ *
+ * Windows: FILE_APPEND_DATA и overlapped WriteFile. Данные копируются
+ * в один из двух буферов, и запись идёт, пока поток обработки готовит
+ * следующую пачку; перед повторным использованием буфера и в flush()
+ * поток дожидается завершения предыдущей записи. Место резервируется
+ * SetFileInformationByHandle(FileAllocationInfo) с тем же шагом.
+ *
+ * В обоих случаях запись идёт в конец файла, поэтому аварийная выгрузка
+ * (openForAppend()) может дописывать в тот же файл.
+ */
+class AppendFile {
+public:
+    static constexpr std::uint64_t PreallocationStep = 8ull * 1024 * 1024;  /**< Шаг резервирования места */
+
+    AppendFile();
+    ~AppendFile();
+
+    AppendFile(const AppendFile&) = delete;
+    AppendFile& operator=(const AppendFile&) = delete;
+
+    /**
+     * @brief Открывает или создаёт файл, закрывая предыдущий.
+     * @param path Путь к файлу.
+     * @param truncate Обрезать существующий файл.
+     * @return true, если файл открыт.
+     */
+    bool open(const std::string& path, bool truncate);
+
+    /**
+     * @brief Дожидается записи, освобождает резерв и закрывает файл.
+     */
+    void close();
+
+    /**
+     * @brief Открыт ли файл.
+     */
+    bool isOpen() const { return handle != InvalidFile; }
+
+    /**
+     * @brief Размер файла вместе с ещё не завершёнными записями.
+     */
+    std::uint64_t size() const { return end; }
+
+    /**
+     * @brief Дописывает данные.
+     * @param data Данные.
+     * @param size Размер данных.
+     * @return false, если запись не удалась.
+     */
+    bool write(const char* data, std::size_t size) {
+        std::string_view part(data, size);
+        return write(&part, 1);
+    }
+
+    /**
+     * @brief Дописывает несколько частей одной записью.
+     * @param parts Части.
+     * @param count Число частей.
+     * @return false, если запись не удалась.
+     */
+    bool write(const std::string_view* parts, std::size_t count);
+
+    /**
+     * @brief Дожидается, пока начатые записи переданы системе.
+     * @return false, если последняя запись не удалась.
+     */
+    bool flush();
+
+private:
+    struct Pending;                  /**< Состояние overlapped-записи (Windows) */
+
+    void reserve(std::uint64_t required);  /**< Зарезервировать место под required байт */
+
+    FileHandle handle = InvalidFile; /**< Дескриптор файла */
+    std::uint64_t end = 0;           /**< Размер файла */
+    std::uint64_t reserved = 0;      /**< Зарезервированное место */
+    std::unique_ptr<Pending> pending;  /**< Буферы и OVERLAPPED (только Windows) */
+};
+
+}
@@ -0,0 +1,421 @@
+﻿#include "Platform.h"
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+namespace platform {
+
+namespace {
+
+constexpr int MaxWriteParts = 64;  /**< Частей в одном вызове writev (не больше IOV_MAX) */
+
+/**
+ * @brief Номер дескриптора из FileHandle.
+ */
+int descriptor(FileHandle file) {
+    return static_cast<int>(file);
+}
+
+/**
+ * @brief Резервирует или выделяет блоки файла.
+ * @param file Дескриптор.
+ * @param keepSize Не менять размер файла (FALLOC_FL_KEEP_SIZE).
+ * @param offset Начало диапазона.
+ * @param length Длина диапазона.
+ * @return false, если файловая система не поддерживает резервирование.
+ */
+bool allocate(int file, bool keepSize, std::uint64_t offset, std::uint64_t length) {
+#if defined(__linux__)
+    return fallocate(file, keepSize ? FALLOC_FL_KEEP_SIZE : 0,
+        static_cast<off_t>(offset), static_cast<off_t>(length)) == 0;
+#else
+    (void)file; (void)keepSize; (void)offset; (void)length;
+    return false;
+#endif
+}
+
+}
+
+/**
+ * @struct AppendFile::Pending
+ * @brief В POSIX запись синхронна, состояние не нужно.
+ */
+struct AppendFile::Pending {};
+
+/**
+ * @brief Местное время (localtime_r).
+ */
+bool localTime(std::time_t time, std::tm& out) {
+    return localtime_r(&time, &out) != nullptr;
+}
+
+/**
+ * @brief Время UTC (gmtime_r).
+ */
+bool utcTime(std::time_t time, std::tm& out) {
+    return gmtime_r(&time, &out) != nullptr;
+}
+
+/**
+ * @brief Декодирует UTF-8 в UTF-32 (wchar_t в POSIX - 32 бита).
+ *
+ * Отклоняются неполные и избыточно длинные последовательности,
+ * суррогаты и значения больше U+10FFFF.
+ */
+std::wstring utf8ToWide(std::string_view utf8) {
+    constexpr char32_t MinCode[] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+    std::wstring wide;
+    wide.reserve(utf8.size());
+    std::size_t i = 0;
+    while (i < utf8.size()) {
+        unsigned lead = static_cast<unsigned char>(utf8[i]);
+        std::size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+        char32_t code = length == 1 ? lead : lead & (0x7Fu >> length);
+
+        bool valid = length != 0 && i + length <= utf8.size();
+        for (std::size_t k = 1; valid && k < length; ++k) {
+            unsigned next = static_cast<unsigned char>(utf8[i + k]);
+            valid = (next & 0xC0) == 0x80;
+            code = (code << 6) | (next & 0x3F);
+        }
+        if (valid && (code < MinCode[length] || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))) {
+            valid = false;
+        }
+
+        if (!valid) {
+            wide += static_cast<wchar_t>(0xFFFD);
+            ++i;
+            continue;
+        }
+        wide += static_cast<wchar_t>(code);
+        i += length;
+    }
+    return wide;
+}
+
+/**
+ * @brief Привязывает поток к ядрам через sched_setaffinity.
+ *
+ * Для нулевой маски поток получает все ядра; ядро само ограничивает
+ * набор разрешёнными процессу (cpuset).
+ */
+void setThreadAffinity(std::uint64_t mask) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (mask == 0 || (cpu < 64 && ((mask >> cpu) & 1) != 0)) CPU_SET(cpu, &set);
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+#else
+    (void)mask;
+#endif
+}
+
+/**
+ * @brief Меняет nice текущего потока: уровни -2..2 соответствуют nice 10, 5, 0, -5, -10.
+ */
+void setThreadPriority(int level) {
+#if defined(__linux__)
+    level = level < -2 ? -2 : level > 2 ? 2 : level;
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), -5 * level);
+#else
+    (void)level;
+#endif
+}
+
+/**
+ * @brief Подсказка процессору: pause на x86, yield на ARM.
+ */
+void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/**
+ * @brief Номер потока: gettid в Linux, в прочих системах - порядковый номер потока в процессе.
+ */
+std::uint32_t currentThreadId() {
+#if defined(__linux__)
+    thread_local std::uint32_t id = static_cast<std::uint32_t>(syscall(SYS_gettid));
+#else
+    static std::atomic<std::uint32_t> next{ 1 };
+    thread_local std::uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+#endif
+    return id;
+}
+
+/**
+ * @brief Номер процесса (getpid).
+ */
+std::uint32_t currentProcessId() {
+    return static_cast<std::uint32_t>(getpid());
+}
+
+/**
+ * @brief SEH в POSIX нет: сбои перехватываются сигналами.
+ */
+void installExceptionHook(void (*hook)()) {
+    (void)hook;
+}
+
+/**
+ * @brief Открывает файл с O_APPEND.
+ */
+FileHandle openForAppend(const char* path) {
+    return ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+}
+
+/**
+ * @brief Открывает файл для чтения и записи.
+ */
+FileHandle openReadWrite(const char* path, bool truncate) {
+    return ::open(path, O_RDWR | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+}
+
+/**
+ * @brief Закрывает дескриптор.
+ */
+void closeFile(FileHandle file) {
+    if (file != InvalidFile) ::close(descriptor(file));
+}
+
+/**
+ * @brief Размер файла (fstat).
+ */
+bool fileSize(FileHandle file, std::uint64_t& size) {
+    struct stat info;
+    if (fstat(descriptor(file), &info) != 0) return false;
+
+    size = static_cast<std::uint64_t>(info.st_size);
+    return true;
+}
+
+/**
+ * @brief Устанавливает размер файла (ftruncate).
+ */
+bool resizeFile(FileHandle file, std::uint64_t size) {
+    return ftruncate(descriptor(file), static_cast<off_t>(size)) == 0;
+}
+
+/**
+ * @brief Записывает все байты, повторяя прерванные и частичные вызовы write.
+ */
+bool writeAll(FileHandle file, const char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(descriptor(file), data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+/**
+ * @brief Дескриптор stdout.
+ */
+FileHandle standardOutput() {
+    return STDOUT_FILENO;
+}
+
+/**
+ * @brief Дескриптор stderr.
+ */
+FileHandle standardError() {
+    return STDERR_FILENO;
+}
+
+/**
+ * @brief Терминал ли stdout (isatty); терминал уже принимает UTF-8.
+ */
+bool prepareConsole(FileHandle file) {
+    return isatty(descriptor(file)) == 1;
+}
+
+/**
+ * @brief Выводит байты в терминал.
+ */
+bool writeConsole(FileHandle file, const char* data, std::size_t size) {
+    return writeAll(file, data, size);
+}
+
+/**
+ * @brief Отображает файл через mmap(MAP_SHARED).
+ *
+ * Блоки новой части файла выделяются fallocate: запись в дыру
+ * разреженного файла при нехватке места закончилась бы SIGBUS.
+ * Если файловая система не умеет fallocate, файл просто удлиняется.
+ */
+bool mapFile(FileHandle file, std::uint64_t size, FileView& view) {
+    std::uint64_t current = 0;
+    if (!fileSize(file, current)) return false;
+    if (size > current && !allocate(descriptor(file), false, current, size - current) && !resizeFile(file, size)) {
+        return false;
+    }
+
+    void* address = mmap(nullptr, static_cast<std::size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor(file), 0);
+    if (address == MAP_FAILED) return false;
+
+    view.data = static_cast<char*>(address);
+    view.size = size;
+    view.mapping = InvalidFile;
+    return true;
+}
+
+/**
+ * @brief Снимает отображение (munmap).
+ */
+void unmapFile(FileView& view) {
+    if (view.data != nullptr) {
+        munmap(view.data, static_cast<std::size_t>(view.size));
+    }
+    view = FileView{};
+}
+
+/**
+ * @brief Инициирует запись страниц (msync с MS_ASYNC).
+ */
+void flushFileView(const FileView& view) {
+    if (view.data != nullptr) {
+        msync(view.data, static_cast<std::size_t>(view.size), MS_ASYNC);
+    }
+}
+
+/**
+ * @brief Конструктор.
+ */
+AppendFile::AppendFile() = default;
+
+/**
+ * @brief Деструктор. Закрывает файл.
+ */
+AppendFile::~AppendFile() {
+    close();
+}
+
+/**
+ * @brief Открывает файл с O_APPEND.
+ */
+bool AppendFile::open(const std::string& path, bool truncate) {
+    close();
+
+    int file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+    if (file < 0) return false;
+
+    std::uint64_t existing = 0;
+    if (!fileSize(file, existing)) {
+        ::close(file);
+        return false;
+    }
+    handle = file;
+    end = existing;
+    reserved = existing;
+    return true;
+}
+
+/**
+ * @brief Закрывает файл.
+ *
+ * Усечение до текущего размера освобождает блоки, зарезервированные
+ * за концом файла; размер берётся у файла, а не у счётчика, так как
+ * аварийная выгрузка могла дописать строки мимо этого объекта.
+ */
+void AppendFile::close() {
+    if (handle == InvalidFile) return;
+
+    std::uint64_t actual = 0;
+    if (reserved > end && fileSize(handle, actual)) {
+        resizeFile(handle, actual);
+    }
+    ::close(descriptor(handle));
+    handle = InvalidFile;
+    end = 0;
+    reserved = 0;
+}
+
+/**
+ * @brief Дописывает части вызовами writev, продолжая после частичной записи.
+ */
+bool AppendFile::write(const std::string_view* parts, std::size_t count) {
+    if (handle == InvalidFile) return false;
+
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < count; ++i) total += parts[i].size();
+    if (total == 0) return true;
+    reserve(end + total);
+
+    std::size_t index = 0;
+    std::size_t offset = 0;
+    while (index < count) {
+        iovec vectors[MaxWriteParts];
+        int used = 0;
+        for (std::size_t i = index; i < count && used < MaxWriteParts; ++i) {
+            std::size_t skip = i == index ? offset : 0;
+            if (parts[i].size() == skip) continue;
+            vectors[used].iov_base = const_cast<char*>(parts[i].data() + skip);
+            vectors[used].iov_len = parts[i].size() - skip;
+            ++used;
+        }
+        if (used == 0) break;
+
+        ssize_t written = ::writev(descriptor(handle), vectors, used);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        end += static_cast<std::uint64_t>(written);
+
+        std::size_t left = static_cast<std::size_t>(written);
+        while (index < count && left >= parts[index].size() - offset) {
+            left -= parts[index].size() - offset;
+            ++index;
+            offset = 0;
+        }
+        offset += left;
+    }
+    return true;
+}
+
+/**
+ * @brief Запись синхронна: данные уже в кэше страниц.
+ */
+bool AppendFile::flush() {
+    return handle != InvalidFile;
+}
+
+/**
+ * @brief Резервирует место шагами PreallocationStep, не меняя размер файла.
+ *
+ * Неудача (файловая система без fallocate) не мешает записи;
+ * повторная попытка будет только на следующем шаге.
+ */
+void AppendFile::reserve(std::uint64_t required) {
+    if (required <= reserved) return;
+
+    std::uint64_t target = (required / PreallocationStep + 1) * PreallocationStep;
+    allocate(descriptor(handle), true, reserved, target - reserved);
+    reserved = target;
+}
+
+}
+
+#endif
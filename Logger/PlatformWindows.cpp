@@ -0,0 +1,407 @@
+﻿#include "Platform.h"
+
+#ifdef _WIN32
+
+#include <algorithm>
+#include <windows.h>
+
+namespace platform {
+
+namespace {
+
+constexpr DWORD MaxConsoleChunk = 32 * 1024;       /**< Наибольший вызов WriteConsoleA */
+constexpr DWORD MaxFileChunk = 1024 * 1024 * 1024; /**< Наибольший вызов WriteFile */
+
+void (*exceptionHook)() = nullptr;                 /**< Функция аварийной выгрузки */
+LPTOP_LEVEL_EXCEPTION_FILTER previousExceptionFilter = nullptr;  /**< Прежний фильтр исключений SEH */
+
+/**
+ * @brief HANDLE из FileHandle.
+ */
+HANDLE nativeHandle(FileHandle file) {
+    return reinterpret_cast<HANDLE>(file);
+}
+
+/**
+ * @brief FileHandle из HANDLE; nullptr и INVALID_HANDLE_VALUE дают InvalidFile.
+ */
+FileHandle fromNative(HANDLE handle) {
+    return handle == nullptr || handle == INVALID_HANDLE_VALUE ? InvalidFile : reinterpret_cast<FileHandle>(handle);
+}
+
+/**
+ * @brief Фильтр необработанных исключений SEH.
+ */
+LONG WINAPI exceptionFilter(EXCEPTION_POINTERS* info) {
+    if (exceptionHook != nullptr) exceptionHook();
+    return previousExceptionFilter != nullptr ? previousExceptionFilter(info) : EXCEPTION_CONTINUE_SEARCH;
+}
+
+}
+
+/**
+ * @struct AppendFile::Pending
+ * @brief Незавершённая overlapped-запись и два буфера для чередования.
+ */
+struct AppendFile::Pending {
+    OVERLAPPED overlapped{};   /**< Описание текущей записи; hEvent создаётся в open() */
+    std::string buffers[2];    /**< Данные записи в полёте и следующей записи */
+    int current = 0;           /**< Буфер для следующей записи */
+    bool inFlight = false;     /**< Запись начата и не завершена */
+    DWORD length = 0;          /**< Длина записи в полёте */
+
+    /**
+     * @brief Дожидается записи в полёте.
+     * @param file Дескриптор файла.
+     * @return false, если запись не удалась или записано меньше length.
+     */
+    bool wait(HANDLE file) {
+        if (!inFlight) return true;
+
+        inFlight = false;
+        DWORD written = 0;
+        return GetOverlappedResult(file, &overlapped, &written, TRUE) && written == length;
+    }
+};
+
+/**
+ * @brief Местное время (localtime_s).
+ */
+bool localTime(std::time_t time, std::tm& out) {
+    return localtime_s(&out, &time) == 0;
+}
+
+/**
+ * @brief Время UTC (gmtime_s).
+ */
+bool utcTime(std::time_t time, std::tm& out) {
+    return gmtime_s(&out, &time) == 0;
+}
+
+/**
+ * @brief Конвертирует UTF-8 в UTF-16 через MultiByteToWideChar.
+ */
+std::wstring utf8ToWide(std::string_view utf8) {
+    if (utf8.empty()) return std::wstring();
+
+    int size = MultiByteToWideChar(CP_UTF8, 0, utf8.data(), static_cast<int>(utf8.size()), nullptr, 0);
+    std::wstring wide(static_cast<std::size_t>(size), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, utf8.data(), static_cast<int>(utf8.size()), wide.data(), size);
+    return wide;
+}
+
+/**
+ * @brief Привязывает поток к ядрам; нулевая маска - маска процесса.
+ */
+void setThreadAffinity(std::uint64_t mask) {
+    DWORD_PTR threadMask = static_cast<DWORD_PTR>(mask);
+    if (threadMask == 0) {
+        DWORD_PTR systemMask = 0;
+        if (!GetProcessAffinityMask(GetCurrentProcess(), &threadMask, &systemMask)) threadMask = 0;
+    }
+    if (threadMask != 0) SetThreadAffinityMask(GetCurrentThread(), threadMask);
+}
+
+/**
+ * @brief Уровни -2..2 соответствуют THREAD_PRIORITY_LOWEST..THREAD_PRIORITY_HIGHEST.
+ */
+void setThreadPriority(int level) {
+    constexpr int Priorities[] = { THREAD_PRIORITY_LOWEST, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL,
+        THREAD_PRIORITY_ABOVE_NORMAL, THREAD_PRIORITY_HIGHEST };
+    SetThreadPriority(GetCurrentThread(), Priorities[(std::clamp)(level, -2, 2) + 2]);
+}
+
+/**
+ * @brief Подсказка процессору (YieldProcessor).
+ */
+void cpuRelax() {
+    YieldProcessor();
+}
+
+/**
+ * @brief Номер потока (GetCurrentThreadId).
+ */
+std::uint32_t currentThreadId() {
+    thread_local std::uint32_t id = GetCurrentThreadId();
+    return id;
+}
+
+/**
+ * @brief Номер процесса (GetCurrentProcessId).
+ */
+std::uint32_t currentProcessId() {
+    return GetCurrentProcessId();
+}
+
+/**
+ * @brief Устанавливает фильтр необработанных исключений SEH.
+ */
+void installExceptionHook(void (*hook)()) {
+    exceptionHook = hook;
+    previousExceptionFilter = SetUnhandledExceptionFilter(&exceptionFilter);
+}
+
+/**
+ * @brief Открывает файл с правом FILE_APPEND_DATA.
+ */
+FileHandle openForAppend(const char* path) {
+    return fromNative(CreateFileA(path, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+}
+
+/**
+ * @brief Открывает файл для чтения и записи.
+ */
+FileHandle openReadWrite(const char* path, bool truncate) {
+    return fromNative(CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE,
+        nullptr, truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+}
+
+/**
+ * @brief Закрывает дескриптор.
+ */
+void closeFile(FileHandle file) {
+    if (file != InvalidFile) CloseHandle(nativeHandle(file));
+}
+
+/**
+ * @brief Размер файла (GetFileSizeEx).
+ */
+bool fileSize(FileHandle file, std::uint64_t& size) {
+    LARGE_INTEGER value;
+    if (!GetFileSizeEx(nativeHandle(file), &value)) return false;
+
+    size = static_cast<std::uint64_t>(value.QuadPart);
+    return true;
+}
+
+/**
+ * @brief Устанавливает размер файла (SetEndOfFile).
+ */
+bool resizeFile(FileHandle file, std::uint64_t size) {
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(size);
+    return SetFilePointerEx(nativeHandle(file), end, nullptr, FILE_BEGIN) && SetEndOfFile(nativeHandle(file));
+}
+
+/**
+ * @brief Записывает все байты синхронным WriteFile.
+ */
+bool writeAll(FileHandle file, const char* data, std::size_t size) {
+    while (size > 0) {
+        DWORD chunk = static_cast<DWORD>((std::min)(size, static_cast<std::size_t>(MaxFileChunk)));
+        DWORD written = 0;
+        if (!WriteFile(nativeHandle(file), data, chunk, &written, nullptr) || written == 0) return false;
+
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+/**
+ * @brief Дескриптор stdout.
+ */
+FileHandle standardOutput() {
+    return fromNative(GetStdHandle(STD_OUTPUT_HANDLE));
+}
+
+/**
+ * @brief Дескриптор stderr.
+ */
+FileHandle standardError() {
+    return fromNative(GetStdHandle(STD_ERROR_HANDLE));
+}
+
+/**
+ * @brief Переключает консоль на UTF-8, если stdout - консоль.
+ */
+bool prepareConsole(FileHandle file) {
+    DWORD mode = 0;
+    if (file == InvalidFile || GetConsoleMode(nativeHandle(file), &mode) == 0) return false;
+
+    SetConsoleOutputCP(CP_UTF8);
+    return true;
+}
+
+/**
+ * @brief Выводит байты в консоль частями через WriteConsoleA.
+ */
+bool writeConsole(FileHandle file, const char* data, std::size_t size) {
+    while (size > 0) {
+        DWORD chunk = static_cast<DWORD>((std::min)(size, static_cast<std::size_t>(MaxConsoleChunk)));
+        DWORD written = 0;
+        if (!WriteConsoleA(nativeHandle(file), data, chunk, &written, nullptr) || written == 0) return false;
+
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+/**
+ * @brief Отображает файл через CreateFileMappingA и MapViewOfFile.
+ */
+bool mapFile(FileHandle file, std::uint64_t size, FileView& view) {
+    HANDLE mapping = CreateFileMappingA(nativeHandle(file), nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xFFFFFFFFu), nullptr);
+    if (mapping == nullptr) return false;
+
+    void* address = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, static_cast<std::size_t>(size));
+    if (address == nullptr) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    view.data = static_cast<char*>(address);
+    view.size = size;
+    view.mapping = fromNative(mapping);
+    return true;
+}
+
+/**
+ * @brief Снимает отображение и закрывает объект отображения.
+ */
+void unmapFile(FileView& view) {
+    if (view.data != nullptr) {
+        UnmapViewOfFile(view.data);
+    }
+    closeFile(view.mapping);
+    view = FileView{};
+}
+
+/**
+ * @brief Инициирует запись страниц (FlushViewOfFile).
+ */
+void flushFileView(const FileView& view) {
+    if (view.data != nullptr) {
+        FlushViewOfFile(view.data, 0);
+    }
+}
+
+/**
+ * @brief Конструктор. Создаёт буферы overlapped-записи.
+ */
+AppendFile::AppendFile()
+    : pending(std::make_unique<Pending>()) {
+}
+
+/**
+ * @brief Деструктор. Дожидается записи и закрывает файл.
+ */
+AppendFile::~AppendFile() {
+    close();
+}
+
+/**
+ * @brief Открывает файл для overlapped-записи в конец.
+ *
+ * Доступ на запись открыт и другим дескрипторам: аварийная
+ * выгрузка дописывает строки в тот же файл.
+ */
+bool AppendFile::open(const std::string& path, bool truncate) {
+    close();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER existing;
+    HANDLE event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    if (event == nullptr || !GetFileSizeEx(file, &existing)) {
+        if (event != nullptr) CloseHandle(event);
+        CloseHandle(file);
+        return false;
+    }
+
+    pending->overlapped = OVERLAPPED{};
+    pending->overlapped.hEvent = event;
+    handle = fromNative(file);
+    end = static_cast<std::uint64_t>(existing.QuadPart);
+    reserved = end;
+    return true;
+}
+
+/**
+ * @brief Дожидается записи, возвращает резерв и закрывает файл.
+ */
+void AppendFile::close() {
+    if (handle == InvalidFile) return;
+
+    HANDLE file = nativeHandle(handle);
+    pending->wait(file);
+
+    LARGE_INTEGER actual;
+    if (reserved > end && GetFileSizeEx(file, &actual)) {
+        FILE_ALLOCATION_INFO allocation{};
+        allocation.AllocationSize = actual;
+        SetFileInformationByHandle(file, FileAllocationInfo, &allocation, sizeof(allocation));
+    }
+    CloseHandle(pending->overlapped.hEvent);
+    pending->overlapped.hEvent = nullptr;
+    CloseHandle(file);
+    handle = InvalidFile;
+    end = 0;
+    reserved = 0;
+}
+
+/**
+ * @brief Собирает части в свободный буфер и начинает overlapped-запись.
+ *
+ * Копирование идёт, пока предыдущая запись ещё выполняется. Смещение
+ * 0xFFFFFFFF:0xFFFFFFFF означает запись в конец файла. Ошибка записи,
+ * завершившейся асинхронно, возвращается следующим вызовом write() или flush().
+ */
+bool AppendFile::write(const std::string_view* parts, std::size_t count) {
+    if (handle == InvalidFile) return false;
+
+    std::string& buffer = pending->buffers[pending->current];
+    buffer.clear();
+    for (std::size_t i = 0; i < count; ++i) buffer.append(parts[i]);
+    if (buffer.empty()) return true;
+
+    HANDLE file = nativeHandle(handle);
+    if (!pending->wait(file)) return false;
+    reserve(end + buffer.size());
+
+    OVERLAPPED& overlapped = pending->overlapped;
+    HANDLE event = overlapped.hEvent;
+    overlapped = OVERLAPPED{};
+    overlapped.hEvent = event;
+    overlapped.Offset = 0xFFFFFFFFu;
+    overlapped.OffsetHigh = 0xFFFFFFFFu;
+
+    DWORD length = static_cast<DWORD>(buffer.size());
+    if (!WriteFile(file, buffer.data(), length, nullptr, &overlapped) && GetLastError() != ERROR_IO_PENDING) {
+        return false;
+    }
+    pending->inFlight = true;
+    pending->length = length;
+    pending->current ^= 1;
+    end += length;
+    return true;
+}
+
+/**
+ * @brief Дожидается записи в полёте.
+ */
+bool AppendFile::flush() {
+    return handle != InvalidFile && pending->wait(nativeHandle(handle));
+}
+
+/**
+ * @brief Резервирует место шагами PreallocationStep (FileAllocationInfo), не меняя размер файла.
+ */
+void AppendFile::reserve(std::uint64_t required) {
+    if (required <= reserved) return;
+
+    std::uint64_t target = (required / PreallocationStep + 1) * PreallocationStep;
+    FILE_ALLOCATION_INFO allocation{};
+    allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(target);
+    SetFileInformationByHandle(nativeHandle(handle), FileAllocationInfo, &allocation, sizeof(allocation));
+    reserved = target;
+}
+
+}
+
+#endif
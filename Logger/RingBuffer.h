@@ -0,0 +1,204 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+
+/**
+ * @brief Размер кэш-линии, по которому выравниваются разделяемые данные.
+ */
+inline constexpr std::size_t CacheLineSize = 64;
+
+/**
+ * @class RingBuffer
+ * @brief Ограниченный lock-free кольцевой буфер "много писателей - один читатель" (MPSC).
+ *
+ * Каждая ячейка хранит счётчик последовательности (схема Д. Вьюкова):
+ * писатели резервируют позицию через CAS на enqueuePos и публикуют значение
+ * записью счётчика ячейки. Извлечение также резервирует позицию через CAS,
+ * поэтому помимо основного читателя элемент может вытеснить и писатель
+ * (политика отбрасывания самых старых сообщений).
+ * Ячейки и счётчики позиций выровнены по кэш-линии, чтобы соседние писатели
+ * не делили одну линию.
+ *
+ * @tparam T Тип элемента. Должен быть конструируемым по умолчанию и перемещаемым.
+ */
+template<typename T>
+class RingBuffer {
+public:
+    /**
+     * @brief Конструктор.
+     * @param capacity Желаемая ёмкость, округляется вверх до степени двойки.
+     */
+    explicit RingBuffer(std::size_t capacity)
+        : mask(roundUpToPowerOfTwo(capacity) - 1),
+          slots(std::make_unique<Slot[]>(mask + 1)) {
+        for (std::size_t i = 0; i <= mask; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    /**
+     * @brief Помещает элемент в буфер. Безопасно для нескольких писателей.
+     * @param value Элемент; перемещается только при успешной вставке.
+     * @return false, если буфер заполнен.
+     */
+    bool tryPush(T&& value) {
+        std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots[pos & mask];
+            std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->value = std::move(value);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Извлекает самый старый элемент из буфера.
+     *
+     * Основной читатель - поток обработки; писатели вызывают метод
+     * только для вытеснения старых элементов при переполнении.
+     *
+     * @param out Приёмник извлечённого элемента.
+     * @return false, если буфер пуст.
+     */
+    bool tryPop(T& out) {
+        return tryPopBefore(out, (std::numeric_limits<std::size_t>::max)());
+    }
+
+    /**
+     * @brief Извлекает самый старый элемент, если его позиция меньше limit.
+     *
+     * Позиция проверяется при резервировании, поэтому элемент за границей
+     * не извлекается, даже если писатель одновременно вытесняет старые.
+     *
+     * @param out Приёмник извлечённого элемента.
+     * @param limit Граница позиций (см. pushPosition()).
+     * @return false, если буфер пуст или следующий элемент за границей.
+     */
+    bool tryPopBefore(T& out, std::size_t limit) {
+        std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            if (pos >= limit) return false;
+            slot = &slots[pos & mask];
+            std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        out = std::move(slot->value);
+        slot->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Извлекает самый старый элемент, не перемещая его из ячейки.
+     *
+     * Элемент передаётся visit по константной ссылке и остаётся в ячейке
+     * до перезаписи, поэтому ни перемещение, ни освобождение его памяти
+     * не выполняются. Используется аварийной выгрузкой, где выделять
+     * и освобождать память нельзя.
+     *
+     * @param visit Вызывается с извлечённым элементом.
+     * @return false, если буфер пуст.
+     */
+    template<typename Visitor>
+    bool tryConsume(Visitor&& visit) {
+        std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots[pos & mask];
+            std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        visit(static_cast<const T&>(slot->value));
+        slot->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Число позиций, зарезервированных писателями с момента создания.
+     */
+    std::size_t pushPosition() const { return enqueuePos.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Число позиций, извлечённых с момента создания.
+     */
+    std::size_t popPosition() const { return dequeuePos.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Проверяет, есть ли в буфере опубликованный элемент.
+     * @return true, если читателю нечего извлечь.
+     */
+    bool empty() const {
+        std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        return slots[pos & mask].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    /**
+     * @brief Ёмкость буфера.
+     */
+    std::size_t capacity() const { return mask + 1; }
+
+private:
+    struct alignas(CacheLineSize) Slot {
+        std::atomic<std::size_t> sequence{ 0 };  /**< Счётчик последовательности ячейки */
+        T value{};                               /**< Хранимый элемент */
+    };
+
+    static std::size_t roundUpToPowerOfTwo(std::size_t value) {
+        std::size_t result = 2;
+        while (result < value) result <<= 1;
+        return result;
+    }
+
+    const std::size_t mask;            /**< Маска индекса (ёмкость - 1) */
+    std::unique_ptr<Slot[]> slots;     /**< Ячейки буфера */
+
+    alignas(CacheLineSize) std::atomic<std::size_t> enqueuePos{ 0 };  /**< Позиция записи (писатели) */
+    alignas(CacheLineSize) std::atomic<std::size_t> dequeuePos{ 0 };  /**< Позиция чтения */
+};
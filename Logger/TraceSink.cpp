@@ -0,0 +1,71 @@
+﻿#include "TraceSink.h"
+#include "LogFormat.h"
+
+/**
+ * @brief Деструктор. Завершает и закрывает файл.
+ */
+TraceSink::~TraceSink() {
+    close();
+}
+
+/**
+ * @brief Создаёт файл трассировки и пишет начало массива событий.
+ * @param path Путь к файлу.
+ * @return true, если файл открыт.
+ */
+bool TraceSink::open(const std::string& path) {
+    close();
+    if (!file.open(path, true)) return false;
+
+    firstEvent = true;
+    return file.write("[\n", 2);
+}
+
+/**
+ * @brief Завершает массив событий и закрывает файл.
+ */
+void TraceSink::close() {
+    if (!file.isOpen()) return;
+
+    file.write("\n]\n", 3);
+    file.close();
+}
+
+/**
+ * @brief Дописывает замеры пачки одной записью.
+ * @param batch Пачка сообщений.
+ */
+void TraceSink::write(const LogBatch& batch) {
+    if (!file.isOpen()) {
+        countFailure();
+        return;
+    }
+
+    // Запятая ставится перед каждым событием, кроме первого в файле;
+    // firstEvent меняется только после успешной записи.
+    LogLevel threshold = level();
+    buffer.clear();
+    for (const BatchRecord& record : batch.records) {
+        if (record.site->level < threshold) continue;
+
+        std::size_t start = buffer.size();
+        if (!firstEvent || start != 0) buffer += ",\n";
+        if (!formatTraceEvent(*record.site, record.payload, processId, buffer, scratch)) buffer.resize(start);
+    }
+    if (buffer.empty()) return;
+
+    if (file.write(buffer.data(), buffer.size())) {
+        firstEvent = false;
+        countWrite(buffer.size());
+    }
+    else {
+        countFailure();
+    }
+}
+
+/**
+ * @brief Дожидается записи начатых событий.
+ */
+void TraceSink::flush() {
+    if (file.isOpen()) file.flush();
+}
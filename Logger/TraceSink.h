@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "LogSink.h"
+#include "Platform.h"
+
+/**
+ * @class TraceSink
+ * @brief Запись замеров LogScope в файл Chrome trace (JSON Array Format).
+ *
+ * Каждый замер пачки становится событием "ph":"X" (formatTraceEvent()),
+ * прочие сообщения пропускаются. Файл открывается chrome://tracing
+ * и ui.perfetto.dev; события одного потока выводятся на общей дорожке tid.
+ * Закрывающая скобка массива дописывается в close(), но формат допускает
+ * её отсутствие, поэтому файл читается и после аварийного завершения.
+ *
+ * Файл открывается до передачи приёмника в Logger::addSink()
+ * и закрывается после removeSink() (или деструктором).
+ */
+class TraceSink : public LogSink {
+public:
+    ~TraceSink() override;
+
+    /**
+     * @brief Создаёт файл трассировки (существующий перезаписывается), закрывая предыдущий.
+     * @param path Путь к файлу.
+     * @return true, если файл открыт.
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Завершает массив событий и закрывает файл.
+     */
+    void close();
+
+    /**
+     * @brief Открыт ли файл.
+     */
+    bool isOpen() const { return file.isOpen(); }
+
+    void write(const LogBatch& batch) override;
+    void flush() override;
+    bool needsText() const override { return false; }
+
+private:
+    platform::AppendFile file;       /**< Файл трассировки */
+    std::string buffer;              /**< События пачки */
+    std::string scratch;             /**< Буфер форматирования аргументов */
+    bool firstEvent = true;          /**< В файле ещё нет событий */
+    std::uint32_t processId = platform::currentProcessId();  /**< Значение pid событий */
+};
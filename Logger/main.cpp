@@ -1,22 +1,36 @@
-﻿#include <windows.h>
-#include <iostream>
-#include <io.h>
-#include <fcntl.h>
+﻿#include <iostream>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <chrono>
 #include "Logger.h"
+#include "Platform.h"
 
-int main() {
-    SetConsoleOutputCP(CP_UTF8);
-    SetConsoleCP(CP_UTF8);
-    _setmode(_fileno(stdout), _O_U16TEXT);
-    _setmode(_fileno(stdin), _O_U16TEXT);
-    setlocale(LC_ALL, "");
+namespace {
+
+/**
+ * @brief Выводит текст UTF-8 в stdout тем же способом, что и ConsoleSink.
+ *
+ * Подсказки и строки лога идут через один дескриптор без перекодирования,
+ * поэтому не перемешиваются и одинаково выглядят в консоли Windows.
+ *
+ * @param text Текст.
+ */
+void print(std::string_view text) {
+    static const platform::FileHandle output = platform::standardOutput();
+    static const bool isConsole = platform::prepareConsole(output);
+    if (output == platform::InvalidFile) return;
+
+    if (isConsole) platform::writeConsole(output, text.data(), text.size());
+    else platform::writeAll(output, text.data(), text.size());
+}
 
-    std::wcout << L"Куда выводить лог? (1 - консоль, 2 - файл, 3 - оба, 4 - пользовательские шаблоны): ";
+}
+
+int main() {
+    print("Куда выводить лог? (1 - консоль, 2 - файл, 3 - оба, 4 - пользовательские шаблоны): ");
     int choice = 0;
-    std::wcin >> choice;
+    std::cin >> choice;
 
     switch (choice) {
     case 1:
@@ -31,14 +45,14 @@ int main() {
     case 4:
         LoggerInstance.setOutputTarget(OutputTarget::Console);
         {
-            std::wcout << L"Выберите шаблон лога:\n";
-            std::wcout << L"1: {t} | {L} | {f}:{l} -> {m}\n";
-            std::wcout << L"2: [{L}] {m}\n";
-            std::wcout << L"3: {t} - {m}\n";
-            std::wcout << L"4: {m} ({f}:{l})\n";
-            std::wcout << L"Введите номер шаблона (1-4): ";
+            print("Выберите шаблон лога:\n");
+            print("1: {t} | {L} | {f}:{l} -> {m}\n");
+            print("2: [{L}] {m}\n");
+            print("3: {t} - {m}\n");
+            print("4: {m} ({f}:{l})\n");
+            print("Введите номер шаблона (1-4): ");
             int fmtChoice = 1;
-            std::wcin >> fmtChoice;
+            std::cin >> fmtChoice;
 
             switch (fmtChoice) {
             case 1:
@@ -60,7 +74,7 @@ int main() {
         }
         break;
     default:
-        std::wcout << L"Неверный выбор. Используется вывод в консоль.\n";
+        print("Неверный выбор. Используется вывод в консоль.\n");
         LoggerInstance.setOutputTarget(OutputTarget::Console);
         break;
     }
@@ -87,6 +101,6 @@ int main() {
 
     std::this_thread::sleep_for(std::chrono::seconds(2));
 
-    std::wcout << L"Завершение программы." << std::endl;
+    print("Завершение программы.\n");
     return 0;
 }
@@ -0,0 +1,385 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Logger.h"
+#include "Platform.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief Шаблоны, которые предлагает демонстрационная программа (main.cpp).
+ */
+constexpr const char* Templates[] = {
+    "{t} | {L} | {f}:{l} -> {m}",
+    "[{L}] {m}",
+    "{t} - {m}",
+    "{m} ({f}:{l})",
+};
+
+/**
+ * @class NullSink
+ * @brief Приёмник, который принимает отформатированный текст и ничего не пишет.
+ *
+ * Текст запрашивается, чтобы поток обработки выполнял полную работу
+ * (сбор, сортировку и форматирование пачки) без затрат на ввод-вывод.
+ */
+class NullSink : public LogSink {
+public:
+    void write(const LogBatch& batch) override { bytes += batch.text.size(); }
+
+    std::uint64_t bytes = 0;  /**< Байт текста, полученных приёмником */
+};
+
+/**
+ * @struct Options
+ * @brief Параметры запуска.
+ */
+struct Options {
+    std::size_t messages = 2000000;        /**< Сообщений в замере пропускной способности (на все потоки) */
+    std::size_t latencyMessages = 200000;  /**< Сообщений в замере задержки */
+    std::size_t consoleMessages = 20000;   /**< Сообщений в замере задержки с консолью */
+    std::size_t maxThreads = 64;           /**< Наибольшее число производителей */
+    std::string outputPath = "LoggerBench.json";  /**< Файл результатов */
+    std::string logDir = "bench_logs";     /**< Каталог файлов лога */
+};
+
+/**
+ * @struct ThroughputResult
+ * @brief Итог замера пропускной способности.
+ */
+struct ThroughputResult {
+    std::size_t threads;   /**< Производителей */
+    std::size_t messages;  /**< Сообщений всего */
+    double seconds;        /**< От старта производителей до завершения flush() */
+};
+
+/**
+ * @struct LatencyResult
+ * @brief Итог замера задержки вызова LOGx.
+ */
+struct LatencyResult {
+    const char* sink;      /**< Приёмник: null, file, console */
+    const char* mode;      /**< Режим форматирования: immediate, deferred */
+    std::size_t messages;  /**< Измеренных вызовов */
+    std::uint64_t p50;     /**< Медиана, нс */
+    std::uint64_t p99;     /**< 99-й процентиль, нс */
+    std::uint64_t p999;    /**< 99.9-й процентиль, нс */
+    std::uint64_t max;     /**< Наибольшая задержка, нс */
+};
+
+/**
+ * @struct FormatResult
+ * @brief Итог замера стоимости форматирования.
+ */
+struct FormatResult {
+    std::string name;      /**< Шаблон или "json" */
+    double nsPerRecord;    /**< Среднее время форматирования одной записи, нс */
+};
+
+/**
+ * @brief Печатает справку по параметрам.
+ */
+void printUsage() {
+    std::fputs(
+        "Использование: LoggerBench [-n сообщений] [-l сообщений] [-t потоков] [-o файл] [-d каталог]\n"
+        "  -n  сообщений в замере пропускной способности, на все потоки (по умолчанию 2000000)\n"
+        "  -l  сообщений в замере задержки (по умолчанию 200000, с консолью - в 10 раз меньше)\n"
+        "  -t  наибольшее число производителей: 1, 2, 4, ... до него (по умолчанию 64)\n"
+        "  -o  файл результатов в JSON (по умолчанию LoggerBench.json)\n"
+        "  -d  каталог файлов лога (по умолчанию bench_logs)\n"
+        "Замер с консолью пишет в stdout; его удобно перенаправить: LoggerBench > NUL\n",
+        stderr);
+}
+
+/**
+ * @brief Разбирает параметры командной строки.
+ * @param argc Число аргументов.
+ * @param argv Аргументы.
+ * @param options Результат.
+ * @return false, если параметры неверны.
+ */
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (value == nullptr) return false;
+
+        if (std::strcmp(argv[i], "-n") == 0) options.messages = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(argv[i], "-l") == 0) {
+            options.latencyMessages = std::strtoull(value, nullptr, 10);
+            options.consoleMessages = (std::max)(options.latencyMessages / 10, std::size_t(1));
+        }
+        else if (std::strcmp(argv[i], "-t") == 0) options.maxThreads = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(argv[i], "-o") == 0) options.outputPath = value;
+        else if (std::strcmp(argv[i], "-d") == 0) options.logDir = value;
+        else return false;
+        ++i;
+    }
+    return options.messages != 0 && options.latencyMessages != 0 && options.maxThreads != 0;
+}
+
+/**
+ * @brief Наносекунды между двумя отсчётами часов.
+ */
+std::uint64_t elapsedNs(Clock::time_point start, Clock::time_point end) {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+/**
+ * @brief Пропускная способность: threads производителей пишут messages сообщений.
+ *
+ * Время считается от одновременного старта производителей (их буферы
+ * уже созданы) до возврата flush(), то есть до записи последнего сообщения.
+ *
+ * @param threads Производителей.
+ * @param messages Сообщений на все потоки.
+ * @return Итог замера.
+ */
+ThroughputResult measureThroughput(std::size_t threads, std::size_t messages) {
+    Logger logger;
+    auto sink = std::make_shared<NullSink>();
+    logger.setOutputTarget(OutputTarget::None);
+    logger.addSink(sink);
+    logger.setFormattingMode(FormattingMode::Deferred);
+
+    std::size_t perThread = (std::max)(messages / threads, std::size_t(1));
+    std::atomic<std::size_t> ready{ 0 };
+    std::atomic<bool> start{ false };
+    std::vector<std::thread> producers;
+    producers.reserve(threads);
+    for (std::size_t t = 0; t < threads; ++t) {
+        producers.emplace_back([&, t] {
+            LOGT_TO(logger, "warm-up ", t);
+            ready.fetch_add(1);
+            while (!start.load(std::memory_order_acquire)) std::this_thread::yield();
+
+            for (std::size_t i = 0; i < perThread; ++i) {
+                LOGI_TO(logger, "request ", i, " from ", t, " took ", 0.25, " ms");
+            }
+            });
+    }
+    while (ready.load() != threads) std::this_thread::yield();
+    logger.flush();
+
+    auto begin = Clock::now();
+    start.store(true, std::memory_order_release);
+    for (auto& producer : producers) producer.join();
+    logger.flush();
+    auto end = Clock::now();
+
+    return { threads, perThread * threads, elapsedNs(begin, end) / 1e9 };
+}
+
+/**
+ * @brief Задержка вызова LOGI_TO в одном потоке.
+ *
+ * Каждый вызов измеряется отдельно; процентили точные (по отсортированным
+ * замерам). Очередь не отбрасывает сообщения, поэтому хвост включает
+ * ожидание места, когда приёмник медленнее производителя.
+ *
+ * @param sinkName null, file или console.
+ * @param mode Режим форматирования.
+ * @param messages Измеряемых вызовов.
+ * @param logDir Каталог файла лога.
+ * @return Итог замера.
+ */
+LatencyResult measureLatency(const char* sinkName, FormattingMode mode, std::size_t messages, const std::string& logDir) {
+    Logger logger;
+    logger.setFormattingMode(mode);
+    if (std::strcmp(sinkName, "file") == 0) {
+        logger.setOutputTarget(OutputTarget::File);
+        logger.init(LogLevel::TRACE, logDir + "/latency.log", false, false);
+    }
+    else if (std::strcmp(sinkName, "console") == 0) {
+        logger.setOutputTarget(OutputTarget::Console);
+    }
+    else {
+        logger.setOutputTarget(OutputTarget::None);
+        logger.addSink(std::make_shared<NullSink>());
+    }
+    LOGT_TO(logger, "warm-up");
+    logger.flush();
+
+    std::vector<std::uint64_t> samples(messages);
+    std::string user = "alice";
+    for (std::size_t i = 0; i < messages; ++i) {
+        auto begin = Clock::now();
+        LOGI_TO(logger, "request ", i, " user ", user, " took ", 0.25, " ms");
+        samples[i] = elapsedNs(begin, Clock::now());
+    }
+    logger.flush();
+
+    std::sort(samples.begin(), samples.end());
+    auto at = [&samples](double q) { return samples[(std::min)(static_cast<std::size_t>(q * samples.size()), samples.size() - 1)]; };
+    return { sinkName, mode == FormattingMode::Deferred ? "deferred" : "immediate", messages,
+        at(0.5), at(0.99), at(0.999), samples.back() };
+}
+
+/**
+ * @brief Стоимость вызова отключённого уровня (среднее по циклу).
+ * @param calls Вызовов.
+ * @return Наносекунд на вызов.
+ */
+double measureDisabled(std::size_t calls) {
+    Logger logger;
+    logger.setOutputTarget(OutputTarget::None);
+    logger.setLogLevel(LogLevel::INFO);
+
+    std::string user = "alice";
+    auto begin = Clock::now();
+    for (std::size_t i = 0; i < calls; ++i) {
+        LOGD_TO(logger, "request ", i, " user ", user);
+    }
+    return static_cast<double>(elapsedNs(begin, Clock::now())) / static_cast<double>(calls);
+}
+
+/**
+ * @brief Стоимость форматирования одной записи в потоке обработки.
+ *
+ * Аргументы сериализуются один раз, как в режиме Deferred, затем запись
+ * многократно форматируется тем же кодом, что и в Logger.
+ *
+ * @param templateText Шаблон или nullptr для LineFormat::JsonLines.
+ * @param records Форматирований.
+ * @return Итог замера.
+ */
+FormatResult measureFormat(const char* templateText, std::size_t records) {
+    static constexpr LogSite site{ LogLevel::INFO, __FILE__, __LINE__ };
+
+    PayloadBuffer payload;
+    ArgumentWriter writer(payload);
+    writer.write(LogLiteral("request "));
+    writer.write(std::size_t(12345));
+    writer.write(LogLiteral(" user "));
+    writer.write(std::string("alice"));
+    writer.write(LogLiteral(" took "));
+    writer.write(0.25);
+    writer.write(LogLiteral(" ms"));
+
+    FormatTemplate format(templateText != nullptr ? templateText : DefaultFormatTemplate);
+    TimestampCache timestamps;
+    timestamps.setPrecision(TimestampPrecision::Milliseconds);
+    std::string out;
+    std::string scratch;
+    auto time = std::chrono::system_clock::now();
+
+    auto begin = Clock::now();
+    for (std::size_t i = 0; i < records; ++i) {
+        out.clear();
+        time += std::chrono::microseconds(10);
+        if (templateText != nullptr) formatRecord(format, timestamps, site, time, payload.view(), out);
+        else formatJsonRecord(timestamps, site, time, payload.view(), out, scratch);
+    }
+    double ns = static_cast<double>(elapsedNs(begin, Clock::now())) / static_cast<double>(records);
+    return { templateText != nullptr ? templateText : "json", ns };
+}
+
+/**
+ * @brief Экранирует строку для JSON (шаблоны не содержат управляющих символов).
+ */
+std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+}
+
+/**
+ * @brief Замеры производительности логгера.
+ *
+ * Пропускная способность для 1-64 производителей, задержка вызова LOGx
+ * с разными приёмниками, стоимость отключённого уровня и форматирования
+ * по шаблонам. Результаты пишутся одним JSON-объектом, чтобы их можно
+ * было сравнивать между версиями; ход замеров печатается в stderr.
+ */
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+    std::filesystem::create_directories(options.logDir);
+
+    std::vector<ThroughputResult> throughput;
+    for (std::size_t threads = 1; threads <= options.maxThreads; threads *= 2) {
+        throughput.push_back(measureThroughput(threads, options.messages));
+        const ThroughputResult& r = throughput.back();
+        std::fprintf(stderr, "throughput %2zu threads: %.0f msg/s\n", r.threads, r.messages / r.seconds);
+    }
+
+    std::vector<LatencyResult> latency;
+    for (const char* sink : { "null", "file", "console" }) {
+        std::size_t count = std::strcmp(sink, "console") == 0 ? options.consoleMessages : options.latencyMessages;
+        for (FormattingMode mode : { FormattingMode::Immediate, FormattingMode::Deferred }) {
+            latency.push_back(measureLatency(sink, mode, count, options.logDir));
+            const LatencyResult& r = latency.back();
+            std::fprintf(stderr, "latency %-7s %-9s p50 %llu ns, p99 %llu ns, p999 %llu ns\n", r.sink, r.mode,
+                static_cast<unsigned long long>(r.p50), static_cast<unsigned long long>(r.p99),
+                static_cast<unsigned long long>(r.p999));
+        }
+    }
+
+    double disabledNs = measureDisabled(options.messages * 10);
+    std::fprintf(stderr, "disabled level: %.2f ns/call\n", disabledNs);
+
+    std::vector<FormatResult> formatting;
+    for (const char* text : Templates) formatting.push_back(measureFormat(text, options.latencyMessages));
+    formatting.push_back(measureFormat(nullptr, options.latencyMessages));
+    for (const FormatResult& r : formatting) {
+        std::fprintf(stderr, "format %-28s %.1f ns/record\n", r.name.c_str(), r.nsPerRecord);
+    }
+
+    std::ofstream out(options.outputPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::fprintf(stderr, "Не удалось создать %s\n", options.outputPath.c_str());
+        return 1;
+    }
+
+    char timeText[32];
+    std::time_t now = std::time(nullptr);
+    std::tm utc{};
+    platform::utcTime(now, utc);
+    std::strftime(timeText, sizeof(timeText), "%Y-%m-%dT%H:%M:%SZ", &utc);
+
+    out << "{\n  \"benchmark\": \"LoggerBench\",\n  \"time\": \"" << timeText << "\",\n"
+        << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+        << "  \"queue_capacity\": " << LOGGER_QUEUE_CAPACITY << ",\n";
+
+    out << "  \"throughput\": [\n";
+    for (std::size_t i = 0; i < throughput.size(); ++i) {
+        const ThroughputResult& r = throughput[i];
+        out << "    {\"threads\": " << r.threads << ", \"messages\": " << r.messages << ", \"seconds\": " << r.seconds
+            << ", \"messages_per_second\": " << static_cast<std::uint64_t>(r.messages / r.seconds) << "}"
+            << (i + 1 < throughput.size() ? ",\n" : "\n");
+    }
+    out << "  ],\n  \"latency\": [\n";
+    for (std::size_t i = 0; i < latency.size(); ++i) {
+        const LatencyResult& r = latency[i];
+        out << "    {\"sink\": \"" << r.sink << "\", \"mode\": \"" << r.mode << "\", \"messages\": " << r.messages
+            << ", \"p50_ns\": " << r.p50 << ", \"p99_ns\": " << r.p99 << ", \"p999_ns\": " << r.p999
+            << ", \"max_ns\": " << r.max << "}" << (i + 1 < latency.size() ? ",\n" : "\n");
+    }
+    out << "  ],\n  \"disabled_level_ns_per_call\": " << disabledNs << ",\n  \"formatting\": [\n";
+    for (std::size_t i = 0; i < formatting.size(); ++i) {
+        const FormatResult& r = formatting[i];
+        out << "    {\"template\": " << jsonString(r.name) << ", \"ns_per_record\": " << r.nsPerRecord << "}"
+            << (i + 1 < formatting.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return 0;
+}
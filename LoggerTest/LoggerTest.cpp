@@ -1,14 +1,895 @@
-﻿#include "Logger.h"
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BinaryLog.h"
+#include "Compression.h"
+#include "LogFile.h"
+#include "LogFormat.h"
+#include "LogIndex.h"
+#include "LogSink.h"
+#include "Logger.h"
+#include "RingBuffer.h"
 
-int main() {
+namespace {
+
+int failures = 0;  /**< Число непройденных проверок */
+
+/**
+ * @brief Отмечает результат проверки; непройденная печатается в stderr.
+ * @param condition Условие, которое должно выполняться.
+ * @param what Описание проверки.
+ */
+void check(bool condition, const char* what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+/**
+ * @brief Каталог для файлов проверок; создаётся пустым.
+ */
+std::filesystem::path testDirectory() {
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "LoggerTest";
+    std::error_code ec;
+    std::filesystem::remove_all(directory, ec);
+    std::filesystem::create_directories(directory, ec);
+    return directory;
+}
+
+/**
+ * @brief Читает файл целиком.
+ */
+std::string readFile(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+/**
+ * @brief Записывает файл целиком.
+ */
+void writeFile(const std::filesystem::path& path, const std::string& data) {
+    std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+/**
+ * @class Inflater
+ * @brief Эталонная распаковка deflate (RFC 1951) для проверки gzipFile().
+ *
+ * Написана прямо по спецификации и поддерживает все три типа блоков,
+ * поэтому не повторяет допущений упаковщика.
+ */
+class Inflater {
+public:
+    explicit Inflater(std::string_view data) : input(data) {}
+
+    /**
+     * @brief Распаковывает поток deflate.
+     * @param out Распакованные данные.
+     * @return false, если поток повреждён или обрывается.
+     */
+    bool inflate(std::string& out) {
+        bool final = false;
+        while (!final) {
+            if (!bits(1, final)) return false;
+            unsigned type = 0;
+            if (!bits(2, type)) return false;
+            bool ok = type == 0 ? stored(out)
+                : type == 1 ? fixed(out)
+                : type == 2 ? dynamic(out)
+                : false;
+            if (!ok) return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Смещение первого байта после потока deflate.
+     */
+    std::size_t consumed() const { return position + (bitPosition != 0 ? 1 : 0); }
+
+private:
+    struct Huffman {
+        std::uint16_t counts[16] = {};   /**< Число кодов каждой длины */
+        std::uint16_t symbols[320] = {}; /**< Символы в порядке кодов */
+    };
+
+    template<typename T>
+    bool bits(unsigned count, T& value) {
+        std::uint32_t result = 0;
+        for (unsigned i = 0; i < count; ++i) {
+            if (position >= input.size()) return false;
+            result |= std::uint32_t((static_cast<unsigned char>(input[position]) >> bitPosition) & 1) << i;
+            if (++bitPosition == 8) {
+                bitPosition = 0;
+                ++position;
+            }
+        }
+        value = static_cast<T>(result);
+        return true;
+    }
+
+    static bool build(Huffman& table, const std::uint8_t* lengths, unsigned count) {
+        for (std::uint16_t& c : table.counts) c = 0;
+        for (unsigned i = 0; i < count; ++i) ++table.counts[lengths[i]];
+        table.counts[0] = 0;
+        std::uint16_t offsets[16] = {};
+        for (unsigned length = 1; length < 16; ++length) {
+            offsets[length] = offsets[length - 1] + table.counts[length - 1];
+        }
+        for (unsigned i = 0; i < count; ++i) {
+            if (lengths[i] != 0) table.symbols[offsets[lengths[i]]++] = static_cast<std::uint16_t>(i);
+        }
+        return true;
+    }
+
+    bool decode(const Huffman& table, unsigned& symbol) {
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (unsigned length = 1; length < 16; ++length) {
+            unsigned bit = 0;
+            if (!bits(1, bit)) return false;
+            code |= static_cast<int>(bit);
+            int count = table.counts[length];
+            if (code - count < first) {
+                symbol = table.symbols[index + (code - first)];
+                return true;
+            }
+            index += count;
+            first += count;
+            first <<= 1;
+            code <<= 1;
+        }
+        return false;
+    }
+
+    bool stored(std::string& out) {
+        if (bitPosition != 0) {
+            bitPosition = 0;
+            ++position;
+        }
+        if (input.size() - position < 4) return false;
+        auto byte = [this](std::size_t at) { return static_cast<unsigned>(static_cast<unsigned char>(input[at])); };
+        unsigned length = byte(position) | (byte(position + 1) << 8);
+        unsigned complement = byte(position + 2) | (byte(position + 3) << 8);
+        position += 4;
+        if ((length ^ 0xFFFF) != complement || input.size() - position < length) return false;
+        out.append(input.substr(position, length));
+        position += length;
+        return true;
+    }
+
+    bool codes(std::string& out, const Huffman& literals, const Huffman& distances) {
+        static constexpr std::uint16_t LengthBase[29] = {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static constexpr std::uint8_t LengthExtra[29] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        static constexpr std::uint16_t DistanceBase[30] = {
+            1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        static constexpr std::uint8_t DistanceExtra[30] = {
+            0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+        for (;;) {
+            unsigned symbol = 0;
+            if (!decode(literals, symbol)) return false;
+            if (symbol < 256) {
+                out.push_back(static_cast<char>(symbol));
+                continue;
+            }
+            if (symbol == 256) return true;
+
+            symbol -= 257;
+            if (symbol >= 29) return false;
+            unsigned extra = 0;
+            if (!bits(LengthExtra[symbol], extra)) return false;
+            std::size_t length = LengthBase[symbol] + extra;
+
+            if (!decode(distances, symbol) || symbol >= 30) return false;
+            if (!bits(DistanceExtra[symbol], extra)) return false;
+            std::size_t distance = DistanceBase[symbol] + extra;
+            if (distance > out.size()) return false;
+
+            for (std::size_t i = 0; i < length; ++i) {
+                out.push_back(out[out.size() - distance]);
+            }
+        }
+    }
+
+    bool fixed(std::string& out) {
+        std::uint8_t lengths[320];
+        unsigned symbol = 0;
+        for (; symbol < 144; ++symbol) lengths[symbol] = 8;
+        for (; symbol < 256; ++symbol) lengths[symbol] = 9;
+        for (; symbol < 280; ++symbol) lengths[symbol] = 7;
+        for (; symbol < 288; ++symbol) lengths[symbol] = 8;
+        Huffman literals;
+        build(literals, lengths, 288);
+        for (symbol = 0; symbol < 30; ++symbol) lengths[symbol] = 5;
+        Huffman distances;
+        build(distances, lengths, 30);
+        return codes(out, literals, distances);
+    }
+
+    bool dynamic(std::string& out) {
+        static constexpr std::uint8_t Order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+        unsigned literalCount = 0;
+        unsigned distanceCount = 0;
+        unsigned codeCount = 0;
+        if (!bits(5, literalCount) || !bits(5, distanceCount) || !bits(4, codeCount)) return false;
+        literalCount += 257;
+        distanceCount += 1;
+        codeCount += 4;
+
+        std::uint8_t lengths[320] = {};
+        for (unsigned i = 0; i < codeCount; ++i) {
+            if (!bits(3, lengths[Order[i]])) return false;
+        }
+        Huffman lengthCodes;
+        build(lengthCodes, lengths, 19);
+
+        unsigned index = 0;
+        while (index < literalCount + distanceCount) {
+            unsigned symbol = 0;
+            if (!decode(lengthCodes, symbol)) return false;
+            if (symbol < 16) {
+                lengths[index++] = static_cast<std::uint8_t>(symbol);
+                continue;
+            }
+            std::uint8_t value = 0;
+            unsigned repeat = 0;
+            if (symbol == 16) {
+                if (index == 0 || !bits(2, repeat)) return false;
+                value = lengths[index - 1];
+                repeat += 3;
+            }
+            else if (symbol == 17) {
+                if (!bits(3, repeat)) return false;
+                repeat += 3;
+            }
+            else {
+                if (!bits(7, repeat)) return false;
+                repeat += 11;
+            }
+            if (index + repeat > literalCount + distanceCount) return false;
+            while (repeat-- != 0) lengths[index++] = value;
+        }
+
+        Huffman literals;
+        build(literals, lengths, literalCount);
+        Huffman distances;
+        build(distances, lengths + literalCount, distanceCount);
+        return codes(out, literals, distances);
+    }
+
+    std::string_view input;      /**< Сжатые данные */
+    std::size_t position = 0;    /**< Текущий байт */
+    unsigned bitPosition = 0;    /**< Текущий бит байта */
+};
+
+/**
+ * @brief CRC-32 (полином 0xEDB88320) побитово, независимо от Compression.cpp.
+ */
+std::uint32_t crc32(const std::string& data) {
+    std::uint32_t crc = 0xFFFFFFFFu;
+    for (char c : data) {
+        crc ^= static_cast<unsigned char>(c);
+        for (int k = 0; k < 8; ++k) {
+            crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Распаковывает gzip и проверяет заголовок, CRC-32 и размер.
+ * @param gzip Содержимое файла .gz.
+ * @param out Распакованные данные.
+ * @return false, если файл повреждён.
+ */
+bool gunzip(const std::string& gzip, std::string& out) {
+    if (gzip.size() < 18 || static_cast<unsigned char>(gzip[0]) != 0x1F || static_cast<unsigned char>(gzip[1]) != 0x8B
+        || gzip[2] != 8 || gzip[3] != 0) {
+        return false;
+    }
+
+    Inflater inflater(std::string_view(gzip).substr(10));
+    out.clear();
+    if (!inflater.inflate(out)) return false;
+
+    std::size_t trailer = 10 + inflater.consumed();
+    if (gzip.size() != trailer + 8) return false;
+    auto le32 = [&gzip](std::size_t at) {
+        std::uint32_t value = 0;
+        for (int i = 3; i >= 0; --i) value = (value << 8) | static_cast<unsigned char>(gzip[at + i]);
+        return value;
+    };
+    return le32(trailer) == crc32(out) && le32(trailer + 4) == static_cast<std::uint32_t>(out.size());
+}
+
+/**
+ * @brief gzipFile() даёт поток, который эталонная распаковка восстанавливает байт в байт.
+ *
+ * Несжимаемые данные должны уходить в блоки без сжатия и почти не расти,
+ * а повторы, перекрывающие сдвиг окна, - оставаться корректными.
+ */
+void testGzipRoundTrip() {
+    std::filesystem::path directory = testDirectory();
+    std::mt19937 random(12345);
+
+    std::string text;
+    for (int i = 0; i < 20000; ++i) {
+        text += "2025-06-04 22:26:16 | INFO | main.cpp:42 -> message " + std::to_string(i) + "\n";
+    }
+    std::string noise(300000, '\0');
+    for (char& c : noise) c = static_cast<char>(random());
+    std::string mixed = noise.substr(0, 70000) + text.substr(0, 100000) + noise.substr(0, 70000);
+
+    struct Case {
+        const char* name;
+        const std::string* data;
+    };
+    const std::string empty;
+    const Case cases[] = { { "empty", &empty }, { "text", &text }, { "noise", &noise }, { "mixed", &mixed } };
+    for (const Case& c : cases) {
+        std::filesystem::path source = directory / (std::string(c.name) + ".log");
+        std::filesystem::path target = directory / (std::string(c.name) + ".log.gz");
+        writeFile(source, *c.data);
+
+        std::string restored;
+        bool compressed = gzipFile(source.string(), target.string());
+        std::string gzip = readFile(target);
+        std::string what = std::string("gzip round trip: ") + c.name;
+        check(compressed && gunzip(gzip, restored) && restored == *c.data, what.c_str());
+
+        if (c.data == &text) check(gzip.size() * 3 < text.size(), "gzipFile compresses log text");
+        if (c.data == &noise) check(gzip.size() < noise.size() + 64, "gzipFile stores incompressible data");
+    }
+}
+
+/**
+ * @brief Учёт сообщений при вытеснении из буферов потоков (DropOldest).
+ *
+ * Несколько потоков пишут в логгер с маленьким буфером потока, так что
+ * поток обработки не успевает их освобождать. Каждое поставленное
+ * сообщение должно быть либо записано в файл, либо учтено как вытесненное.
+ */
+void testDropOldestThroughLogger() {
+    constexpr int Producers = 4;
+    constexpr int PerProducer = 20000;
+    std::filesystem::path path = testDirectory() / "drop_oldest.log";
+
+    LoggerStats stats;
+    {
+        Logger logger(16);
+        logger.setOutputTarget(OutputTarget::File);
+        logger.setBackpressurePolicy(BackpressurePolicy::DropOldest);
+        logger.init(LogLevel::INFO, path.string(), false, false);
+
+        std::vector<std::thread> producers;
+        for (int p = 0; p < Producers; ++p) {
+            producers.emplace_back([&logger, p]() {
+                for (int i = 0; i < PerProducer; ++i) {
+                    LOGI_TO(logger, "producer ", p, " message ", i);
+                }
+                });
+        }
+        for (std::thread& producer : producers) producer.join();
+        logger.flush();
+        stats = logger.getStats();
+    }
+
+    std::uint64_t enqueued = 0;
+    std::uint64_t written = 0;
+    for (std::size_t i = 0; i < LogLevelCount; ++i) {
+        enqueued += stats.enqueued[i];
+        written += stats.written[i];
+    }
+    std::string data = readFile(path);
+    auto lines = static_cast<std::uint64_t>(std::count(data.begin(), data.end(), '\n'));
+
+    check(enqueued == std::uint64_t(Producers) * PerProducer, "every log call is enqueued under DropOldest");
+    check(written + stats.drops.droppedOldest == enqueued, "DropOldest writes or counts every enqueued message");
+    check(lines == written, "the file holds every message the worker wrote");
+}
+
+Logger* noisyLogger = nullptr;  /**< Логгер, в который пишет operator<< для Noisy */
+
+/**
+ * @struct Noisy
+ * @brief Тип, чей operator<< сам пишет в лог.
+ */
+struct Noisy {};
+
+std::ostream& operator<<(std::ostream& stream, const Noisy&) {
+    LOGI_TO(*noisyLogger, "inner ", 42);
+    return stream << "VALUE-FROM-OUTER";
+}
+
+/**
+ * @brief Лог изнутри operator<< не портит форматирование внешнего сообщения.
+ *
+ * Вложенный вызов не должен перенаправить поток внешнего сообщения
+ * в свой буфер; проверяется в обоих режимах форматирования.
+ */
+void testNestedStreaming() {
+    const FormattingMode modes[] = { FormattingMode::Immediate, FormattingMode::Deferred };
+    for (FormattingMode mode : modes) {
+        std::filesystem::path path = testDirectory() / "nested.log";
+        {
+            Logger logger;
+            noisyLogger = &logger;
+            logger.setOutputTarget(OutputTarget::File);
+            logger.setFormattingMode(mode);
+            logger.setFormatTemplate("{m}");
+            logger.init(LogLevel::INFO, path.string(), false, false);
+            LOGI_TO(logger, "outer ", Noisy{}, " tail");
+            logger.flush();
+        }
+        noisyLogger = nullptr;
+
+        std::string data = readFile(path);
+        bool immediate = mode == FormattingMode::Immediate;
+        check(data.find("outer VALUE-FROM-OUTER tail\n") != std::string::npos,
+            immediate ? "immediate mode keeps the outer message around a nested log call"
+                : "deferred mode keeps the outer message around a nested log call");
+        check(data.find("inner 42\n") != std::string::npos,
+            immediate ? "immediate mode writes the nested log call" : "deferred mode writes the nested log call");
+    }
+}
+
+/**
+ * @brief Сообщения, поставленные до смены настроек, пишутся по прежнему снимку.
+ *
+ * Шаблон меняется, пока очередь ещё не записана: первые сообщения
+ * (в том числе из другого, уже завершившегося потока) должны выйти
+ * без префикса, следующие - с префиксом своего шаблона.
+ */
+void testConfigOrdering() {
+    static constexpr int PerPhase = 500;
+    std::filesystem::path path = testDirectory() / "ordering.log";
+    {
+        Logger logger;
+        logger.setOutputTarget(OutputTarget::File);
+        logger.setFormatTemplate("{m}");
+        logger.init(LogLevel::INFO, path.string(), false, false);
+
+        std::thread other([&logger]() {
+            for (int i = 0; i < PerPhase; ++i) LOGI_TO(logger, "a ", i);
+            });
+        other.join();
+        for (int i = 0; i < PerPhase; ++i) LOGI_TO(logger, "a ", i);
+        logger.setFormatTemplate("B {m}");
+        for (int i = 0; i < PerPhase; ++i) LOGI_TO(logger, "b ", i);
+        logger.setFormatTemplate("C {m}");
+        for (int i = 0; i < PerPhase; ++i) LOGI_TO(logger, "c ", i);
+        logger.flush();
+    }
+
+    std::string data = readFile(path);
+    if (data.rfind("\xEF\xBB\xBF", 0) == 0) data.erase(0, 3);
+    std::istringstream lines(data);
+    std::string line;
+    int counts[3] = {};
+    bool formatted = true;
+    while (std::getline(lines, line)) {
+        if (line.rfind("a ", 0) == 0) ++counts[0];
+        else if (line.rfind("B b ", 0) == 0) ++counts[1];
+        else if (line.rfind("C c ", 0) == 0) ++counts[2];
+        else formatted = false;
+    }
+    check(formatted, "every message uses the template published before it was logged");
+    check(counts[0] == 2 * PerPhase && counts[1] == PerPhase && counts[2] == PerPhase,
+        "config changes keep all queued messages");
+}
+
+/**
+ * @brief Ротация по размеру через FileSink соблюдает maxFileSize и maxFiles.
+ *
+ * Рядом уже лежат файлы прошлых запусков, в том числе сжатый: номера
+ * новых файлов должны продолжить их, а удаляться - самые старые.
+ * Пачки больше предела делятся между файлами; больше предела может быть
+ * только файл с единственной слишком длинной строкой.
+ */
+void testRotation() {
+    static constexpr LogSite Site{ LogLevel::INFO, "rotation.cpp", 1 };
+    static constexpr std::uint64_t MaxFileSize = 200;
+    static constexpr std::size_t MaxFiles = 5;
+    static constexpr char Bom[] = "\xEF\xBB\xBF";
+
+    std::filesystem::path directory = testDirectory();
+    std::filesystem::path path = directory / "rotated.log";
+    writeFile(directory / "rotated.2.log", "old 2\n");
+    writeFile(directory / "rotated.3.log", "old 3\n");
+    writeFile(directory / "rotated.5.log.gz", "old 5");
+
+    std::vector<std::string> written;
+    std::uint64_t rotations = 0;
+    {
+        FileSink sink;
+        RotationPolicy policy;
+        policy.maxFileSize = MaxFileSize;
+        policy.maxFiles = MaxFiles;
+        sink.file().setRotation(policy);
+        check(sink.file().open(path.string(), true), "rotated log opens");
+
+        LogBatch batch;
+        for (int b = 0; b < 6; ++b) {
+            batch.clear();
+            for (int i = 0; i < 7; ++i) {
+                std::string text = "batch " + std::to_string(b) + " line " + std::to_string(i);
+                text.resize(b == 4 && i == 3 ? 450 : 39, '.');
+                text += '\n';
+                batch.lines.push_back({ static_cast<std::uint32_t>(batch.text.size()), static_cast<std::uint32_t>(text.size()), Site.level });
+                batch.records.push_back({ &Site, std::chrono::system_clock::now(), {} });
+                batch.text += text;
+                written.push_back(std::move(text));
+            }
+            batch.minLevel = Site.level;
+            sink.write(batch);
+        }
+        rotations = sink.file().generation() - 1;
+    }
+
+    unsigned newest = 0;
+    std::vector<std::string> names;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        std::string name = entry.path().filename().string();
+        names.push_back(name);
+        unsigned index = 0;
+        if (std::sscanf(name.c_str(), "rotated.%u.log", &index) == 1) newest = (std::max)(newest, index);
+    }
+    std::sort(names.begin(), names.end());
+
+    // Файлы от старых к новым: прошлые запуски, исходный файл, затем 6, 7, ...
+    std::vector<std::string> sequence = { "rotated.2.log", "rotated.3.log", "rotated.5.log.gz", "rotated.log" };
+    for (unsigned index = 6; index <= newest; ++index) sequence.push_back("rotated." + std::to_string(index) + ".log");
+    std::vector<std::string> kept(sequence.end() - (std::min)(sequence.size(), MaxFiles), sequence.end());
+    std::vector<std::string> keptNames = kept;
+    std::sort(keptNames.begin(), keptNames.end());
+    check(newest > 6 && newest == 5 + rotations, "rotation numbering continues after existing files");
+    check(names == keptNames, "rotation removes the oldest files");
+
+    bool withinLimit = true;
+    std::string contents;
+    for (const std::string& name : kept) {
+        std::string data = readFile(directory / name);
+        bool bom = data.rfind(Bom, 0) == 0;
+        std::string lines = bom ? data.substr(3) : data;
+        bool singleLine = lines.find('\n') == lines.size() - 1;
+        withinLimit = bom && (data.size() <= MaxFileSize || singleLine) && withinLimit;
+        contents += lines;
+    }
+    std::string tail;
+    for (const std::string& line : written) tail += line;
+    check(withinLimit, "rotated files stay within maxFileSize unless they hold one oversized line");
+    check(!contents.empty() && tail.ends_with(contents), "rotated files hold the newest lines in order");
+}
+
+/**
+ * @brief Уровни по файлам верны и после заполнения кэша ссылками на разные файлы.
+ *
+ * Указателей __FILE__ больше, чем ячеек кэша, и после смены
+ * переопределения ни один из них не должен получить прежний уровень.
+ */
+void testFileLevels() {
     Logger logger;
+    logger.setLogLevel(LogLevel::INFO);
+    logger.setFileLogLevel("Network.cpp", LogLevel::ERROR_);
+
+    std::vector<std::string> files;
+    for (int i = 0; i < 600; ++i) {
+        files.emplace_back(i % 2 == 0 ? "src/Network.cpp" : "src/MyNetwork.cpp");
+    }
+    auto levelsMatch = [&](LogLevel network) {
+        bool match = true;
+        for (std::size_t i = 0; i < files.size(); ++i) {
+            bool expected = i % 2 == 0 ? LogLevel::WARNING >= network : true;
+            match = logger.isEnabled(LogLevel::WARNING, files[i].c_str()) == expected && match;
+        }
+        return match;
+    };
+
+    check(levelsMatch(LogLevel::ERROR_) && levelsMatch(LogLevel::ERROR_),
+        "file levels resolve past a full cache");
+    logger.setFileLogLevel("Network.cpp", LogLevel::DEBUG);
+    check(levelsMatch(LogLevel::DEBUG), "a new file level replaces the cached one");
+    logger.clearFileLogLevels();
+    check(logger.isEnabled(LogLevel::INFO, files[0].c_str()) && !logger.isEnabled(LogLevel::DEBUG, files[0].c_str()),
+        "cleared file levels fall back to the global level");
+}
+
+/**
+ * @brief Сообщения, закодированные BinaryLogEncoder, читаются BinaryLogReader без потерь.
+ *
+ * Между сообщениями словарь сбрасывается, как в начале блока индекса,
+ * поэтому читатель должен принять повторно объявленные Site и String.
+ * Обрезанный файл должен читаться до последней целой записи.
+ */
+void testBinaryRoundTrip() {
+    static constexpr LogSite InfoSite{ LogLevel::INFO, "first.cpp", 10 };
+    static constexpr LogSite ErrorSite{ LogLevel::ERROR_, "second.cpp", 20 };
+    static constexpr char Literal[] = "static literal";
+
+    struct Source {
+        const LogSite* site;
+        std::chrono::system_clock::time_point time;
+        PayloadBuffer payload;
+    };
+    std::vector<Source> sources(6);
+    auto base = std::chrono::system_clock::now();
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+        Source& source = sources[i];
+        source.site = i % 2 == 0 ? &InfoSite : &ErrorSite;
+        source.time = base + std::chrono::microseconds(i * 1500);
+        ArgumentWriter writer(source.payload);
+        writer.write(LogLiteral("value "));
+        writer.write(static_cast<int>(i) - 3);
+        writer.write(' ');
+        writer.write(2.5 * static_cast<double>(i));
+        writer.write(std::string(i, 'x'));
+        writer.write(LogLiteral(Literal));
+        writer.write(kv("ok", i % 3 == 0));
+    }
+
+    std::string data(BinaryLogMagic);
+    BinaryLogEncoder encoder;
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+        if (i == 3) encoder.reset();
+        encoder.encodeRecord({ sources[i].site, sources[i].time, sources[i].payload.view() }, data);
+    }
+
+    BinaryLogReader reader(data);
+    check(reader.valid(), "binary log starts with its magic");
+    BinaryLogEntry entry;
+    std::size_t count = 0;
+    bool same = true;
+    while (reader.next(entry)) {
+        if (count >= sources.size()) {
+            same = false;
+            break;
+        }
+        const Source& source = sources[count++];
+        std::string expected;
+        std::string actual;
+        appendArguments(source.payload.view(), expected);
+        appendArguments(entry.payload, actual);
+        same = same && entry.site.level == source.site->level && entry.site.line == source.site->line
+            && std::string_view(entry.site.file) == source.site->file && entry.time == source.time && actual == expected;
+    }
+    check(same && count == sources.size(), "binary log round trip restores sites, times and arguments");
+    check(!reader.damaged(), "complete binary log is not reported as damaged");
+
+    BinaryLogReader truncated(std::string_view(data).substr(0, data.size() - 1));
+    count = 0;
+    while (truncated.next(entry)) ++count;
+    check(count == sources.size() - 1 && truncated.damaged(), "truncated binary log stops at the last complete record");
+}
+
+/**
+ * @brief Индекс времени находит все строки интервала, читая лишь часть файла.
+ *
+ * Строки пишутся через LogFile с индексом так же, как FileSink, время
+ * иногда идёт назад внутри блока. Блоки выбираются по правилу LogQuery:
+ * пересечение с [from, to) и нужный уровень; непроиндексированные
+ * участки читаются целиком. Каждая строка интервала должна попасть
+ * в выбранные блоки.
+ */
+void testIndexRangeQuery() {
+    std::filesystem::path path = testDirectory() / "indexed.log";
+    const std::chrono::system_clock::time_point base{ std::chrono::seconds(1700000000) };
+
+    struct Line {
+        std::int64_t time;
+        LogLevel level;
+    };
+    std::vector<Line> lines;
+    {
+        LogFile file;
+        file.setIndexInterval(1024);
+        check(file.open(path.string(), false), "indexed log opens");
+        for (int i = 0; i < 2000; ++i) {
+            auto time = base + std::chrono::milliseconds(i) - std::chrono::milliseconds(i % 20 == 0 ? 30 : 0);
+            LogLevel level = i % 50 == 0 ? LogLevel::ERROR_ : LogLevel::INFO;
+            std::int64_t moment = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+            std::string text = std::to_string(moment) + (level == LogLevel::ERROR_ ? " E" : " I") + " indexed line\n";
+
+            file.index().mark(file.size(), time, level);
+            file.append(text.data(), text.size());
+            file.index().commit();
+            lines.push_back({ moment, level });
+        }
+    }
+
+    std::string data = readFile(path);
+    std::vector<LogIndexEntry> entries;
+    check(parseLogIndex(readFile(logIndexPath(path.string())), entries) && entries.size() > 10,
+        "index describes the log in many blocks");
+
+    auto query = [&](std::int64_t from, std::int64_t to, LogLevel minLevel, std::uint64_t& bytesRead) {
+        unsigned levelMask = 0;
+        for (std::size_t i = static_cast<std::size_t>(minLevel); i < LogLevelCount; ++i) levelMask |= 1u << i;
+
+        std::string selected;
+        std::uint64_t cursor = 3;
+        for (const LogIndexEntry& entry : entries) {
+            selected += data.substr(cursor, entry.offset - cursor);
+            if ((entry.levels & levelMask) != 0 && entry.lastTime >= from && entry.firstTime < to) {
+                selected += data.substr(entry.offset, entry.length);
+            }
+            cursor = entry.offset + entry.length;
+        }
+        selected += data.substr(cursor);
+        bytesRead = selected.size();
+
+        std::size_t found = 0;
+        for (std::size_t start = 0; start < selected.size();) {
+            std::size_t stop = selected.find('\n', start);
+            if (stop == std::string::npos) break;
+            std::int64_t time = std::stoll(selected.substr(start, selected.find(' ', start) - start));
+            LogLevel level = selected[selected.find(' ', start) + 1] == 'E' ? LogLevel::ERROR_ : LogLevel::INFO;
+            if (time >= from && time < to && level >= minLevel) ++found;
+            start = stop + 1;
+        }
+        return found;
+    };
+    auto expected = [&lines](std::int64_t from, std::int64_t to, LogLevel minLevel) {
+        std::size_t count = 0;
+        for (const Line& line : lines) {
+            if (line.time >= from && line.time < to && line.level >= minLevel) ++count;
+        }
+        return count;
+    };
+
+    std::int64_t from = lines[610].time;
+    std::int64_t to = lines[900].time;
+    std::uint64_t bytesRead = 0;
+    check(query(from, to, LogLevel::TRACE, bytesRead) == expected(from, to, LogLevel::TRACE),
+        "index range query finds every line of the interval");
+    check(bytesRead * 2 < data.size(), "index range query skips blocks outside the interval");
+
+    std::int64_t all = (std::numeric_limits<std::int64_t>::max)();
+    check(query(-all, all, LogLevel::ERROR_, bytesRead) == expected(-all, all, LogLevel::ERROR_),
+        "index level query finds every error line");
+}
+
+/**
+ * @brief Кольцевой буфер сохраняет порядок, когда позиции многократно обходят ёмкость.
+ */
+void testRingBufferWraparound() {
+    RingBuffer<int> ring(4);
+    check(ring.capacity() == 4, "ring buffer capacity is rounded to a power of two");
+
+    // Один элемент всё время остаётся в буфере, поэтому пачки разной длины
+    // начинаются с разных ячеек и многократно переходят через конец массива.
+    int next = 0;
+    int expected = 0;
+    bool ordered = true;
+    int first = next++;
+    ordered = ring.tryPush(std::move(first));
+    for (int round = 0; round < 100; ++round) {
+        int count = 1 + round % 3;
+        for (int i = 0; i < count; ++i) {
+            int value = next++;
+            ordered = ring.tryPush(std::move(value)) && ordered;
+        }
+        for (int i = 0; i < count; ++i) {
+            int value = -1;
+            ordered = ring.tryPop(value) && value == expected++ && ordered;
+        }
+    }
+    int last = -1;
+    ordered = ring.tryPop(last) && last == expected && ordered;
+    check(ordered, "ring buffer keeps FIFO order across wraparound");
+    check(ring.empty(), "ring buffer is empty after draining");
+    check(ring.pushPosition() == ring.popPosition() && ring.pushPosition() > 4 * ring.capacity(),
+        "ring buffer positions advance past capacity");
+
+    for (int i = 0; i < 4; ++i) {
+        int value = i;
+        ring.tryPush(std::move(value));
+    }
+    int extra = 4;
+    check(!ring.tryPush(std::move(extra)), "full ring buffer rejects a push");
+}
+
+/**
+ * @brief Вытеснение старых элементов писателями (DropOldest) при работающем читателе.
+ *
+ * Писатели вставляют возрастающие номера и при переполнении вытесняют
+ * самый старый элемент, как Logger::enqueueLog(). Каждый элемент должен
+ * быть либо прочитан, либо вытеснен ровно один раз, а номера одного
+ * писателя - прочитаны по возрастанию.
+ */
+void testDropOldestUnderContention() {
+    constexpr int Producers = 4;
+    constexpr std::uint64_t PerProducer = 200000;
+    RingBuffer<std::uint64_t> ring(64);
+
+    std::atomic<std::uint64_t> evicted{ 0 };
+    std::atomic<int> running{ Producers };
+    std::vector<std::thread> producers;
+    for (int p = 0; p < Producers; ++p) {
+        producers.emplace_back([&ring, &evicted, &running, p]() {
+            for (std::uint64_t i = 0; i < PerProducer; ++i) {
+                std::uint64_t value = (std::uint64_t(p) << 32) | i;
+                while (!ring.tryPush(std::move(value))) {
+                    std::uint64_t oldest = 0;
+                    if (ring.tryPop(oldest)) evicted.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            running.fetch_sub(1, std::memory_order_release);
+            });
+    }
+
+    std::uint64_t consumed = 0;
+    bool ordered = true;
+    std::int64_t last[Producers];
+    for (std::int64_t& value : last) value = -1;
+    for (;;) {
+        bool done = running.load(std::memory_order_acquire) == 0;
+        std::uint64_t value = 0;
+        while (ring.tryPop(value)) {
+            int producer = static_cast<int>(value >> 32);
+            auto sequence = static_cast<std::int64_t>(value & 0xFFFFFFFFu);
+            ordered = producer < Producers && sequence > last[producer] && ordered;
+            if (producer < Producers) last[producer] = sequence;
+            ++consumed;
+        }
+        if (done) break;
+    }
+    for (std::thread& producer : producers) producer.join();
+
+    check(ordered, "DropOldest keeps per-producer order for consumed elements");
+    check(consumed + evicted.load() == Producers * PerProducer, "DropOldest consumes or evicts every element exactly once");
+    check(ring.pushPosition() == ring.popPosition(), "ring buffer positions agree after DropOldest contention");
+}
+
+}
+
+int main() {
+    {
+        Logger logger;
+
+        // Укажем путь к файлу логов и создадим папку, если нужно
+        logger.init(LogLevel::DEBUG, "logs/mylog.txt", true);
 
-    // Укажем путь к файлу логов и создадим папку, если нужно
-    logger.init(LogLevel::DEBUG, "logs/mylog.txt", true);
+        logger.log(LogLevel::TRACE, "This is a trace message", __FILE__, __LINE__);
+        logger.log(LogLevel::DEBUG, "This is a debug message", __FILE__, __LINE__);
+        logger.log(LogLevel::ERROR_, "This is an error message", __FILE__, __LINE__);
+    }
 
-    logger.log(LogLevel::TRACE, "This is a trace message", __FILE__, __LINE__);
-    logger.log(LogLevel::DEBUG, "This is a debug message", __FILE__, __LINE__);
-    logger.log(LogLevel::ERROR, "This is an error message", __FILE__, __LINE__);
+    testRingBufferWraparound();
+    testDropOldestUnderContention();
+    testDropOldestThroughLogger();
+    testGzipRoundTrip();
+    testRotation();
+    testNestedStreaming();
+    testConfigOrdering();
+    testFileLevels();
+    testBinaryRoundTrip();
+    testIndexRangeQuery();
 
+    if (failures != 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
     return 0;
 }